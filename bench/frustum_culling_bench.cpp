@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+#include <glm/glm.hpp>
+
+#include "scene/Camera.hpp"
+#include "scene/FrustumCulling.hpp"
+
+
+// Frustum culling of a million instance boxes with cull_frustum, compared to
+// calling the scalar is_box_in_frustum on the AoS bounds for every instance.
+// Usage: frustum_culling_bench
+
+namespace
+{
+
+constexpr std::size_t INSTANCE_COUNT = 1'000'000;
+constexpr int REPETITIONS = 20;
+
+// Instances scattered over a city-sized area, viewed
+// from its center at a shallow angle
+std::vector<Bounds> random_instance_bounds(std::size_t count)
+{
+  std::mt19937 rng{42};
+  std::uniform_real_distribution<float> horizontal{-2000.0f, 2000.0f};
+  std::uniform_real_distribution<float> vertical{0.0f, 50.0f};
+  std::uniform_real_distribution<float> extent{0.5f, 10.0f};
+
+  std::vector<Bounds> result(count);
+  for (auto& bounds : result)
+  {
+    const glm::vec3 center{horizontal(rng), vertical(rng), horizontal(rng)};
+    const glm::vec3 size{extent(rng), extent(rng), extent(rng)};
+    const glm::vec3 min = center - size;
+    const glm::vec3 max = center + size;
+    bounds.box = BoundingBox{.maxCoord = {max.x, max.y, max.z}, .minCoord = {min.x, min.y, min.z}};
+    bounds.sphere =
+      BoundingSphere{.center = {center.x, center.y, center.z}, .radius = glm::length(size)};
+  }
+  return result;
+}
+
+template <class F>
+double best_of_ms(F&& f)
+{
+  double bestMs = 1e30;
+  for (int i = 0; i < REPETITIONS; ++i)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return bestMs;
+}
+
+} // namespace
+
+int main()
+{
+  const auto bounds = random_instance_bounds(INSTANCE_COUNT);
+  const auto boxes = make_frustum_culling_boxes(bounds);
+
+  Camera camera;
+  camera.zFar = 1000;
+  camera.lookAt({0, 20, 0}, {100, 0, 100}, {0, 1, 0});
+  const Frustum frustum = extract_frustum(camera.projTm(16.0f / 9.0f) * camera.viewTm());
+
+  std::vector<std::uint32_t> visible(INSTANCE_COUNT);
+
+  std::size_t scalarCount = 0;
+  const double scalarMs = best_of_ms([&] {
+    scalarCount = 0;
+    for (std::size_t i = 0; i < bounds.size(); ++i)
+      if (is_box_in_frustum(frustum, bounds[i].box))
+        visible[scalarCount++] = static_cast<std::uint32_t>(i);
+  });
+
+  std::size_t simdCount = 0;
+  const double simdMs =
+    best_of_ms([&] { simdCount = cull_frustum(frustum, boxes, 0, boxes.size(), visible); });
+
+  fmt::print("{} instances, {} visible\n", INSTANCE_COUNT, simdCount);
+  fmt::print(
+    "scalar is_box_in_frustum {:8.3f} ms ({:.2f} ns/instance, {} visible)\n",
+    scalarMs,
+    scalarMs * 1e6 / static_cast<double>(INSTANCE_COUNT),
+    scalarCount);
+  fmt::print(
+    "cull_frustum             {:8.3f} ms ({:.2f} ns/instance), {:.1f}x\n",
+    simdMs,
+    simdMs * 1e6 / static_cast<double>(INSTANCE_COUNT),
+    scalarMs / simdMs);
+  return scalarCount == simdCount ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <span>
+#include <vector>
+
+#include <fmt/format.h>
+#include <glm/glm.hpp>
+
+#include "scene/Camera.hpp"
+#include "scene/FrustumCulling.hpp"
+
+
+// Checks that the SIMD cull_frustum keeps exactly the boxes the scalar
+// is_box_in_frustum does, for every remainder of the SIMD width, unaligned
+// ranges and degenerate boxes. Both share the plane math, so culling is also
+// checked against the clip volume of the camera directly: boxes with a point
+// inside of it have to be kept.
+// Usage: frustum_culling_test
+
+namespace
+{
+
+constexpr std::size_t BOX_COUNT = 4096;
+constexpr std::size_t CAMERA_COUNT = 16;
+// Covers every tail length for both 4 and 8 lanes, twice
+constexpr std::size_t MAX_SMALL_COUNT = 33;
+constexpr std::uint32_t GUARD = 0xDEADBEEF;
+// Besides the corners and the center
+constexpr int INTERIOR_SAMPLES = 16;
+
+struct View
+{
+  glm::mat4x4 viewProj;
+  Frustum frustum;
+};
+
+View random_view(std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> coordinate{-50.0f, 50.0f};
+  Camera camera;
+  // With the default near plane nearly all of the depth range is right
+  // next to the far plane, which leaves no room for the clip volume margin
+  camera.zNear = 0.1f;
+  camera.zFar = 200;
+  const glm::vec3 from{coordinate(rng), coordinate(rng), coordinate(rng)};
+  glm::vec3 to{coordinate(rng), coordinate(rng), coordinate(rng)};
+  if (glm::length(to - from) < 1.0f)
+    to = from + glm::vec3{0, 0, 1};
+  camera.lookAt(from, to, {0, 1, 0});
+  const glm::mat4x4 viewProj = camera.projTm(16.0f / 9.0f) * camera.viewTm();
+  return View{.viewProj = viewProj, .frustum = extract_frustum(viewProj)};
+}
+
+BoundingBox box_from(glm::vec3 center, glm::vec3 extent)
+{
+  const glm::vec3 min = center - extent;
+  const glm::vec3 max = center + extent;
+  return BoundingBox{.maxCoord = {max.x, max.y, max.z}, .minCoord = {min.x, min.y, min.z}};
+}
+
+// Mostly ordinary boxes around the cameras, with every few one of the
+// degenerate kinds scenes can produce mixed in
+std::vector<Bounds> random_bounds(std::mt19937& rng, std::size_t count)
+{
+  constexpr float INF = std::numeric_limits<float>::infinity();
+  constexpr float QNAN = std::numeric_limits<float>::quiet_NaN();
+
+  std::uniform_real_distribution<float> coordinate{-250.0f, 250.0f};
+  std::uniform_real_distribution<float> extent{0.0f, 20.0f};
+  std::uniform_int_distribution<int> kind{0, 15};
+
+  std::vector<Bounds> result(count);
+  for (auto& bounds : result)
+  {
+    const glm::vec3 center{coordinate(rng), coordinate(rng), coordinate(rng)};
+    const glm::vec3 size{extent(rng), extent(rng), extent(rng)};
+    auto& box = bounds.box;
+    switch (kind(rng))
+    {
+    case 0:
+      // What bounds of primitives without vertices are initialized to
+      box = BoundingBox{.maxCoord = {-INF, -INF, -INF}, .minCoord = {INF, INF, INF}};
+      break;
+    case 1:
+      // Inverted, i.e. empty
+      box = box_from(center, -size);
+      break;
+    case 2:
+      box = box_from(center, size);
+      box.minCoord[kind(rng) % 3] = QNAN;
+      break;
+    case 3:
+      box = box_from(center, size);
+      box.maxCoord[kind(rng) % 3] = QNAN;
+      break;
+    case 4:
+      box = box_from(center, glm::vec3{0});
+      break;
+    case 5:
+      // Spans the whole world
+      box = BoundingBox{.maxCoord = {INF, INF, INF}, .minCoord = {-INF, -INF, -INF}};
+      break;
+    default:
+      box = box_from(center, size);
+      break;
+    }
+  }
+  return result;
+}
+
+std::vector<std::uint32_t> reference_cull(
+  const Frustum& frustum, std::span<const Bounds> bounds, std::size_t first, std::size_t count)
+{
+  std::vector<std::uint32_t> result;
+  for (std::size_t i = first; i < first + count; ++i)
+    if (is_box_in_frustum(frustum, bounds[i].box))
+      result.push_back(static_cast<std::uint32_t>(i));
+  return result;
+}
+
+// Returns whether the results match, the guard after the
+// written indices catches writes past the end of the output
+bool check_range(
+  const Frustum& frustum,
+  std::span<const Bounds> bounds,
+  const FrustumCullingBoxes& boxes,
+  std::size_t first,
+  std::size_t count)
+{
+  const auto expected = reference_cull(frustum, bounds, first, count);
+
+  std::vector<std::uint32_t> visible(count + 1, GUARD);
+  const std::size_t visibleCount =
+    cull_frustum(frustum, boxes, first, count, std::span{visible}.first(count));
+
+  const bool matches = visibleCount == expected.size() &&
+    std::equal(expected.begin(), expected.end(), visible.begin()) && visible[count] == GUARD;
+  if (!matches)
+    fmt::print(
+      "Mismatch for boxes [{}, {}): {} visible, {} expected\n",
+      first,
+      first + count,
+      visibleCount,
+      expected.size());
+  return matches;
+}
+
+// -w <= x, y <= w and 0 <= z <= w, points right at the boundary
+// could go either way after rounding, so they don't count
+bool is_in_clip_volume(const glm::mat4x4& view_proj, glm::vec3 point)
+{
+  const glm::vec4 clip = view_proj * glm::vec4{point, 1.0f};
+  const float limit = clip.w * (1.0f - 1e-4f);
+  return clip.w > 0 && glm::abs(clip.x) <= limit && glm::abs(clip.y) <= limit &&
+    clip.z >= clip.w * 1e-4f && clip.z <= limit;
+}
+
+bool is_finite_and_nonempty(const BoundingBox& box)
+{
+  for (std::size_t i = 0; i < 3; ++i)
+    if (
+      !std::isfinite(box.minCoord[i]) || !std::isfinite(box.maxCoord[i]) ||
+      box.minCoord[i] > box.maxCoord[i])
+      return false;
+  return true;
+}
+
+// Corners, the center and random interior points of the box
+bool has_point_in_clip_volume(
+  const glm::mat4x4& view_proj, const BoundingBox& box, std::mt19937& rng)
+{
+  const glm::vec3 min{box.minCoord[0], box.minCoord[1], box.minCoord[2]};
+  const glm::vec3 max{box.maxCoord[0], box.maxCoord[1], box.maxCoord[2]};
+  auto lerp = [&](glm::vec3 t) {
+    return glm::vec3{
+      min.x + (max.x - min.x) * t.x, min.y + (max.y - min.y) * t.y, min.z + (max.z - min.z) * t.z};
+  };
+
+  for (int corner = 0; corner < 8; ++corner)
+  {
+    const glm::vec3 t{
+      static_cast<float>(corner & 1),
+      static_cast<float>((corner >> 1) & 1),
+      static_cast<float>((corner >> 2) & 1)};
+    if (is_in_clip_volume(view_proj, lerp(t)))
+      return true;
+  }
+
+  if (is_in_clip_volume(view_proj, lerp(glm::vec3{0.5f})))
+    return true;
+
+  std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+  for (int i = 0; i < INTERIOR_SAMPLES; ++i)
+    if (is_in_clip_volume(view_proj, lerp(glm::vec3{unit(rng), unit(rng), unit(rng)})))
+      return true;
+
+  return false;
+}
+
+struct ClipVolumeCheck
+{
+  // Boxes with a point in the clip volume, i.e. ones that definitely are visible
+  std::size_t seen = 0;
+  // Those of them that got culled anyway
+  std::size_t missed = 0;
+};
+
+// Independent of extract_frustum and the plane tests, so it catches wrong
+// planes as well as culling that isn't conservative
+ClipVolumeCheck check_clip_volume(
+  const View& view,
+  std::span<const Bounds> bounds,
+  const FrustumCullingBoxes& boxes,
+  std::mt19937& rng)
+{
+  std::vector<std::uint32_t> visible(bounds.size());
+  visible.resize(cull_frustum(view.frustum, boxes, 0, bounds.size(), visible));
+
+  std::vector<bool> kept(bounds.size(), false);
+  for (auto idx : visible)
+    kept[idx] = true;
+
+  ClipVolumeCheck result;
+  for (std::size_t i = 0; i < bounds.size(); ++i)
+  {
+    const auto& box = bounds[i].box;
+    if (!is_finite_and_nonempty(box) || !has_point_in_clip_volume(view.viewProj, box, rng))
+      continue;
+
+    ++result.seen;
+    if (!kept[i])
+    {
+      ++result.missed;
+      fmt::print(
+        "Box {} has a point in the clip volume, but was culled: "
+        "min ({}, {}, {}), max ({}, {}, {})\n",
+        i,
+        box.minCoord[0],
+        box.minCoord[1],
+        box.minCoord[2],
+        box.maxCoord[0],
+        box.maxCoord[1],
+        box.maxCoord[2]);
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+int main()
+{
+  std::mt19937 rng{42};
+  const auto bounds = random_bounds(rng, BOX_COUNT);
+  const auto boxes = make_frustum_culling_boxes(bounds);
+
+  std::size_t failures = 0;
+  std::size_t checks = 0;
+  std::size_t visibleTotal = 0;
+  std::size_t clipVolumeSeen = 0;
+  for (std::size_t camera = 0; camera < CAMERA_COUNT; ++camera)
+  {
+    const View view = random_view(rng);
+    const Frustum& frustum = view.frustum;
+
+    for (std::size_t first = 0; first < 9; ++first)
+      for (std::size_t count = 0; count <= MAX_SMALL_COUNT; ++count, ++checks)
+        failures += check_range(frustum, bounds, boxes, first, count) ? 0 : 1;
+
+    for (std::size_t first : {std::size_t{0}, std::size_t{3}})
+    {
+      const std::size_t count = BOX_COUNT - first - 5;
+      failures += check_range(frustum, bounds, boxes, first, count) ? 0 : 1;
+      ++checks;
+    }
+
+    visibleTotal += reference_cull(frustum, bounds, 0, BOX_COUNT).size();
+
+    const auto clipVolume = check_clip_volume(view, bounds, boxes, rng);
+    clipVolumeSeen += clipVolume.seen;
+    failures += clipVolume.missed;
+    checks += clipVolume.seen;
+  }
+
+  // Makes sure the cameras actually see something, otherwise everything matches trivially
+  if (visibleTotal == 0 || clipVolumeSeen == 0)
+  {
+    fmt::print("No box is visible from any camera\n");
+    return 1;
+  }
+
+  fmt::print(
+    "{} of {} checks failed, {:.1f}% of boxes visible on average\n",
+    failures,
+    checks,
+    100.0 * static_cast<double>(visibleTotal) / static_cast<double>(CAMERA_COUNT * BOX_COUNT));
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <tiny_gltf.h>
+
+#include "parallel/ThreadPool.hpp"
+#include "scene/SceneInstances.hpp"
+
+
+// Times process_instances on synthetic hierarchies of a few hundred thousand
+// nodes with different shapes, for a growing number of worker threads.
+// Usage: hierarchy_bench
+
+namespace
+{
+
+constexpr int REPETITIONS = 5;
+constexpr int MESH_COUNT = 16;
+
+class HierarchyBuilder
+{
+public:
+  HierarchyBuilder()
+  {
+    model.meshes.resize(MESH_COUNT);
+    model.scenes.emplace_back();
+    model.defaultScene = 0;
+  }
+
+  int addNode(int parent)
+  {
+    const int idx = static_cast<int>(model.nodes.size());
+    auto& node = model.nodes.emplace_back();
+    node.mesh = idx % MESH_COUNT;
+
+    std::uniform_real_distribution<double> offset(-10.0, 10.0);
+    std::uniform_real_distribution<double> component(-1.0, 1.0);
+    std::uniform_real_distribution<double> scale(0.5, 2.0);
+
+    node.translation = {offset(rng), offset(rng), offset(rng)};
+    std::vector<double> rotation{component(rng), component(rng), component(rng), component(rng)};
+    const double length = std::sqrt(
+      rotation[0] * rotation[0] + rotation[1] * rotation[1] + rotation[2] * rotation[2] +
+      rotation[3] * rotation[3]);
+    for (auto& value : rotation)
+      value /= length;
+    node.rotation = std::move(rotation);
+    node.scale = {scale(rng), scale(rng), scale(rng)};
+
+    if (parent < 0)
+      model.scenes.front().nodes.push_back(idx);
+    else
+      model.nodes[parent].children.push_back(idx);
+    return idx;
+  }
+
+  tinygltf::Model model;
+
+private:
+  std::mt19937 rng{42};
+};
+
+// A single root with all of the other nodes as its children
+tinygltf::Model wide_hierarchy(int node_count)
+{
+  HierarchyBuilder builder;
+  const int root = builder.addNode(-1);
+  for (int i = 1; i < node_count; ++i)
+    builder.addNode(root);
+  return std::move(builder.model);
+}
+
+// A few long chains, i.e. lots of tiny levels
+tinygltf::Model deep_hierarchy(int chain_count, int depth)
+{
+  HierarchyBuilder builder;
+  for (int chain = 0; chain < chain_count; ++chain)
+  {
+    int parent = -1;
+    for (int i = 0; i < depth; ++i)
+      parent = builder.addNode(parent);
+  }
+  return std::move(builder.model);
+}
+
+// Every node has the same number of children up to the given depth
+tinygltf::Model balanced_hierarchy(int branching, int depth)
+{
+  HierarchyBuilder builder;
+  std::function<void(int, int)> addSubtree = [&](int parent, int level) {
+    const int node = builder.addNode(parent);
+    if (level + 1 < depth)
+      for (int i = 0; i < branching; ++i)
+        addSubtree(node, level + 1);
+  };
+  addSubtree(-1, 0);
+  return std::move(builder.model);
+}
+
+void bench_hierarchy(std::string_view name, const tinygltf::Model& model)
+{
+  fmt::print("{}: {} nodes\n", name, model.nodes.size());
+
+  std::vector<std::size_t> workerCounts;
+  const std::size_t maxWorkers = ThreadPool::defaultWorkerCount();
+  for (std::size_t count = 0; count < maxWorkers; count = count * 2 + 1)
+    workerCounts.push_back(count);
+  workerCounts.push_back(maxWorkers);
+
+  double singleThreadedMs = 0;
+  for (auto workerCount : workerCounts)
+  {
+    ThreadPool workers{workerCount};
+
+    double best = 1e30;
+    for (int i = 0; i < REPETITIONS; ++i)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      const auto instances = process_instances(model, workers);
+      const auto end = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    if (workerCount == 0)
+      singleThreadedMs = best;
+    fmt::print(
+      "  {:3} threads: {:8.3f} ms ({:.2f}x)\n", workerCount + 1, best, singleThreadedMs / best);
+  }
+}
+
+} // namespace
+
+int main()
+{
+  bench_hierarchy("wide", wide_hierarchy(500'000));
+  bench_hierarchy("deep", deep_hierarchy(64, 4096));
+  bench_hierarchy("balanced", balanced_hierarchy(8, 7));
+  return 0;
+}
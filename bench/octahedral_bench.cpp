@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <glm/glm.hpp>
+
+#include "octahedral.h"
+
+
+// Angular error and CPU decode cost of the octahedral encoding at every
+// precision that is in use, compared to the encodings it replaced.
+// Usage: octahedral_bench
+
+namespace
+{
+
+constexpr std::size_t VECTOR_COUNT = 1 << 22;
+constexpr int REPETITIONS = 10;
+
+// The 16-bit xy + sign of z packing SceneManager used to have
+std::uint32_t legacy_encode_xy(glm::vec3 normal)
+{
+  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
+  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+
+  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
+  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
+  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+
+  return sx | sy;
+}
+
+glm::vec3 legacy_decode_xy(std::uint32_t data)
+{
+  const std::uint32_t encX = data & 0x0000FFFFu;
+  const std::uint32_t encY = (data & 0xFFFF0000u) >> 16;
+  const float sign = (encX & 0x0001u) != 0 ? -1.0f : 1.0f;
+
+  const auto sx = static_cast<std::int16_t>(encX & 0x0000FFFEu);
+  const auto sy = static_cast<std::int16_t>(encY);
+
+  const float x = sx * (1.0f / 32767.0f);
+  const float y = sy * (1.0f / 32767.0f);
+  const float z = sign * std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+
+  return {x, y, z};
+}
+
+// The 8-bit xyz packing the baker used to have
+std::uint32_t legacy_encode_xyz(glm::vec3 normal)
+{
+  auto component = [](float v) {
+    return static_cast<std::uint32_t>(static_cast<std::int8_t>(std::round(v * 127.0f))) & 0xFFu;
+  };
+  return component(normal.x) | component(normal.y) << 8 | component(normal.z) << 16;
+}
+
+glm::vec3 legacy_decode_xyz(std::uint32_t data)
+{
+  auto component = [data](int shift) {
+    return std::max(static_cast<std::int8_t>((data >> shift) & 0xFFu) / 127.0f, -1.0f);
+  };
+  return {component(0), component(8), component(16)};
+}
+
+struct Encoding
+{
+  std::string_view name;
+  std::uint32_t (*encode)(glm::vec3);
+  glm::vec3 (*decode)(std::uint32_t);
+};
+
+template <std::uint32_t Bits>
+std::uint32_t oct_encode_bits(glm::vec3 normal)
+{
+  return octahedral::oct_encode(normal, Bits);
+}
+
+template <std::uint32_t Bits>
+glm::vec3 oct_decode_bits(std::uint32_t data)
+{
+  return octahedral::oct_decode(data, Bits);
+}
+
+const std::array ENCODINGS{
+  Encoding{"octahedral 8+8", &oct_encode_bits<8>, &oct_decode_bits<8>},
+  Encoding{"octahedral 10+10", &oct_encode_bits<10>, &oct_decode_bits<10>},
+  Encoding{"octahedral 15+15 (tangents)", &oct_encode_bits<15>, &oct_decode_bits<15>},
+  Encoding{"octahedral 16+16", &oct_encode_bits<16>, &oct_decode_bits<16>},
+  Encoding{"legacy 16+16 xy + sign of z", &legacy_encode_xy, &legacy_decode_xy},
+  Encoding{"legacy 8+8+8 xyz", &legacy_encode_xyz, &legacy_decode_xyz},
+};
+
+// Uniformly distributed over the sphere
+std::vector<glm::vec3> random_unit_vectors(std::size_t count)
+{
+  std::mt19937 rng{42};
+  std::normal_distribution<float> coordinate;
+  std::vector<glm::vec3> result;
+  result.reserve(count);
+  while (result.size() < count)
+  {
+    const glm::vec3 v{coordinate(rng), coordinate(rng), coordinate(rng)};
+    const float length = glm::length(v);
+    if (length > 1e-6f)
+      result.push_back(v / length);
+  }
+  return result;
+}
+
+// Unlike acos of the dot product, this is accurate for tiny angles
+double angle_degrees(glm::dvec3 a, glm::dvec3 b)
+{
+  return glm::degrees(std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+}
+
+void bench_encoding(const Encoding& encoding, const std::vector<glm::vec3>& vectors)
+{
+  std::vector<std::uint32_t> encoded(vectors.size());
+  double maxDegrees = 0;
+  double sumDegrees = 0;
+  for (std::size_t i = 0; i < vectors.size(); ++i)
+  {
+    encoded[i] = encoding.encode(vectors[i]);
+    const double degrees = angle_degrees(
+      glm::dvec3{vectors[i]}, glm::dvec3{glm::normalize(encoding.decode(encoded[i]))});
+    maxDegrees = std::max(maxDegrees, degrees);
+    sumDegrees += degrees;
+  }
+
+  // Summing the results keeps the decoding from being optimized away
+  glm::vec3 sum{0};
+  double bestMs = 1e30;
+  for (int i = 0; i < REPETITIONS; ++i)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (auto data : encoded)
+      sum += encoding.decode(data);
+    const auto end = std::chrono::steady_clock::now();
+    bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  fmt::print(
+    "{:<28} max {:8.4f} deg, mean {:8.4f} deg, decode {:6.2f} ns/vector (checksum {:.1f})\n",
+    encoding.name,
+    maxDegrees,
+    sumDegrees / static_cast<double>(vectors.size()),
+    bestMs * 1e6 / static_cast<double>(encoded.size()),
+    sum.x + sum.y + sum.z);
+}
+
+} // namespace
+
+int main()
+{
+  const auto vectors = random_unit_vectors(VECTOR_COUNT);
+  fmt::print("{} random unit vectors\n", vectors.size());
+  for (const auto& encoding : ENCODINGS)
+    bench_encoding(encoding, vectors);
+  return 0;
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include <fmt/format.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include "scene/VertexTranscoder.hpp"
+
+
+// Compares transcode_vertices against the per-vertex loop SceneManager::processMeshes
+// used to have, on every triangle primitive of the given glTF scenes.
+// Usage: transcoder_bench [scene.gltf...]
+
+namespace
+{
+
+constexpr int REPETITIONS = 10;
+
+// The legacy loop only ever handled float attributes, so it is given exactly those
+struct LegacyPrimitive
+{
+  std::size_t vertexCount;
+  std::array<const std::byte*, 4> ptrs;
+  std::array<std::size_t, 4> strides;
+};
+
+std::uint32_t encode_normal(glm::vec3 normal)
+{
+  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
+  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+
+  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
+  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
+  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+
+  return sx | sy;
+}
+
+void transcode_legacy(LegacyPrimitive prim, glm::vec4* out)
+{
+  auto& [vertexCount, ptrs, strides] = prim;
+  const bool hasNormals = ptrs[1] != nullptr;
+  const bool hasTangents = ptrs[2] != nullptr;
+  const bool hasTexcoord = ptrs[3] != nullptr;
+
+  for (std::size_t i = 0; i < vertexCount; ++i)
+  {
+    glm::vec3 pos;
+    glm::vec3 normal{0};
+    glm::vec3 tangent{0};
+    glm::vec2 texcoord{0};
+    std::memcpy(&pos, ptrs[0], sizeof(pos));
+
+    if (hasNormals)
+      std::memcpy(&normal, ptrs[1], sizeof(normal));
+    if (hasTangents)
+      std::memcpy(&tangent, ptrs[2], sizeof(tangent));
+    if (hasTexcoord)
+      std::memcpy(&texcoord, ptrs[3], sizeof(texcoord));
+
+    out[2 * i] = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
+    out[2 * i + 1] = glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
+
+    ptrs[0] += strides[0];
+    if (hasNormals)
+      ptrs[1] += strides[1];
+    if (hasTangents)
+      ptrs[2] += strides[2];
+    if (hasTexcoord)
+      ptrs[3] += strides[3];
+  }
+}
+
+VertexAttributeStream accessor_stream(const tinygltf::Model& model, int accessor_idx)
+{
+  const auto& accessor = model.accessors[accessor_idx];
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  return VertexAttributeStream{
+    .data = reinterpret_cast<const std::byte*>(model.buffers[bufView.buffer].data.data()) +
+      bufView.byteOffset + accessor.byteOffset,
+    .stride = bufView.byteStride != 0
+      ? bufView.byteStride
+      : static_cast<std::size_t>(
+          tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+          tinygltf::GetNumComponentsInType(accessor.type)),
+    .componentType = accessor.componentType,
+  };
+}
+
+// Best of REPETITIONS, in milliseconds
+template <class F>
+double time_best(F&& f)
+{
+  double best = 1e30;
+  for (int i = 0; i < REPETITIONS; ++i)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+void bench_scene(const std::filesystem::path& path)
+{
+  tinygltf::TinyGLTF loader;
+  tinygltf::Model model;
+  std::string error;
+  std::string warning;
+  if (!loader.LoadASCIIFromFile(&model, &error, &warning, path.string()))
+  {
+    fmt::print("{}: failed to load, skipping ({})\n", path.string(), error);
+    return;
+  }
+
+  std::vector<VertexTranscodeJob> jobs;
+  std::vector<LegacyPrimitive> legacy;
+  std::size_t totalVertices = 0;
+  for (const auto& mesh : model.meshes)
+    for (const auto& prim : mesh.primitives)
+    {
+      if (prim.mode != TINYGLTF_MODE_TRIANGLES)
+        continue;
+
+      auto optionalAttribute = [&](const char* name) {
+        const auto it = prim.attributes.find(name);
+        return it != prim.attributes.end() ? accessor_stream(model, it->second)
+                                           : VertexAttributeStream{};
+      };
+
+      const int positionAccessor = prim.attributes.at("POSITION");
+      const VertexTranscodeJob job{
+        .vertexCount = model.accessors[positionAccessor].count,
+        .position = accessor_stream(model, positionAccessor),
+        .normal = optionalAttribute("NORMAL"),
+        .tangent = optionalAttribute("TANGENT"),
+        .texcoord = optionalAttribute("TEXCOORD_0"),
+      };
+      jobs.push_back(job);
+      totalVertices += job.vertexCount;
+
+      if (job.texcoord.data != nullptr &&
+        job.texcoord.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
+      {
+        fmt::print(
+          "{}: has quantized texcoords which the legacy loop can't decode\n", path.string());
+        return;
+      }
+      legacy.push_back(LegacyPrimitive{
+        .vertexCount = job.vertexCount,
+        .ptrs = {job.position.data, job.normal.data, job.tangent.data, job.texcoord.data},
+        .strides =
+          {job.position.stride, job.normal.stride, job.tangent.stride, job.texcoord.stride},
+      });
+    }
+
+  std::vector<glm::vec4> out(totalVertices * 2);
+
+  const double legacyMs = time_best([&] {
+    std::size_t first = 0;
+    for (const auto& prim : legacy)
+    {
+      transcode_legacy(prim, out.data() + 2 * first);
+      first += prim.vertexCount;
+    }
+  });
+
+  const double transcoderMs = time_best([&] {
+    std::size_t first = 0;
+    for (const auto& job : jobs)
+    {
+      transcode_vertices(job, reinterpret_cast<float*>(out.data() + 2 * first));
+      first += job.vertexCount;
+    }
+  });
+
+  fmt::print(
+    "{}: {} primitives, {} vertices\n"
+    "  legacy loop:        {:8.3f} ms\n"
+    "  transcode_vertices: {:8.3f} ms ({:.2f}x)\n",
+    path.filename().string(),
+    jobs.size(),
+    totalVertices,
+    legacyMs,
+    transcoderMs,
+    legacyMs / transcoderMs);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  std::vector<std::filesystem::path> scenes(argv + 1, argv + argc);
+  if (scenes.empty())
+    scenes = {
+      GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/lovely_town/scene.gltf",
+      GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf",
+    };
+
+  for (const auto& scene : scenes)
+    bench_scene(scene);
+
+  return 0;
+}
@@ -17,6 +17,26 @@ elseif(CMAKE_CXX_COMPILER_FRONTEND_VARIANT STREQUAL "GNU") # gcc and clang
   add_compile_options(-Wall -Wextra -Werror -pedantic)
 endif()
 
+# NOTE: SSE2 is always available on x86-64, but the wider AVX2 kernels
+# are only compiled in when explicitly requested, as the resulting binaries
+# won't run on older CPUs.
+option(GRAPHICS_COURSE_ENABLE_AVX2 "Compile SIMD kernels with AVX2 support" OFF)
+
+# Compiles the listed sources of the current directory with AVX2 if it's enabled.
+# Only files with AVX2 kernels should be listed, and FMA is deliberately left out:
+# with it, the compiler is free to contract a * b + c in the scalar reference
+# paths, which then stop being bit-exact with the kernels.
+function(enable_avx2_kernels)
+  if(NOT GRAPHICS_COURSE_ENABLE_AVX2)
+    return()
+  endif()
+  if(CMAKE_CXX_COMPILER_FRONTEND_VARIANT STREQUAL "MSVC")
+    set_source_files_properties(${ARGN} PROPERTIES COMPILE_OPTIONS /arch:AVX2)
+  else()
+    set_source_files_properties(${ARGN} PROPERTIES COMPILE_OPTIONS -mavx2)
+  endif()
+endfunction()
+
 add_compile_definitions(
   GRAPHICS_COURSE_RESOURCES_ROOT="${PROJECT_SOURCE_DIR}/resources"
   GRAPHICS_COURSE_ROOT="${PROJECT_SOURCE_DIR}"
@@ -0,0 +1,183 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <memory>
+
+
+namespace
+{
+
+// Lets submit tell whether it is called by one of the workers
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local std::size_t currentWorker = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t worker_count)
+  : localQueues(worker_count)
+{
+  workers.reserve(worker_count);
+  for (std::size_t i = 0; i < worker_count; ++i)
+    workers.emplace_back([this, i]() { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::unique_lock lock{sleepMutex};
+    stopping = true;
+  }
+  sleepCondition.notify_all();
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+std::size_t ThreadPool::defaultWorkerCount()
+{
+  const std::size_t hardwareThreads = std::thread::hardware_concurrency();
+  return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+void ThreadPool::submit(Task task)
+{
+  if (workers.empty())
+  {
+    task();
+    return;
+  }
+
+  // Counted before being pushed, so that the counter never goes below zero.
+  // A worker might spin a couple of times in between, which is harmless.
+  queuedTasks.fetch_add(1, std::memory_order_release);
+
+  auto& queue = currentPool == this ? localQueues[currentWorker] : sharedQueue;
+  {
+    std::unique_lock lock{queue.mutex};
+    queue.tasks.push_back(std::move(task));
+  }
+
+  // Workers check the counter under this mutex before going to sleep,
+  // so they either see the new task or get the notification
+  {
+    std::unique_lock lock{sleepMutex};
+  }
+  sleepCondition.notify_one();
+}
+
+std::optional<ThreadPool::Task> ThreadPool::popTask(std::size_t worker_idx)
+{
+  auto pop = [this](TaskQueue& queue, bool newest) -> std::optional<Task> {
+    std::unique_lock lock{queue.mutex};
+    if (queue.tasks.empty())
+      return std::nullopt;
+
+    Task task;
+    if (newest)
+    {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+    else
+    {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+  };
+
+  // Own tasks are taken newest first, as their data is the most likely to
+  // still be in the cache, while stolen ones are the oldest, which tend
+  // to be the biggest chunks of work.
+  if (auto task = pop(localQueues[worker_idx], true))
+    return task;
+  if (auto task = pop(sharedQueue, false))
+    return task;
+  for (std::size_t i = 1; i < localQueues.size(); ++i)
+    if (auto task = pop(localQueues[(worker_idx + i) % localQueues.size()], false))
+      return task;
+
+  return std::nullopt;
+}
+
+void ThreadPool::workerLoop(std::size_t worker_idx)
+{
+  currentPool = this;
+  currentWorker = worker_idx;
+
+  while (true)
+  {
+    if (auto task = popTask(worker_idx))
+    {
+      (*task)();
+      continue;
+    }
+
+    std::unique_lock lock{sleepMutex};
+    // NOTE: remaining tasks are still drained when stopping,
+    // someone might be waiting on them.
+    if (stopping && queuedTasks.load(std::memory_order_acquire) == 0)
+      return;
+    sleepCondition.wait(lock, [this]() {
+      return stopping || queuedTasks.load(std::memory_order_acquire) > 0;
+    });
+  }
+}
+
+void ThreadPool::parallelFor(std::size_t count, fu2::function_view<void(std::size_t)> body)
+{
+  if (count == 0)
+    return;
+
+  // Helpers may get scheduled after the loop is already over, so
+  // the shared state must outlive this call. The body, on the other hand,
+  // is only ever touched for valid indices, all of which are finished
+  // before we return.
+  struct State
+  {
+    State(fu2::function_view<void(std::size_t)> loop_body, std::size_t index_count)
+      : body{loop_body}
+      , count{index_count}
+    {
+    }
+
+    fu2::function_view<void(std::size_t)> body;
+    std::size_t count;
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> finished{0};
+
+    std::mutex mutex;
+    std::condition_variable allFinished;
+  };
+
+  auto state = std::make_shared<State>(body, count);
+
+  auto work = [](State& st) {
+    while (true)
+    {
+      const std::size_t idx = st.next.fetch_add(1, std::memory_order_relaxed);
+      if (idx >= st.count)
+        return;
+
+      st.body(idx);
+
+      if (st.finished.fetch_add(1, std::memory_order_acq_rel) + 1 == st.count)
+      {
+        std::unique_lock lock{st.mutex};
+        st.allFinished.notify_all();
+      }
+    }
+  };
+
+  const std::size_t helperCount = std::min(workers.size(), count - 1);
+  for (std::size_t i = 0; i < helperCount; ++i)
+    submit([state, work]() { work(*state); });
+
+  work(*state);
+
+  std::unique_lock lock{state->mutex};
+  state->allFinished.wait(lock, [&]() {
+    return state->finished.load(std::memory_order_acquire) == state->count;
+  });
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <function2/function2.hpp>
+
+
+// A fixed set of worker threads with a task queue each. Tasks submitted by
+// a worker go to its own queue and idle workers steal from the others, so
+// nested parallelism (e.g. parallelFor inside of a task) stays mostly local.
+// The thread calling parallelFor participates in the work, so a pool with
+// N workers runs parallel loops on N + 1 threads.
+class ThreadPool
+{
+public:
+  using Task = fu2::unique_function<void()>;
+
+  // By default leaves one hardware thread for the caller
+  explicit ThreadPool(std::size_t worker_count = defaultWorkerCount());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  std::size_t getWorkerCount() const { return workers.size(); }
+
+  // Runs the task asynchronously on some worker thread.
+  // Without workers, the task is executed right away.
+  void submit(Task task);
+
+  // Calls body(i) for every i in [0, count) and waits for all of the calls to finish.
+  // Indices are handed out dynamically, so uneven per-index costs are fine.
+  void parallelFor(std::size_t count, fu2::function_view<void(std::size_t)> body);
+
+  static std::size_t defaultWorkerCount();
+
+private:
+  struct TaskQueue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void workerLoop(std::size_t worker_idx);
+  std::optional<Task> popTask(std::size_t worker_idx);
+
+private:
+  std::vector<TaskQueue> localQueues;
+  // Tasks submitted from outside of the pool
+  TaskQueue sharedQueue;
+  std::atomic<std::size_t> queuedTasks{0};
+
+  std::mutex sleepMutex;
+  std::condition_variable sleepCondition;
+  bool stopping = false;
+
+  std::vector<std::thread> workers;
+};
@@ -11,6 +11,9 @@
 #define SHADER_NAMESPACE(name) namespace name {
 #define SHADER_NAMESPACE_END }
 
+// Functions defined in shared headers end up in several translation units
+#define SHADER_FUNCTION inline
+
 // NOLINTBEGIN
 
 // NOTE: This is technically completely wrong,
@@ -37,6 +40,8 @@ using shader_bool = glm::uint;
 #define SHADER_NAMESPACE(name)
 #define SHADER_NAMESPACE_END
 
+#define SHADER_FUNCTION
+
 
 #define shader_uint uint
 #define shader_uvec2 uvec2
@@ -0,0 +1,121 @@
+#ifndef OCTAHEDRAL_H_INCLUDED
+#define OCTAHEDRAL_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+// Octahedral encoding of unit vectors: the vector is projected onto the
+// octahedron |x| + |y| + |z| = 1, whose lower half is then folded over the
+// upper one, so that the whole sphere maps onto the [-1, 1]^2 square.
+// Unlike storing xy and the sign of z, the error is almost uniform over the
+// sphere, so the same quality is achievable with much fewer bits.
+// See "A Survey of Efficient Representations for Independent Unit Vectors".
+
+SHADER_NAMESPACE(octahedral)
+
+#ifdef __cplusplus
+using glm::abs;
+using glm::clamp;
+using glm::max;
+using glm::normalize;
+#endif
+
+// Bits per component, anything from 2 to 16 works, but these are the
+// ones that are worth using: 8 and 16 fill up unorm/snorm formats, while
+// 10 is what is left of a 32-bit word after 12 bits of something else.
+const shader_uint OCT_BITS_8 = 8u;
+const shader_uint OCT_BITS_10 = 10u;
+const shader_uint OCT_BITS_16 = 16u;
+
+// Normals of all vertex formats
+const shader_uint OCT_VERTEX_BITS = OCT_BITS_16;
+
+// Tangents also have to carry the handedness of the tangent frame (glTF's
+// tangent.w) in the top bit, so they get one bit less per component.
+// Bit 30 is unused.
+const shader_uint OCT_TANGENT_BITS = OCT_VERTEX_BITS - 1u;
+const shader_uint OCT_TANGENT_SIGN_BIT = 0x80000000u;
+
+SHADER_FUNCTION shader_vec2 oct_wrap(shader_vec2 a_v)
+{
+  return (shader_vec2(1.0f) - abs(shader_vec2(a_v.y, a_v.x))) *
+    shader_vec2(a_v.x >= 0.0f ? 1.0f : -1.0f, a_v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+// Result is in [-1, 1]^2, zero and NaN vectors end up at (0, 0), i.e. +Z
+SHADER_FUNCTION shader_vec2 oct_encode_float(shader_vec3 a_normal)
+{
+  const shader_float l1 = abs(a_normal.x) + abs(a_normal.y) + abs(a_normal.z);
+  if (!(l1 > 0.0f))
+    return shader_vec2(0.0f);
+
+  const shader_vec2 p = shader_vec2(a_normal.x / l1, a_normal.y / l1);
+  return a_normal.z < 0.0f ? oct_wrap(p) : p;
+}
+
+// Unfolding the lower half through a single max instead of a branch
+// per component, as suggested by Rune Stubbe
+SHADER_FUNCTION shader_vec3 oct_decode_float(shader_vec2 a_p)
+{
+  shader_vec3 n = shader_vec3(a_p.x, a_p.y, 1.0f - abs(a_p.x) - abs(a_p.y));
+  const shader_float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
+// Round half away from zero. Spelled out instead of using round(), which
+// leaves ties to the implementation in GLSL and is hard to vectorize on SSE2.
+SHADER_FUNCTION int oct_round(shader_float a_v)
+{
+  return int(a_v + (a_v >= 0.0f ? 0.5f : -0.5f));
+}
+
+// Snorm quantization of both components, x ends up in the low bits
+SHADER_FUNCTION shader_uint oct_quantize(shader_vec2 a_p, shader_uint a_bits)
+{
+  const shader_float scale = shader_float((1u << (a_bits - 1u)) - 1u);
+  const shader_uint mask = (1u << a_bits) - 1u;
+  const shader_uint x = shader_uint(oct_round(clamp(a_p.x, -1.0f, 1.0f) * scale)) & mask;
+  const shader_uint y = shader_uint(oct_round(clamp(a_p.y, -1.0f, 1.0f) * scale)) & mask;
+  return x | (y << a_bits);
+}
+
+SHADER_FUNCTION shader_vec2 oct_dequantize(shader_uint a_data, shader_uint a_bits)
+{
+  // Shifting the sign bit to the top and back sign-extends the value
+  const shader_uint shift = 32u - a_bits;
+  const int x = int(a_data << shift) >> int(shift);
+  const int y = int((a_data >> a_bits) << shift) >> int(shift);
+  const shader_float scale = 1.0f / shader_float((1u << (a_bits - 1u)) - 1u);
+  // Snorm has two representations of -1
+  return max(shader_vec2(x, y) * scale, shader_vec2(-1.0f));
+}
+
+SHADER_FUNCTION shader_uint oct_encode(shader_vec3 a_normal, shader_uint a_bits)
+{
+  return oct_quantize(oct_encode_float(a_normal), a_bits);
+}
+
+SHADER_FUNCTION shader_vec3 oct_decode(shader_uint a_data, shader_uint a_bits)
+{
+  return oct_decode_float(oct_dequantize(a_data, a_bits));
+}
+
+// Handedness is the sign of w, with 0 and NaN counting as positive
+SHADER_FUNCTION shader_uint oct_encode_tangent(shader_vec4 a_tangent)
+{
+  const shader_vec3 t = shader_vec3(a_tangent.x, a_tangent.y, a_tangent.z);
+  return oct_encode(t, OCT_TANGENT_BITS) | (a_tangent.w < 0.0f ? OCT_TANGENT_SIGN_BIT : 0u);
+}
+
+// w is the handedness, either 1 or -1
+SHADER_FUNCTION shader_vec4 oct_decode_tangent(shader_uint a_data)
+{
+  return shader_vec4(
+    oct_decode(a_data & ~OCT_TANGENT_SIGN_BIT, OCT_TANGENT_BITS),
+    (a_data & OCT_TANGENT_SIGN_BIT) != 0u ? -1.0f : 1.0f);
+}
+
+SHADER_NAMESPACE_END
+
+#endif // OCTAHEDRAL_H_INCLUDED
@@ -3,19 +3,36 @@
 
 // NOTE: .glsl extension is used for helper files with shader code
 
+#include "octahedral.h"
+
+// See octahedral.h, encoded by the baker
 vec3 decode_normal(uint a_data)
 {
-  const uint a_enc_x = (a_data & 0x000000FFu) >> 0;
-  const uint a_enc_y = (a_data & 0x0000FF00u) >> 8;
-  const uint a_enc_z = (a_data & 0x00FF0000u) >> 16;
+  return oct_decode(a_data, OCT_VERTEX_BITS);
+}
+
+// xyz is the tangent, w is the handedness of the tangent frame
+vec4 decode_tangent(uint a_data)
+{
+  return oct_decode_tangent(a_data);
+}
 
-  ivec3 enc_i = ivec3(a_enc_x, a_enc_y, a_enc_z);
-  enc_i += 128;
-  enc_i %= 256;
-  enc_i -= 128;
-  vec3 enc = vec3(enc_i);
+// Compact baked vertices store positions as 16-bit unorm relative to the
+// bounding box of their relem. The box minimum is applied through the
+// translation of the model matrix, while the box size is passed in its
+// last row, which is always (0, 0, 0, 1) for affine transforms anyway.
+vec3 dequantize_position(vec3 a_pos, mat4 a_quantizedModel)
+{
+  return a_pos * vec3(a_quantizedModel[0][3], a_quantizedModel[1][3], a_quantizedModel[2][3]);
+}
 
-  return max(enc / 127.0, -1.0);
+mat4 unpack_quantized_model(mat4 a_quantizedModel)
+{
+  mat4 model = a_quantizedModel;
+  model[0][3] = 0.0f;
+  model[1][3] = 0.0f;
+  model[2][3] = 0.0f;
+  return model;
 }
 
 #endif // UNPACK_ATTRIBUTES_GLSL_INCLUDED
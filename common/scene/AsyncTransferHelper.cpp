@@ -0,0 +1,164 @@
+#include "AsyncTransferHelper.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include <etna/GlobalContext.hpp>
+
+
+AsyncTransferHelper::AsyncTransferHelper(CreateInfo info)
+  : sliceSize{info.sliceSize}
+{
+  ETNA_VERIFY(info.sliceCount > 0 && info.sliceSize > 0);
+
+  auto& ctx = etna::get_context();
+  auto device = ctx.getDevice();
+
+  commandPool = etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer |
+      vk::CommandPoolCreateFlagBits::eTransient,
+    .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+  }));
+
+  auto commandBuffers =
+    etna::unwrap_vk_result(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+      .commandPool = commandPool.get(),
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = info.sliceCount,
+    }));
+
+  slices.resize(info.sliceCount);
+  for (std::size_t i = 0; i < slices.size(); ++i)
+  {
+    auto& slice = slices[i];
+    slice.staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = sliceSize,
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = "async_transfer_staging",
+    });
+    slice.staging.map();
+    slice.commandBuffer = commandBuffers[i];
+    slice.fence = etna::unwrap_vk_result(device.createFenceUnique(vk::FenceCreateInfo{}));
+  }
+}
+
+AsyncTransferHelper::~AsyncTransferHelper()
+{
+  wait();
+}
+
+AsyncTransferHelper::Slice& AsyncTransferHelper::acquireSlice()
+{
+  // Slices are used round-robin, so the next one is always the oldest submission
+  auto& slice = slices[nextSlice];
+  nextSlice = (nextSlice + 1) % slices.size();
+
+  if (slice.inFlight)
+  {
+    auto device = etna::get_context().getDevice();
+    ETNA_CHECK_VK_RESULT(
+      device.waitForFences({slice.fence.get()}, vk::True, std::numeric_limits<std::uint64_t>::max()));
+    ETNA_CHECK_VK_RESULT(device.resetFences({slice.fence.get()}));
+    slice.inFlight = false;
+  }
+
+  return slice;
+}
+
+std::span<std::byte> AsyncTransferHelper::beginStaging()
+{
+  ETNA_VERIFY(pendingSlice == nullptr);
+  pendingSlice = &acquireSlice();
+  return {pendingSlice->staging.data(), static_cast<std::size_t>(sliceSize)};
+}
+
+void AsyncTransferHelper::submitStaging(std::span<const StagingCopy> copies)
+{
+  ETNA_VERIFY(pendingSlice != nullptr);
+  auto& slice = *std::exchange(pendingSlice, nullptr);
+
+  auto cmdBuf = slice.commandBuffer;
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+
+  std::vector<vk::BufferMemoryBarrier2> barriers;
+  barriers.reserve(copies.size());
+  for (const auto& copy : copies)
+  {
+    ETNA_VERIFY(copy.srcOffset + copy.size <= sliceSize);
+
+    const vk::BufferCopy region{
+      .srcOffset = copy.srcOffset,
+      .dstOffset = copy.dstOffset,
+      .size = copy.size,
+    };
+    cmdBuf.copyBuffer(slice.staging.get(), copy.dst->get(), 1, &region);
+
+    // Make the data visible to whatever reads it in later submissions
+    barriers.push_back(vk::BufferMemoryBarrier2{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+      .dstAccessMask = vk::AccessFlagBits2::eMemoryRead,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = copy.dst->get(),
+      .offset = copy.dstOffset,
+      .size = copy.size,
+    });
+  }
+  cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+    .bufferMemoryBarrierCount = static_cast<std::uint32_t>(barriers.size()),
+    .pBufferMemoryBarriers = barriers.data(),
+  });
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+
+  const vk::SubmitInfo submitInfo{
+    .commandBufferCount = 1,
+    .pCommandBuffers = &cmdBuf,
+  };
+  ETNA_CHECK_VK_RESULT(etna::get_context().getQueue().submit(1, &submitInfo, slice.fence.get()));
+  slice.inFlight = true;
+}
+
+void AsyncTransferHelper::uploadBuffer(
+  const etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> src)
+{
+  while (!src.empty())
+  {
+    const auto staging = beginStaging();
+    const std::size_t chunkSize = std::min(src.size(), staging.size());
+    std::memcpy(staging.data(), src.data(), chunkSize);
+
+    const StagingCopy copy{
+      .dst = &dst,
+      .srcOffset = 0,
+      .dstOffset = offset,
+      .size = chunkSize,
+    };
+    submitStaging({&copy, 1});
+
+    src = src.subspan(chunkSize);
+    offset += chunkSize;
+  }
+}
+
+void AsyncTransferHelper::wait()
+{
+  auto device = etna::get_context().getDevice();
+  for (auto& slice : slices)
+  {
+    if (!slice.inFlight)
+      continue;
+
+    ETNA_CHECK_VK_RESULT(
+      device.waitForFences({slice.fence.get()}, vk::True, std::numeric_limits<std::uint64_t>::max()));
+    ETNA_CHECK_VK_RESULT(device.resetFences({slice.fence.get()}));
+    slice.inFlight = false;
+  }
+}
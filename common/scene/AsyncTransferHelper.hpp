@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+
+
+// Streams data into device-local buffers through several staging slices.
+// Unlike etna::BlockingTransferHelper, an upload only blocks the CPU when
+// every slice is still being copied by the GPU, so the caller can prepare
+// the next portion of data while the previous one is in flight.
+// NOTE: etna creates a single universal queue, so copies are submitted there.
+// Must be used from the thread that owns that queue.
+class AsyncTransferHelper
+{
+public:
+  struct CreateInfo
+  {
+    vk::DeviceSize sliceSize;
+    std::uint32_t sliceCount = 2;
+  };
+
+  explicit AsyncTransferHelper(CreateInfo info);
+  ~AsyncTransferHelper();
+
+  AsyncTransferHelper(const AsyncTransferHelper&) = delete;
+  AsyncTransferHelper& operator=(const AsyncTransferHelper&) = delete;
+
+  AsyncTransferHelper(AsyncTransferHelper&&) = delete;
+  AsyncTransferHelper& operator=(AsyncTransferHelper&&) = delete;
+
+  // A single copy out of the staging memory returned by beginStaging
+  struct StagingCopy
+  {
+    const etna::Buffer* dst;
+    vk::DeviceSize srcOffset;
+    vk::DeviceSize dstOffset;
+    vk::DeviceSize size;
+  };
+
+  // Size of the memory returned by beginStaging
+  vk::DeviceSize getSliceSize() const { return sliceSize; }
+
+  // Hands out the mapped memory of the next free staging slice, so that the caller
+  // can produce data right in it instead of having it copied there by uploadBuffer.
+  // Has to be followed by submitStaging before anything else is uploaded.
+  std::span<std::byte> beginStaging();
+  void submitStaging(std::span<const StagingCopy> copies);
+
+  // Schedules a copy of src into dst at the given offset. The src memory
+  // may be reused as soon as this returns.
+  void uploadBuffer(const etna::Buffer& dst, vk::DeviceSize offset, std::span<const std::byte> src);
+
+  template <class T>
+  void uploadBuffer(const etna::Buffer& dst, vk::DeviceSize offset, std::span<const T> src)
+  {
+    uploadBuffer(dst, offset, std::as_bytes(src));
+  }
+
+  // Blocks until all of the scheduled copies are done
+  void wait();
+
+private:
+  struct Slice
+  {
+    etna::Buffer staging;
+    vk::CommandBuffer commandBuffer;
+    vk::UniqueFence fence;
+    bool inFlight = false;
+  };
+
+  Slice& acquireSlice();
+
+private:
+  vk::DeviceSize sliceSize;
+  vk::UniqueCommandPool commandPool;
+  std::vector<Slice> slices;
+  std::size_t nextSlice = 0;
+  // Between beginStaging and submitStaging
+  Slice* pendingSlice = nullptr;
+};
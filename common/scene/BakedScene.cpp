@@ -0,0 +1,319 @@
+#include "BakedScene.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+
+static_assert(std::is_trivially_copyable_v<BakedSceneHeader>);
+static_assert(std::is_trivially_copyable_v<Mesh> && sizeof(Mesh) == 48);
+static_assert(std::is_trivially_copyable_v<Bounds> && sizeof(Bounds) == 40);
+static_assert(std::is_trivially_copyable_v<RenderElement> && sizeof(RenderElement) == 36);
+static_assert(std::is_trivially_copyable_v<RenderElementLod> && sizeof(RenderElementLod) == 12);
+static_assert(std::is_trivially_copyable_v<Meshlet> && sizeof(Meshlet) == 40);
+static_assert(std::is_trivially_copyable_v<BakedCompactVertex> && sizeof(BakedCompactVertex) == 20);
+static_assert(sizeof(glm::mat4x4) == 64);
+
+std::size_t baked_vertex_size(BakedVertexFormat format)
+{
+  switch (format)
+  {
+  case BakedVertexFormat::Full:
+    return 32;
+  case BakedVertexFormat::Compact:
+    return sizeof(BakedCompactVertex);
+  }
+  return 0;
+}
+
+static constexpr std::size_t section_index(BakedSceneSection section)
+{
+  return static_cast<std::size_t>(section);
+}
+
+static std::uint64_t align_up(std::uint64_t value)
+{
+  return (value + BAKED_SCENE_ALIGNMENT - 1) / BAKED_SCENE_ALIGNMENT * BAKED_SCENE_ALIGNMENT;
+}
+
+bool write_baked_scene(const std::filesystem::path& path, const BakedSceneData& data)
+{
+  const std::array<std::span<const std::byte>, section_index(BakedSceneSection::Count)> contents = {
+    std::as_bytes(data.instanceMatrices),
+    std::as_bytes(data.instanceMeshes),
+    std::as_bytes(data.meshes),
+    std::as_bytes(data.renderElements),
+    std::as_bytes(data.renderElementBounds),
+    std::as_bytes(data.renderElementVertexCounts),
+    std::as_bytes(data.meshlets),
+    std::as_bytes(data.renderElementLods),
+    data.vertices,
+    std::as_bytes(data.indices),
+    std::as_bytes(data.indices16),
+  };
+
+  BakedSceneHeader header{};
+  header.magic = BAKED_SCENE_MAGIC;
+  header.version = BAKED_SCENE_VERSION;
+  header.sectionCount = static_cast<std::uint32_t>(contents.size());
+  header.vertexFormat = data.vertexFormat;
+
+  std::uint64_t offset = sizeof(BakedSceneHeader);
+  for (std::size_t i = 0; i < contents.size(); ++i)
+  {
+    offset = align_up(offset);
+    header.sections[i] = BakedSceneSectionRange{.offset = offset, .size = contents[i].size()};
+    offset += contents[i].size();
+  }
+
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  if (!file)
+  {
+    spdlog::error("Unable to open {} for writing", path);
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  static constexpr std::array<char, BAKED_SCENE_ALIGNMENT> PADDING{};
+  std::uint64_t written = sizeof(header);
+  for (std::size_t i = 0; i < contents.size(); ++i)
+  {
+    file.write(PADDING.data(), static_cast<std::streamsize>(header.sections[i].offset - written));
+    file.write(
+      reinterpret_cast<const char*>(contents[i].data()),
+      static_cast<std::streamsize>(contents[i].size()));
+    written = header.sections[i].offset + header.sections[i].size;
+  }
+
+  if (!file)
+  {
+    spdlog::error("Failed to write {}", path);
+    return false;
+  }
+
+  return true;
+}
+
+template <class T>
+static std::optional<std::span<const T>> section_view(
+  std::span<const std::byte> file, const BakedSceneHeader& header, BakedSceneSection section)
+{
+  const auto& range = header.sections[section_index(section)];
+  if (
+    range.offset % BAKED_SCENE_ALIGNMENT != 0 || range.offset > file.size() ||
+    range.size > file.size() - range.offset || range.size % sizeof(T) != 0)
+  {
+    spdlog::error("Baked scene: section {} is out of bounds", section_index(section));
+    return std::nullopt;
+  }
+
+  return std::span{
+    reinterpret_cast<const T*>(file.data() + range.offset), range.size / sizeof(T)};
+}
+
+#ifndef NDEBUG
+// One past the largest index, 0 for an empty range
+template <class Index>
+static std::size_t referenced_vertex_count(std::span<const Index> indices)
+{
+  std::size_t result = 0;
+  for (Index index : indices)
+    result = std::max(result, std::size_t{index} + 1);
+  return result;
+}
+#endif
+
+std::optional<BakedSceneData> parse_baked_scene(std::span<const std::byte> file)
+{
+  if (file.size() < sizeof(BakedSceneHeader))
+  {
+    spdlog::error("Baked scene: the file is too small to contain a header");
+    return std::nullopt;
+  }
+
+  BakedSceneHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (header.magic != BAKED_SCENE_MAGIC)
+  {
+    spdlog::error("Baked scene: bad magic, this is not a baked scene");
+    return std::nullopt;
+  }
+
+  if (header.version != BAKED_SCENE_VERSION)
+  {
+    spdlog::error(
+      "Baked scene: version {} is not supported (expected {}), please re-bake the scene",
+      header.version,
+      BAKED_SCENE_VERSION);
+    return std::nullopt;
+  }
+
+  if (header.sectionCount != section_index(BakedSceneSection::Count))
+  {
+    spdlog::error("Baked scene: unexpected section count {}", header.sectionCount);
+    return std::nullopt;
+  }
+
+  const std::size_t vertexSize = baked_vertex_size(header.vertexFormat);
+  if (vertexSize == 0)
+  {
+    spdlog::error(
+      "Baked scene: unknown vertex format {}", static_cast<std::uint32_t>(header.vertexFormat));
+    return std::nullopt;
+  }
+
+  auto instanceMatrices =
+    section_view<glm::mat4x4>(file, header, BakedSceneSection::InstanceMatrices);
+  auto instanceMeshes =
+    section_view<std::uint32_t>(file, header, BakedSceneSection::InstanceMeshes);
+  auto meshes = section_view<Mesh>(file, header, BakedSceneSection::Meshes);
+  auto relems = section_view<RenderElement>(file, header, BakedSceneSection::RenderElements);
+  auto relemBounds = section_view<Bounds>(file, header, BakedSceneSection::RenderElementBounds);
+  auto relemVertexCounts =
+    section_view<std::uint32_t>(file, header, BakedSceneSection::RenderElementVertexCounts);
+  auto meshlets = section_view<Meshlet>(file, header, BakedSceneSection::Meshlets);
+  auto lods = section_view<RenderElementLod>(file, header, BakedSceneSection::RenderElementLods);
+  auto vertices = section_view<std::byte>(file, header, BakedSceneSection::Vertices);
+  auto indices = section_view<std::uint32_t>(file, header, BakedSceneSection::Indices);
+  auto indices16 = section_view<std::uint16_t>(file, header, BakedSceneSection::Indices16);
+
+  if (
+    !instanceMatrices || !instanceMeshes || !meshes || !relems || !relemBounds ||
+    !relemVertexCounts || !meshlets || !lods || !vertices || !indices || !indices16)
+    return std::nullopt;
+
+  if (vertices->size() % vertexSize != 0)
+  {
+    spdlog::error("Baked scene: vertex data is not a whole number of vertices");
+    return std::nullopt;
+  }
+
+  if (instanceMatrices->size() != instanceMeshes->size())
+  {
+    spdlog::error("Baked scene: instance matrix and mesh counts differ");
+    return std::nullopt;
+  }
+
+  if (relems->size() != relemBounds->size() || relems->size() != relemVertexCounts->size())
+  {
+    spdlog::error("Baked scene: render element, bounds and vertex count counts differ");
+    return std::nullopt;
+  }
+
+  // Cheap sanity checks of the cross-references, so that a corrupted
+  // file can't make us read out of bounds later on
+  for (auto meshIdx : *instanceMeshes)
+    if (meshIdx >= meshes->size())
+    {
+      spdlog::error("Baked scene: instance references a non-existent mesh {}", meshIdx);
+      return std::nullopt;
+    }
+
+  for (const auto& mesh : *meshes)
+    if (std::size_t{mesh.firstRelem} + mesh.relemCount > relems->size())
+    {
+      spdlog::error("Baked scene: mesh references non-existent render elements");
+      return std::nullopt;
+    }
+
+  // Meshlets and LODs use the index region of the relem they belong to
+  const std::size_t vertexCount = vertices->size() / vertexSize;
+  for (std::size_t relemIdx = 0; relemIdx < relems->size(); ++relemIdx)
+  {
+    const auto& relem = (*relems)[relemIdx];
+    const std::uint32_t relemVertexCount = (*relemVertexCounts)[relemIdx];
+    if (
+      std::size_t{relem.firstMeshlet} + relem.meshletCount > meshlets->size() ||
+      std::size_t{relem.firstLod} + relem.lodCount > lods->size())
+    {
+      spdlog::error("Baked scene: render element references non-existent subranges");
+      return std::nullopt;
+    }
+
+    std::size_t regionSize = 0;
+    switch (relem.indexFormat)
+    {
+    case IndexFormat::Uint32:
+      regionSize = indices->size();
+      break;
+    case IndexFormat::Uint16:
+      regionSize = indices16->size();
+      break;
+    default:
+      spdlog::error(
+        "Baked scene: unknown index format {}", static_cast<std::uint32_t>(relem.indexFormat));
+      return std::nullopt;
+    }
+
+    auto inRegion = [regionSize](std::uint32_t offset, std::uint32_t count) {
+      return std::size_t{offset} + count <= regionSize;
+    };
+
+    // Meshlets partition the relem's own range
+    auto inRelem = [&relem](std::uint32_t offset, std::uint32_t count) {
+      return offset >= relem.indexOffset &&
+        std::size_t{offset} + count <= std::size_t{relem.indexOffset} + relem.indexCount;
+    };
+
+    bool valid = inRegion(relem.indexOffset, relem.indexCount);
+    for (const auto& meshlet : meshlets->subspan(relem.firstMeshlet, relem.meshletCount))
+      valid = valid && inRelem(meshlet.indexOffset, meshlet.indexCount);
+    for (const auto& lod : lods->subspan(relem.firstLod, relem.lodCount))
+      valid = valid && inRegion(lod.indexOffset, lod.indexCount);
+
+    if (!valid)
+    {
+      spdlog::error("Baked scene: render element references non-existent indices");
+      return std::nullopt;
+    }
+
+    // Indices are relative to vertexOffset and the baker keeps them below
+    // the relem's vertex count, so checking the count is enough
+    if (std::size_t{relem.vertexOffset} + relemVertexCount > vertexCount)
+    {
+      spdlog::error("Baked scene: render element references non-existent vertices");
+      return std::nullopt;
+    }
+
+#ifndef NDEBUG
+    // Scanning all indices is O(scene), so release builds trust the baker.
+    // Meshlets are covered by the relem itself.
+    auto referencedVertices = [&](std::uint32_t offset, std::uint32_t count) {
+      return relem.indexFormat == IndexFormat::Uint16
+        ? referenced_vertex_count(indices16->subspan(offset, count))
+        : referenced_vertex_count(indices->subspan(offset, count));
+    };
+
+    std::size_t referenced = referencedVertices(relem.indexOffset, relem.indexCount);
+    for (const auto& lod : lods->subspan(relem.firstLod, relem.lodCount))
+      referenced = std::max(referenced, referencedVertices(lod.indexOffset, lod.indexCount));
+
+    if (referenced > relemVertexCount)
+    {
+      spdlog::error("Baked scene: render element indices exceed its vertex count");
+      return std::nullopt;
+    }
+#endif
+  }
+
+  return BakedSceneData{
+    .instanceMatrices = *instanceMatrices,
+    .instanceMeshes = *instanceMeshes,
+    .meshes = *meshes,
+    .renderElements = *relems,
+    .renderElementBounds = *relemBounds,
+    .renderElementVertexCounts = *relemVertexCounts,
+    .meshlets = *meshlets,
+    .renderElementLods = *lods,
+    .vertexFormat = header.vertexFormat,
+    .vertices = *vertices,
+    .indices = *indices,
+    .indices16 = *indices16,
+  };
+}
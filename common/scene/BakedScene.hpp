@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include <glm/glm.hpp>
+
+#include "scene/Mesh.hpp"
+
+
+// Engine-native container for baked scenes (*_baked.scene). The file starts
+// with a fixed-size header followed by raw sections, each of which is aligned
+// so that it can be used in place straight from a memory mapping:
+//
+//   BakedSceneHeader | instance matrices | instance meshes | meshes |
+//   render elements | render element bounds | render element vertex counts |
+//   meshlets | render element LODs | vertices | 32-bit indices | 16-bit indices
+//
+// Everything is stored in the native (little-endian) byte order. Any change
+// to the layout of the section contents must bump BAKED_SCENE_VERSION.
+
+inline constexpr std::array<char, 8> BAKED_SCENE_MAGIC = {'G', 'C', 'S', 'C', 'E', 'N', 'E', '\0'};
+inline constexpr std::uint32_t BAKED_SCENE_VERSION = 10;
+inline constexpr std::size_t BAKED_SCENE_ALIGNMENT = 64;
+
+enum class BakedSceneSection : std::uint32_t
+{
+  InstanceMatrices = 0,          //< glm::mat4x4[instanceCount]
+  InstanceMeshes = 1,            //< std::uint32_t[instanceCount]
+  Meshes = 2,                    //< Mesh[meshCount]
+  RenderElements = 3,            //< RenderElement[relemCount]
+  RenderElementBounds = 4,       //< Bounds[relemCount]
+  RenderElementVertexCounts = 5, //< std::uint32_t[relemCount]
+  Meshlets = 6,                  //< Meshlet[meshletCount]
+  RenderElementLods = 7,         //< RenderElementLod[lodCount]
+  Vertices = 8,                  //< Vertices in BakedSceneHeader::vertexFormat
+  Indices = 9,                   //< std::uint32_t[indexCount]
+  Indices16 = 10,                //< std::uint16_t[index16Count]
+  Count = 11,
+};
+
+enum class BakedVertexFormat : std::uint32_t
+{
+  // 32 bytes: float3 position, packed normal, float2 texcoord, packed tangent, padding.
+  // Normals and tangents are octahedral, see oct_encode and oct_encode_tangent
+  Full = 0,
+  // 20 bytes, see BakedCompactVertex
+  Compact = 1,
+};
+
+// Positions are 16-bit unorm relative to the bounding box of the relem the
+// vertex belongs to (the one in the RenderElementBounds section), so they
+// have to be dequantized per relem, see unpack_attributes_baked.glsl.
+struct BakedCompactVertex
+{
+  // 4th component is unused
+  std::array<std::uint16_t, 4> position;
+  std::uint32_t normal;
+  std::uint32_t tangent;
+  // Two half floats
+  std::uint32_t texCoord;
+};
+
+std::size_t baked_vertex_size(BakedVertexFormat format);
+
+struct BakedSceneSectionRange
+{
+  // In bytes from the beginning of the file
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct alignas(BAKED_SCENE_ALIGNMENT) BakedSceneHeader
+{
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t sectionCount;
+  BakedVertexFormat vertexFormat;
+  std::uint32_t reserved;
+  std::array<BakedSceneSectionRange, static_cast<std::size_t>(BakedSceneSection::Count)> sections;
+};
+
+// Views into the contents of a baked scene. When reading, they point
+// into the (mapped) file and are only valid while it is alive.
+struct BakedSceneData
+{
+  std::span<const glm::mat4x4> instanceMatrices;
+  std::span<const std::uint32_t> instanceMeshes;
+  std::span<const Mesh> meshes;
+  std::span<const RenderElement> renderElements;
+  std::span<const Bounds> renderElementBounds;
+  // Vertices starting at vertexOffset that the relem and its LODs reference.
+  // The baker guarantees that indices stay below it, so loading can bounds-check
+  // relems without looking at their indices.
+  std::span<const std::uint32_t> renderElementVertexCounts;
+  std::span<const Meshlet> meshlets;
+  std::span<const RenderElementLod> renderElementLods;
+  BakedVertexFormat vertexFormat;
+  std::span<const std::byte> vertices;
+  // Regions of the relems with IndexFormat::Uint32 and IndexFormat::Uint16
+  std::span<const std::uint32_t> indices;
+  std::span<const std::uint16_t> indices16;
+};
+
+bool write_baked_scene(const std::filesystem::path& path, const BakedSceneData& data);
+
+// Validates the header, section bounds and cross-references in O(relems),
+// returns nullopt for malformed files. Debug builds also check every index.
+std::optional<BakedSceneData> parse_baked_scene(std::span<const std::byte> file);
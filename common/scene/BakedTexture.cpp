@@ -0,0 +1,282 @@
+#include "BakedTexture.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+
+
+static_assert(std::is_trivially_copyable_v<BakedTextureHeader>);
+
+std::size_t baked_texture_block_size(BakedTextureFormat format)
+{
+  switch (format)
+  {
+  case BakedTextureFormat::Bc1Unorm:
+  case BakedTextureFormat::Bc1Srgb:
+    return 8;
+  case BakedTextureFormat::Bc5Unorm:
+  case BakedTextureFormat::Bc7Unorm:
+  case BakedTextureFormat::Bc7Srgb:
+    return 16;
+  }
+  return 0;
+}
+
+vk::Format baked_texture_vk_format(BakedTextureFormat format)
+{
+  switch (format)
+  {
+  case BakedTextureFormat::Bc1Unorm:
+    return vk::Format::eBc1RgbUnormBlock;
+  case BakedTextureFormat::Bc1Srgb:
+    return vk::Format::eBc1RgbSrgbBlock;
+  case BakedTextureFormat::Bc5Unorm:
+    return vk::Format::eBc5UnormBlock;
+  case BakedTextureFormat::Bc7Unorm:
+    return vk::Format::eBc7UnormBlock;
+  case BakedTextureFormat::Bc7Srgb:
+    return vk::Format::eBc7SrgbBlock;
+  }
+  return vk::Format::eUndefined;
+}
+
+static std::uint32_t level_extent(std::uint32_t extent, std::size_t level)
+{
+  return std::max(extent >> level, 1u);
+}
+
+static std::uint64_t level_size(
+  BakedTextureFormat format, std::uint32_t width, std::uint32_t height, std::size_t level)
+{
+  const std::uint64_t blocksX = (level_extent(width, level) + 3) / 4;
+  const std::uint64_t blocksY = (level_extent(height, level) + 3) / 4;
+  return blocksX * blocksY * baked_texture_block_size(format);
+}
+
+static std::uint64_t align_up(std::uint64_t value)
+{
+  return (value + BAKED_TEXTURE_ALIGNMENT - 1) / BAKED_TEXTURE_ALIGNMENT * BAKED_TEXTURE_ALIGNMENT;
+}
+
+bool write_baked_texture(const std::filesystem::path& path, const BakedTextureData& data)
+{
+  if (data.levels.empty() || data.levels.size() > BAKED_TEXTURE_MAX_LEVELS)
+  {
+    spdlog::error("Baked texture: unsupported level count {}", data.levels.size());
+    return false;
+  }
+
+  BakedTextureHeader header{};
+  header.magic = BAKED_TEXTURE_MAGIC;
+  header.version = BAKED_TEXTURE_VERSION;
+  header.format = data.format;
+  header.width = data.width;
+  header.height = data.height;
+  header.levelCount = static_cast<std::uint32_t>(data.levels.size());
+
+  std::uint64_t offset = sizeof(BakedTextureHeader);
+  for (std::size_t i = data.levels.size(); i-- > 0;)
+  {
+    offset = align_up(offset);
+    header.levels[i] = BakedTextureLevelRange{.offset = offset, .size = data.levels[i].size()};
+    offset += data.levels[i].size();
+  }
+
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  if (!file)
+  {
+    spdlog::error("Unable to open {} for writing", path);
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  static constexpr std::array<char, BAKED_TEXTURE_ALIGNMENT> PADDING{};
+  std::uint64_t written = sizeof(header);
+  for (std::size_t i = data.levels.size(); i-- > 0;)
+  {
+    file.write(PADDING.data(), static_cast<std::streamsize>(header.levels[i].offset - written));
+    file.write(
+      reinterpret_cast<const char*>(data.levels[i].data()),
+      static_cast<std::streamsize>(data.levels[i].size()));
+    written = header.levels[i].offset + header.levels[i].size;
+  }
+
+  if (!file)
+  {
+    spdlog::error("Failed to write {}", path);
+    return false;
+  }
+
+  return true;
+}
+
+std::optional<BakedTextureData> parse_baked_texture(std::span<const std::byte> file)
+{
+  if (file.size() < sizeof(BakedTextureHeader))
+  {
+    spdlog::error("Baked texture: the file is too small to contain a header");
+    return std::nullopt;
+  }
+
+  BakedTextureHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (header.magic != BAKED_TEXTURE_MAGIC)
+  {
+    spdlog::error("Baked texture: bad magic, this is not a baked texture");
+    return std::nullopt;
+  }
+
+  if (header.version != BAKED_TEXTURE_VERSION)
+  {
+    spdlog::error(
+      "Baked texture: version {} is not supported (expected {}), please re-bake the texture",
+      header.version,
+      BAKED_TEXTURE_VERSION);
+    return std::nullopt;
+  }
+
+  if (baked_texture_block_size(header.format) == 0)
+  {
+    spdlog::error(
+      "Baked texture: unknown format {}", static_cast<std::uint32_t>(header.format));
+    return std::nullopt;
+  }
+
+  if (
+    header.width == 0 || header.height == 0 || header.levelCount == 0 ||
+    header.levelCount > BAKED_TEXTURE_MAX_LEVELS ||
+    (std::max(header.width, header.height) >> (header.levelCount - 1)) == 0)
+  {
+    spdlog::error(
+      "Baked texture: bad dimensions {}x{} with {} levels",
+      header.width,
+      header.height,
+      header.levelCount);
+    return std::nullopt;
+  }
+
+  BakedTextureData result{
+    .format = header.format,
+    .width = header.width,
+    .height = header.height,
+    .levels = {},
+  };
+
+  for (std::size_t i = 0; i < header.levelCount; ++i)
+  {
+    const auto& range = header.levels[i];
+    if (
+      range.offset % BAKED_TEXTURE_ALIGNMENT != 0 || range.offset > file.size() ||
+      range.size > file.size() - range.offset ||
+      range.size != level_size(header.format, header.width, header.height, i))
+    {
+      spdlog::error("Baked texture: level {} is out of bounds", i);
+      return std::nullopt;
+    }
+    result.levels.push_back(file.subspan(range.offset, range.size));
+  }
+
+  return result;
+}
+
+bool is_baked_texture_format_supported(BakedTextureFormat format)
+{
+  const auto properties =
+    etna::get_context().getPhysicalDevice().getFormatProperties(baked_texture_vk_format(format));
+  constexpr auto REQUIRED =
+    vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eTransferDst;
+  return (properties.optimalTilingFeatures & REQUIRED) == REQUIRED;
+}
+
+etna::Image upload_baked_texture(
+  const BakedTextureData& data, std::string_view name, vk::ImageUsageFlags extra_usage)
+{
+  auto& ctx = etna::get_context();
+
+  auto image = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{data.width, data.height, 1},
+    .name = name,
+    .format = baked_texture_vk_format(data.format),
+    .imageUsage =
+      vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | extra_usage,
+    .mipLevels = data.levels.size(),
+  });
+
+  std::vector<vk::BufferImageCopy> regions;
+  vk::DeviceSize stagingSize = 0;
+  for (std::size_t i = 0; i < data.levels.size(); ++i)
+  {
+    regions.push_back(vk::BufferImageCopy{
+      .bufferOffset = stagingSize,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource =
+        vk::ImageSubresourceLayers{
+          .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .mipLevel = static_cast<std::uint32_t>(i),
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+      .imageOffset = vk::Offset3D{0, 0, 0},
+      .imageExtent = vk::Extent3D{level_extent(data.width, i), level_extent(data.height, i), 1},
+    });
+    // Offsets of copies of block-compressed formats must be multiples of the block size
+    stagingSize = align_up(stagingSize + data.levels[i].size());
+  }
+
+  // All levels at once, as even a 4k BC7 texture with mips is only about 22 MB
+  auto staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = stagingSize,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "baked_texture_staging",
+  });
+  staging.map();
+  for (std::size_t i = 0; i < data.levels.size(); ++i)
+    std::memcpy(
+      staging.data() + regions[i].bufferOffset, data.levels[i].data(), data.levels[i].size());
+  staging.unmap();
+
+  auto cmdManager = ctx.createOneShotCmdMgr();
+  auto cmdBuf = cmdManager->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+  etna::set_state(
+    cmdBuf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmdBuf);
+
+  cmdBuf.copyBufferToImage(
+    staging.get(),
+    image.get(),
+    vk::ImageLayout::eTransferDstOptimal,
+    static_cast<std::uint32_t>(regions.size()),
+    regions.data());
+
+  etna::set_state(
+    cmdBuf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmdBuf);
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  cmdManager->submitAndWait(cmdBuf);
+
+  return image;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <etna/Image.hpp>
+
+
+// Engine-native container for baked textures (*_baked.tex), modelled after
+// KTX2: a fixed-size header with a level index, followed by the levels, the
+// smallest one first so that a streamer can start with a prefix of the file.
+//
+//   BakedTextureHeader | level N-1 | ... | level 1 | level 0
+//
+// Levels are block-compressed, rows of 4x4 blocks going top to bottom, and
+// are aligned so that they can be copied straight from a memory mapping.
+// Everything is stored in the native (little-endian) byte order.
+
+inline constexpr std::array<char, 8> BAKED_TEXTURE_MAGIC = {
+  'G', 'C', 'T', 'E', 'X', 'T', 'R', '\0'};
+inline constexpr std::uint32_t BAKED_TEXTURE_VERSION = 1;
+inline constexpr std::size_t BAKED_TEXTURE_ALIGNMENT = 16;
+// Enough for 32768x32768, which is way past what any GPU supports anyway
+inline constexpr std::size_t BAKED_TEXTURE_MAX_LEVELS = 16;
+
+enum class BakedTextureFormat : std::uint32_t
+{
+  Bc1Unorm = 0, //< RGB, 8 bytes per block
+  Bc1Srgb = 1,
+  Bc5Unorm = 2, //< RG, 16 bytes per block, used for tangent space normals
+  Bc7Unorm = 3, //< RGBA, 16 bytes per block
+  Bc7Srgb = 4,
+};
+
+// 0 for unknown formats
+std::size_t baked_texture_block_size(BakedTextureFormat format);
+vk::Format baked_texture_vk_format(BakedTextureFormat format);
+
+struct BakedTextureLevelRange
+{
+  // In bytes from the beginning of the file
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct alignas(BAKED_TEXTURE_ALIGNMENT) BakedTextureHeader
+{
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  BakedTextureFormat format;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t levelCount;
+  std::uint32_t reserved;
+  std::array<BakedTextureLevelRange, BAKED_TEXTURE_MAX_LEVELS> levels;
+};
+
+// Views into the contents of a baked texture. When reading, they point
+// into the (mapped) file and are only valid while it is alive.
+struct BakedTextureData
+{
+  BakedTextureFormat format;
+  std::uint32_t width;
+  std::uint32_t height;
+  // Indexed by mip level, so the biggest one comes first
+  std::vector<std::span<const std::byte>> levels;
+};
+
+bool write_baked_texture(const std::filesystem::path& path, const BakedTextureData& data);
+
+// Validates the header and level bounds, returns nullopt for malformed files
+std::optional<BakedTextureData> parse_baked_texture(std::span<const std::byte> file);
+
+// Whether the device can sample images of this format, BC formats additionally
+// need the textureCompressionBC feature to be enabled
+bool is_baked_texture_format_supported(BakedTextureFormat format);
+
+// Creates a sampled image with all of the levels and uploads them as they are,
+// no decoding happens on the CPU. Blocks until the upload is complete.
+etna::Image upload_baked_texture(
+  const BakedTextureData& data, std::string_view name, vk::ImageUsageFlags extra_usage = {});
@@ -0,0 +1,105 @@
+#include "BakedWorld.hpp"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+
+bool write_baked_world(const std::filesystem::path& path, const BakedWorld& world)
+{
+  std::ofstream file{path, std::ios::trunc};
+  if (!file)
+  {
+    spdlog::error("Unable to open {} for writing", path);
+    return false;
+  }
+
+  // Bounds have to survive the round trip exactly
+  file.precision(std::numeric_limits<float>::max_digits10);
+  file << "version " << BAKED_WORLD_VERSION << "\n";
+  file << "vertex_format " << static_cast<std::uint32_t>(world.vertexFormat) << "\n";
+  file << "images " << world.imageCount << "\n";
+  for (const auto& sector : world.sectors)
+  {
+    file << "sector";
+    for (float coord : sector.box.minCoord)
+      file << " " << coord;
+    for (float coord : sector.box.maxCoord)
+      file << " " << coord;
+    file << " " << sector.path.filename().generic_string() << "\n";
+  }
+
+  if (!file)
+  {
+    spdlog::error("Failed to write {}", path);
+    return false;
+  }
+  return true;
+}
+
+std::optional<BakedWorld> read_baked_world(const std::filesystem::path& path)
+{
+  std::ifstream file{path};
+  if (!file)
+  {
+    spdlog::error("Unable to open {}", path);
+    return std::nullopt;
+  }
+
+  BakedWorld result;
+  std::optional<std::uint32_t> version;
+  for (std::string line; std::getline(file, line);)
+  {
+    std::istringstream stream{line};
+    std::string key;
+    stream >> key;
+    bool valid = true;
+    if (key == "version")
+      valid = static_cast<bool>(stream >> version.emplace());
+    else if (key == "vertex_format")
+    {
+      std::uint32_t format = 0;
+      valid = stream >> format && format <= static_cast<std::uint32_t>(BakedVertexFormat::Compact);
+      result.vertexFormat = static_cast<BakedVertexFormat>(format);
+    }
+    else if (key == "images")
+      valid = static_cast<bool>(stream >> result.imageCount);
+    else if (key == "sector")
+    {
+      BakedWorldSector sector;
+      std::string fileName;
+      for (float& coord : sector.box.minCoord)
+        valid = valid && stream >> coord;
+      for (float& coord : sector.box.maxCoord)
+        valid = valid && stream >> coord;
+      // The file name is last and may contain spaces
+      valid = valid && std::getline(stream >> std::ws, fileName) && !fileName.empty();
+      sector.path = path.parent_path() / fileName;
+      result.sectors.push_back(std::move(sector));
+    }
+    else
+      valid = key.empty();
+
+    if (!valid)
+    {
+      spdlog::error("Baked world {}: malformed line '{}'", path, line);
+      return std::nullopt;
+    }
+  }
+
+  if (version != BAKED_WORLD_VERSION)
+  {
+    spdlog::error(
+      "Baked world {}: version {} is not supported (expected {}), please re-bake the scene",
+      path,
+      version.value_or(0),
+      BAKED_WORLD_VERSION);
+    return std::nullopt;
+  }
+
+  return result;
+}
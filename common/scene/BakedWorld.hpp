@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "scene/BakedScene.hpp"
+#include "scene/Mesh.hpp"
+
+
+// Manifest of a world split into sectors (*_baked.world). Every sector is an
+// ordinary baked scene container (see BakedScene.hpp) with the instances whose
+// bounds are centered within a single cell of a horizontal grid, along with
+// only the geometry those instances use. Relems keep their glTF image indices,
+// so textures are shared by all sectors of the world.
+//
+// The manifest itself is text, one entry per line:
+//
+//   version <BAKED_WORLD_VERSION>
+//   vertex_format <BakedVertexFormat of all sectors>
+//   images <glTF image count>
+//   sector <min x> <min y> <min z> <max x> <max y> <max z> <file name>
+//
+// Sector file names are relative to the directory of the manifest.
+
+inline constexpr std::uint32_t BAKED_WORLD_VERSION = 1;
+
+struct BakedWorldSector
+{
+  std::filesystem::path path;
+  // World-space, encloses all of the instances of the sector
+  BoundingBox box;
+};
+
+struct BakedWorld
+{
+  BakedVertexFormat vertexFormat = BakedVertexFormat::Full;
+  std::uint32_t imageCount = 0;
+  std::vector<BakedWorldSector> sectors;
+};
+
+// Only file names of the sector paths are stored, sectors have to end up
+// in the same directory as the manifest
+bool write_baked_world(const std::filesystem::path& path, const BakedWorld& world);
+
+// Sector paths of the result are resolved against the directory of the manifest
+std::optional<BakedWorld> read_baked_world(const std::filesystem::path& path);
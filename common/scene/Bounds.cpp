@@ -0,0 +1,243 @@
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define SCENE_BOUNDS_SSE 1
+#endif
+
+
+namespace
+{
+
+bool is_empty(const BoundingBox& box)
+{
+  return box.minCoord[0] > box.maxCoord[0];
+}
+
+glm::vec3 box_center(const BoundingBox& box)
+{
+  return 0.5f *
+    (glm::vec3{box.minCoord[0], box.minCoord[1], box.minCoord[2]} +
+     glm::vec3{box.maxCoord[0], box.maxCoord[1], box.maxCoord[2]});
+}
+
+void compute_box_scalar(
+  const float* vertices, std::size_t count, std::size_t stride_floats, BoundingBox& box)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const float* pos = vertices + i * stride_floats;
+    for (std::size_t j = 0; j < 3; ++j)
+    {
+      box.minCoord[j] = std::min(box.minCoord[j], pos[j]);
+      box.maxCoord[j] = std::max(box.maxCoord[j], pos[j]);
+    }
+  }
+}
+
+float max_distance_squared_scalar(
+  const float* vertices, std::size_t count, std::size_t stride_floats, glm::vec3 center)
+{
+  float result = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const float* pos = vertices + i * stride_floats;
+    const glm::vec3 d = glm::vec3{pos[0], pos[1], pos[2]} - center;
+    result = std::max(result, glm::dot(d, d));
+  }
+  return result;
+}
+
+#if defined(SCENE_BOUNDS_SSE)
+
+// Positions are loaded as whole 4-float rows, the 4th lane is simply ignored.
+// Only 3 floats of the last vertex might be readable though, so it is always
+// left to the scalar path.
+void compute_box(const float* vertices, std::size_t count, std::size_t stride_floats, BoundingBox& box)
+{
+  if (stride_floats < 4)
+  {
+    compute_box_scalar(vertices, count, stride_floats, box);
+    return;
+  }
+
+  __m128 min = _mm_set1_ps(std::numeric_limits<float>::max());
+  __m128 max = _mm_set1_ps(std::numeric_limits<float>::lowest());
+  for (std::size_t i = 0; i + 1 < count; ++i)
+  {
+    const __m128 pos = _mm_loadu_ps(vertices + i * stride_floats);
+    min = _mm_min_ps(min, pos);
+    max = _mm_max_ps(max, pos);
+  }
+
+  alignas(16) float minValues[4];
+  alignas(16) float maxValues[4];
+  _mm_store_ps(minValues, min);
+  _mm_store_ps(maxValues, max);
+  for (std::size_t j = 0; j < 3; ++j)
+  {
+    box.minCoord[j] = std::min(box.minCoord[j], minValues[j]);
+    box.maxCoord[j] = std::max(box.maxCoord[j], maxValues[j]);
+  }
+  compute_box_scalar(vertices + (count - 1) * stride_floats, 1, stride_floats, box);
+}
+
+// 4 vertices per iteration, transposed so that every lane is a separate vertex.
+// Same as above, the last vertex always goes through the scalar path.
+float max_distance_squared(
+  const float* vertices, std::size_t count, std::size_t stride_floats, glm::vec3 center)
+{
+  if (stride_floats < 4)
+    return max_distance_squared_scalar(vertices, count, stride_floats, center);
+
+  const __m128 cx = _mm_set1_ps(center.x);
+  const __m128 cy = _mm_set1_ps(center.y);
+  const __m128 cz = _mm_set1_ps(center.z);
+
+  __m128 result = _mm_setzero_ps();
+  std::size_t i = 0;
+  for (; i + 4 < count; i += 4)
+  {
+    __m128 x = _mm_loadu_ps(vertices + (i + 0) * stride_floats);
+    __m128 y = _mm_loadu_ps(vertices + (i + 1) * stride_floats);
+    __m128 z = _mm_loadu_ps(vertices + (i + 2) * stride_floats);
+    __m128 unused = _mm_loadu_ps(vertices + (i + 3) * stride_floats);
+    _MM_TRANSPOSE4_PS(x, y, z, unused);
+
+    const __m128 dx = _mm_sub_ps(x, cx);
+    const __m128 dy = _mm_sub_ps(y, cy);
+    const __m128 dz = _mm_sub_ps(z, cz);
+    const __m128 dist =
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    result = _mm_max_ps(result, dist);
+  }
+
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, result);
+  return std::max(
+    {lanes[0],
+     lanes[1],
+     lanes[2],
+     lanes[3],
+     max_distance_squared_scalar(vertices + i * stride_floats, count - i, stride_floats, center)});
+}
+
+#else
+
+void compute_box(const float* vertices, std::size_t count, std::size_t stride_floats, BoundingBox& box)
+{
+  compute_box_scalar(vertices, count, stride_floats, box);
+}
+
+float max_distance_squared(
+  const float* vertices, std::size_t count, std::size_t stride_floats, glm::vec3 center)
+{
+  return max_distance_squared_scalar(vertices, count, stride_floats, center);
+}
+
+#endif
+
+} // namespace
+
+BoundingBox empty_bounding_box()
+{
+  const float min = std::numeric_limits<float>::lowest();
+  const float max = std::numeric_limits<float>::max();
+  return BoundingBox{.maxCoord = {min, min, min}, .minCoord = {max, max, max}};
+}
+
+Bounds compute_vertex_bounds(const float* vertices, std::size_t count, std::size_t stride_floats)
+{
+  Bounds result{.box = empty_bounding_box(), .sphere = {}};
+  if (count == 0)
+    return result;
+
+  compute_box(vertices, count, stride_floats, result.box);
+
+  // Sphere around the box center is not the tightest possible one,
+  // but is within a few percent of it for typical meshes and takes
+  // a single extra pass over the data.
+  const glm::vec3 center = box_center(result.box);
+  result.sphere = BoundingSphere{
+    .center = {center.x, center.y, center.z},
+    .radius = std::sqrt(max_distance_squared(vertices, count, stride_floats, center)),
+  };
+
+  return result;
+}
+
+Bounds merge_bounds(std::span<const Bounds> parts)
+{
+  Bounds result{.box = empty_bounding_box(), .sphere = {}};
+
+  for (const auto& part : parts)
+    if (!is_empty(part.box))
+      for (std::size_t j = 0; j < 3; ++j)
+      {
+        result.box.minCoord[j] = std::min(result.box.minCoord[j], part.box.minCoord[j]);
+        result.box.maxCoord[j] = std::max(result.box.maxCoord[j], part.box.maxCoord[j]);
+      }
+
+  if (is_empty(result.box))
+    return result;
+
+  const glm::vec3 center = box_center(result.box);
+  float radius = 0;
+  for (const auto& part : parts)
+    if (!is_empty(part.box))
+    {
+      const glm::vec3 partCenter{part.sphere.center[0], part.sphere.center[1], part.sphere.center[2]};
+      radius = std::max(radius, glm::length(partCenter - center) + part.sphere.radius);
+    }
+
+  result.sphere = BoundingSphere{.center = {center.x, center.y, center.z}, .radius = radius};
+  return result;
+}
+
+Bounds transform_bounds(const Bounds& bounds, const glm::mat4x4& transform)
+{
+  if (is_empty(bounds.box))
+    return bounds;
+
+  Bounds result;
+
+  // Arvo's method: the extent along every world axis is the sum of
+  // the absolute projections of the local extents.
+  {
+    const glm::vec3 min{bounds.box.minCoord[0], bounds.box.minCoord[1], bounds.box.minCoord[2]};
+    const glm::vec3 max{bounds.box.maxCoord[0], bounds.box.maxCoord[1], bounds.box.maxCoord[2]};
+    const glm::vec3 center = glm::vec3{transform * glm::vec4{0.5f * (min + max), 1.0f}};
+    const glm::vec3 extent = 0.5f * (max - min);
+
+    glm::vec3 worldExtent{0};
+    for (int i = 0; i < 3; ++i)
+      worldExtent += glm::abs(glm::vec3{transform[i]}) * extent[i];
+
+    for (int j = 0; j < 3; ++j)
+    {
+      result.box.minCoord[j] = center[j] - worldExtent[j];
+      result.box.maxCoord[j] = center[j] + worldExtent[j];
+    }
+  }
+
+  {
+    const glm::vec4 center{
+      bounds.sphere.center[0], bounds.sphere.center[1], bounds.sphere.center[2], 1.0f};
+    const glm::vec3 worldCenter = glm::vec3{transform * center};
+    const float maxScale = std::max(
+      {glm::length(glm::vec3{transform[0]}),
+       glm::length(glm::vec3{transform[1]}),
+       glm::length(glm::vec3{transform[2]})});
+
+    result.sphere = BoundingSphere{
+      .center = {worldCenter.x, worldCenter.y, worldCenter.z},
+      .radius = bounds.sphere.radius * maxScale,
+    };
+  }
+
+  return result;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include <glm/glm.hpp>
+
+#include "scene/Mesh.hpp"
+
+
+// Box with min > max, which is an identity for merging
+BoundingBox empty_bounding_box();
+
+// Tight bounds of vertex positions. Every vertex starts with 3 floats of
+// position and vertices are stride_floats floats apart. Nothing past the
+// position of the last vertex is read, so strided source data is fine too.
+Bounds compute_vertex_bounds(const float* vertices, std::size_t count, std::size_t stride_floats);
+
+// Conservative bounds enclosing all of the parts
+Bounds merge_bounds(std::span<const Bounds> parts);
+
+// Bounds of the geometry after being transformed by the matrix
+Bounds transform_bounds(const Bounds& bounds, const glm::mat4x4& transform);
@@ -0,0 +1,260 @@
+#include "FrustumCulling.hpp"
+
+#include <bit>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCENE_CULLING_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define SCENE_CULLING_SSE 1
+#endif
+
+
+namespace
+{
+
+// Same operation order as the SIMD kernels, so that the results match exactly.
+// NaNs, e.g. of empty boxes with infinite extents, count as outside.
+bool is_in_frustum(const Frustum& frustum, glm::vec3 center, glm::vec3 extent)
+{
+  for (const auto& plane : frustum.planes)
+  {
+    const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+    const float radius = glm::abs(plane.x) * extent.x + glm::abs(plane.y) * extent.y +
+      glm::abs(plane.z) * extent.z;
+    if (!(distance + radius >= 0))
+      return false;
+  }
+  return true;
+}
+
+std::size_t cull_frustum_scalar(
+  const Frustum& frustum,
+  const FrustumCullingBoxes& boxes,
+  std::size_t first,
+  std::size_t last,
+  std::uint32_t* visible)
+{
+  std::size_t visibleCount = 0;
+  for (std::size_t i = first; i < last; ++i)
+  {
+    const glm::vec3 center{boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]};
+    const glm::vec3 extent{boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]};
+    if (is_in_frustum(frustum, center, extent))
+      visible[visibleCount++] = static_cast<std::uint32_t>(i);
+  }
+  return visibleCount;
+}
+
+#if defined(SCENE_CULLING_AVX2) || defined(SCENE_CULLING_SSE)
+
+// Lanes are compacted by walking the set bits of the mask,
+// so batches with nothing visible cost a single branch
+std::size_t append_visible(unsigned mask, std::size_t base, std::uint32_t* visible)
+{
+  std::size_t visibleCount = 0;
+  while (mask != 0)
+  {
+    visible[visibleCount++] = static_cast<std::uint32_t>(base + std::countr_zero(mask));
+    mask &= mask - 1;
+  }
+  return visibleCount;
+}
+
+#endif
+
+#if defined(SCENE_CULLING_AVX2)
+
+std::size_t cull_frustum_simd(
+  const Frustum& frustum,
+  const FrustumCullingBoxes& boxes,
+  std::size_t first,
+  std::size_t last,
+  std::uint32_t* visible)
+{
+  const __m256 signMask = _mm256_set1_ps(-0.0f);
+  const __m256 zero = _mm256_setzero_ps();
+
+  __m256 planes[6][4];
+  __m256 absNormals[6][3];
+  for (std::size_t p = 0; p < 6; ++p)
+    for (int j = 0; j < 4; ++j)
+    {
+      planes[p][j] = _mm256_set1_ps(frustum.planes[p][j]);
+      if (j < 3)
+        absNormals[p][j] = _mm256_andnot_ps(signMask, planes[p][j]);
+    }
+
+  std::size_t visibleCount = 0;
+  std::size_t i = first;
+  for (; i + 8 <= last; i += 8)
+  {
+    const __m256 cx = _mm256_loadu_ps(boxes.centerX.data() + i);
+    const __m256 cy = _mm256_loadu_ps(boxes.centerY.data() + i);
+    const __m256 cz = _mm256_loadu_ps(boxes.centerZ.data() + i);
+    const __m256 ex = _mm256_loadu_ps(boxes.extentX.data() + i);
+    const __m256 ey = _mm256_loadu_ps(boxes.extentY.data() + i);
+    const __m256 ez = _mm256_loadu_ps(boxes.extentZ.data() + i);
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (std::size_t p = 0; p < 6; ++p)
+    {
+      const auto& plane = planes[p];
+      const auto& absNormal = absNormals[p];
+      __m256 distance = _mm256_add_ps(_mm256_mul_ps(plane[0], cx), _mm256_mul_ps(plane[1], cy));
+      distance = _mm256_add_ps(_mm256_add_ps(distance, _mm256_mul_ps(plane[2], cz)), plane[3]);
+      __m256 radius = _mm256_mul_ps(absNormal[0], ex);
+      radius = _mm256_add_ps(radius, _mm256_mul_ps(absNormal[1], ey));
+      radius = _mm256_add_ps(radius, _mm256_mul_ps(absNormal[2], ez));
+      inside = _mm256_and_ps(
+        inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+    }
+
+    visibleCount += append_visible(
+      static_cast<unsigned>(_mm256_movemask_ps(inside)), i, visible + visibleCount);
+  }
+
+  return visibleCount + cull_frustum_scalar(frustum, boxes, i, last, visible + visibleCount);
+}
+
+#elif defined(SCENE_CULLING_SSE)
+
+std::size_t cull_frustum_simd(
+  const Frustum& frustum,
+  const FrustumCullingBoxes& boxes,
+  std::size_t first,
+  std::size_t last,
+  std::uint32_t* visible)
+{
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  const __m128 zero = _mm_setzero_ps();
+
+  __m128 planes[6][4];
+  __m128 absNormals[6][3];
+  for (std::size_t p = 0; p < 6; ++p)
+    for (int j = 0; j < 4; ++j)
+    {
+      planes[p][j] = _mm_set1_ps(frustum.planes[p][j]);
+      if (j < 3)
+        absNormals[p][j] = _mm_andnot_ps(signMask, planes[p][j]);
+    }
+
+  std::size_t visibleCount = 0;
+  std::size_t i = first;
+  for (; i + 4 <= last; i += 4)
+  {
+    const __m128 cx = _mm_loadu_ps(boxes.centerX.data() + i);
+    const __m128 cy = _mm_loadu_ps(boxes.centerY.data() + i);
+    const __m128 cz = _mm_loadu_ps(boxes.centerZ.data() + i);
+    const __m128 ex = _mm_loadu_ps(boxes.extentX.data() + i);
+    const __m128 ey = _mm_loadu_ps(boxes.extentY.data() + i);
+    const __m128 ez = _mm_loadu_ps(boxes.extentZ.data() + i);
+
+    __m128 inside = _mm_cmpeq_ps(zero, zero);
+    for (std::size_t p = 0; p < 6; ++p)
+    {
+      const auto& plane = planes[p];
+      const auto& absNormal = absNormals[p];
+      __m128 distance = _mm_add_ps(_mm_mul_ps(plane[0], cx), _mm_mul_ps(plane[1], cy));
+      distance = _mm_add_ps(_mm_add_ps(distance, _mm_mul_ps(plane[2], cz)), plane[3]);
+      __m128 radius = _mm_add_ps(_mm_mul_ps(absNormal[0], ex), _mm_mul_ps(absNormal[1], ey));
+      radius = _mm_add_ps(radius, _mm_mul_ps(absNormal[2], ez));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+    }
+
+    visibleCount +=
+      append_visible(static_cast<unsigned>(_mm_movemask_ps(inside)), i, visible + visibleCount);
+  }
+
+  return visibleCount + cull_frustum_scalar(frustum, boxes, i, last, visible + visibleCount);
+}
+
+#else
+
+std::size_t cull_frustum_simd(
+  const Frustum& frustum,
+  const FrustumCullingBoxes& boxes,
+  std::size_t first,
+  std::size_t last,
+  std::uint32_t* visible)
+{
+  return cull_frustum_scalar(frustum, boxes, first, last, visible);
+}
+
+#endif
+
+} // namespace
+
+Frustum extract_frustum(const glm::mat4x4& view_proj)
+{
+  // glm matrices are column-major, rows of the math notation are gathered here
+  std::array<glm::vec4, 4> rows;
+  for (int i = 0; i < 4; ++i)
+    rows[i] = glm::vec4{view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]};
+
+  // -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip space
+  Frustum result{.planes = {
+                   rows[3] + rows[0],
+                   rows[3] - rows[0],
+                   rows[3] + rows[1],
+                   rows[3] - rows[1],
+                   rows[2],
+                   rows[3] - rows[2],
+                 }};
+
+  for (auto& plane : result.planes)
+  {
+    const float length = glm::length(glm::vec3{plane});
+    if (length > 0)
+      plane /= length;
+  }
+
+  return result;
+}
+
+FrustumCullingBoxes make_frustum_culling_boxes(std::span<const Bounds> bounds)
+{
+  FrustumCullingBoxes result;
+  for (auto* component :
+       {&result.centerX,
+        &result.centerY,
+        &result.centerZ,
+        &result.extentX,
+        &result.extentY,
+        &result.extentZ})
+    component->resize(bounds.size());
+
+  for (std::size_t i = 0; i < bounds.size(); ++i)
+  {
+    const auto& box = bounds[i].box;
+    result.centerX[i] = 0.5f * (box.minCoord[0] + box.maxCoord[0]);
+    result.centerY[i] = 0.5f * (box.minCoord[1] + box.maxCoord[1]);
+    result.centerZ[i] = 0.5f * (box.minCoord[2] + box.maxCoord[2]);
+    // Empty boxes get negative extents and end up culled
+    result.extentX[i] = 0.5f * (box.maxCoord[0] - box.minCoord[0]);
+    result.extentY[i] = 0.5f * (box.maxCoord[1] - box.minCoord[1]);
+    result.extentZ[i] = 0.5f * (box.maxCoord[2] - box.minCoord[2]);
+  }
+
+  return result;
+}
+
+bool is_box_in_frustum(const Frustum& frustum, const BoundingBox& box)
+{
+  const glm::vec3 min{box.minCoord[0], box.minCoord[1], box.minCoord[2]};
+  const glm::vec3 max{box.maxCoord[0], box.maxCoord[1], box.maxCoord[2]};
+  return is_in_frustum(frustum, 0.5f * (min + max), 0.5f * (max - min));
+}
+
+std::size_t cull_frustum(
+  const Frustum& frustum,
+  const FrustumCullingBoxes& boxes,
+  std::size_t first,
+  std::size_t count,
+  std::span<std::uint32_t> visible)
+{
+  if (count == 0)
+    return 0;
+  return cull_frustum_simd(frustum, boxes, first, first + count, visible.data());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene/Mesh.hpp"
+
+
+// Planes of a view frustum, normals point inwards and are normalized, so
+// dot(xyz, p) + w is the signed distance from a point p to a plane
+struct Frustum
+{
+  std::array<glm::vec4, 6> planes;
+};
+
+// Gribb-Hartmann extraction from a projection * view matrix with the
+// Vulkan depth range of [0, 1]. World-space planes come out of a world
+// to clip space matrix, mesh-space ones out of a mesh to clip space one.
+Frustum extract_frustum(const glm::mat4x4& view_proj);
+
+// World-space boxes stored as separate arrays of every component of their
+// centers and half extents, so that SIMD lanes test different boxes
+struct FrustumCullingBoxes
+{
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> extentX;
+  std::vector<float> extentY;
+  std::vector<float> extentZ;
+
+  std::size_t size() const { return centerX.size(); }
+};
+
+FrustumCullingBoxes make_frustum_culling_boxes(std::span<const Bounds> bounds);
+
+// Scalar reference for a single box, conservative: boxes that intersect
+// the frustum planes but not the frustum itself near its corners pass
+bool is_box_in_frustum(const Frustum& frustum, const BoundingBox& box);
+
+// Writes indices of the boxes in [first, first + count) that are in the
+// frustum to visible, in increasing order. Returns the number of written
+// indices, visible has to fit count of them.
+// 8 boxes are tested per iteration with AVX2, 4 with SSE.
+std::size_t cull_frustum(
+  const Frustum& frustum,
+  const FrustumCullingBoxes& boxes,
+  std::size_t first,
+  std::size_t count,
+  std::span<std::uint32_t> visible);
@@ -0,0 +1,162 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  HANDLE file = CreateFileW(
+    path.c_str(),
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    nullptr,
+    OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+    nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    spdlog::error("Unable to open {} for mapping", path);
+    return;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    spdlog::error("Unable to map {}: the file is empty or inaccessible", path);
+    CloseHandle(file);
+    return;
+  }
+
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr)
+  {
+    spdlog::error("Unable to create a mapping for {}", path);
+    CloseHandle(file);
+    return;
+  }
+
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (view == nullptr)
+  {
+    spdlog::error("Unable to map a view of {}", path);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return;
+  }
+
+  fileHandle = file;
+  mappingHandle = mapping;
+  data = static_cast<std::byte*>(view);
+  size = static_cast<std::size_t>(fileSize.QuadPart);
+}
+
+void MappedFile::reset()
+{
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (mappingHandle != nullptr)
+    CloseHandle(mappingHandle);
+  if (fileHandle != nullptr)
+    CloseHandle(fileHandle);
+
+  data = nullptr;
+  size = 0;
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    spdlog::error("Unable to open {} for mapping", path);
+    return;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    spdlog::error("Unable to map {}: the file is empty or inaccessible", path);
+    close(fd);
+    return;
+  }
+
+  const auto fileSize = static_cast<std::size_t>(fileStat.st_size);
+  void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive by itself
+  close(fd);
+
+  if (view == MAP_FAILED)
+  {
+    spdlog::error("Unable to map {}", path);
+    return;
+  }
+
+  // We are going to stream through the whole thing exactly once
+  madvise(view, fileSize, MADV_SEQUENTIAL);
+
+  data = static_cast<std::byte*>(view);
+  size = fileSize;
+}
+
+void MappedFile::reset()
+{
+  if (data != nullptr)
+    munmap(data, size);
+
+  data = nullptr;
+  size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  reset();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : data{std::exchange(other.data, nullptr)}
+  , size{std::exchange(other.size, 0)}
+#ifdef _WIN32
+  , fileHandle{std::exchange(other.fileHandle, nullptr)}
+  , mappingHandle{std::exchange(other.mappingHandle, nullptr)}
+#endif
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this == &other)
+    return *this;
+
+  reset();
+
+  data = std::exchange(other.data, nullptr);
+  size = std::exchange(other.size, 0);
+#ifdef _WIN32
+  fileHandle = std::exchange(other.fileHandle, nullptr);
+  mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+
+  return *this;
+}
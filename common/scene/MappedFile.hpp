@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+
+// Read-only memory mapping of a whole file. Pages are loaded by the OS on
+// first access and belong to the page cache, so mapping a huge file doesn't
+// count towards our private memory usage the way reading it into a vector does.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  bool isValid() const { return data != nullptr; }
+
+  std::span<const std::byte> getData() const { return {data, size}; }
+
+private:
+  void reset();
+
+private:
+  std::byte* data = nullptr;
+  std::size_t size = 0;
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,17 @@
+#include "Materials.hpp"
+
+#include "Mesh.hpp"
+
+
+std::uint32_t base_color_image(const tinygltf::Model& model, const tinygltf::Primitive& prim)
+{
+  if (prim.material < 0 || static_cast<std::size_t>(prim.material) >= model.materials.size())
+    return NO_TEXTURE;
+  const int texture = model.materials[prim.material].pbrMetallicRoughness.baseColorTexture.index;
+  if (texture < 0 || static_cast<std::size_t>(texture) >= model.textures.size())
+    return NO_TEXTURE;
+  const int source = model.textures[texture].source;
+  if (source < 0 || static_cast<std::size_t>(source) >= model.images.size())
+    return NO_TEXTURE;
+  return static_cast<std::uint32_t>(source);
+}
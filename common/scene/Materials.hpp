@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+#include <tiny_gltf.h>
+
+
+// glTF image the primitive takes its base color from, NO_TEXTURE if it has none
+// or the material references something that isn't there.
+// See RenderElement::baseColorImage.
+std::uint32_t base_color_image(const tinygltf::Model& model, const tinygltf::Primitive& prim);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+// Width of a relem's indices. The unified index buffer consists of two
+// regions, one per format, and relems only ever reference their own one.
+enum class IndexFormat : std::uint32_t
+{
+  Uint32 = 0,
+  Uint16 = 1,
+};
+
+// Relems with fewer than 2^16 vertices get 16-bit indices
+inline IndexFormat index_format_for(std::size_t vertex_count)
+{
+  return vertex_count < (std::size_t{1} << 16) ? IndexFormat::Uint16 : IndexFormat::Uint32;
+}
+
+// A single render element (relem) corresponds to a single draw call
+// of a certain pipeline with specific bindings (including material data)
+struct RenderElement
+{
+  std::uint32_t vertexOffset;
+  // In indices of indexFormat from the start of that format's region
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  IndexFormat indexFormat;
+  // Meshlets partitioning this relem's index range, see SceneManager::getMeshlets.
+  // Only baked scenes have them, meshletCount is 0 otherwise.
+  std::uint32_t firstMeshlet;
+  std::uint32_t meshletCount;
+  // Progressively coarser versions of this relem, see SceneManager::getRenderElementLods.
+  // Only baked scenes have them, lodCount is 0 otherwise.
+  std::uint32_t firstLod;
+  std::uint32_t lodCount;
+  // Index of the glTF image with the base color, NO_TEXTURE if there is none.
+  // This is all of the material that is supported so far.
+  std::uint32_t baseColorImage;
+};
+
+inline constexpr std::uint32_t NO_TEXTURE = 0xFFFFFFFF;
+
+struct BoundingBox
+{
+  std::array<float, 3> maxCoord;
+  std::array<float, 3> minCoord;
+};
+
+struct BoundingSphere
+{
+  std::array<float, 3> center;
+  float radius;
+};
+
+// Both kinds of bounds of the same piece of geometry. Spheres are cheaper
+// to test, boxes are tighter, so culling usually wants both.
+struct Bounds
+{
+  BoundingBox box;
+  BoundingSphere sphere;
+};
+
+// A mesh is a collection of relems. A scene may have the same mesh
+// located in several different places, so a scene consists of **instances**,
+// not meshes.
+struct Mesh
+{
+  std::uint32_t firstRelem;
+  std::uint32_t relemCount;
+
+  // In mesh space, enclose all of the relems
+  BoundingBox box;
+  BoundingSphere sphere;
+};
+
+// A simplified version of a relem, drawn with the relem's vertexOffset
+// and indexFormat. LOD 0 is the relem itself and has zero error.
+struct RenderElementLod
+{
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  // Maximum deviation from the full detail surface, in mesh space units
+  float error;
+};
+
+// A small cluster of a relem's triangles (at most MESHLET_MAX_VERTICES unique
+// vertices and MESHLET_MAX_TRIANGLES triangles), which is small enough for its
+// visibility to be decided as a whole.
+struct Meshlet
+{
+  // Range of the relem's index region. Just like for the relem itself,
+  // indices in it are relative to the relem's vertexOffset.
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+
+  // In mesh space
+  BoundingSphere sphere;
+
+  // Cone containing all of the triangle normals. The whole meshlet is
+  // back-facing for a camera at position p if
+  //   dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius
+  // A cutoff of 1 means the meshlet can never be back-face culled.
+  std::array<float, 3> coneAxis;
+  float coneCutoff;
+};
+
+inline constexpr std::uint32_t MESHLET_MAX_VERTICES = 64;
+inline constexpr std::uint32_t MESHLET_MAX_TRIANGLES = 124;
@@ -0,0 +1,59 @@
+#include "RangeAllocator.hpp"
+
+#include <iterator>
+
+#include <etna/Assert.hpp>
+
+
+RangeAllocator::RangeAllocator(std::uint64_t total_capacity)
+  : capacity{total_capacity}
+{
+  if (capacity > 0)
+    freeRanges.emplace(0, capacity);
+}
+
+std::optional<RangeAllocator::Range> RangeAllocator::allocate(std::uint64_t size)
+{
+  if (size == 0)
+    return Range{};
+
+  for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+  {
+    auto [offset, freeSize] = *it;
+    if (freeSize < size)
+      continue;
+
+    freeRanges.erase(it);
+    if (freeSize > size)
+      freeRanges.emplace(offset + size, freeSize - size);
+    used += size;
+    return Range{.offset = offset, .size = size};
+  }
+  return std::nullopt;
+}
+
+void RangeAllocator::free(Range range)
+{
+  if (range.size == 0)
+    return;
+
+  ETNA_VERIFY(range.offset + range.size <= capacity && range.size <= used);
+  used -= range.size;
+
+  auto next = freeRanges.lower_bound(range.offset);
+  if (next != freeRanges.end() && range.offset + range.size == next->first)
+  {
+    range.size += next->second;
+    next = freeRanges.erase(next);
+  }
+  if (next != freeRanges.begin())
+  {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == range.offset)
+    {
+      prev->second += range.size;
+      return;
+    }
+  }
+  freeRanges.emplace_hint(next, range.offset, range.size);
+}
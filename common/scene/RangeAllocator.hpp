@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+
+
+// First-fit suballocator of a range of units, e.g. elements of a buffer that
+// lives for a long time while its contents come and go. Freed ranges are
+// merged with the free ones around them, so fragmentation stays bounded by
+// the sizes that are actually in use.
+class RangeAllocator
+{
+public:
+  struct Range
+  {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+  };
+
+  explicit RangeAllocator(std::uint64_t capacity = 0);
+
+  // Empty ranges always succeed and don't occupy anything
+  std::optional<Range> allocate(std::uint64_t size);
+  void free(Range range);
+
+  std::uint64_t getCapacity() const { return capacity; }
+  std::uint64_t getUsed() const { return used; }
+
+private:
+  std::uint64_t capacity;
+  std::uint64_t used = 0;
+  // Offset to size, neighbours are never adjacent
+  std::map<std::uint64_t, std::uint64_t> freeRanges;
+};
@@ -0,0 +1,280 @@
+#include "SceneInstances.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define SCENE_INSTANCES_SSE 1
+#endif
+
+
+namespace
+{
+
+// Nodes are processed in chunks of this size to amortize the scheduling cost
+constexpr std::size_t NODE_CHUNK_SIZE = 1024;
+
+// Local translation-rotation-scale transforms of all nodes in SoA form,
+// so that they can be turned into matrices several nodes at a time.
+struct TrsArrays
+{
+  explicit TrsArrays(std::size_t count)
+    : tx(count)
+    , ty(count)
+    , tz(count)
+    , qx(count)
+    , qy(count)
+    , qz(count)
+    , qw(count)
+    , sx(count)
+    , sy(count)
+    , sz(count)
+  {
+  }
+
+  std::vector<float> tx, ty, tz;
+  std::vector<float> qx, qy, qz, qw;
+  std::vector<float> sx, sy, sz;
+};
+
+void gather_trs(const tinygltf::Node& node, TrsArrays& trs, std::size_t idx)
+{
+  auto component = [](const std::vector<double>& values, std::size_t i, float fallback) {
+    return values.empty() ? fallback : static_cast<float>(values[i]);
+  };
+
+  trs.tx[idx] = component(node.translation, 0, 0.0f);
+  trs.ty[idx] = component(node.translation, 1, 0.0f);
+  trs.tz[idx] = component(node.translation, 2, 0.0f);
+
+  trs.qx[idx] = component(node.rotation, 0, 0.0f);
+  trs.qy[idx] = component(node.rotation, 1, 0.0f);
+  trs.qz[idx] = component(node.rotation, 2, 0.0f);
+  trs.qw[idx] = component(node.rotation, 3, 1.0f);
+
+  trs.sx[idx] = component(node.scale, 0, 1.0f);
+  trs.sy[idx] = component(node.scale, 1, 1.0f);
+  trs.sz[idx] = component(node.scale, 2, 1.0f);
+}
+
+// Computes T * R * S for nodes [first, last), as mandated by the glTF spec
+void trs_to_matrices_scalar(
+  const TrsArrays& trs, std::size_t first, std::size_t last, glm::mat4x4* out)
+{
+  for (std::size_t i = first; i < last; ++i)
+  {
+    const float x = trs.qx[i], y = trs.qy[i], z = trs.qz[i], w = trs.qw[i];
+
+    auto& m = out[i];
+    m[0] = glm::vec4{
+      trs.sx[i] * (1.0f - 2.0f * (y * y + z * z)),
+      trs.sx[i] * (2.0f * (x * y + w * z)),
+      trs.sx[i] * (2.0f * (x * z - w * y)),
+      0.0f};
+    m[1] = glm::vec4{
+      trs.sy[i] * (2.0f * (x * y - w * z)),
+      trs.sy[i] * (1.0f - 2.0f * (x * x + z * z)),
+      trs.sy[i] * (2.0f * (y * z + w * x)),
+      0.0f};
+    m[2] = glm::vec4{
+      trs.sz[i] * (2.0f * (x * z + w * y)),
+      trs.sz[i] * (2.0f * (y * z - w * x)),
+      trs.sz[i] * (1.0f - 2.0f * (x * x + y * y)),
+      0.0f};
+    m[3] = glm::vec4{trs.tx[i], trs.ty[i], trs.tz[i], 1.0f};
+  }
+}
+
+#if defined(SCENE_INSTANCES_SSE)
+
+// Same as the scalar version, but 4 nodes per iteration: every register
+// holds a single matrix entry of 4 different nodes, which get transposed
+// into columns right before storing.
+void trs_to_matrices(const TrsArrays& trs, std::size_t first, std::size_t last, glm::mat4x4* out)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 two = _mm_set1_ps(2.0f);
+
+  std::size_t i = first;
+  for (; i + 4 <= last; i += 4)
+  {
+    const __m128 x = _mm_loadu_ps(trs.qx.data() + i);
+    const __m128 y = _mm_loadu_ps(trs.qy.data() + i);
+    const __m128 z = _mm_loadu_ps(trs.qz.data() + i);
+    const __m128 w = _mm_loadu_ps(trs.qw.data() + i);
+
+    const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    const __m128 sx = _mm_loadu_ps(trs.sx.data() + i);
+    const __m128 sy = _mm_loadu_ps(trs.sy.data() + i);
+    const __m128 sz = _mm_loadu_ps(trs.sz.data() + i);
+
+    auto diagonal = [&](__m128 a, __m128 b, __m128 s) {
+      return _mm_mul_ps(s, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(a, b))));
+    };
+    auto sum = [&](__m128 a, __m128 b, __m128 s) {
+      return _mm_mul_ps(s, _mm_mul_ps(two, _mm_add_ps(a, b)));
+    };
+    auto difference = [&](__m128 a, __m128 b, __m128 s) {
+      return _mm_mul_ps(s, _mm_mul_ps(two, _mm_sub_ps(a, b)));
+    };
+
+    __m128 columns[4][4] = {
+      {diagonal(yy, zz, sx), sum(xy, wz, sx), difference(xz, wy, sx), _mm_setzero_ps()},
+      {difference(xy, wz, sy), diagonal(xx, zz, sy), sum(yz, wx, sy), _mm_setzero_ps()},
+      {sum(xz, wy, sz), difference(yz, wx, sz), diagonal(xx, yy, sz), _mm_setzero_ps()},
+      {_mm_loadu_ps(trs.tx.data() + i),
+       _mm_loadu_ps(trs.ty.data() + i),
+       _mm_loadu_ps(trs.tz.data() + i),
+       one},
+    };
+
+    for (std::size_t col = 0; col < 4; ++col)
+    {
+      auto& c = columns[col];
+      _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+      for (std::size_t node = 0; node < 4; ++node)
+        _mm_storeu_ps(&out[i + node][col][0], c[node]);
+    }
+  }
+
+  trs_to_matrices_scalar(trs, i, last, out);
+}
+
+#else
+
+void trs_to_matrices(const TrsArrays& trs, std::size_t first, std::size_t last, glm::mat4x4* out)
+{
+  trs_to_matrices_scalar(trs, first, last, out);
+}
+
+#endif
+
+std::size_t chunk_count(std::size_t count)
+{
+  return (count + NODE_CHUNK_SIZE - 1) / NODE_CHUNK_SIZE;
+}
+
+} // namespace
+
+SceneInstances process_instances(const tinygltf::Model& model, ThreadPool& workers)
+{
+  const std::size_t nodeCount = model.nodes.size();
+
+  // Local transforms, computed for all nodes at once
+  std::vector<glm::mat4x4> nodeTransforms(nodeCount);
+  {
+    TrsArrays trs(nodeCount);
+
+    workers.parallelFor(chunk_count(nodeCount), [&](std::size_t chunk) {
+      const std::size_t first = chunk * NODE_CHUNK_SIZE;
+      const std::size_t last = std::min(first + NODE_CHUNK_SIZE, nodeCount);
+
+      for (std::size_t i = first; i < last; ++i)
+        gather_trs(model.nodes[i], trs, i);
+
+      trs_to_matrices(trs, first, last, nodeTransforms.data());
+
+      // Nodes with an explicit matrix don't have TRS at all
+      for (std::size_t i = first; i < last; ++i)
+      {
+        const auto& matrix = model.nodes[i].matrix;
+        if (matrix.empty())
+          continue;
+        for (int col = 0; col < 4; ++col)
+          for (int row = 0; row < 4; ++row)
+            nodeTransforms[i][col][row] = static_cast<float>(matrix[4 * col + row]);
+      }
+    });
+  }
+
+  // Level-order traversal of the hierarchy: all nodes of a level are
+  // independent from each other and only depend on the previous level.
+  std::vector<std::size_t> levelOrder;
+  std::vector<std::size_t> levelStarts;
+  std::vector<int> parents(nodeCount, -1);
+  if (!model.scenes.empty())
+  {
+    const auto& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+
+    levelOrder.reserve(nodeCount);
+    std::vector<bool> visited(nodeCount, false);
+    for (auto root : scene.nodes)
+      if (!visited[root])
+      {
+        visited[root] = true;
+        levelOrder.push_back(static_cast<std::size_t>(root));
+      }
+
+    std::size_t levelBegin = 0;
+    while (levelBegin < levelOrder.size())
+    {
+      const std::size_t levelEnd = levelOrder.size();
+      levelStarts.push_back(levelBegin);
+      for (std::size_t i = levelBegin; i < levelEnd; ++i)
+        for (auto child : model.nodes[levelOrder[i]].children)
+        {
+          // Malformed files might have cycles or shared children
+          if (visited[child])
+            continue;
+          visited[child] = true;
+          parents[child] = static_cast<int>(levelOrder[i]);
+          levelOrder.push_back(static_cast<std::size_t>(child));
+        }
+      levelBegin = levelEnd;
+    }
+    levelStarts.push_back(levelOrder.size());
+  }
+
+  // Roots already have their world transforms, every next level is
+  // one parent * child product per node, done in parallel.
+  for (std::size_t level = 1; level + 1 < levelStarts.size(); ++level)
+  {
+    const std::size_t levelBegin = levelStarts[level];
+    const std::size_t levelSize = levelStarts[level + 1] - levelBegin;
+
+    workers.parallelFor(chunk_count(levelSize), [&](std::size_t chunk) {
+      const std::size_t first = levelBegin + chunk * NODE_CHUNK_SIZE;
+      const std::size_t last = std::min(first + NODE_CHUNK_SIZE, levelBegin + levelSize);
+      for (std::size_t i = first; i < last; ++i)
+      {
+        const std::size_t node = levelOrder[i];
+        nodeTransforms[node] = nodeTransforms[parents[node]] * nodeTransforms[node];
+      }
+    });
+  }
+
+  SceneInstances result;
+
+  std::vector<std::size_t> meshBucketCounts(model.meshes.size());
+
+  // Don't overallocate matrices, they are pretty chonky.
+  {
+    std::size_t totalNodesWithMeshes = 0;
+    for (std::size_t i = 0; i < model.nodes.size(); ++i)
+      if (model.nodes[i].mesh >= 0)
+      {
+        ++totalNodesWithMeshes;
+        ++meshBucketCounts[model.nodes[i].mesh];
+      }
+    result.matrices.resize(totalNodesWithMeshes);
+    result.meshes.resize(totalNodesWithMeshes);
+  }
+
+  for (size_t i = 1; i < meshBucketCounts.size(); ++i)
+  {
+    meshBucketCounts[i] += meshBucketCounts[i - 1];
+  }
+
+  for (std::size_t i = 0; i < model.nodes.size(); ++i)
+    if (model.nodes[i].mesh >= 0)
+    {
+      std::size_t index = --meshBucketCounts[model.nodes[i].mesh];
+      result.matrices[index] = nodeTransforms[i];
+      result.meshes[index] = model.nodes[i].mesh;
+    }
+
+  return result;
+}
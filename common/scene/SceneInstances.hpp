@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include "parallel/ThreadPool.hpp"
+
+
+// Flattened node hierarchy of a glTF scene: every node with a mesh becomes an
+// instance with its world transform. Instances are sorted by mesh index.
+// The hierarchy is processed level by level, with every level split
+// between the workers.
+struct SceneInstances
+{
+  std::vector<glm::mat4x4> matrices;
+  std::vector<std::uint32_t> meshes;
+};
+
+SceneInstances process_instances(const tinygltf::Model& model, ThreadPool& workers);
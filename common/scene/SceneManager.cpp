@@ -1,20 +1,57 @@
 #include "SceneManager.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
 #include <limits>
-#include <stack>
+#include <type_traits>
+#include <utility>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/gtc/quaternion.hpp>
+#include <fmt/chrono.h>
+#include <json.hpp>
+#include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
-#include <etna/OneShotCmdMgr.hpp>
 
+#include "BakedScene.hpp"
+#include "BakedWorld.hpp"
+#include "Bounds.hpp"
+#include "Materials.hpp"
+#include "SceneInstances.hpp"
+
+
+// Keeps the encoded bytes instead of letting tinygltf decode images one by one
+// right in the middle of parsing, TextureLoader decodes all of them in parallel later
+static bool collect_encoded_image(
+  tinygltf::Image*,
+  int image_idx,
+  std::string*,
+  std::string*,
+  int,
+  int,
+  const unsigned char* bytes,
+  int size,
+  void* user_data)
+{
+  auto& encoded = *static_cast<std::vector<std::vector<std::byte>>*>(user_data);
+  const auto idx = static_cast<std::size_t>(image_idx);
+  if (encoded.size() <= idx)
+    encoded.resize(idx + 1);
+  const auto* data = reinterpret_cast<const std::byte*>(bytes);
+  encoded[idx].assign(data, data + size);
+  return true;
+}
 
 SceneManager::SceneManager()
-  : oneShotCommands{etna::get_context().createOneShotCmdMgr()}
-  , transferHelper{etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 4}}
+  : workers{std::make_unique<ThreadPool>()}
+  , transferHelper{AsyncTransferHelper::CreateInfo{.sliceSize = 16 * 1024 * 1024, .sliceCount = 3}}
+  , textureLoader{*workers, TextureLoader::CreateInfo{}}
 {
+  loader.SetImageLoader(&collect_encoded_image, &encodedImages);
 }
 
 std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path path)
@@ -25,6 +62,8 @@ std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path pat
   std::string warning;
   bool success = false;
 
+  encodedImages.clear();
+
   auto ext = path.extension();
   if (ext == ".gltf")
     success = loader.LoadASCIIFromFile(&model, &error, &warning, path.string());
@@ -54,107 +93,138 @@ std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path pat
   return model;
 }
 
-SceneManager::ProcessedInstances SceneManager::processInstances(const tinygltf::Model& model) const
+std::optional<SceneManager::BakedModel> SceneManager::loadBakedModel(std::filesystem::path path)
 {
-  std::vector nodeTransforms(model.nodes.size(), glm::identity<glm::mat4x4>());
-
-  for (std::size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx)
+  // NOTE: tinygltf insists on reading every buffer into a std::vector, which
+  // for baked scenes means an extra copy of all of the geometry in RAM. Instead,
+  // we strip the buffer from the JSON before handing it over and map the binary
+  // file ourselves, so that the geometry goes from the page cache straight into
+  // the staging buffer.
+  std::string text;
   {
-    const auto& node = model.nodes[nodeIdx];
-    auto& transform = nodeTransforms[nodeIdx];
-
-    if (!node.matrix.empty())
-    {
-      for (int i = 0; i < 4; ++i)
-        for (int j = 0; j < 4; ++j)
-          transform[i][j] = static_cast<float>(node.matrix[4 * i + j]);
-    }
-    else
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
     {
-      if (!node.scale.empty())
-        transform = scale(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.scale[0]),
-            static_cast<float>(node.scale[1]),
-            static_cast<float>(node.scale[2])));
-
-      if (!node.rotation.empty())
-        transform *= mat4_cast(glm::quat(
-          static_cast<float>(node.rotation[3]),
-          static_cast<float>(node.rotation[0]),
-          static_cast<float>(node.rotation[1]),
-          static_cast<float>(node.rotation[2])));
-
-      if (!node.translation.empty())
-        transform = translate(
-          transform,
-          glm::vec3(
-            static_cast<float>(node.translation[0]),
-            static_cast<float>(node.translation[1]),
-            static_cast<float>(node.translation[2])));
+      spdlog::error("glTF: Unable to open {}", path);
+      return std::nullopt;
     }
+    text.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
   }
 
-  std::stack<std::size_t> vertices;
-  for (auto vert : model.scenes[model.defaultScene].nodes)
-    vertices.push(vert);
-
-  while (!vertices.empty())
+  auto json = nlohmann::json::parse(text, nullptr, false);
+  if (json.is_discarded())
   {
-    auto vert = vertices.top();
-    vertices.pop();
+    spdlog::error("glTF: {} is not a valid JSON file", path);
+    return std::nullopt;
+  }
 
-    for (auto child : model.nodes[vert].children)
-    {
-      nodeTransforms[child] = nodeTransforms[vert] * nodeTransforms[child];
-      vertices.push(child);
-    }
+  const auto buffersIt = json.find("buffers");
+  if (buffersIt == json.end() || !buffersIt->is_array() || buffersIt->size() != 1)
+  {
+    spdlog::error("glTF: Baked scenes are expected to have exactly one buffer");
+    return std::nullopt;
   }
 
-  ProcessedInstances result;
+  const std::string binaryUri = (*buffersIt)[0].value("uri", "");
+  const std::size_t binaryLength = (*buffersIt)[0].value("byteLength", std::size_t{0});
+  json.erase(buffersIt);
+  text = json.dump();
 
-  std::vector<std::size_t> meshBucketCounts(model.meshes.size());
+  BakedModel result;
+
+  encodedImages.clear();
+
+  std::string error;
+  std::string warning;
+  const bool success = loader.LoadASCIIFromString(
+    &result.model,
+    &error,
+    &warning,
+    text.c_str(),
+    static_cast<unsigned int>(text.size()),
+    path.parent_path().string());
 
-  // Don't overallocate matrices, they are pretty chonky.
+  if (!success)
   {
-    std::size_t totalNodesWithMeshes = 0;
-    for (std::size_t i = 0; i < model.nodes.size(); ++i)
-      if (model.nodes[i].mesh >= 0)
-      {
-        ++totalNodesWithMeshes;
-        ++meshBucketCounts[model.nodes[i].mesh];
-      }
-    result.matrices.resize(totalNodesWithMeshes);
-    result.meshes.resize(totalNodesWithMeshes);
+    spdlog::error("glTF: Failed to load model!");
+    if (!error.empty())
+      spdlog::error("glTF: {}", error);
+    return std::nullopt;
   }
 
-  for (size_t i = 1; i < meshBucketCounts.size(); ++i)
+  if (!warning.empty())
+    spdlog::warn("glTF: {}", warning);
+
+  result.binary = MappedFile{path.parent_path() / binaryUri};
+  if (!result.binary.isValid())
+    return std::nullopt;
+
+  if (result.binary.getData().size() < binaryLength)
   {
-    meshBucketCounts[i] += meshBucketCounts[i - 1];
+    spdlog::error(
+      "glTF: {} is truncated, expected {} bytes, got {}",
+      binaryUri,
+      binaryLength,
+      result.binary.getData().size());
+    return std::nullopt;
   }
 
-  for (std::size_t i = 0; i < model.nodes.size(); ++i)
-    if (model.nodes[i].mesh >= 0)
-    {
-      std::size_t index = --meshBucketCounts[model.nodes[i].mesh];
-      result.matrices[index] = nodeTransforms[i];
-      result.meshes[index] = model.nodes[i].mesh;
-    }
-
   return result;
 }
 
-static std::uint32_t encode_normal(glm::vec3 normal)
+static VertexAttributeStream accessor_stream(const tinygltf::Model& model, int accessor_idx)
 {
-  const std::int32_t x = static_cast<std::int32_t>(normal.x * 32767.0f);
-  const std::int32_t y = static_cast<std::int32_t>(normal.y * 32767.0f);
+  const auto& accessor = model.accessors[accessor_idx];
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  return VertexAttributeStream{
+    .data = reinterpret_cast<const std::byte*>(model.buffers[bufView.buffer].data.data()) +
+      bufView.byteOffset + accessor.byteOffset,
+    .stride = bufView.byteStride != 0
+      ? bufView.byteStride
+      : static_cast<std::size_t>(
+          tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+          tinygltf::GetNumComponentsInType(accessor.type)),
+    .componentType = accessor.componentType,
+  };
+}
 
-  const std::uint32_t sign = normal.z >= 0 ? 0 : 1;
-  const std::uint32_t sx = static_cast<std::uint32_t>(x & 0xfffe) | sign;
-  const std::uint32_t sy = static_cast<std::uint32_t>(y & 0xffff) << 16;
+// Narrowing is only ever requested for primitives whose indices fit
+template <class Index>
+static void decode_indices(const VertexAttributeStream& src, std::size_t count, Index* dst)
+{
+  auto convert = [&]<class Source>() {
+    if constexpr (std::is_same_v<Source, Index>)
+      std::memcpy(dst, src.data, sizeof(Index) * count);
+    else
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        Source index;
+        std::memcpy(&index, src.data + i * sizeof(index), sizeof(index));
+        dst[i] = static_cast<Index>(index);
+      }
+  };
 
-  return sx | sy;
+  switch (src.componentType)
+  {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    convert.template operator()<std::uint32_t>();
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    convert.template operator()<std::uint16_t>();
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    convert.template operator()<std::uint8_t>();
+    break;
+  default:
+    spdlog::warn("glTF: Unsupported index component type {}, zeroing indices", src.componentType);
+    std::memset(dst, 0, sizeof(Index) * count);
+    break;
+  }
+}
+
+static std::size_t index_size(IndexFormat format)
+{
+  return format == IndexFormat::Uint16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
 }
 
 SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model& model) const
@@ -165,45 +235,30 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
   // is appropriate for GPU upload right after reading from disc.
 
   ProcessedMeshes result;
-
-  // Pre-allocate enough memory so as not to hit the
-  // allocator on the memcpy hotpath
-  {
-    std::size_t vertexBytes = 0;
-    std::size_t indexBytes = 0;
-    for (const auto& bufView : model.bufferViews)
-    {
-      switch (bufView.target)
-      {
-      case TINYGLTF_TARGET_ARRAY_BUFFER:
-        vertexBytes += bufView.byteLength;
-        break;
-      case TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER:
-        indexBytes += bufView.byteLength;
-        break;
-      default:
-        break;
-      }
-    }
-    result.vertices.reserve(vertexBytes / sizeof(Vertex));
-    result.indices.reserve(indexBytes / sizeof(std::uint32_t));
-  }
+  auto& jobs = result.jobs;
 
   {
     std::size_t totalPrimitives = 0;
     for (const auto& mesh : model.meshes)
       totalPrimitives += mesh.primitives.size();
     result.relems.reserve(totalPrimitives);
+    jobs.reserve(totalPrimitives);
   }
 
   result.meshes.reserve(model.meshes.size());
 
+  // First pass: only look at accessor counts to find out where every
+  // primitive's data will end up in the unified buffers.
+  std::size_t totalVertices = 0;
+  std::size_t totalIndices = 0;
+  std::size_t totalIndices16 = 0;
   for (const auto& mesh : model.meshes)
   {
     result.meshes.push_back(Mesh{
       .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
       .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
-      .box = {}});
+      .box = {},
+      .sphere = {}});
 
     for (const auto& prim : mesh.primitives)
     {
@@ -215,177 +270,250 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         continue;
       }
 
-      const auto normalIt = prim.attributes.find("NORMAL");
-      const auto tangentIt = prim.attributes.find("TANGENT");
-      const auto texcoordIt = prim.attributes.find("TEXCOORD_0");
-
-      const bool hasNormals = normalIt != prim.attributes.end();
-      const bool hasTangents = tangentIt != prim.attributes.end();
-      const bool hasTexcoord = texcoordIt != prim.attributes.end();
-      std::array accessorIndices{
-        prim.indices,
-        prim.attributes.at("POSITION"),
-        hasNormals ? normalIt->second : -1,
-        hasTangents ? tangentIt->second : -1,
-        hasTexcoord ? texcoordIt->second : -1,
+      auto optionalAttribute = [&](const char* name) {
+        const auto it = prim.attributes.find(name);
+        return it != prim.attributes.end() ? accessor_stream(model, it->second)
+                                           : VertexAttributeStream{};
       };
 
-      std::array accessors{
-        &model.accessors[prim.indices],
-        &model.accessors[accessorIndices[1]],
-        hasNormals ? &model.accessors[accessorIndices[2]] : nullptr,
-        hasTangents ? &model.accessors[accessorIndices[3]] : nullptr,
-        hasTexcoord ? &model.accessors[accessorIndices[4]] : nullptr,
-      };
+      const int positionAccessor = prim.attributes.at("POSITION");
+      const std::size_t vertexCount = model.accessors[positionAccessor].count;
+      const std::size_t indexCount = model.accessors[prim.indices].count;
 
-      std::array bufViews{
-        &model.bufferViews[accessors[0]->bufferView],
-        &model.bufferViews[accessors[1]->bufferView],
-        hasNormals ? &model.bufferViews[accessors[2]->bufferView] : nullptr,
-        hasTangents ? &model.bufferViews[accessors[3]->bufferView] : nullptr,
-        hasTexcoord ? &model.bufferViews[accessors[4]->bufferView] : nullptr,
-      };
+      // Indices are guaranteed to have no stride
+      ETNA_VERIFY(model.bufferViews[model.accessors[prim.indices].bufferView].byteStride == 0);
+
+      const IndexFormat indexFormat = index_format_for(vertexCount);
+      std::size_t& regionIndices =
+        indexFormat == IndexFormat::Uint16 ? totalIndices16 : totalIndices;
 
       result.relems.push_back(RenderElement{
-        .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
-        .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
-        .indexCount = static_cast<std::uint32_t>(accessors[0]->count),
+        .vertexOffset = static_cast<std::uint32_t>(totalVertices),
+        .indexOffset = static_cast<std::uint32_t>(regionIndices),
+        .indexCount = static_cast<std::uint32_t>(indexCount),
+        .indexFormat = indexFormat,
+        .firstMeshlet = 0,
+        .meshletCount = 0,
+        .firstLod = 0,
+        .lodCount = 0,
+        .baseColorImage = base_color_image(model, prim),
       });
 
-      const std::size_t vertexCount = accessors[1]->count;
-
-      std::array ptrs{
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[0]->buffer].data.data()) +
-          bufViews[0]->byteOffset + accessors[0]->byteOffset,
-        reinterpret_cast<const std::byte*>(model.buffers[bufViews[1]->buffer].data.data()) +
-          bufViews[1]->byteOffset + accessors[1]->byteOffset,
-        hasNormals
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[2]->buffer].data.data()) +
-            bufViews[2]->byteOffset + accessors[2]->byteOffset
-          : nullptr,
-        hasTangents
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[3]->buffer].data.data()) +
-            bufViews[3]->byteOffset + accessors[3]->byteOffset
-          : nullptr,
-        hasTexcoord
-          ? reinterpret_cast<const std::byte*>(model.buffers[bufViews[4]->buffer].data.data()) +
-            bufViews[4]->byteOffset + accessors[4]->byteOffset
-          : nullptr,
-      };
+      jobs.push_back(PrimitiveDecodeJob{
+        .vertices =
+          VertexTranscodeJob{
+            .vertexCount = vertexCount,
+            .position = accessor_stream(model, positionAccessor),
+            .normal = optionalAttribute("NORMAL"),
+            .tangent = optionalAttribute("TANGENT"),
+            .texcoord = optionalAttribute("TEXCOORD_0"),
+          },
+        .indices = accessor_stream(model, prim.indices),
+        .indexCount = indexCount,
+        .indexFormat = indexFormat,
+        .firstVertex = totalVertices,
+        .firstIndex = regionIndices,
+      });
 
-      std::array strides{
-        bufViews[0]->byteStride != 0
-          ? bufViews[0]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[0]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[0]->type),
-        bufViews[1]->byteStride != 0
-          ? bufViews[1]->byteStride
-          : tinygltf::GetComponentSizeInBytes(accessors[1]->componentType) *
-            tinygltf::GetNumComponentsInType(accessors[1]->type),
-        hasNormals ? (bufViews[2]->byteStride != 0
-                        ? bufViews[2]->byteStride
-                        : tinygltf::GetComponentSizeInBytes(accessors[2]->componentType) *
-                          tinygltf::GetNumComponentsInType(accessors[2]->type))
-                   : 0,
-        hasTangents ? (bufViews[3]->byteStride != 0
-                         ? bufViews[3]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[3]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[3]->type))
-                    : 0,
-        hasTexcoord ? (bufViews[4]->byteStride != 0
-                         ? bufViews[4]->byteStride
-                         : tinygltf::GetComponentSizeInBytes(accessors[4]->componentType) *
-                           tinygltf::GetNumComponentsInType(accessors[4]->type))
-                    : 0,
-      };
+      totalVertices += vertexCount;
+      regionIndices += indexCount;
+    }
+  }
 
-      for (std::size_t i = 0; i < vertexCount; ++i)
-      {
-        auto& vtx = result.vertices.emplace_back();
-        glm::vec3 pos;
-        // Fall back to 0 in case we don't have something.
-        // NOTE: if tangents are not available, one could use http://mikktspace.com/
-        // NOTE: if normals are not available, reconstructing them is possible but will look ugly
-        glm::vec3 normal{0};
-        glm::vec3 tangent{0};
-        glm::vec2 texcoord{0};
-        std::memcpy(&pos, ptrs[1], sizeof(pos));
-
-        // NOTE: it's faster to do a template here with specializations for all combinations than to
-        // do ifs at runtime. Also, SIMD should be used. Try implementing this!
-        if (hasNormals)
-          std::memcpy(&normal, ptrs[2], sizeof(normal));
-        if (hasTangents)
-          std::memcpy(&tangent, ptrs[3], sizeof(tangent));
-        if (hasTexcoord)
-          std::memcpy(&texcoord, ptrs[4], sizeof(texcoord));
-
-
-        vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
-        vtx.texCoordAndTangentAndPadding =
-          glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
-
-        ptrs[1] += strides[1];
-        if (hasNormals)
-          ptrs[2] += strides[2];
-        if (hasTangents)
-          ptrs[3] += strides[3];
-        if (hasTexcoord)
-          ptrs[4] += strides[4];
-      }
+  result.totalVertices = totalVertices;
+  result.totalIndices = totalIndices;
+  result.totalIndices16 = totalIndices16;
 
-      // Indices are guaranteed to have no stride
-      ETNA_VERIFY(bufViews[0]->byteStride == 0);
-      const std::size_t indexCount = accessors[0]->count;
-      if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
-      {
-        for (std::size_t i = 0; i < indexCount; ++i)
+  return result;
+}
+
+// Positions are copied verbatim by the transcoder, so their bounds can just as
+// well be computed from the source, without reading back the staging memory
+static Bounds source_vertex_bounds(const VertexTranscodeJob& job)
+{
+  return compute_vertex_bounds(
+    reinterpret_cast<const float*>(job.position.data),
+    job.vertexCount,
+    job.position.stride / sizeof(float));
+}
+
+void SceneManager::decodeAndUpload(
+  std::span<const PrimitiveDecodeJob> jobs, std::span<Bounds> relem_bounds)
+{
+  // Primitives don't overlap in the output, so all of them can be decoded in
+  // parallel straight into a mapped staging slice. To overlap decoding with the
+  // transfer, jobs are split into batches of at most one slice worth of data:
+  // while the GPU copies batch N, the CPU is already busy with batch N + 1.
+  const std::size_t sliceSize = transferHelper.getSliceSize();
+  auto jobBytes = [](const PrimitiveDecodeJob& job) {
+    return job.vertices.vertexCount * sizeof(Vertex) + job.indexCount * index_size(job.indexFormat);
+  };
+
+  std::size_t batchStart = 0;
+  while (batchStart < jobs.size())
+  {
+    if (jobBytes(jobs[batchStart]) > sliceSize)
+    {
+      decodeAndUploadLarge(jobs[batchStart], relem_bounds[batchStart]);
+      ++batchStart;
+      continue;
+    }
+
+    std::size_t batchEnd = batchStart;
+    std::size_t batchBytes = 0;
+    while (batchEnd < jobs.size() && batchBytes + jobBytes(jobs[batchEnd]) <= sliceSize)
+      batchBytes += jobBytes(jobs[batchEnd++]);
+
+    const auto batch = jobs.subspan(batchStart, batchEnd - batchStart);
+
+    // Jobs are laid out back to back, so a batch is a contiguous range of the
+    // vertex buffer and of both of the index regions. These go into the slice
+    // one after another.
+    const std::size_t firstVertex = batch.front().firstVertex;
+    const std::size_t vertexCount =
+      batch.back().firstVertex + batch.back().vertices.vertexCount - firstVertex;
+
+    struct IndexRange
+    {
+      std::size_t first = 0;
+      std::size_t count = 0;
+    };
+    auto indexRange = [&](IndexFormat format) {
+      std::size_t begin = std::numeric_limits<std::size_t>::max();
+      std::size_t end = 0;
+      for (const auto& job : batch)
+        if (job.indexFormat == format)
         {
-          std::uint16_t index;
-          std::memcpy(&index, ptrs[0], sizeof(index));
-          result.indices.push_back(index);
-          ptrs[0] += 2;
+          begin = std::min(begin, job.firstIndex);
+          end = std::max(end, job.firstIndex + job.indexCount);
         }
-      }
-      else if (accessors[0]->componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
-      {
-        const std::size_t lastTotalIndices = result.indices.size();
-        result.indices.resize(lastTotalIndices + indexCount);
-        std::memcpy(
-          result.indices.data() + lastTotalIndices,
-          ptrs[0],
-          sizeof(result.indices[0]) * indexCount);
-      }
-    }
+      return begin < end ? IndexRange{begin, end - begin} : IndexRange{};
+    };
+    const IndexRange indexRange32 = indexRange(IndexFormat::Uint32);
+    const IndexRange indexRange16 = indexRange(IndexFormat::Uint16);
+
+    const auto staging = transferHelper.beginStaging();
+    const std::size_t indicesOffset = vertexCount * sizeof(Vertex);
+    const std::size_t indices16Offset = indicesOffset + indexRange32.count * sizeof(std::uint32_t);
+    auto* vertices = reinterpret_cast<Vertex*>(staging.data());
+    auto* indices = reinterpret_cast<std::uint32_t*>(staging.data() + indicesOffset);
+    auto* indices16 = reinterpret_cast<std::uint16_t*>(staging.data() + indices16Offset);
+
+    workers->parallelFor(batch.size(), [&](std::size_t i) {
+      const auto& job = batch[i];
+      transcode_vertices(
+        job.vertices, reinterpret_cast<float*>(vertices + (job.firstVertex - firstVertex)));
+      relem_bounds[batchStart + i] = source_vertex_bounds(job.vertices);
+      if (job.indexFormat == IndexFormat::Uint16)
+        decode_indices(
+          job.indices, job.indexCount, indices16 + (job.firstIndex - indexRange16.first));
+      else
+        decode_indices(
+          job.indices, job.indexCount, indices + (job.firstIndex - indexRange32.first));
+    });
+
+    std::array<AsyncTransferHelper::StagingCopy, 3> copies{};
+    std::size_t copyCount = 0;
+    auto addCopy = [&](const etna::Buffer& dst, std::size_t src_offset, std::size_t dst_offset,
+                       std::size_t size) {
+      // Zero-sized copies are not allowed
+      if (size > 0)
+        copies[copyCount++] = AsyncTransferHelper::StagingCopy{
+          .dst = &dst,
+          .srcOffset = src_offset,
+          .dstOffset = dst_offset,
+          .size = size,
+        };
+    };
+    addCopy(unifiedVbuf, 0, firstVertex * sizeof(Vertex), vertexCount * sizeof(Vertex));
+    addCopy(
+      unifiedIbuf,
+      indicesOffset,
+      indexRange32.first * sizeof(std::uint32_t),
+      indexRange32.count * sizeof(std::uint32_t));
+    addCopy(
+      unifiedIbuf,
+      indices16Offset,
+      unifiedIbuf16Offset + indexRange16.first * sizeof(std::uint16_t),
+      indexRange16.count * sizeof(std::uint16_t));
+    transferHelper.submitStaging(std::span{copies}.first(copyCount));
+
+    batchStart = batchEnd;
   }
 
-  return result;
+  transferHelper.wait();
 }
 
-void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+void SceneManager::decodeAndUploadLarge(const PrimitiveDecodeJob& job, Bounds& bounds)
+{
+  // Doesn't fit into a single slice, so it can't be decoded in place and
+  // has to be split by uploadBuffer. Meshes this big are rare.
+  std::vector<Vertex> vertices(job.vertices.vertexCount);
+  transcode_vertices(job.vertices, reinterpret_cast<float*>(vertices.data()));
+  bounds = source_vertex_bounds(job.vertices);
+  transferHelper.uploadBuffer<Vertex>(unifiedVbuf, job.firstVertex * sizeof(Vertex), vertices);
+
+  if (job.indexFormat == IndexFormat::Uint16)
+  {
+    std::vector<std::uint16_t> indices(job.indexCount);
+    decode_indices(job.indices, job.indexCount, indices.data());
+    transferHelper.uploadBuffer<std::uint16_t>(
+      unifiedIbuf, unifiedIbuf16Offset + job.firstIndex * sizeof(std::uint16_t), indices);
+  }
+  else
+  {
+    std::vector<std::uint32_t> indices(job.indexCount);
+    decode_indices(job.indices, job.indexCount, indices.data());
+    transferHelper.uploadBuffer<std::uint32_t>(
+      unifiedIbuf, job.firstIndex * sizeof(std::uint32_t), indices);
+  }
+}
+
+void SceneManager::createUnifiedBuffers(
+  std::size_t vertex_bytes, std::size_t index_count, std::size_t index16_count)
 {
   unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = vertices.size_bytes(),
+    .size = vertex_bytes,
     .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedVbuf",
   });
 
+  unifiedIbuf16Offset = index_count * sizeof(std::uint32_t);
   unifiedIbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = indices.size_bytes(),
+    .size = unifiedIbuf16Offset + index16_count * sizeof(std::uint16_t),
     .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedIbuf",
   });
+}
+
+void SceneManager::uploadData(
+  std::span<const std::byte> vertices,
+  std::span<const std::uint32_t> indices,
+  std::span<const std::uint16_t> indices16)
+{
+  createUnifiedBuffers(vertices.size(), indices.size(), indices16.size());
+
+  transferHelper.uploadBuffer(unifiedVbuf, 0, vertices);
+  transferHelper.uploadBuffer<std::uint32_t>(unifiedIbuf, 0, indices);
+  transferHelper.uploadBuffer<std::uint16_t>(unifiedIbuf, unifiedIbuf16Offset, indices16);
+  transferHelper.wait();
+}
 
-  transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
-  transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+void SceneManager::bindIndexBuffer(vk::CommandBuffer cmd_buf, IndexFormat format)
+{
+  if (sectorStreamer)
+    sectorStreamer->bindIndexBuffer(cmd_buf, format);
+  else if (format == IndexFormat::Uint16)
+    cmd_buf.bindIndexBuffer(unifiedIbuf.get(), unifiedIbuf16Offset, vk::IndexType::eUint16);
+  else
+    cmd_buf.bindIndexBuffer(unifiedIbuf.get(), 0, vk::IndexType::eUint32);
 }
 
 
 SceneManager::ProcessedMeshesBaked SceneManager::processMeshesBaked(
-  const tinygltf::Model& model) const
+  const tinygltf::Model& model, std::span<const std::byte> binary) const
 {
 
   ProcessedMeshesBaked result;
@@ -399,50 +527,78 @@ SceneManager::ProcessedMeshesBaked SceneManager::processMeshesBaked(
 
   result.meshes.reserve(model.meshes.size());
 
+  std::vector<std::size_t> relemVertexCounts;
+  relemVertexCounts.reserve(result.relems.capacity());
+
   for (const auto& mesh : model.meshes)
   {
-    {
-      float min = std::numeric_limits<float>::lowest();
-      float max = std::numeric_limits<float>::max();
-      result.meshes.push_back(Mesh{
-        .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
-        .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
-        .box = {{min, min, min}, {max, max, max}}});
-    }
+    result.meshes.push_back(Mesh{
+      .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
+      .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
+      .box = {},
+      .sphere = {}});
 
     for (const auto& prim : mesh.primitives)
     {
       auto& ind_accessor = model.accessors[prim.indices];
       auto& pos_accessor = model.accessors[prim.attributes.at("POSITION")];
 
-      {
-        auto& resBox = result.meshes.back().box;
-        auto& currMax = pos_accessor.maxValues;
-        auto& currMin = pos_accessor.minValues;
-        for (std::size_t i = 0; i < 3; ++i)
-        {
-          resBox.maxCoord[i] = std::max(resBox.maxCoord[i], static_cast<float>(currMax[i]));
-          resBox.minCoord[i] = std::min(resBox.minCoord[i], static_cast<float>(currMin[i]));
-        }
-      }
+      // The baker puts 16-bit indices into a buffer view of their own
+      const IndexFormat indexFormat =
+        ind_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ? IndexFormat::Uint16
+                                                                             : IndexFormat::Uint32;
 
+      relemVertexCounts.push_back(pos_accessor.count);
       result.relems.push_back(RenderElement{
         .vertexOffset = static_cast<std::uint32_t>(pos_accessor.byteOffset / sizeof(Vertex)),
-        .indexOffset = static_cast<std::uint32_t>(ind_accessor.byteOffset / sizeof(uint32_t)),
+        .indexOffset =
+          static_cast<std::uint32_t>(ind_accessor.byteOffset / index_size(indexFormat)),
         .indexCount = static_cast<std::uint32_t>(ind_accessor.count),
+        .indexFormat = indexFormat,
+        .firstMeshlet = 0,
+        .meshletCount = 0,
+        .firstLod = 0,
+        .lodCount = 0,
+        .baseColorImage = base_color_image(model, prim),
       });
     }
   }
 
   {
-    auto ptr = model.buffers[0].data.data();
+    auto ptr = binary.data();
     auto vertex_count = model.bufferViews[0].byteLength / sizeof(Vertex);
     auto index_count = model.bufferViews[1].byteLength / sizeof(uint32_t);
+    // The 16-bit index view is left out when there are no such indices,
+    // views of decoded attributes for other tools might follow
+    auto index16_count = model.bufferViews.size() > 2 &&
+        model.bufferViews[2].target == TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER
+      ? model.bufferViews[2].byteLength / sizeof(uint16_t)
+      : 0;
+    ETNA_VERIFY(
+      vertex_count * sizeof(Vertex) + index_count * sizeof(uint32_t) +
+        index16_count * sizeof(uint16_t) <=
+      binary.size());
     result.indices = {
       reinterpret_cast<const uint32_t*>(ptr + vertex_count * sizeof(Vertex)), index_count};
+    result.indices16 = {
+      reinterpret_cast<const uint16_t*>(
+        ptr + vertex_count * sizeof(Vertex) + index_count * sizeof(uint32_t)),
+      index16_count};
     result.vertices = {reinterpret_cast<const Vertex*>(ptr), vertex_count};
   }
 
+  // Accessor min/max are optional and only give us boxes,
+  // so compute proper bounds from the vertices themselves.
+  result.relemBounds.resize(result.relems.size());
+  workers->parallelFor(result.relems.size(), [&](std::size_t i) {
+    const auto& relem = result.relems[i];
+    ETNA_VERIFY(relem.vertexOffset + relemVertexCounts[i] <= result.vertices.size());
+    result.relemBounds[i] = compute_vertex_bounds(
+      reinterpret_cast<const float*>(result.vertices.data() + relem.vertexOffset),
+      relemVertexCounts[i],
+      sizeof(Vertex) / sizeof(float));
+  });
+
   return result;
 }
 
@@ -452,6 +608,8 @@ void SceneManager::selectScene(std::filesystem::path path)
   if (!maybeModel.has_value())
     return;
 
+  stopStreaming();
+
   auto model = std::move(*maybeModel);
 
   // By aggregating all SceneManager fields mutations here,
@@ -459,20 +617,163 @@ void SceneManager::selectScene(std::filesystem::path path)
   // when re-loading a scene.
 
   // NOTE: you might want to store these on the GPU for GPU-driven rendering.
-  auto [instMats, instMeshes] = processInstances(model);
+  auto [instMats, instMeshes] = process_instances(model, *workers);
   instanceMatrices = std::move(instMats);
   instanceMeshes = std::move(instMeshes);
 
-  auto [verts, inds, relems, meshs] = processMeshes(model);
+  const auto decodeStart = std::chrono::steady_clock::now();
+  auto [jobs, vertexCount, indexCount, index16Count, relems, meshs] = processMeshes(model);
 
   renderElements = std::move(relems);
   meshes = std::move(meshs);
+  renderElementBounds.resize(renderElements.size());
+  meshlets.clear();
+  renderElementLods.clear();
+
+  vertexFormat = BakedVertexFormat::Full;
+  createUnifiedBuffers(vertexCount * sizeof(Vertex), indexCount, index16Count);
+  decodeAndUpload(jobs, renderElementBounds);
+  updateMeshAndInstanceBounds();
+  const auto decodeEnd = std::chrono::steady_clock::now();
+
+  spdlog::info(
+    "Decoded and uploaded {} vertices and {} indices ({} of them 16-bit) of '{}' in {}",
+    vertexCount,
+    indexCount + index16Count,
+    index16Count,
+    path.filename(),
+    std::chrono::duration_cast<std::chrono::milliseconds>(decodeEnd - decodeStart));
+
+  loadTextures(model);
+}
+
+void SceneManager::loadTextures(const tinygltf::Model& model)
+{
+  // Only color textures are sRGB-encoded, everything else is plain data
+  std::vector<bool> srgb(model.images.size(), false);
+  auto markSrgb = [&](int texture_idx) {
+    if (texture_idx < 0 || static_cast<std::size_t>(texture_idx) >= model.textures.size())
+      return;
+    const int source = model.textures[texture_idx].source;
+    if (source >= 0 && static_cast<std::size_t>(source) < srgb.size())
+      srgb[source] = true;
+  };
+  for (const auto& material : model.materials)
+  {
+    markSrgb(material.pbrMetallicRoughness.baseColorTexture.index);
+    markSrgb(material.emissiveTexture.index);
+  }
+
+  encodedImages.resize(model.images.size());
+
+  std::vector<TextureLoader::Source> sources;
+  sources.reserve(model.images.size());
+  for (std::size_t i = 0; i < model.images.size(); ++i)
+  {
+    const auto& image = model.images[i];
+    sources.push_back(TextureLoader::Source{
+      .encoded = encodedImages[i],
+      .srgb = srgb[i],
+      .name = !image.name.empty() ? image.name
+        : !image.uri.empty()      ? image.uri
+                                  : fmt::format("image{}", i),
+    });
+  }
+
+  textures = textureLoader.load(sources);
+  encodedImages = {};
+}
+
+void SceneManager::updateMeshAndInstanceBounds()
+{
+  for (auto& mesh : meshes)
+  {
+    const auto merged =
+      merge_bounds(std::span{renderElementBounds}.subspan(mesh.firstRelem, mesh.relemCount));
+    mesh.box = merged.box;
+    mesh.sphere = merged.sphere;
+  }
+
+  instanceBounds.resize(instanceMatrices.size());
+  for (std::size_t i = 0; i < instanceMatrices.size(); ++i)
+  {
+    const auto& mesh = meshes[instanceMeshes[i]];
+    instanceBounds[i] =
+      transform_bounds(Bounds{.box = mesh.box, .sphere = mesh.sphere}, instanceMatrices[i]);
+  }
+}
+
+void SceneManager::tileInstances(std::uint32_t grid_size)
+{
+  if (sectorStreamer != nullptr || grid_size <= 1 || instanceMatrices.empty())
+    return;
+
+  const auto sceneBox = merge_bounds(instanceBounds).box;
+  const glm::vec3 sceneSize{
+    sceneBox.maxCoord[0] - sceneBox.minCoord[0],
+    sceneBox.maxCoord[1] - sceneBox.minCoord[1],
+    sceneBox.maxCoord[2] - sceneBox.minCoord[2],
+  };
+  // Copies of flat or point-like scenes still shouldn't end up on top of each other
+  const glm::vec3 step = 1.25f * glm::max(sceneSize, glm::vec3{1e-3f});
+
+  const std::size_t instanceCount = instanceMatrices.size();
+  const std::size_t copyCount = std::size_t{grid_size} * grid_size;
+  instanceMatrices.resize(instanceCount * copyCount);
+  instanceMeshes.resize(instanceCount * copyCount);
+  instanceBounds.resize(instanceCount * copyCount);
+
+  // The original instances are the sources of every copy and get overwritten
+  // by the first one, so the copies are written back to front
+  for (std::size_t copy = copyCount; copy-- > 0;)
+  {
+    const float center = 0.5f * static_cast<float>(grid_size - 1);
+    glm::mat4x4 shift{1.0f};
+    shift[3] = glm::vec4{
+      (static_cast<float>(copy % grid_size) - center) * step.x,
+      0,
+      (static_cast<float>(copy / grid_size) - center) * step.z,
+      1};
+
+    for (std::size_t i = 0; i < instanceCount; ++i)
+    {
+      const std::size_t dst = copy * instanceCount + i;
+      instanceMatrices[dst] = shift * instanceMatrices[i];
+      instanceMeshes[dst] = instanceMeshes[i];
+      instanceBounds[dst] = transform_bounds(instanceBounds[i], shift);
+    }
+  }
 
-  uploadData(verts, inds);
+  spdlog::info("Tiled the scene into {} copies, {} instances", copyCount, instanceMatrices.size());
 }
 
 etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
 {
+  return getVertexFormatDescription(vertexFormat);
+}
+
+etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription(
+  BakedVertexFormat format)
+{
+  if (format == BakedVertexFormat::Compact)
+    return etna::VertexByteStreamFormatDescription{
+      .stride = sizeof(BakedCompactVertex),
+      .attributes = {
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR16G16B16A16Unorm,
+          .offset = offsetof(BakedCompactVertex, position),
+        },
+        // Normal and tangent
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR32G32Uint,
+          .offset = offsetof(BakedCompactVertex, normal),
+        },
+        etna::VertexByteStreamFormatDescription::Attribute{
+          .format = vk::Format::eR16G16Sfloat,
+          .offset = offsetof(BakedCompactVertex, texCoord),
+        },
+      }};
+
   return etna::VertexByteStreamFormatDescription{
     .stride = sizeof(Vertex),
     .attributes = {
@@ -487,23 +788,179 @@ etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription
     }};
 }
 
+void SceneManager::selectBakedSceneContainer(const std::filesystem::path& path)
+{
+  const auto loadStart = std::chrono::steady_clock::now();
+
+  MappedFile file{path};
+  if (!file.isValid())
+    return;
+
+  auto maybeData = parse_baked_scene(file.getData());
+  if (!maybeData.has_value())
+  {
+    spdlog::error("Failed to load baked scene {}", path);
+    return;
+  }
+
+  const auto& data = *maybeData;
+
+  instanceMatrices.assign(data.instanceMatrices.begin(), data.instanceMatrices.end());
+  instanceMeshes.assign(data.instanceMeshes.begin(), data.instanceMeshes.end());
+  meshes.assign(data.meshes.begin(), data.meshes.end());
+  renderElements.assign(data.renderElements.begin(), data.renderElements.end());
+  renderElementBounds.assign(data.renderElementBounds.begin(), data.renderElementBounds.end());
+  meshlets.assign(data.meshlets.begin(), data.meshlets.end());
+  renderElementLods.assign(data.renderElementLods.begin(), data.renderElementLods.end());
+  vertexFormat = data.vertexFormat;
+  textures.clear();
+  updateMeshAndInstanceBounds();
+
+  uploadData(data.vertices, data.indices, data.indices16);
+
+  spdlog::info(
+    "Loaded baked scene {} ({} bytes of geometry) in {}",
+    path.filename(),
+    data.vertices.size_bytes() + data.indices.size_bytes() + data.indices16.size_bytes(),
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - loadStart));
+}
+
 void SceneManager::selectScenePrebaked(std::filesystem::path path)
 {
-  auto maybeModel = loadModel(path);
+  stopStreaming();
+
+  if (path.extension() != ".scene")
+  {
+    auto containerPath = path;
+    containerPath.replace_extension(".scene");
+    if (std::filesystem::exists(containerPath))
+      path = std::move(containerPath);
+  }
+
+  if (path.extension() == ".scene")
+  {
+    selectBakedSceneContainer(path);
+    return;
+  }
+
+  const auto loadStart = std::chrono::steady_clock::now();
+
+  auto maybeModel = loadBakedModel(path);
   if (!maybeModel.has_value())
     return;
 
-  auto model = std::move(*maybeModel);
+  auto [model, binary] = std::move(*maybeModel);
 
   // NOTE: you might want to store these on the GPU for GPU-driven rendering.
-  auto [instMats, instMeshes] = processInstances(model);
+  auto [instMats, instMeshes] = process_instances(model, *workers);
   instanceMatrices = std::move(instMats);
   instanceMeshes = std::move(instMeshes);
 
-  auto [verts, inds, relems, meshs] = processMeshesBaked(model);
+  auto [verts, inds, inds16, relems, relemBounds, meshs] =
+    processMeshesBaked(model, binary.getData());
 
   renderElements = std::move(relems);
+  renderElementBounds = std::move(relemBounds);
+  meshlets.clear();
+  renderElementLods.clear();
   meshes = std::move(meshs);
+  vertexFormat = BakedVertexFormat::Full;
+  updateMeshAndInstanceBounds();
+
+  uploadData(std::as_bytes(verts), inds, inds16);
+  loadTextures(model);
+
+  spdlog::info(
+    "Loaded baked scene {} ({} bytes of geometry) in {}",
+    path.filename(),
+    verts.size_bytes() + inds.size_bytes() + inds16.size_bytes(),
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - loadStart));
+}
+
+void SceneManager::selectWorld(std::filesystem::path path, SectorStreamer::CreateInfo info)
+{
+  auto world = read_baked_world(path);
+  if (!world.has_value())
+    return;
+
+  // Frames in flight might still be drawing the previous scene
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+  sectorStreamer.reset();
+  unifiedVbuf = {};
+  unifiedIbuf = {};
+
+  instanceMatrices.clear();
+  instanceMeshes.clear();
+  meshes.clear();
+  renderElements.clear();
+  renderElementBounds.clear();
+  meshlets.clear();
+  renderElementLods.clear();
+  instanceBounds.clear();
+  textures.clear();
+  vertexFormat = world->vertexFormat;
+
+  spdlog::info("Streaming {} sectors of {}", world->sectors.size(), path.filename());
+  sectorStreamer = std::make_unique<SectorStreamer>(std::move(*world), info);
+}
+
+void SceneManager::updateStreaming(vk::CommandBuffer cmd_buf, glm::vec3 camera_position)
+{
+  if (sectorStreamer == nullptr || !sectorStreamer->update(cmd_buf, camera_position))
+    return;
+
+  instanceMatrices.clear();
+  instanceMeshes.clear();
+  meshes.clear();
+  renderElements.clear();
+  renderElementBounds.clear();
+  meshlets.clear();
+  renderElementLods.clear();
+
+  // Sectors index everything within themselves, so the indices
+  // have to be shifted once they are put one after another
+  for (const auto* sector : sectorStreamer->getResidentSectors())
+  {
+    const auto meshBase = static_cast<std::uint32_t>(meshes.size());
+    const auto relemBase = static_cast<std::uint32_t>(renderElements.size());
+    const auto meshletBase = static_cast<std::uint32_t>(meshlets.size());
+    const auto lodBase = static_cast<std::uint32_t>(renderElementLods.size());
+
+    instanceMatrices.insert(
+      instanceMatrices.end(), sector->instanceMatrices.begin(), sector->instanceMatrices.end());
+    for (std::uint32_t mesh : sector->instanceMeshes)
+      instanceMeshes.push_back(meshBase + mesh);
+    for (auto mesh : sector->meshes)
+    {
+      mesh.firstRelem += relemBase;
+      meshes.push_back(mesh);
+    }
+    for (auto relem : sector->renderElements)
+    {
+      relem.firstMeshlet += meshletBase;
+      relem.firstLod += lodBase;
+      renderElements.push_back(relem);
+    }
+    renderElementBounds.insert(
+      renderElementBounds.end(),
+      sector->renderElementBounds.begin(),
+      sector->renderElementBounds.end());
+    meshlets.insert(meshlets.end(), sector->meshlets.begin(), sector->meshlets.end());
+    renderElementLods.insert(
+      renderElementLods.end(), sector->renderElementLods.begin(), sector->renderElementLods.end());
+  }
+
+  updateMeshAndInstanceBounds();
+}
+
+void SceneManager::stopStreaming()
+{
+  if (sectorStreamer == nullptr)
+    return;
 
-  uploadData(verts, inds);
+  // Frames in flight might still be drawing from the heaps
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+  sectorStreamer.reset();
 }
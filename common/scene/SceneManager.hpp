@@ -5,37 +5,18 @@
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 #include <etna/Buffer.hpp>
-#include <etna/BlockingTransferHelper.hpp>
+#include <etna/Image.hpp>
 #include <etna/VertexInput.hpp>
 
+#include "parallel/ThreadPool.hpp"
+#include "scene/AsyncTransferHelper.hpp"
+#include "scene/BakedScene.hpp"
+#include "scene/MappedFile.hpp"
+#include "scene/Mesh.hpp"
+#include "scene/SectorStreamer.hpp"
+#include "scene/TextureLoader.hpp"
+#include "scene/VertexTranscoder.hpp"
 
-// A single render element (relem) corresponds to a single draw call
-// of a certain pipeline with specific bindings (including material data)
-struct RenderElement
-{
-  std::uint32_t vertexOffset;
-  std::uint32_t indexOffset;
-  std::uint32_t indexCount;
-  // Not implemented!
-  // Material* material;
-};
-
-struct BoundingBox
-{
-  std::array<float, 3> maxCoord;
-  std::array<float, 3> minCoord;
-};
-
-// A mesh is a collection of relems. A scene may have the same mesh
-// located in several different places, so a scene consists of **instances**,
-// not meshes.
-struct Mesh
-{
-  std::uint32_t firstRelem;
-  std::uint32_t relemCount;
-
-  BoundingBox box;
-};
 
 class SceneManager
 {
@@ -43,7 +24,25 @@ public:
   SceneManager();
 
   void selectScene(std::filesystem::path path);
+  // Accepts either a *_baked.scene container or a legacy *_baked.gltf file.
+  // For the latter, a container sitting next to it is used instead if there is one.
   void selectScenePrebaked(std::filesystem::path path);
+  // Streams the sectors of a *_baked.world (see BakedWorld.hpp) in and out around
+  // the camera instead of loading the whole scene at once. Everything below then
+  // describes just the resident sectors and only changes in updateStreaming.
+  void selectWorld(std::filesystem::path path, SectorStreamer::CreateInfo info);
+  // Has to be called every frame before the scene is drawn, records uploads of
+  // the sectors that got loaded. Never waits for the disk. No-op unless a world
+  // is selected.
+  void updateStreaming(vk::CommandBuffer cmd_buf, glm::vec3 camera_position);
+  // Null unless a world is selected
+  const SectorStreamer* getSectorStreamer() { return sectorStreamer.get(); }
+
+  // Turns the selected scene into a stress test: every instance is repeated on a
+  // horizontal grid of grid_size x grid_size copies of the whole scene, centered
+  // on the original. Copies come one after another, so instances of the same mesh
+  // are no longer next to each other. Streamed worlds are left as they are.
+  void tileInstances(std::uint32_t grid_size);
 
   // Every instance is a mesh drawn with a certain transform
   // NOTE: maybe you can pass some additional data through unused matrix entries?
@@ -56,21 +55,59 @@ public:
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
-  vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
-  vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
+  // Mesh-space bounds of every relem, indexed the same way as relems
+  std::span<const Bounds> getRenderElementBounds() { return renderElementBounds; }
+
+  // Every relem of a baked scene is split into meshlets,
+  // see RenderElement::firstMeshlet and meshletCount
+  std::span<const Meshlet> getMeshlets() { return meshlets; }
+
+  // Simplified versions of baked relems,
+  // see RenderElement::firstLod and lodCount
+  std::span<const RenderElementLod> getRenderElementLods() { return renderElementLods; }
+
+  // World-space bounds of every instance
+  std::span<const Bounds> getInstanceBounds() { return instanceBounds; }
 
+  // Indexed the same way as glTF images, with full mip chains. Images
+  // that failed to load are left empty. Baked scene containers have none.
+  std::span<const etna::Image> getTextures() { return textures; }
+
+  vk::Buffer getVertexBuffer()
+  {
+    return sectorStreamer ? sectorStreamer->getVertexBuffer() : unifiedVbuf.get();
+  }
+  vk::Buffer getIndexBuffer()
+  {
+    return sectorStreamer ? sectorStreamer->getIndexBuffer() : unifiedIbuf.get();
+  }
+
+  // Binds the region of the unified index buffer that relems with
+  // the given format index into, see RenderElement::indexFormat
+  void bindIndexBuffer(vk::CommandBuffer cmd_buf, IndexFormat format);
+
+  // Baked scenes might come with compact vertices, everything else is always
+  // BakedVertexFormat::Full. Shaders have to be picked accordingly.
+  BakedVertexFormat getVertexFormat() { return vertexFormat; }
+
+  // Of the currently loaded scene
   etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  static etna::VertexByteStreamFormatDescription getVertexFormatDescription(
+    BakedVertexFormat format);
 
 private:
   std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
 
-  struct ProcessedInstances
+  // A glTF model whose only buffer is memory-mapped instead of being read into RAM
+  struct BakedModel
   {
-    std::vector<glm::mat4x4> matrices;
-    std::vector<std::uint32_t> meshes;
+    tinygltf::Model model;
+    MappedFile binary;
   };
 
-  ProcessedInstances processInstances(const tinygltf::Model& model) const;
+  std::optional<BakedModel> loadBakedModel(std::filesystem::path path);
+
+  void selectBakedSceneContainer(const std::filesystem::path& path);
 
   struct Vertex
   {
@@ -82,10 +119,25 @@ private:
 
   static_assert(sizeof(Vertex) == sizeof(float) * 8);
 
+  // Where a single glTF primitive's data comes from and where it goes
+  // in the unified buffers
+  struct PrimitiveDecodeJob
+  {
+    VertexTranscodeJob vertices;
+    VertexAttributeStream indices;
+    std::size_t indexCount;
+    IndexFormat indexFormat;
+    std::size_t firstVertex;
+    // Within the region of indexFormat
+    std::size_t firstIndex;
+  };
+
   struct ProcessedMeshes
   {
-    std::vector<Vertex> vertices;
-    std::vector<std::uint32_t> indices;
+    std::vector<PrimitiveDecodeJob> jobs;
+    std::size_t totalVertices;
+    std::size_t totalIndices;
+    std::size_t totalIndices16;
     std::vector<RenderElement> relems;
     std::vector<Mesh> meshes;
   };
@@ -94,23 +146,57 @@ private:
   {
     std::span<const Vertex> vertices;
     std::span<const std::uint32_t> indices;
+    std::span<const std::uint16_t> indices16;
     std::vector<RenderElement> relems;
+    std::vector<Bounds> relemBounds;
     std::vector<Mesh> meshes;
   };
   ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t> indices);
-  ProcessedMeshesBaked processMeshesBaked(const tinygltf::Model& model) const;
+  void decodeAndUpload(std::span<const PrimitiveDecodeJob> jobs, std::span<Bounds> relem_bounds);
+  void decodeAndUploadLarge(const PrimitiveDecodeJob& job, Bounds& bounds);
+  void createUnifiedBuffers(
+    std::size_t vertex_bytes, std::size_t index_count, std::size_t index16_count);
+  void uploadData(
+    std::span<const std::byte> vertices,
+    std::span<const std::uint32_t> indices,
+    std::span<const std::uint16_t> indices16);
+  ProcessedMeshesBaked processMeshesBaked(
+    const tinygltf::Model& model, std::span<const std::byte> binary) const;
+
+  // Encoded images are collected by the image loader hook during
+  // loadModel and loadBakedModel, this decodes and uploads them
+  void loadTextures(const tinygltf::Model& model);
+
+  // Derives mesh bounds from relem bounds and instance bounds from mesh bounds
+  void updateMeshAndInstanceBounds();
+
+  // Called by everything that selects a non-streamed scene
+  void stopStreaming();
 
 private:
   tinygltf::TinyGLTF loader;
-  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
-  etna::BlockingTransferHelper transferHelper;
+  std::unique_ptr<ThreadPool> workers;
+  AsyncTransferHelper transferHelper;
+  TextureLoader textureLoader;
+  // Of the model being loaded, indexed the same way as its images
+  std::vector<std::vector<std::byte>> encodedImages;
 
   std::vector<RenderElement> renderElements;
+  std::vector<Bounds> renderElementBounds;
+  std::vector<Meshlet> meshlets;
+  std::vector<RenderElementLod> renderElementLods;
   std::vector<Mesh> meshes;
   std::vector<glm::mat4x4> instanceMatrices;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<Bounds> instanceBounds;
+  BakedVertexFormat vertexFormat = BakedVertexFormat::Full;
+  std::vector<etna::Image> textures;
 
   etna::Buffer unifiedVbuf;
   etna::Buffer unifiedIbuf;
+  // 32-bit indices come first, followed by the 16-bit ones
+  vk::DeviceSize unifiedIbuf16Offset = 0;
+
+  // Replaces the unified buffers while a world is selected
+  std::unique_ptr<SectorStreamer> sectorStreamer;
 };
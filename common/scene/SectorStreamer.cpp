@@ -0,0 +1,431 @@
+#include "SectorStreamer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <tracy/Tracy.hpp>
+#include <etna/GlobalContext.hpp>
+
+#include "scene/BakedScene.hpp"
+#include "scene/MappedFile.hpp"
+
+
+namespace
+{
+
+// Keeps the disk busy without letting loads pile up faster than they are uploaded
+constexpr std::size_t MAX_PENDING_LOADS = 4;
+
+// Index heap ranges are allocated in these, which keeps them aligned for both formats
+constexpr vk::DeviceSize INDEX_UNIT = sizeof(std::uint32_t);
+
+float distance_to_box(glm::vec3 point, const BoundingBox& box)
+{
+  const glm::vec3 min{box.minCoord[0], box.minCoord[1], box.minCoord[2]};
+  const glm::vec3 max{box.maxCoord[0], box.maxCoord[1], box.maxCoord[2]};
+  return glm::length(point - glm::clamp(point, min, max));
+}
+
+} // namespace
+
+SectorStreamer::SectorStreamer(BakedWorld world, CreateInfo info)
+  : vertexFormat{world.vertexFormat}
+  , imageCount{world.imageCount}
+  , config{info}
+  , vertexSize{baked_vertex_size(world.vertexFormat)}
+  , vertexAllocator{info.vertexHeapSize / vertexSize}
+  , indexAllocator{info.indexHeapSize / INDEX_UNIT}
+  , loaders{info.loadThreads}
+{
+  ETNA_VERIFY(config.framesInFlight > 0 && config.maxUploadPerFrame > 0);
+
+  auto& ctx = etna::get_context();
+  vertexHeap = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = vertexAllocator.getCapacity() * vertexSize,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "sector_vertex_heap",
+  });
+  indexHeap = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = indexAllocator.getCapacity() * INDEX_UNIT,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "sector_index_heap",
+  });
+  staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = config.maxUploadPerFrame * config.framesInFlight,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "sector_staging",
+  });
+  staging.map();
+
+  sectors.resize(world.sectors.size());
+  for (std::size_t i = 0; i < sectors.size(); ++i)
+    sectors[i].info = std::move(world.sectors[i]);
+}
+
+SectorStreamer::~SectorStreamer()
+{
+  waitForLoads();
+}
+
+bool SectorStreamer::update(vk::CommandBuffer cmd_buf, glm::vec3 camera_position)
+{
+  ZoneScoped;
+
+  ++frame;
+  while (!retired.empty() && retired.front().frame + config.framesInFlight <= frame)
+  {
+    vertexAllocator.free(retired.front().vertexRange);
+    indexAllocator.free(retired.front().indexRange);
+    retired.pop_front();
+  }
+
+  bool changed = false;
+  for (std::size_t i = 0; i < sectors.size(); ++i)
+  {
+    auto& slot = sectors[i];
+    slot.distance = distance_to_box(camera_position, slot.info.box);
+    const bool evictable = slot.state == SectorState::Loaded ||
+      slot.state == SectorState::Uploading || slot.state == SectorState::Resident;
+    if (evictable && slot.distance > config.unloadRadius)
+    {
+      changed = changed || slot.state == SectorState::Resident;
+      evict(i);
+    }
+  }
+
+  processCompletedLoads();
+  requestLoads();
+  changed = allocateLoaded() || changed;
+  changed = uploadSectors(cmd_buf) || changed;
+  return changed;
+}
+
+std::vector<const SectorStreamer::Sector*> SectorStreamer::getResidentSectors() const
+{
+  std::vector<const Sector*> result;
+  for (const auto& slot : sectors)
+    if (slot.state == SectorState::Resident)
+      result.push_back(&slot.resident);
+  return result;
+}
+
+void SectorStreamer::bindIndexBuffer(vk::CommandBuffer cmd_buf, IndexFormat format) const
+{
+  cmd_buf.bindIndexBuffer(
+    indexHeap.get(),
+    0,
+    format == IndexFormat::Uint16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+}
+
+std::unique_ptr<SectorStreamer::LoadedSector> SectorStreamer::loadSector(
+  const std::filesystem::path& path) const
+{
+  ZoneScopedN("loadSector");
+
+  MappedFile file{path};
+  if (!file.isValid())
+    return nullptr;
+
+  const auto data = parse_baked_scene(file.getData());
+  if (!data.has_value())
+  {
+    spdlog::error("Failed to load sector {}", path);
+    return nullptr;
+  }
+  if (data->vertexFormat != vertexFormat)
+  {
+    spdlog::error("Sector {} has a different vertex format than its world", path);
+    return nullptr;
+  }
+
+  // Pages of the mapping are only read from disk when touched, which happens here
+  auto result = std::make_unique<LoadedSector>();
+  auto& sector = result->sector;
+  sector.instanceMatrices.assign(data->instanceMatrices.begin(), data->instanceMatrices.end());
+  sector.instanceMeshes.assign(data->instanceMeshes.begin(), data->instanceMeshes.end());
+  sector.meshes.assign(data->meshes.begin(), data->meshes.end());
+  sector.renderElements.assign(data->renderElements.begin(), data->renderElements.end());
+  sector.renderElementBounds.assign(
+    data->renderElementBounds.begin(), data->renderElementBounds.end());
+  sector.meshlets.assign(data->meshlets.begin(), data->meshlets.end());
+  sector.renderElementLods.assign(
+    data->renderElementLods.begin(), data->renderElementLods.end());
+
+  result->vertices.assign(data->vertices.begin(), data->vertices.end());
+
+  const auto indices = std::as_bytes(data->indices);
+  const auto indices16 = std::as_bytes(data->indices16);
+  result->indices.resize(
+    (indices.size() + indices16.size() + INDEX_UNIT - 1) / INDEX_UNIT * INDEX_UNIT);
+  std::memcpy(result->indices.data(), indices.data(), indices.size());
+  std::memcpy(result->indices.data() + indices.size(), indices16.data(), indices16.size());
+  result->indices32Count = data->indices.size();
+
+  return result;
+}
+
+void SectorStreamer::processCompletedLoads()
+{
+  std::deque<CompletedLoad> completed;
+  {
+    std::unique_lock lock{completedMutex};
+    std::swap(completed, completedLoads);
+  }
+
+  for (auto& load : completed)
+  {
+    --pendingLoads;
+    auto& slot = sectors[load.sector];
+    if (load.loaded == nullptr)
+      slot.state = SectorState::Failed;
+    // The camera might have moved away while the sector was being read
+    else if (slot.distance > config.unloadRadius)
+      slot.state = SectorState::Unloaded;
+    else
+    {
+      slot.state = SectorState::Loaded;
+      slot.loaded = std::move(load.loaded);
+    }
+  }
+}
+
+void SectorStreamer::requestLoads()
+{
+  std::vector<std::size_t> candidates;
+  for (std::size_t i = 0; i < sectors.size(); ++i)
+    if (sectors[i].state == SectorState::Unloaded && sectors[i].distance <= config.loadRadius)
+      candidates.push_back(i);
+  std::ranges::sort(candidates, {}, [&](std::size_t i) { return sectors[i].distance; });
+
+  for (std::size_t idx : candidates)
+  {
+    if (pendingLoads >= MAX_PENDING_LOADS)
+      break;
+
+    sectors[idx].state = SectorState::Loading;
+    ++pendingLoads;
+    loaders.submit([this, idx, path = sectors[idx].info.path]() {
+      auto loaded = loadSector(path);
+
+      std::unique_lock lock{completedMutex};
+      completedLoads.push_back(CompletedLoad{.sector = idx, .loaded = std::move(loaded)});
+      loadCompleted.notify_one();
+    });
+  }
+}
+
+bool SectorStreamer::allocateLoaded()
+{
+  std::vector<std::size_t> candidates;
+  for (std::size_t i = 0; i < sectors.size(); ++i)
+    if (sectors[i].state == SectorState::Loaded)
+      candidates.push_back(i);
+  std::ranges::sort(candidates, {}, [&](std::size_t i) { return sectors[i].distance; });
+
+  for (std::size_t idx : candidates)
+  {
+    auto& slot = sectors[idx];
+    const std::uint64_t vertexCount = (slot.loaded->vertices.size() + vertexSize - 1) / vertexSize;
+    const std::uint64_t indexUnits = slot.loaded->indices.size() / INDEX_UNIT;
+    if (vertexCount > vertexAllocator.getCapacity() || indexUnits > indexAllocator.getCapacity())
+    {
+      spdlog::error(
+        "Sector {} doesn't fit into the heaps even when they are empty", slot.info.path);
+      slot.loaded.reset();
+      slot.state = SectorState::Failed;
+      continue;
+    }
+
+    auto vertexRange = vertexAllocator.allocate(vertexCount);
+    auto indexRange =
+      vertexRange.has_value() ? indexAllocator.allocate(indexUnits) : std::nullopt;
+    if (vertexRange.has_value() && indexRange.has_value())
+    {
+      slot.vertexRange = *vertexRange;
+      slot.indexRange = *indexRange;
+      placeInHeaps(slot);
+      slot.state = SectorState::Uploading;
+      continue;
+    }
+    if (vertexRange.has_value())
+      vertexAllocator.free(*vertexRange);
+
+    // Ranges of evicted sectors only come back a few frames later,
+    // evicting more in the meantime would most likely be for nothing
+    if (!retired.empty())
+      return false;
+
+    // Only sectors that are farther than this one make room for it
+    std::optional<std::size_t> victim;
+    for (std::size_t i = 0; i < sectors.size(); ++i)
+    {
+      const auto& other = sectors[i];
+      const bool hasRanges =
+        other.state == SectorState::Uploading || other.state == SectorState::Resident;
+      if (
+        hasRanges && other.distance > slot.distance &&
+        (!victim.has_value() || other.distance > sectors[*victim].distance))
+        victim = i;
+    }
+    if (!victim.has_value())
+      continue;
+
+    const bool wasResident = sectors[*victim].state == SectorState::Resident;
+    evict(*victim);
+    return wasResident;
+  }
+  return false;
+}
+
+bool SectorStreamer::uploadSectors(vk::CommandBuffer cmd_buf)
+{
+  std::vector<std::size_t> candidates;
+  for (std::size_t i = 0; i < sectors.size(); ++i)
+    if (sectors[i].state == SectorState::Uploading)
+      candidates.push_back(i);
+  std::ranges::sort(candidates, {}, [&](std::size_t i) { return sectors[i].distance; });
+
+  // The slice of the frame that used it last is done, etna waited for it
+  // before handing out its command buffer again
+  const vk::DeviceSize sliceOffset = frame % config.framesInFlight * config.maxUploadPerFrame;
+  vk::DeviceSize stagingUsed = 0;
+  bool becameResident = false;
+
+  for (std::size_t idx : candidates)
+  {
+    if (stagingUsed == config.maxUploadPerFrame)
+      break;
+
+    ZoneScopedN("uploadSector");
+
+    auto& slot = sectors[idx];
+    const auto& loaded = *slot.loaded;
+
+    // Both blobs are uploaded one after another as far as the budget allows
+    auto upload = [&](
+                    std::span<const std::byte> bytes,
+                    vk::Buffer heap,
+                    vk::DeviceSize heap_offset,
+                    vk::DeviceSize blob_start) {
+      const vk::DeviceSize from = std::max(slot.uploadedBytes, blob_start) - blob_start;
+      if (from >= bytes.size() || stagingUsed == config.maxUploadPerFrame)
+        return;
+      const vk::DeviceSize size =
+        std::min<vk::DeviceSize>(bytes.size() - from, config.maxUploadPerFrame - stagingUsed);
+
+      std::memcpy(staging.data() + sliceOffset + stagingUsed, bytes.data() + from, size);
+      cmd_buf.copyBuffer(
+        staging.get(),
+        heap,
+        vk::BufferCopy{
+          .srcOffset = sliceOffset + stagingUsed,
+          .dstOffset = heap_offset + from,
+          .size = size,
+        });
+      stagingUsed += size;
+      slot.uploadedBytes += size;
+    };
+    upload(loaded.vertices, vertexHeap.get(), slot.vertexRange.offset * vertexSize, 0);
+    upload(
+      loaded.indices,
+      indexHeap.get(),
+      slot.indexRange.offset * INDEX_UNIT,
+      loaded.vertices.size());
+
+    if (slot.uploadedBytes == loaded.vertices.size() + loaded.indices.size())
+    {
+      slot.loaded.reset();
+      slot.state = SectorState::Resident;
+      becameResident = true;
+    }
+  }
+
+  if (stagingUsed > 0)
+  {
+    const vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask =
+        vk::PipelineStageFlagBits2::eVertexAttributeInput | vk::PipelineStageFlagBits2::eIndexInput,
+      .dstAccessMask = vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eIndexRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
+  return becameResident;
+}
+
+void SectorStreamer::evict(std::size_t sector_idx)
+{
+  auto& slot = sectors[sector_idx];
+  if (slot.state == SectorState::Uploading || slot.state == SectorState::Resident)
+    retired.push_back(RetiredRanges{
+      .frame = frame,
+      .vertexRange = slot.vertexRange,
+      .indexRange = slot.indexRange,
+    });
+
+  slot.state = SectorState::Unloaded;
+  slot.loaded.reset();
+  slot.resident = {};
+  slot.vertexRange = {};
+  slot.indexRange = {};
+  slot.uploadedBytes = 0;
+}
+
+void SectorStreamer::placeInHeaps(SectorSlot& slot)
+{
+  auto& loaded = *slot.loaded;
+  slot.resident = std::move(loaded.sector);
+  auto& sector = slot.resident;
+
+  // Indices are relative to the start of the heap bound with their format
+  const auto vertexBase = static_cast<std::uint32_t>(slot.vertexRange.offset);
+  const auto indexBase = static_cast<std::uint32_t>(slot.indexRange.offset);
+  const auto index16Base = static_cast<std::uint32_t>(
+    (slot.indexRange.offset * INDEX_UNIT + loaded.indices32Count * sizeof(std::uint32_t)) /
+    sizeof(std::uint16_t));
+
+  // LODs and meshlets may be shared by several relems
+  std::vector<bool> lodPlaced(sector.renderElementLods.size());
+  std::vector<bool> meshletPlaced(sector.meshlets.size());
+  for (auto& relem : sector.renderElements)
+  {
+    const std::uint32_t base = relem.indexFormat == IndexFormat::Uint16 ? index16Base : indexBase;
+    relem.vertexOffset += vertexBase;
+    relem.indexOffset += base;
+
+    for (std::uint32_t i = relem.firstLod; i < relem.firstLod + relem.lodCount; ++i)
+      if (!lodPlaced[i])
+      {
+        sector.renderElementLods[i].indexOffset += base;
+        lodPlaced[i] = true;
+      }
+    for (std::uint32_t i = relem.firstMeshlet; i < relem.firstMeshlet + relem.meshletCount; ++i)
+      if (!meshletPlaced[i])
+      {
+        sector.meshlets[i].indexOffset += base;
+        meshletPlaced[i] = true;
+      }
+  }
+}
+
+void SectorStreamer::waitForLoads()
+{
+  std::unique_lock lock{completedMutex};
+  loadCompleted.wait(lock, [&]() { return completedLoads.size() == pendingLoads; });
+  completedLoads.clear();
+  pendingLoads = 0;
+  for (auto& slot : sectors)
+    if (slot.state == SectorState::Loading)
+      slot.state = SectorState::Unloaded;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <etna/Buffer.hpp>
+
+#include "parallel/ThreadPool.hpp"
+#include "scene/BakedWorld.hpp"
+#include "scene/Mesh.hpp"
+#include "scene/RangeAllocator.hpp"
+
+
+// Keeps the sectors of a baked world (see BakedWorld.hpp) that are close to
+// the camera resident. Sectors that come within loadRadius are read and parsed
+// on background threads, then their geometry gets suballocated in persistent
+// vertex and index heaps and uploaded over the next frames, nearest sectors
+// first and at most maxUploadPerFrame bytes per frame. Sectors farther than
+// unloadRadius are evicted, and so are the farthest ones when the heaps are
+// full. update never waits for a read, so a slow disk only makes sectors pop
+// in later instead of making frames longer.
+// NOTE: both index formats share a single heap. Its ranges are aligned to
+// 4 bytes, so a relem's indexOffset can address either format as long as the
+// whole heap is bound with that format, see bindIndexBuffer.
+class SectorStreamer
+{
+public:
+  struct CreateInfo
+  {
+    // Distances are measured from the camera to the bounding boxes of sectors
+    float loadRadius = 150;
+    // Should be larger than loadRadius, otherwise moving back and forth
+    // along the border loads and evicts the same sectors over and over
+    float unloadRadius = 200;
+    vk::DeviceSize vertexHeapSize = 256 * 1024 * 1024;
+    vk::DeviceSize indexHeapSize = 128 * 1024 * 1024;
+    // Caps the hitch caused by uploads within a single frame
+    vk::DeviceSize maxUploadPerFrame = 8 * 1024 * 1024;
+    std::uint32_t loadThreads = 2;
+    // Has to match etna's, heap ranges of evicted sectors are reused this many frames later
+    std::uint32_t framesInFlight = 2;
+  };
+
+  // A resident sector. Offsets of its relems, LODs and meshlets point into
+  // the heaps, everything else is indexed within the sector.
+  struct Sector
+  {
+    std::vector<glm::mat4x4> instanceMatrices;
+    std::vector<std::uint32_t> instanceMeshes;
+    std::vector<Mesh> meshes;
+    std::vector<RenderElement> renderElements;
+    std::vector<Bounds> renderElementBounds;
+    std::vector<Meshlet> meshlets;
+    std::vector<RenderElementLod> renderElementLods;
+  };
+
+  SectorStreamer(BakedWorld world, CreateInfo info);
+  ~SectorStreamer();
+
+  SectorStreamer(const SectorStreamer&) = delete;
+  SectorStreamer& operator=(const SectorStreamer&) = delete;
+
+  SectorStreamer(SectorStreamer&&) = delete;
+  SectorStreamer& operator=(SectorStreamer&&) = delete;
+
+  // Has to be called once per frame before anything draws from the heaps.
+  // Returns whether the set of resident sectors changed.
+  bool update(vk::CommandBuffer cmd_buf, glm::vec3 camera_position);
+
+  // In the order of the world manifest
+  std::vector<const Sector*> getResidentSectors() const;
+
+  BakedVertexFormat getVertexFormat() const { return vertexFormat; }
+  // Of the glTF scene the world was baked from, see BakedWorld::imageCount
+  std::uint32_t getImageCount() const { return imageCount; }
+  vk::Buffer getVertexBuffer() const { return vertexHeap.get(); }
+  vk::Buffer getIndexBuffer() const { return indexHeap.get(); }
+  void bindIndexBuffer(vk::CommandBuffer cmd_buf, IndexFormat format) const;
+
+private:
+  enum class SectorState
+  {
+    Unloaded,
+    // Being read on a background thread
+    Loading,
+    // Read, waits for heap ranges
+    Loaded,
+    // Has heap ranges, the geometry is being uploaded
+    Uploading,
+    Resident,
+    // Failed to load, never retried
+    Failed,
+  };
+
+  // Everything a background thread reads from a sector file
+  struct LoadedSector
+  {
+    // Offsets are still relative to the sector itself
+    Sector sector;
+    std::vector<std::byte> vertices;
+    // 32-bit indices, then 16-bit ones, padded to 4 bytes
+    std::vector<std::byte> indices;
+    std::size_t indices32Count = 0;
+  };
+
+  struct SectorSlot
+  {
+    BakedWorldSector info;
+    SectorState state = SectorState::Unloaded;
+    // Distance from the camera as of the last update
+    float distance = 0;
+    // While Loaded and Uploading
+    std::unique_ptr<LoadedSector> loaded;
+    // While Uploading and Resident
+    Sector resident;
+    RangeAllocator::Range vertexRange;
+    RangeAllocator::Range indexRange;
+    // Of the vertices followed by the indices
+    vk::DeviceSize uploadedBytes = 0;
+  };
+
+  struct CompletedLoad
+  {
+    std::size_t sector;
+    std::unique_ptr<LoadedSector> loaded;
+  };
+
+  // Heap ranges that frames still in flight might use
+  struct RetiredRanges
+  {
+    std::uint64_t frame;
+    RangeAllocator::Range vertexRange;
+    RangeAllocator::Range indexRange;
+  };
+
+  std::unique_ptr<LoadedSector> loadSector(const std::filesystem::path& path) const;
+
+  void processCompletedLoads();
+  void requestLoads();
+  // Returns whether a resident sector got evicted
+  bool allocateLoaded();
+  // Returns whether a sector became resident
+  bool uploadSectors(vk::CommandBuffer cmd_buf);
+
+  void evict(std::size_t sector_idx);
+  // Points offsets of the loaded sector into its heap ranges
+  void placeInHeaps(SectorSlot& slot);
+  void waitForLoads();
+
+private:
+  BakedVertexFormat vertexFormat;
+  std::uint32_t imageCount;
+  CreateInfo config;
+  vk::DeviceSize vertexSize;
+
+  std::vector<SectorSlot> sectors;
+  std::uint64_t frame = 0;
+
+  etna::Buffer vertexHeap;
+  etna::Buffer indexHeap;
+  // In vertices
+  RangeAllocator vertexAllocator;
+  // In 4 byte units
+  RangeAllocator indexAllocator;
+  std::deque<RetiredRanges> retired;
+
+  // One slice of maxUploadPerFrame per frame in flight
+  etna::Buffer staging;
+
+  std::size_t pendingLoads = 0;
+  std::mutex completedMutex;
+  std::condition_variable loadCompleted;
+  std::deque<CompletedLoad> completedLoads;
+
+  // Destroyed first, so that no load outlives the rest
+  ThreadPool loaders;
+};
@@ -0,0 +1,493 @@
+#include "TextureLoader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#include <spdlog/spdlog.h>
+#include <fmt/chrono.h>
+#include <stb_image.h>
+#include <tracy/Tracy.hpp>
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+namespace
+{
+
+// Offsets of buffer to image copies must be multiples of the texel size,
+// 16 also keeps memcpy into the staging buffer aligned
+constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+vk::DeviceSize align_up(vk::DeviceSize value)
+{
+  return (value + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+}
+
+struct StbiDeleter
+{
+  void operator()(stbi_uc* pixels) const { stbi_image_free(pixels); }
+};
+
+struct DecodedImage
+{
+  std::size_t index = 0;
+  // RGBA8, null if decoding failed
+  std::unique_ptr<stbi_uc, StbiDeleter> pixels;
+  std::uint32_t width = 0;
+  std::uint32_t height = 0;
+};
+
+vk::Offset3D level_extent(std::uint32_t width, std::uint32_t height, std::uint32_t level)
+{
+  return vk::Offset3D{
+    static_cast<std::int32_t>(std::max(width >> level, 1u)),
+    static_cast<std::int32_t>(std::max(height >> level, 1u)),
+    1,
+  };
+}
+
+vk::ImageSubresourceLayers color_level(std::uint32_t level)
+{
+  return vk::ImageSubresourceLayers{
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .mipLevel = level,
+    .baseArrayLayer = 0,
+    .layerCount = 1,
+  };
+}
+
+void transfer_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::Image image,
+  std::uint32_t base_level,
+  std::uint32_t level_count,
+  vk::ImageLayout old_layout,
+  vk::AccessFlags2 src_access,
+  vk::ImageLayout new_layout,
+  vk::AccessFlags2 dst_access)
+{
+  const vk::ImageMemoryBarrier2 barrier{
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = src_access,
+    .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = dst_access,
+    .oldLayout = old_layout,
+    .newLayout = new_layout,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange =
+      {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .baseMipLevel = base_level,
+        .levelCount = level_count,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      },
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers = &barrier,
+  });
+}
+
+// Copies level 0 from the staging buffer and blits every next level from the previous one
+void record_upload(
+  vk::CommandBuffer cmd_buf,
+  vk::Buffer staging,
+  vk::DeviceSize staging_offset,
+  vk::Image image,
+  std::uint32_t width,
+  std::uint32_t height,
+  std::uint32_t level_count)
+{
+  etna::set_state(
+    cmd_buf,
+    image,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  const vk::BufferImageCopy region{
+    .bufferOffset = staging_offset,
+    .bufferRowLength = 0,
+    .bufferImageHeight = 0,
+    .imageSubresource = color_level(0),
+    .imageOffset = vk::Offset3D{0, 0, 0},
+    .imageExtent = vk::Extent3D{width, height, 1},
+  };
+  cmd_buf.copyBufferToImage(staging, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+
+  for (std::uint32_t level = 1; level < level_count; ++level)
+  {
+    transfer_barrier(
+      cmd_buf,
+      image,
+      level - 1,
+      1,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::ImageLayout::eTransferSrcOptimal,
+      vk::AccessFlagBits2::eTransferRead);
+
+    const vk::ImageBlit blit{
+      .srcSubresource = color_level(level - 1),
+      .srcOffsets = std::array{vk::Offset3D{}, level_extent(width, height, level - 1)},
+      .dstSubresource = color_level(level),
+      .dstOffsets = std::array{vk::Offset3D{}, level_extent(width, height, level)},
+    };
+    cmd_buf.blitImage(
+      image,
+      vk::ImageLayout::eTransferSrcOptimal,
+      image,
+      vk::ImageLayout::eTransferDstOptimal,
+      1,
+      &blit,
+      vk::Filter::eLinear);
+  }
+
+  // etna tracks the whole image as a transfer destination, so the source
+  // levels have to be put back before it transitions the image for sampling
+  if (level_count > 1)
+    transfer_barrier(
+      cmd_buf,
+      image,
+      0,
+      level_count - 1,
+      vk::ImageLayout::eTransferSrcOptimal,
+      vk::AccessFlagBits2::eTransferRead,
+      vk::ImageLayout::eTransferDstOptimal,
+      vk::AccessFlagBits2::eTransferWrite);
+
+  etna::set_state(
+    cmd_buf,
+    image,
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+}
+
+} // namespace
+
+TextureLoader::TextureLoader(ThreadPool& shared_workers, CreateInfo info)
+  : workers{shared_workers}
+  , batchSize{info.batchSize}
+  , stagingSize{align_up(info.stagingSize)}
+{
+  ETNA_VERIFY(info.stagingSize > 0 && info.batchSize > 0);
+
+  auto& ctx = etna::get_context();
+
+  commandPool =
+    etna::unwrap_vk_result(ctx.getDevice().createCommandPoolUnique(vk::CommandPoolCreateInfo{
+      .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer |
+        vk::CommandPoolCreateFlagBits::eTransient,
+      .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+    }));
+
+  staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = stagingSize,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "texture_loader_staging",
+  });
+  staging.map();
+}
+
+TextureLoader::~TextureLoader()
+{
+  submitBatch();
+  wait();
+}
+
+std::vector<etna::Image> TextureLoader::load(std::span<const Source> sources)
+{
+  ZoneScoped;
+
+  using Clock = std::chrono::steady_clock;
+  const auto loadStart = Clock::now();
+
+  // Decoded images wait here until the main thread uploads them
+  struct
+  {
+    std::mutex mutex;
+    std::condition_variable readyCondition;
+    std::deque<DecodedImage> ready;
+    Clock::duration decodeTime{};
+  } shared;
+
+  std::size_t pending = 0;
+  for (std::size_t i = 0; i < sources.size(); ++i)
+  {
+    if (sources[i].encoded.empty())
+      continue;
+
+    ++pending;
+    workers.submit([&shared, &source = sources[i], i]() {
+      ZoneScopedN("decodeTexture");
+      ZoneText(source.name.data(), source.name.size());
+
+      const auto decodeStart = Clock::now();
+      int width = 0;
+      int height = 0;
+      int channels = 0;
+      DecodedImage image{
+        .index = i,
+        .pixels = std::unique_ptr<stbi_uc, StbiDeleter>{stbi_load_from_memory(
+          reinterpret_cast<const stbi_uc*>(source.encoded.data()),
+          static_cast<int>(source.encoded.size()),
+          &width,
+          &height,
+          &channels,
+          4)},
+        .width = static_cast<std::uint32_t>(width),
+        .height = static_cast<std::uint32_t>(height),
+      };
+      if (image.pixels == nullptr)
+        spdlog::warn("Unable to decode texture '{}': {}", source.name, stbi_failure_reason());
+      const auto decodeTime = Clock::now() - decodeStart;
+
+      // Notifying under the lock, as the state is gone as soon as the last image is taken
+      std::unique_lock lock{shared.mutex};
+      shared.decodeTime += decodeTime;
+      shared.ready.push_back(std::move(image));
+      shared.readyCondition.notify_one();
+    });
+  }
+
+  std::vector<etna::Image> result(sources.size());
+  std::size_t loadedCount = 0;
+  std::size_t batchCount = 0;
+  vk::DeviceSize uploadedBytes = 0;
+  Clock::duration idleTime{};
+
+  while (pending > 0)
+  {
+    DecodedImage image;
+    {
+      std::unique_lock lock{shared.mutex};
+      // Nothing to add to the batch right now, so let the GPU start on it
+      // instead of keeping it waiting for the next decode
+      if (shared.ready.empty() && recording.has_value())
+      {
+        lock.unlock();
+        submitBatch();
+        ++batchCount;
+        continue;
+      }
+
+      const auto idleStart = Clock::now();
+      shared.readyCondition.wait(lock, [&]() { return !shared.ready.empty(); });
+      idleTime += Clock::now() - idleStart;
+
+      image = std::move(shared.ready.front());
+      shared.ready.pop_front();
+    }
+    --pending;
+
+    if (image.pixels == nullptr)
+      continue;
+
+    ZoneScopedN("uploadTexture");
+
+    const auto& source = sources[image.index];
+    const std::uint32_t levelCount = std::bit_width(std::max(image.width, image.height));
+    auto& texture = result[image.index];
+    texture = etna::get_context().createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{image.width, image.height, 1},
+      .name = source.name,
+      .format = source.srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm,
+      .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst |
+        vk::ImageUsageFlagBits::eTransferSrc,
+      .mipLevels = levelCount,
+    });
+
+    const vk::DeviceSize size = vk::DeviceSize{image.width} * image.height * 4;
+    const vk::DeviceSize offset = allocateStaging(size);
+    std::memcpy(staging.data() + offset, image.pixels.get(), size);
+    image.pixels.reset();
+
+    record_upload(
+      currentCommandBuffer(),
+      staging.get(),
+      offset,
+      texture.get(),
+      image.width,
+      image.height,
+      levelCount);
+
+    ++loadedCount;
+    uploadedBytes += size;
+    recordedBytes += size;
+    if (recordedBytes >= batchSize)
+    {
+      submitBatch();
+      ++batchCount;
+    }
+  }
+
+  if (recording.has_value())
+  {
+    submitBatch();
+    ++batchCount;
+  }
+  wait();
+
+  // Decode time is summed over all workers, so it exceeding the total time
+  // means that decoding ran in parallel, and the main thread being idle for
+  // a small part of it means that uploads were hidden behind the decodes.
+  const auto toMs = [](Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d);
+  };
+  spdlog::info(
+    "Loaded {} textures ({} MB of pixels) in {} batches in {}: {} spent decoding on {} threads, "
+    "{} waiting for decodes",
+    loadedCount,
+    uploadedBytes / (1024 * 1024),
+    batchCount,
+    toMs(Clock::now() - loadStart),
+    toMs(shared.decodeTime),
+    std::max<std::size_t>(workers.getWorkerCount(), 1),
+    toMs(idleTime));
+
+  return result;
+}
+
+vk::DeviceSize TextureLoader::allocateStaging(vk::DeviceSize size)
+{
+  size = align_up(size);
+
+  while (true)
+  {
+    if (stagingHead == stagingTail)
+      stagingHead = stagingTail = 0;
+
+    // Free space is [head, end) and [0, tail) when not wrapped and [head, tail)
+    // otherwise. The head never catches up with the tail, so that equality
+    // still means an empty ring.
+    if (stagingHead >= stagingTail)
+    {
+      if (stagingSize - stagingHead >= size)
+      {
+        const vk::DeviceSize offset = stagingHead;
+        stagingHead += size;
+        return offset;
+      }
+      if (stagingTail > size)
+      {
+        stagingHead = size;
+        return 0;
+      }
+    }
+    else if (stagingTail - stagingHead > size)
+    {
+      const vk::DeviceSize offset = stagingHead;
+      stagingHead += size;
+      return offset;
+    }
+
+    if (!inFlight.empty())
+      retireOldest();
+    else if (recording.has_value())
+      submitBatch();
+    else
+    {
+      // Nothing uses the ring, so it can be safely replaced with a bigger one
+      stagingSize = std::max(2 * stagingSize, size);
+      spdlog::info("Texture staging ring grows to {} MB", stagingSize / (1024 * 1024));
+      staging = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+        .size = stagingSize,
+        .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+        .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+        .name = "texture_loader_staging",
+      });
+      staging.map();
+    }
+  }
+}
+
+vk::CommandBuffer TextureLoader::currentCommandBuffer()
+{
+  if (!recording.has_value())
+  {
+    if (freeSubmissions.empty())
+    {
+      auto device = etna::get_context().getDevice();
+      auto commandBuffers =
+        etna::unwrap_vk_result(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+          .commandPool = commandPool.get(),
+          .level = vk::CommandBufferLevel::ePrimary,
+          .commandBufferCount = 1,
+        }));
+      freeSubmissions.push_back(submissions.size());
+      submissions.push_back(Submission{
+        .commandBuffer = commandBuffers[0],
+        .fence = etna::unwrap_vk_result(device.createFenceUnique(vk::FenceCreateInfo{})),
+      });
+    }
+
+    recording = freeSubmissions.back();
+    freeSubmissions.pop_back();
+    ETNA_CHECK_VK_RESULT(
+      submissions[*recording].commandBuffer.begin(vk::CommandBufferBeginInfo{
+        .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+      }));
+  }
+
+  return submissions[*recording].commandBuffer;
+}
+
+void TextureLoader::submitBatch()
+{
+  if (!recording.has_value())
+    return;
+
+  ZoneScopedN("submitTextureBatch");
+
+  auto& submission = submissions[*recording];
+  ETNA_CHECK_VK_RESULT(submission.commandBuffer.end());
+
+  const vk::SubmitInfo submitInfo{
+    .commandBufferCount = 1,
+    .pCommandBuffers = &submission.commandBuffer,
+  };
+  ETNA_CHECK_VK_RESULT(
+    etna::get_context().getQueue().submit(1, &submitInfo, submission.fence.get()));
+
+  submission.stagingEnd = stagingHead;
+  inFlight.push_back(*recording);
+  recording.reset();
+  recordedBytes = 0;
+}
+
+void TextureLoader::retireOldest()
+{
+  ZoneScopedN("waitTextureBatch");
+
+  auto& submission = submissions[inFlight.front()];
+  auto device = etna::get_context().getDevice();
+  ETNA_CHECK_VK_RESULT(device.waitForFences(
+    {submission.fence.get()}, vk::True, std::numeric_limits<std::uint64_t>::max()));
+  ETNA_CHECK_VK_RESULT(device.resetFences({submission.fence.get()}));
+
+  stagingTail = submission.stagingEnd;
+  freeSubmissions.push_back(inFlight.front());
+  inFlight.pop_front();
+}
+
+void TextureLoader::wait()
+{
+  while (!inFlight.empty())
+    retireOldest();
+}
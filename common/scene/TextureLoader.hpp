@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+
+#include "parallel/ThreadPool.hpp"
+
+
+// Decodes compressed images (PNG, JPEG and whatever else stb_image reads)
+// on a thread pool and uploads them with full mip chains. Every image goes
+// into a shared staging ring as soon as its decode finishes, and uploads
+// together with blits for the mips are recorded in batches, so the GPU works
+// on some images while the workers are still busy decoding the rest.
+// NOTE: etna creates a single universal queue, so batches are submitted there.
+// Must be used from the thread that owns that queue.
+class TextureLoader
+{
+public:
+  struct CreateInfo
+  {
+    // Grows if a single image doesn't fit
+    vk::DeviceSize stagingSize = 64 * 1024 * 1024;
+    // A batch is also submitted early when nothing else has been decoded yet
+    vk::DeviceSize batchSize = 16 * 1024 * 1024;
+  };
+
+  struct Source
+  {
+    std::span<const std::byte> encoded;
+    // Colors are sampled as sRGB, everything else as unorm
+    bool srgb;
+    std::string name;
+  };
+
+  TextureLoader(ThreadPool& shared_workers, CreateInfo info);
+  ~TextureLoader();
+
+  TextureLoader(const TextureLoader&) = delete;
+  TextureLoader& operator=(const TextureLoader&) = delete;
+
+  TextureLoader(TextureLoader&&) = delete;
+  TextureLoader& operator=(TextureLoader&&) = delete;
+
+  // Images are in the order of sources and are ready for sampling in fragment
+  // shaders once this returns. Sources that are empty or fail to decode are
+  // left as default-constructed images.
+  std::vector<etna::Image> load(std::span<const Source> sources);
+
+private:
+  struct Submission
+  {
+    vk::CommandBuffer commandBuffer;
+    vk::UniqueFence fence;
+    // Staging ring offset right after the data of this submission
+    vk::DeviceSize stagingEnd = 0;
+  };
+
+  vk::DeviceSize allocateStaging(vk::DeviceSize size);
+  vk::CommandBuffer currentCommandBuffer();
+  void submitBatch();
+  void retireOldest();
+  void wait();
+
+private:
+  ThreadPool& workers;
+  vk::DeviceSize batchSize;
+
+  etna::Buffer staging;
+  vk::DeviceSize stagingSize;
+  // Data is written at head, and the oldest submission still reads from tail.
+  // Both are equal only when the ring is empty.
+  vk::DeviceSize stagingHead = 0;
+  vk::DeviceSize stagingTail = 0;
+
+  vk::UniqueCommandPool commandPool;
+  std::vector<Submission> submissions;
+  std::vector<std::size_t> freeSubmissions;
+  std::deque<std::size_t> inFlight;
+  // The batch being recorded, if any
+  std::optional<std::size_t> recording;
+  vk::DeviceSize recordedBytes = 0;
+};
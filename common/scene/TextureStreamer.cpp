@@ -0,0 +1,530 @@
+#include "TextureStreamer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <fmt/chrono.h>
+#include <tracy/Tracy.hpp>
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+
+
+namespace
+{
+
+// Keeps the disk busy without letting reads pile up faster than they are uploaded
+constexpr std::size_t MAX_PENDING_READS = 4;
+
+// vkCmdUpdateBuffer takes at most this much at a time
+constexpr vk::DeviceSize MAX_UPDATE_SIZE = 65536;
+
+std::uint32_t level_extent(std::uint32_t extent, std::uint32_t level)
+{
+  return std::max(extent >> level, 1u);
+}
+
+vk::ImageSubresourceLayers color_level(std::uint32_t level)
+{
+  return vk::ImageSubresourceLayers{
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .mipLevel = level,
+    .baseArrayLayer = 0,
+    .layerCount = 1,
+  };
+}
+
+void buffer_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::Buffer buffer,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  const vk::BufferMemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = buffer,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .bufferMemoryBarrierCount = 1,
+    .pBufferMemoryBarriers = &barrier,
+  });
+}
+
+etna::Buffer create_feedback_buffer(std::size_t texture_count)
+{
+  return etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<std::size_t>(texture_count, 1) * sizeof(TextureFeedback),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer |
+      vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .name = "texture_feedback",
+  });
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer(CreateInfo info)
+  : config{info}
+{
+  ETNA_VERIFY(config.framesInFlight > 0);
+
+  // A single BC1 block with both endpoints white
+  static constexpr std::array<std::byte, 8> WHITE_BLOCK = {
+    std::byte{0xFF},
+    std::byte{0xFF},
+    std::byte{0xFF},
+    std::byte{0xFF},
+    std::byte{0},
+    std::byte{0},
+    std::byte{0},
+    std::byte{0},
+  };
+  fallback = upload_baked_texture(
+    BakedTextureData{
+      .format = BakedTextureFormat::Bc1Unorm,
+      .width = 1,
+      .height = 1,
+      .levels = {std::span{WHITE_BLOCK}},
+    },
+    "streamed_texture_fallback");
+
+  feedback = create_feedback_buffer(0);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  waitForReads();
+}
+
+void TextureStreamer::load(std::span<const std::filesystem::path> paths)
+{
+  ZoneScoped;
+
+  const auto loadStart = std::chrono::steady_clock::now();
+
+  waitForReads();
+  if (!textures.empty() || !retired.empty())
+    ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+  retired.clear();
+  textures.clear();
+  residentBytes = 0;
+  nextReadCandidate = 0;
+
+  textures.resize(paths.size());
+  std::size_t streamedCount = 0;
+  vk::DeviceSize pinnedBytes = 0;
+  vk::DeviceSize fullBytes = 0;
+  for (std::size_t i = 0; i < paths.size(); ++i)
+  {
+    // MappedFile complains about missing files, but those are fine here
+    std::error_code error;
+    if (paths[i].empty() || !std::filesystem::exists(paths[i], error))
+      continue;
+
+    auto& texture = textures[i];
+    texture.file = MappedFile{paths[i]};
+    if (!texture.file.isValid())
+      continue;
+
+    auto data = parse_baked_texture(texture.file.getData());
+    if (!data.has_value())
+    {
+      spdlog::warn("Texture {} won't be streamed", paths[i]);
+      texture.file = {};
+      continue;
+    }
+    texture.data = std::move(*data);
+
+    const auto levelCount = static_cast<std::uint32_t>(texture.data.levels.size());
+    const std::uint32_t extent = std::max(texture.data.width, texture.data.height);
+    std::uint32_t pinned = 0;
+    while (pinned + 1 < levelCount && level_extent(extent, pinned) > config.residentExtent)
+      ++pinned;
+    texture.pinnedLevel = texture.residentLevel = texture.wantedLevel = pinned;
+
+    // Smallest levels come first in the file, so only its beginning is read here
+    const BakedTextureData resident{
+      .format = texture.data.format,
+      .width = level_extent(texture.data.width, pinned),
+      .height = level_extent(texture.data.height, pinned),
+      .levels = {texture.data.levels.begin() + pinned, texture.data.levels.end()},
+    };
+    texture.image = upload_baked_texture(
+      resident, paths[i].filename().string(), vk::ImageUsageFlagBits::eTransferSrc);
+
+    ++streamedCount;
+    for (std::uint32_t level = 0; level < levelCount; ++level)
+    {
+      fullBytes += texture.data.levels[level].size();
+      if (level >= pinned)
+        pinnedBytes += texture.data.levels[level].size();
+    }
+  }
+
+  feedback = create_feedback_buffer(textures.size());
+  readbacks.clear();
+  for (std::uint32_t i = 0; i < config.framesInFlight; ++i)
+  {
+    auto& readback = readbacks.emplace_back();
+    readback.buffer = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = std::max<std::size_t>(textures.size(), 1) * sizeof(TextureFeedback),
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = "texture_feedback_readback",
+    });
+    readback.buffer.map();
+  }
+
+  spdlog::info(
+    "Streaming {} textures: {} KB of small levels loaded upfront in {}, {} MB in total",
+    streamedCount,
+    pinnedBytes / 1024,
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - loadStart),
+    fullBytes / (1024 * 1024));
+}
+
+bool TextureStreamer::isStreamed(std::uint32_t texture) const
+{
+  return texture < textures.size() && textures[texture].image.get();
+}
+
+const etna::Image& TextureStreamer::getImage(std::uint32_t texture) const
+{
+  return isStreamed(texture) ? textures[texture].image : fallback;
+}
+
+void TextureStreamer::update(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  ++frame;
+  while (!retired.empty() && retired.front().frame + config.framesInFlight <= frame)
+    retired.pop_front();
+
+  if (textures.empty())
+    return;
+
+  processFeedback();
+  uploadCompletedReads(cmd_buf);
+  requestReads();
+  resetFeedback(cmd_buf);
+}
+
+void TextureStreamer::processFeedback()
+{
+  // The frame that wrote this is done, etna waited for it before handing
+  // out its command buffer again
+  auto& readback = readbacks[frame % readbacks.size()];
+  if (!readback.written)
+    return;
+
+  const auto* entries = reinterpret_cast<const TextureFeedback*>(readback.buffer.data());
+  for (std::uint32_t i = 0; i < textures.size(); ++i)
+  {
+    const std::uint32_t requested = entries[i].requestedLevel;
+    if (requested == TEXTURE_NOT_SAMPLED || !isStreamed(i))
+      continue;
+
+    auto& texture = textures[i];
+    texture.lastSampledFrame = frame;
+    texture.wantedLevel = std::min(requested, texture.pinnedLevel);
+  }
+}
+
+void TextureStreamer::uploadCompletedReads(vk::CommandBuffer cmd_buf)
+{
+  vk::DeviceSize uploaded = 0;
+  while (uploaded < config.maxUploadPerFrame)
+  {
+    CompletedRead read;
+    {
+      std::unique_lock lock{completedMutex};
+      if (completedReads.empty())
+        break;
+      read = std::move(completedReads.front());
+      completedReads.pop_front();
+    }
+    --pendingReads;
+
+    auto& texture = textures[read.texture];
+    texture.readPending = false;
+
+    // The texture might have been evicted while the level was being read
+    if (read.level + 1 != texture.residentLevel)
+      continue;
+    // Requested again later if it is still wanted by then
+    if (!makeRoom(cmd_buf, read.bytes.size(), read.texture))
+      continue;
+
+    ZoneScopedN("uploadTextureLevel");
+
+    auto staging = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = read.bytes.size(),
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = "texture_streaming_staging",
+    });
+    staging.map();
+    std::memcpy(staging.data(), read.bytes.data(), read.bytes.size());
+    staging.unmap();
+
+    setResidentLevel(cmd_buf, read.texture, read.level, staging.get());
+    retired.push_back(Retired{.frame = frame, .image = {}, .staging = std::move(staging)});
+    uploaded += read.bytes.size();
+  }
+}
+
+void TextureStreamer::requestReads()
+{
+  for (std::size_t checked = 0; checked < textures.size() && pendingReads < MAX_PENDING_READS;
+       ++checked)
+  {
+    const auto idx = static_cast<std::uint32_t>(nextReadCandidate);
+    nextReadCandidate = (nextReadCandidate + 1) % textures.size();
+
+    auto& texture = textures[idx];
+    if (!isStreamed(idx) || texture.readPending || texture.wantedLevel >= texture.residentLevel)
+      continue;
+
+    const std::uint32_t level = texture.residentLevel - 1;
+    const auto bytes = texture.data.levels[level];
+    // Otherwise the same level would be read over and over only to be dropped
+    if (residentBytes + bytes.size() > config.budget && !findEvictionVictim(idx).has_value())
+      continue;
+
+    texture.readPending = true;
+    ++pendingReads;
+    // Pages of the mapping are only read from disk when touched, which happens here
+    ioThread.submit([this, bytes, idx, level]() {
+      ZoneScopedN("readTextureLevel");
+      CompletedRead read{
+        .texture = idx,
+        .level = level,
+        .bytes = {bytes.begin(), bytes.end()},
+      };
+
+      std::unique_lock lock{completedMutex};
+      completedReads.push_back(std::move(read));
+      readCompleted.notify_one();
+    });
+  }
+}
+
+void TextureStreamer::resetFeedback(vk::CommandBuffer cmd_buf)
+{
+  std::vector<TextureFeedback> entries(textures.size());
+  for (std::size_t i = 0; i < textures.size(); ++i)
+    entries[i] = TextureFeedback{
+      .residentLevel = textures[i].residentLevel,
+      .requestedLevel = TEXTURE_NOT_SAMPLED,
+    };
+
+  // Shaders and the readback of the previous frame are done with it
+  buffer_barrier(
+    cmd_buf,
+    feedback.get(),
+    vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eTransferRead,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite);
+
+  const auto bytes = std::as_bytes(std::span{entries});
+  for (vk::DeviceSize offset = 0; offset < bytes.size(); offset += MAX_UPDATE_SIZE)
+  {
+    const vk::DeviceSize size = std::min<vk::DeviceSize>(MAX_UPDATE_SIZE, bytes.size() - offset);
+    cmd_buf.updateBuffer(feedback.get(), offset, size, bytes.data() + offset);
+  }
+
+  buffer_barrier(
+    cmd_buf,
+    feedback.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+}
+
+void TextureStreamer::readBackFeedback(vk::CommandBuffer cmd_buf)
+{
+  if (textures.empty())
+    return;
+
+  auto& readback = readbacks[frame % readbacks.size()];
+
+  buffer_barrier(
+    cmd_buf,
+    feedback.get(),
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead);
+
+  const vk::BufferCopy region{
+    .srcOffset = 0,
+    .dstOffset = 0,
+    .size = textures.size() * sizeof(TextureFeedback),
+  };
+  cmd_buf.copyBuffer(feedback.get(), readback.buffer.get(), 1, &region);
+
+  buffer_barrier(
+    cmd_buf,
+    readback.buffer.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eHost,
+    vk::AccessFlagBits2::eHostRead);
+
+  readback.written = true;
+}
+
+std::optional<std::uint32_t> TextureStreamer::findEvictionVictim(std::uint32_t for_texture) const
+{
+  // Textures with more levels than they currently want go first, then the
+  // least recently sampled ones. Evicting textures sampled as recently as the
+  // one that needs the room would only make them take turns being blurry.
+  std::optional<std::uint32_t> result;
+  bool resultUnwanted = false;
+  for (std::uint32_t i = 0; i < textures.size(); ++i)
+  {
+    const auto& texture = textures[i];
+    if (i == for_texture || !isStreamed(i) || texture.residentLevel >= texture.pinnedLevel)
+      continue;
+
+    const bool unwanted = texture.residentLevel < texture.wantedLevel;
+    if (!unwanted && texture.lastSampledFrame >= textures[for_texture].lastSampledFrame)
+      continue;
+
+    if (
+      !result.has_value() || (unwanted && !resultUnwanted) ||
+      (unwanted == resultUnwanted &&
+       texture.lastSampledFrame < textures[*result].lastSampledFrame))
+    {
+      result = i;
+      resultUnwanted = unwanted;
+    }
+  }
+  return result;
+}
+
+bool TextureStreamer::makeRoom(
+  vk::CommandBuffer cmd_buf, vk::DeviceSize size, std::uint32_t for_texture)
+{
+  // A linear search per evicted level, which is nothing next to the copies it causes
+  while (residentBytes + size > config.budget)
+  {
+    const auto victim = findEvictionVictim(for_texture);
+    if (!victim.has_value())
+      return false;
+    setResidentLevel(cmd_buf, *victim, textures[*victim].residentLevel + 1, {});
+  }
+  return true;
+}
+
+void TextureStreamer::setResidentLevel(
+  vk::CommandBuffer cmd_buf, std::uint32_t texture_idx, std::uint32_t level, vk::Buffer staging)
+{
+  auto& texture = textures[texture_idx];
+  const std::uint32_t oldLevel = texture.residentLevel;
+  const auto levelCount = static_cast<std::uint32_t>(texture.data.levels.size());
+  const std::uint32_t width = texture.data.width;
+  const std::uint32_t height = texture.data.height;
+
+  // Only a single level is ever streamed in at a time
+  ETNA_VERIFY(level + 1 == oldLevel || level == oldLevel + 1);
+  ETNA_VERIFY(level > oldLevel || staging);
+
+  auto image = etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{level_extent(width, level), level_extent(height, level), 1},
+    .name = fmt::format("streamed_texture{}", texture_idx),
+    .format = baked_texture_vk_format(texture.data.format),
+    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst |
+      vk::ImageUsageFlagBits::eTransferSrc,
+    .mipLevels = levelCount - level,
+  });
+
+  etna::set_state(
+    cmd_buf,
+    texture.image.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead,
+    vk::ImageLayout::eTransferSrcOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::set_state(
+    cmd_buf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  std::vector<vk::ImageCopy> copies;
+  for (std::uint32_t l = std::max(level, oldLevel); l < levelCount; ++l)
+    copies.push_back(vk::ImageCopy{
+      .srcSubresource = color_level(l - oldLevel),
+      .srcOffset = vk::Offset3D{0, 0, 0},
+      .dstSubresource = color_level(l - level),
+      .dstOffset = vk::Offset3D{0, 0, 0},
+      .extent = vk::Extent3D{level_extent(width, l), level_extent(height, l), 1},
+    });
+  cmd_buf.copyImage(
+    texture.image.get(),
+    vk::ImageLayout::eTransferSrcOptimal,
+    image.get(),
+    vk::ImageLayout::eTransferDstOptimal,
+    static_cast<std::uint32_t>(copies.size()),
+    copies.data());
+
+  if (level < oldLevel)
+  {
+    const vk::BufferImageCopy region{
+      .bufferOffset = 0,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = color_level(0),
+      .imageOffset = vk::Offset3D{0, 0, 0},
+      .imageExtent = vk::Extent3D{level_extent(width, level), level_extent(height, level), 1},
+    };
+    cmd_buf.copyBufferToImage(
+      staging, image.get(), vk::ImageLayout::eTransferDstOptimal, 1, &region);
+    residentBytes += texture.data.levels[level].size();
+  }
+  else
+    residentBytes -= texture.data.levels[oldLevel].size();
+
+  etna::set_state(
+    cmd_buf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eFragmentShader,
+    vk::AccessFlagBits2::eShaderSampledRead,
+    vk::ImageLayout::eShaderReadOnlyOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  retired.push_back(Retired{.frame = frame, .image = std::move(texture.image), .staging = {}});
+  texture.image = std::move(image);
+  texture.residentLevel = level;
+}
+
+void TextureStreamer::waitForReads()
+{
+  std::unique_lock lock{completedMutex};
+  readCompleted.wait(lock, [&]() { return completedReads.size() == pendingReads; });
+  completedReads.clear();
+  pendingReads = 0;
+  for (auto& texture : textures)
+    texture.readPending = false;
+}
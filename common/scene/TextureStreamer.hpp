@@ -0,0 +1,163 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+
+#include "parallel/ThreadPool.hpp"
+#include "scene/BakedTexture.hpp"
+#include "scene/MappedFile.hpp"
+
+
+// Per texture entry of the feedback buffer, see static_mesh.frag of model_bakery
+struct TextureFeedback
+{
+  // Written by the CPU every frame: the level of the full mip chain
+  // that level 0 of the currently resident image corresponds to
+  std::uint32_t residentLevel;
+  // Written by shaders: the finest level of the full mip chain they wanted
+  // to sample during the frame, TEXTURE_NOT_SAMPLED if none
+  std::uint32_t requestedLevel;
+};
+
+inline constexpr std::uint32_t TEXTURE_NOT_SAMPLED = 0xFFFFFFFF;
+
+// Keeps baked textures (see BakedTexture.hpp) resident only down to the mip
+// levels that shaders actually sampled recently. Shaders report the finest
+// level they wanted per texture into a feedback buffer, which is read back
+// once the frame is done on the GPU. Finer levels are then read from disk on
+// a background thread, one level at a time. When the resident levels of all
+// textures would exceed the budget, the least recently sampled textures lose
+// their finest levels first.
+// Textures start with only their small levels resident, so a scene can
+// be rendered right after loading, just blurry for a few frames.
+// NOTE: there is no sparse residency here, an image is re-created with the
+// new level range instead, and the levels it keeps are copied over on the GPU.
+class TextureStreamer
+{
+public:
+  struct CreateInfo
+  {
+    // For all resident levels of all textures, not counting the small levels
+    // that are always resident
+    vk::DeviceSize budget = 256 * 1024 * 1024;
+    // Levels this size and smaller are loaded upfront and never evicted
+    std::uint32_t residentExtent = 64;
+    // Caps the hitch caused by uploads within a single frame
+    vk::DeviceSize maxUploadPerFrame = 16 * 1024 * 1024;
+    // Has to match etna's, feedback of a frame is read back this many frames later
+    std::uint32_t framesInFlight = 2;
+  };
+
+  explicit TextureStreamer(CreateInfo info);
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer&) = delete;
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+  TextureStreamer(TextureStreamer&&) = delete;
+  TextureStreamer& operator=(TextureStreamer&&) = delete;
+
+  // Replaces all textures. Paths that are empty or can't be loaded are skipped,
+  // the rest are indexed the same way as the paths.
+  void load(std::span<const std::filesystem::path> paths);
+
+  // Has to be called once per frame before anything samples streamed textures.
+  // Reads back the feedback of an older frame, records uploads of finished
+  // reads and evictions, requests new reads and resets the feedback buffer.
+  void update(vk::CommandBuffer cmd_buf);
+  // Has to be called once per frame after everything that samples streamed textures
+  void readBackFeedback(vk::CommandBuffer cmd_buf);
+
+  bool isStreamed(std::uint32_t texture) const;
+  // A white 1x1 image for textures that are not streamed
+  const etna::Image& getImage(std::uint32_t texture) const;
+  // TextureFeedback[texture count]
+  const etna::Buffer& getFeedbackBuffer() const { return feedback; }
+
+  vk::DeviceSize getResidentBytes() const { return residentBytes; }
+
+private:
+  struct Texture
+  {
+    MappedFile file;
+    // Views into the file
+    BakedTextureData data;
+    etna::Image image;
+    // Level of the full chain at level 0 of the image
+    std::uint32_t residentLevel = 0;
+    // Levels from this one on are always resident
+    std::uint32_t pinnedLevel = 0;
+    // Finest level requested by shaders the last time the texture was sampled
+    std::uint32_t wantedLevel = 0;
+    std::uint64_t lastSampledFrame = 0;
+    bool readPending = false;
+  };
+
+  struct CompletedRead
+  {
+    std::uint32_t texture;
+    std::uint32_t level;
+    std::vector<std::byte> bytes;
+  };
+
+  // Resources that frames still in flight might use
+  struct Retired
+  {
+    std::uint64_t frame;
+    etna::Image image;
+    etna::Buffer staging;
+  };
+
+  struct Readback
+  {
+    etna::Buffer buffer;
+    bool written = false;
+  };
+
+  void processFeedback();
+  void uploadCompletedReads(vk::CommandBuffer cmd_buf);
+  void requestReads();
+  void resetFeedback(vk::CommandBuffer cmd_buf);
+
+  std::optional<std::uint32_t> findEvictionVictim(std::uint32_t for_texture) const;
+  bool makeRoom(vk::CommandBuffer cmd_buf, vk::DeviceSize size, std::uint32_t for_texture);
+  // Re-creates the image with the new level range. Going finer takes the data
+  // of the new level from staging, going coarser just drops the finest level.
+  void setResidentLevel(
+    vk::CommandBuffer cmd_buf, std::uint32_t texture_idx, std::uint32_t level, vk::Buffer staging);
+  void waitForReads();
+
+private:
+  CreateInfo config;
+
+  std::vector<Texture> textures;
+  etna::Image fallback;
+  vk::DeviceSize residentBytes = 0;
+  std::uint64_t frame = 0;
+  // Textures are checked for reads round-robin from here
+  std::size_t nextReadCandidate = 0;
+
+  etna::Buffer feedback;
+  // One per frame in flight
+  std::vector<Readback> readbacks;
+
+  std::deque<Retired> retired;
+
+  std::size_t pendingReads = 0;
+  std::mutex completedMutex;
+  std::condition_variable readCompleted;
+  std::deque<CompletedRead> completedReads;
+
+  // Destroyed first, so that no read outlives the mappings
+  ThreadPool ioThread{1};
+};
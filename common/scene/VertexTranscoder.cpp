@@ -0,0 +1,487 @@
+#include "VertexTranscoder.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include <tiny_gltf.h>
+
+#include "octahedral.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCENE_TRANSCODER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_TRANSCODER_SSE2 1
+#endif
+
+
+namespace
+{
+
+constexpr std::uint32_t ATTR_NORMAL = 1u << 0;
+constexpr std::uint32_t ATTR_TANGENT = 1u << 1;
+constexpr std::uint32_t ATTR_TEXCOORD = 1u << 2;
+constexpr std::uint32_t ATTR_COMBINATIONS = 1u << 3;
+
+constexpr std::uint32_t NORMAL_BITS = octahedral::OCT_VERTEX_BITS;
+constexpr std::uint32_t TANGENT_BITS = octahedral::OCT_TANGENT_BITS;
+
+std::uint32_t encode_normal(const float (&normal)[3])
+{
+  return octahedral::oct_encode(glm::vec3{normal[0], normal[1], normal[2]}, NORMAL_BITS);
+}
+
+std::uint32_t encode_tangent(const float (&tangent)[4])
+{
+  return octahedral::oct_encode_tangent(glm::vec4{tangent[0], tangent[1], tangent[2], tangent[3]});
+}
+
+template <std::uint32_t Bits>
+constexpr float SNORM_SCALE = static_cast<float>((1u << (Bits - 1)) - 1);
+
+template <std::uint32_t Bits>
+constexpr std::int32_t SNORM_MASK = (1 << Bits) - 1;
+
+// glTF only allows float or normalized unsigned integer texcoords
+template <class TexcoordT>
+float load_texcoord(const std::byte* ptr)
+{
+  TexcoordT value;
+  std::memcpy(&value, ptr, sizeof(value));
+  if constexpr (std::is_same_v<TexcoordT, float>)
+    return value;
+  else
+    return static_cast<float>(value) *
+      (1.0f / static_cast<float>(std::numeric_limits<TexcoordT>::max()));
+}
+
+template <std::uint32_t Attributes, class TexcoordT>
+void transcode_scalar(
+  const VertexTranscodeJob& job, std::size_t first, std::size_t last, float* out)
+{
+  for (std::size_t i = first; i < last; ++i)
+  {
+    float* vtx = out + 8 * i;
+
+    // Fall back to 0 in case we don't have something.
+    // NOTE: if tangents are not available, one could use http://mikktspace.com/
+    // NOTE: if normals are not available, reconstructing them is possible but will look ugly
+    float normal[3] = {0, 0, 0};
+    float tangent[4] = {0, 0, 0, 0};
+    float texcoord[2] = {0, 0};
+
+    std::memcpy(vtx, job.position.data + i * job.position.stride, sizeof(float) * 3);
+    if constexpr ((Attributes & ATTR_NORMAL) != 0)
+      std::memcpy(normal, job.normal.data + i * job.normal.stride, sizeof(normal));
+    if constexpr ((Attributes & ATTR_TANGENT) != 0)
+      std::memcpy(tangent, job.tangent.data + i * job.tangent.stride, sizeof(tangent));
+    if constexpr ((Attributes & ATTR_TEXCOORD) != 0)
+    {
+      const std::byte* ptr = job.texcoord.data + i * job.texcoord.stride;
+      texcoord[0] = load_texcoord<TexcoordT>(ptr);
+      texcoord[1] = load_texcoord<TexcoordT>(ptr + sizeof(TexcoordT));
+    }
+
+    vtx[3] = std::bit_cast<float>(encode_normal(normal));
+    vtx[4] = texcoord[0];
+    vtx[5] = texcoord[1];
+    vtx[6] = std::bit_cast<float>(encode_tangent(tangent));
+    vtx[7] = 0;
+  }
+}
+
+#if defined(SCENE_TRANSCODER_AVX2)
+
+constexpr std::size_t SIMD_WIDTH = 8;
+
+__m256i lane_offsets(std::size_t stride)
+{
+  const auto s = static_cast<int>(stride);
+  return _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+}
+
+__m256 gather_floats(const std::byte* base, __m256i offsets)
+{
+  return _mm256_i32gather_ps(reinterpret_cast<const float*>(base), offsets, 1);
+}
+
+// -1 for negative lanes, 1 for everything else, including -0
+__m256 sign_not_zero(__m256 v)
+{
+  const __m256 negative = _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OQ);
+  return _mm256_or_ps(_mm256_and_ps(negative, _mm256_set1_ps(-0.0f)), _mm256_set1_ps(1.0f));
+}
+
+template <std::uint32_t Bits>
+__m256i quantize_snorm(__m256 v)
+{
+  v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+  v = _mm256_mul_ps(v, _mm256_set1_ps(SNORM_SCALE<Bits>));
+  const __m256 half = _mm256_mul_ps(sign_not_zero(v), _mm256_set1_ps(0.5f));
+  const __m256i result = _mm256_cvttps_epi32(_mm256_add_ps(v, half));
+  return _mm256_and_si256(result, _mm256_set1_epi32(SNORM_MASK<Bits>));
+}
+
+// Vectorized version of oct_encode, same results for finite inputs
+template <std::uint32_t Bits>
+__m256 encode_normals(__m256 x, __m256 y, __m256 z)
+{
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 zero = _mm256_setzero_ps();
+
+  const __m256 l1 = _mm256_add_ps(
+    _mm256_add_ps(_mm256_and_ps(x, absMask), _mm256_and_ps(y, absMask)),
+    _mm256_and_ps(z, absMask));
+  // Zero vectors end up at (0, 0) and don't get folded
+  const __m256 valid = _mm256_cmp_ps(l1, zero, _CMP_GT_OQ);
+  const __m256 px = _mm256_and_ps(_mm256_div_ps(x, l1), valid);
+  const __m256 py = _mm256_and_ps(_mm256_div_ps(y, l1), valid);
+
+  const __m256 lower = _mm256_and_ps(_mm256_cmp_ps(z, zero, _CMP_LT_OQ), valid);
+  const __m256 foldedX = _mm256_mul_ps(
+    _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_and_ps(py, absMask)), sign_not_zero(px));
+  const __m256 foldedY = _mm256_mul_ps(
+    _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_and_ps(px, absMask)), sign_not_zero(py));
+
+  const __m256i qx = quantize_snorm<Bits>(_mm256_blendv_ps(px, foldedX, lower));
+  const __m256i qy = quantize_snorm<Bits>(_mm256_blendv_ps(py, foldedY, lower));
+  return _mm256_castsi256_ps(_mm256_or_si256(qx, _mm256_slli_epi32(qy, Bits)));
+}
+
+// Vectorized version of encode_tangent. The sign bit of -0.0f is exactly
+// OCT_TANGENT_SIGN_BIT.
+__m256 encode_tangents(__m256 x, __m256 y, __m256 z, __m256 w)
+{
+  const __m256 negative = _mm256_cmp_ps(w, _mm256_setzero_ps(), _CMP_LT_OQ);
+  return _mm256_or_ps(
+    encode_normals<TANGENT_BITS>(x, y, z), _mm256_and_ps(negative, _mm256_set1_ps(-0.0f)));
+}
+
+// Rows are attributes of 8 vertices, after this they become 8 complete vertices
+void transpose_and_store(const __m256 (&rows)[8], float* out)
+{
+  const __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+  const __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+  const __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+  const __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+  const __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+  const __m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+  const __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+  const __m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+
+  const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+  _mm256_storeu_ps(out + 0, _mm256_permute2f128_ps(s0, s4, 0x20));
+  _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(s1, s5, 0x20));
+  _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(s2, s6, 0x20));
+  _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(s3, s7, 0x20));
+  _mm256_storeu_ps(out + 32, _mm256_permute2f128_ps(s0, s4, 0x31));
+  _mm256_storeu_ps(out + 40, _mm256_permute2f128_ps(s1, s5, 0x31));
+  _mm256_storeu_ps(out + 48, _mm256_permute2f128_ps(s2, s6, 0x31));
+  _mm256_storeu_ps(out + 56, _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+
+template <class TexcoordT>
+void load_texcoords(const VertexAttributeStream& stream, __m256i offsets, __m256& u, __m256& v)
+{
+  if constexpr (std::is_same_v<TexcoordT, float>)
+  {
+    u = gather_floats(stream.data, offsets);
+    v = gather_floats(stream.data + sizeof(float), offsets);
+  }
+  else if constexpr (std::is_same_v<TexcoordT, std::uint16_t>)
+  {
+    const __m256i packed =
+      _mm256_i32gather_epi32(reinterpret_cast<const int*>(stream.data), offsets, 1);
+    const __m256 scale = _mm256_set1_ps(1.0f / 65535.0f);
+    u = _mm256_mul_ps(
+      _mm256_cvtepi32_ps(_mm256_and_si256(packed, _mm256_set1_epi32(0xffff))), scale);
+    v = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(packed, 16)), scale);
+  }
+  else
+  {
+    // A 32-bit gather could read past the end of the buffer for byte texcoords
+    alignas(32) float us[SIMD_WIDTH];
+    alignas(32) float vs[SIMD_WIDTH];
+    for (std::size_t i = 0; i < SIMD_WIDTH; ++i)
+    {
+      const std::byte* ptr = stream.data + i * stream.stride;
+      us[i] = load_texcoord<TexcoordT>(ptr);
+      vs[i] = load_texcoord<TexcoordT>(ptr + sizeof(TexcoordT));
+    }
+    u = _mm256_load_ps(us);
+    v = _mm256_load_ps(vs);
+  }
+}
+
+template <std::uint32_t Attributes, class TexcoordT>
+std::size_t transcode_simd(const VertexTranscodeJob& job, float* out)
+{
+  const std::size_t batchCount = job.vertexCount / SIMD_WIDTH;
+
+  const __m256i positionOffsets = lane_offsets(job.position.stride);
+  const __m256i normalOffsets = lane_offsets(job.normal.stride);
+  const __m256i tangentOffsets = lane_offsets(job.tangent.stride);
+  const __m256i texcoordOffsets = lane_offsets(job.texcoord.stride);
+
+  const __m256 zero = _mm256_setzero_ps();
+
+  __m256 rows[8];
+  rows[3] = zero;
+  rows[4] = zero;
+  rows[5] = zero;
+  rows[6] = zero;
+  rows[7] = zero;
+
+  for (std::size_t batch = 0; batch < batchCount; ++batch)
+  {
+    const std::size_t first = batch * SIMD_WIDTH;
+
+    const std::byte* position = job.position.data + first * job.position.stride;
+    rows[0] = gather_floats(position, positionOffsets);
+    rows[1] = gather_floats(position + sizeof(float), positionOffsets);
+    rows[2] = gather_floats(position + 2 * sizeof(float), positionOffsets);
+
+    if constexpr ((Attributes & ATTR_NORMAL) != 0)
+    {
+      const std::byte* normal = job.normal.data + first * job.normal.stride;
+      rows[3] = encode_normals<NORMAL_BITS>(
+        gather_floats(normal, normalOffsets),
+        gather_floats(normal + sizeof(float), normalOffsets),
+        gather_floats(normal + 2 * sizeof(float), normalOffsets));
+    }
+
+    if constexpr ((Attributes & ATTR_TEXCOORD) != 0)
+    {
+      VertexAttributeStream texcoord = job.texcoord;
+      texcoord.data += first * texcoord.stride;
+      load_texcoords<TexcoordT>(texcoord, texcoordOffsets, rows[4], rows[5]);
+    }
+
+    if constexpr ((Attributes & ATTR_TANGENT) != 0)
+    {
+      const std::byte* tangent = job.tangent.data + first * job.tangent.stride;
+      rows[6] = encode_tangents(
+        gather_floats(tangent, tangentOffsets),
+        gather_floats(tangent + sizeof(float), tangentOffsets),
+        gather_floats(tangent + 2 * sizeof(float), tangentOffsets),
+        gather_floats(tangent + 3 * sizeof(float), tangentOffsets));
+    }
+
+    transpose_and_store(rows, out + 8 * first);
+  }
+
+  return batchCount * SIMD_WIDTH;
+}
+
+#elif defined(SCENE_TRANSCODER_SSE2)
+
+constexpr std::size_t SIMD_WIDTH = 4;
+
+float load_float(const std::byte* ptr)
+{
+  float result;
+  std::memcpy(&result, ptr, sizeof(result));
+  return result;
+}
+
+// SSE2 has no gathers, so we fill the registers lane by lane
+__m128 load_lanes(const std::byte* base, std::size_t stride)
+{
+  return _mm_setr_ps(
+    load_float(base),
+    load_float(base + stride),
+    load_float(base + 2 * stride),
+    load_float(base + 3 * stride));
+}
+
+// -1 for negative lanes, 1 for everything else, including -0
+__m128 sign_not_zero(__m128 v)
+{
+  const __m128 negative = _mm_cmplt_ps(v, _mm_setzero_ps());
+  return _mm_or_ps(_mm_and_ps(negative, _mm_set1_ps(-0.0f)), _mm_set1_ps(1.0f));
+}
+
+template <std::uint32_t Bits>
+__m128i quantize_snorm(__m128 v)
+{
+  v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+  v = _mm_mul_ps(v, _mm_set1_ps(SNORM_SCALE<Bits>));
+  const __m128 half = _mm_mul_ps(sign_not_zero(v), _mm_set1_ps(0.5f));
+  const __m128i result = _mm_cvttps_epi32(_mm_add_ps(v, half));
+  return _mm_and_si128(result, _mm_set1_epi32(SNORM_MASK<Bits>));
+}
+
+// SSE2 has no blendv
+__m128 select(__m128 mask, __m128 if_true, __m128 if_false)
+{
+  return _mm_or_ps(_mm_and_ps(mask, if_true), _mm_andnot_ps(mask, if_false));
+}
+
+// Vectorized version of oct_encode, same results for finite inputs
+template <std::uint32_t Bits>
+__m128 encode_normals(__m128 x, __m128 y, __m128 z)
+{
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 zero = _mm_setzero_ps();
+
+  const __m128 l1 = _mm_add_ps(
+    _mm_add_ps(_mm_and_ps(x, absMask), _mm_and_ps(y, absMask)), _mm_and_ps(z, absMask));
+  // Zero vectors end up at (0, 0) and don't get folded
+  const __m128 valid = _mm_cmpgt_ps(l1, zero);
+  const __m128 px = _mm_and_ps(_mm_div_ps(x, l1), valid);
+  const __m128 py = _mm_and_ps(_mm_div_ps(y, l1), valid);
+
+  const __m128 lower = _mm_and_ps(_mm_cmplt_ps(z, zero), valid);
+  const __m128 foldedX =
+    _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_and_ps(py, absMask)), sign_not_zero(px));
+  const __m128 foldedY =
+    _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_and_ps(px, absMask)), sign_not_zero(py));
+
+  const __m128i qx = quantize_snorm<Bits>(select(lower, foldedX, px));
+  const __m128i qy = quantize_snorm<Bits>(select(lower, foldedY, py));
+  return _mm_castsi128_ps(_mm_or_si128(qx, _mm_slli_epi32(qy, Bits)));
+}
+
+// Vectorized version of encode_tangent. The sign bit of -0.0f is exactly
+// OCT_TANGENT_SIGN_BIT.
+__m128 encode_tangents(__m128 x, __m128 y, __m128 z, __m128 w)
+{
+  const __m128 negative = _mm_cmplt_ps(w, _mm_setzero_ps());
+  return _mm_or_ps(encode_normals<TANGENT_BITS>(x, y, z), _mm_and_ps(negative, _mm_set1_ps(-0.0f)));
+}
+
+template <std::uint32_t Attributes, class TexcoordT>
+std::size_t transcode_simd(const VertexTranscodeJob& job, float* out)
+{
+  const std::size_t batchCount = job.vertexCount / SIMD_WIDTH;
+
+  for (std::size_t batch = 0; batch < batchCount; ++batch)
+  {
+    const std::size_t first = batch * SIMD_WIDTH;
+
+    const std::byte* position = job.position.data + first * job.position.stride;
+    __m128 px = load_lanes(position, job.position.stride);
+    __m128 py = load_lanes(position + sizeof(float), job.position.stride);
+    __m128 pz = load_lanes(position + 2 * sizeof(float), job.position.stride);
+    __m128 normal = _mm_setzero_ps();
+    __m128 u = _mm_setzero_ps();
+    __m128 v = _mm_setzero_ps();
+    __m128 tangent = _mm_setzero_ps();
+    __m128 padding = _mm_setzero_ps();
+
+    if constexpr ((Attributes & ATTR_NORMAL) != 0)
+    {
+      const std::byte* ptr = job.normal.data + first * job.normal.stride;
+      normal = encode_normals<NORMAL_BITS>(
+        load_lanes(ptr, job.normal.stride),
+        load_lanes(ptr + sizeof(float), job.normal.stride),
+        load_lanes(ptr + 2 * sizeof(float), job.normal.stride));
+    }
+
+    if constexpr ((Attributes & ATTR_TEXCOORD) != 0)
+    {
+      alignas(16) float us[SIMD_WIDTH];
+      alignas(16) float vs[SIMD_WIDTH];
+      for (std::size_t i = 0; i < SIMD_WIDTH; ++i)
+      {
+        const std::byte* ptr = job.texcoord.data + (first + i) * job.texcoord.stride;
+        us[i] = load_texcoord<TexcoordT>(ptr);
+        vs[i] = load_texcoord<TexcoordT>(ptr + sizeof(TexcoordT));
+      }
+      u = _mm_load_ps(us);
+      v = _mm_load_ps(vs);
+    }
+
+    if constexpr ((Attributes & ATTR_TANGENT) != 0)
+    {
+      const std::byte* ptr = job.tangent.data + first * job.tangent.stride;
+      tangent = encode_tangents(
+        load_lanes(ptr, job.tangent.stride),
+        load_lanes(ptr + sizeof(float), job.tangent.stride),
+        load_lanes(ptr + 2 * sizeof(float), job.tangent.stride),
+        load_lanes(ptr + 3 * sizeof(float), job.tangent.stride));
+    }
+
+    _MM_TRANSPOSE4_PS(px, py, pz, normal);
+    _MM_TRANSPOSE4_PS(u, v, tangent, padding);
+
+    float* vtx = out + 8 * first;
+    _mm_storeu_ps(vtx + 0, px);
+    _mm_storeu_ps(vtx + 4, u);
+    _mm_storeu_ps(vtx + 8, py);
+    _mm_storeu_ps(vtx + 12, v);
+    _mm_storeu_ps(vtx + 16, pz);
+    _mm_storeu_ps(vtx + 20, tangent);
+    _mm_storeu_ps(vtx + 24, normal);
+    _mm_storeu_ps(vtx + 28, padding);
+  }
+
+  return batchCount * SIMD_WIDTH;
+}
+
+#endif
+
+template <std::uint32_t Attributes, class TexcoordT>
+void transcode(const VertexTranscodeJob& job, float* out)
+{
+  std::size_t done = 0;
+#if defined(SCENE_TRANSCODER_AVX2) || defined(SCENE_TRANSCODER_SSE2)
+  done = transcode_simd<Attributes, TexcoordT>(job, out);
+#endif
+  transcode_scalar<Attributes, TexcoordT>(job, done, job.vertexCount, out);
+}
+
+using TranscodeFunction = void (*)(const VertexTranscodeJob&, float*);
+
+template <class TexcoordT, std::size_t... Combinations>
+constexpr std::array<TranscodeFunction, sizeof...(Combinations)> make_transcoder_table(
+  std::index_sequence<Combinations...>)
+{
+  return {&transcode<static_cast<std::uint32_t>(Combinations), TexcoordT>...};
+}
+
+constexpr auto FLOAT_TEXCOORD_TRANSCODERS =
+  make_transcoder_table<float>(std::make_index_sequence<ATTR_COMBINATIONS>{});
+constexpr auto USHORT_TEXCOORD_TRANSCODERS =
+  make_transcoder_table<std::uint16_t>(std::make_index_sequence<ATTR_COMBINATIONS>{});
+constexpr auto UBYTE_TEXCOORD_TRANSCODERS =
+  make_transcoder_table<std::uint8_t>(std::make_index_sequence<ATTR_COMBINATIONS>{});
+
+} // namespace
+
+void transcode_vertices(const VertexTranscodeJob& job, float* out)
+{
+  std::uint32_t attributes = 0;
+  if (job.normal.data != nullptr)
+    attributes |= ATTR_NORMAL;
+  if (job.tangent.data != nullptr)
+    attributes |= ATTR_TANGENT;
+  if (job.texcoord.data != nullptr)
+    attributes |= ATTR_TEXCOORD;
+
+  switch (job.texcoord.componentType)
+  {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    USHORT_TEXCOORD_TRANSCODERS[attributes](job, out);
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    UBYTE_TEXCOORD_TRANSCODERS[attributes](job, out);
+    break;
+  default:
+    FLOAT_TEXCOORD_TRANSCODERS[attributes](job, out);
+    break;
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Converts (almost) arbitrary glTF vertex attribute streams into the
+// interleaved 32-byte vertex format used by SceneManager, i.e.
+// float3 position, packed normal, float2 texcoord, packed tangent, padding.
+// Normals are packed with octahedral::oct_encode, tangents along with their
+// handedness with octahedral::oct_encode_tangent.
+// The attribute set and the texcoord component type are resolved once per
+// primitive, after which a fully specialized SIMD kernel does the work.
+
+struct VertexAttributeStream
+{
+  // nullptr means that the attribute is missing and should be zero-filled
+  const std::byte* data = nullptr;
+  std::size_t stride = 0;
+  // One of TINYGLTF_COMPONENT_TYPE_*
+  int componentType = 0;
+};
+
+struct VertexTranscodeJob
+{
+  std::size_t vertexCount = 0;
+
+  VertexAttributeStream position;
+  VertexAttributeStream normal;
+  VertexAttributeStream tangent;
+  VertexAttributeStream texcoord;
+};
+
+// Writes job.vertexCount vertices, 8 floats each, to `out`.
+void transcode_vertices(const VertexTranscodeJob& job, float* out);
@@ -166,7 +166,7 @@ void WorldRenderer::renderScene(
     return;
 
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+  std::optional<IndexFormat> boundIndexFormat;
 
   pushConst2M.projView = glob_tm;
 
@@ -189,6 +189,11 @@ void WorldRenderer::renderScene(
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
+      if (relem.indexFormat != boundIndexFormat)
+      {
+        sceneMgr->bindIndexBuffer(cmd_buf, relem.indexFormat);
+        boundIndexFormat = relem.indexFormat;
+      }
       cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
     }
   }
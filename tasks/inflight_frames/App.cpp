@@ -7,7 +7,10 @@
 #include <etna/RenderTargetStates.hpp>
 #include <etna/BlockingTransferHelper.hpp>
 #include <etna/Profiling.hpp>
+#include <spdlog/spdlog.h>
 #include "stb_image.h"
+#include "scene/BakedTexture.hpp"
+#include "scene/MappedFile.hpp"
 
 static glm::mat3 yaw(float angle)
 {
@@ -24,6 +27,26 @@ static glm::mat3 pitch(float angle)
 
 void App::uploadTexture()
 {
+  // Block-compressed with a full mip chain by model_bakery_baker,
+  // so there is nothing to decode and a lot less to upload
+  const std::filesystem::path bakedPath =
+    GRAPHICS_COURSE_RESOURCES_ROOT "/textures/brass_baked.tex";
+  if (std::filesystem::exists(bakedPath))
+  {
+    MappedFile file{bakedPath};
+    auto texture = parse_baked_texture(file.getData());
+    if (texture.has_value() && is_baked_texture_format_supported(texture->format))
+    {
+      brassTexture = upload_baked_texture(*texture, "brassTexture");
+      return;
+    }
+  }
+
+  spdlog::warn(
+    "{} is missing, invalid or unsupported by the GPU, loading the uncompressed "
+    "brass.png instead. It is baked as a part of the inflight_frames build.",
+    bakedPath.string());
+
   int x, y, n;
   auto maybeData = stbi_load(GRAPHICS_COURSE_RESOURCES_ROOT "/textures/brass.png", &x, &y, &n, 4);
   assert(maybeData != nullptr && "couldn't read brass texture\n");
@@ -33,7 +56,8 @@ void App::uploadTexture()
   brassTexture = etna::get_context().createImage(etna::Image::CreateInfo{
     .extent = vk::Extent3D{static_cast<uint32_t>(x), static_cast<uint32_t>(y), 1},
     .name = "brassTexture",
-    .format = vk::Format::eR8G8B8A8Unorm,
+    // Same color space as the baked BC1/BC7 sRGB texture
+    .format = vk::Format::eR8G8B8A8Srgb,
     .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
   });
   helper.uploadImage(
@@ -84,6 +108,8 @@ App::App()
       .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
       .instanceExtensions = instanceExtensions,
       .deviceExtensions = deviceExtensions,
+      // For the baked brass texture
+      .features = vk::PhysicalDeviceFeatures2{.features = {.textureCompressionBC = true}},
       // Replace with an index if etna detects your preferred GPU incorrectly
       .physicalDeviceIndexOverride = {},
       .numFramesInFlight = static_cast<uint32_t>(workCount.multiBufferingCount()),
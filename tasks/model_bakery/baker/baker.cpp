@@ -1,15 +1,53 @@
 #include "baker.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
 #include <stack>
+#include <string_view>
+#include <unordered_map>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
 #include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/OneShotCmdMgr.hpp>
 #include <fstream>
 
+#include "cache.hpp"
+#include "meshlets.hpp"
+#include "octahedral.h"
+#include "optimizer.hpp"
+#include "sectors.hpp"
+#include "simplifier.hpp"
+#include "textures.hpp"
+#include "scene/BakedScene.hpp"
+#include "scene/BakedWorld.hpp"
+#include "scene/Bounds.hpp"
+#include "scene/Materials.hpp"
+#include "scene/SceneInstances.hpp"
+
+
+// Bump whenever the outputs change for the same inputs and options
+// without BAKED_SCENE_VERSION changing, so that stale bakes get redone
+static constexpr std::uint32_t BAKER_VERSION = 6;
+
+Baker::Baker()
+  : ownWorkers{std::make_unique<ThreadPool>()}
+  , workers{*ownWorkers}
+{
+}
+
+Baker::Baker(ThreadPool& shared_workers)
+  : workers{shared_workers}
+{
+}
 
 std::optional<tinygltf::Model> Baker::loadModel(std::filesystem::path path)
 {
@@ -48,25 +86,91 @@ std::optional<tinygltf::Model> Baker::loadModel(std::filesystem::path path)
   return model;
 }
 
-static std::uint32_t encode_normal(glm::vec4 normal)
+static std::uint32_t encode_normal(glm::vec3 normal)
 {
+  return octahedral::oct_encode(normal, octahedral::OCT_VERTEX_BITS);
+}
 
-  const int8_t x = static_cast<int8_t>(round(normal.x * 127.0));
-  const int8_t y = static_cast<int8_t>(round(normal.y * 127.0));
-  const int8_t z = static_cast<int8_t>(round(normal.z * 127.0));
-  const int8_t w = static_cast<int8_t>(round(normal.w * 127.0));
+// Handedness (the w component) ends up in the top bit
+static std::uint32_t encode_tangent(glm::vec4 tangent)
+{
+  return octahedral::oct_encode_tangent(tangent);
+}
 
-  int8_t arr[4] = {x, y, z, w};
+// Octahedral normals and tangents can't be described by glTF accessors,
+// so the inspection glTF gets decoded copies of them
+struct DecodedNormalTangent
+{
+  glm::vec3 normal;
+  glm::vec4 tangent;
+};
 
-  auto res = std::bit_cast<uint32_t>(arr);
+static_assert(sizeof(DecodedNormalTangent) == sizeof(float) * 7);
 
-  return res;
+static DecodedNormalTangent decode_normal_tangent(
+  glm::vec4 position_and_normal, glm::vec4 tex_coord_and_tangent)
+{
+  return DecodedNormalTangent{
+    .normal = octahedral::oct_decode(
+      std::bit_cast<std::uint32_t>(position_and_normal.w), octahedral::OCT_VERTEX_BITS),
+    .tangent =
+      octahedral::oct_decode_tangent(std::bit_cast<std::uint32_t>(tex_coord_and_tangent.z)),
+  };
 }
 
-static std::uint32_t encode_normal(glm::vec3 normal)
+// Angular error of the normal encoding at every supported precision,
+// so that it's clear what changing OCT_VERTEX_BITS would cost
+struct NormalEncodingError
 {
-  return encode_normal(glm::vec4{normal, 0});
-}
+  static constexpr std::array<std::uint32_t, 3> BITS = {
+    octahedral::OCT_BITS_8, octahedral::OCT_BITS_10, octahedral::OCT_BITS_16};
+
+  std::array<double, BITS.size()> maxDegrees{};
+  std::array<double, BITS.size()> sumDegrees{};
+  std::size_t count = 0;
+
+  void add(glm::vec3 normal)
+  {
+    const float length = glm::length(normal);
+    if (!(length > 0))
+      return;
+    normal /= length;
+
+    for (std::size_t i = 0; i < BITS.size(); ++i)
+    {
+      const glm::dvec3 a{normal};
+      const glm::dvec3 b{octahedral::oct_decode(octahedral::oct_encode(normal, BITS[i]), BITS[i])};
+      // Unlike acos of the dot product, this is accurate for tiny angles
+      const double degrees =
+        glm::degrees(std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+      maxDegrees[i] = std::max(maxDegrees[i], degrees);
+      sumDegrees[i] += degrees;
+    }
+    ++count;
+  }
+
+  NormalEncodingError& operator+=(const NormalEncodingError& other)
+  {
+    for (std::size_t i = 0; i < BITS.size(); ++i)
+    {
+      maxDegrees[i] = std::max(maxDegrees[i], other.maxDegrees[i]);
+      sumDegrees[i] += other.sumDegrees[i];
+    }
+    count += other.count;
+    return *this;
+  }
+
+  void log() const
+  {
+    for (std::size_t i = 0; i < BITS.size(); ++i)
+      spdlog::info(
+        "Octahedral normals, {} bits{}: max error {:.4f} deg, mean {:.4f} deg",
+        2 * BITS[i],
+        BITS[i] == octahedral::OCT_VERTEX_BITS ? " (used)" : "",
+        maxDegrees[i],
+        count == 0 ? 0.0 : sumDegrees[i] / count);
+  }
+};
 
 void Baker::ProcessAttribute(
   const tinygltf::Model& model, int accessor_ind, std::span<Vertex> vertices, auto setter) const
@@ -86,7 +190,7 @@ void Baker::ProcessAttribute(
   }
 }
 
-static void updateMinMax(RenderElement& relem, glm::vec3 curr)
+static void updateMinMax(RawRenderElement& relem, glm::vec3 curr)
 {
   for (uint32_t i = 0; i < 3; ++i)
   {
@@ -96,48 +200,87 @@ static void updateMinMax(RenderElement& relem, glm::vec3 curr)
 }
 
 
-Baker::ProcessedMeshes Baker::processMeshes(const tinygltf::Model& model) const
+// Bytes per index, 0 for component types glTF doesn't allow for indices
+static std::size_t index_component_size(int component_type)
 {
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return sizeof(std::uint8_t);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return sizeof(std::uint16_t);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return sizeof(std::uint32_t);
+  default:
+    return 0;
+  }
+}
 
-  ProcessedMeshes result;
-  // Pre-allocate enough memory so as not to hit the
-  // allocator on the memcpy hotpath
+// Whether the indices of the primitive are of a supported type
+// and entirely within their buffer
+static bool indices_readable(const tinygltf::Model& model, const tinygltf::Primitive& prim)
+{
+  if (prim.indices < 0 || static_cast<std::size_t>(prim.indices) >= model.accessors.size())
   {
-    std::size_t vertexBytes = 0;
-    std::size_t indexBytes = 0;
-    for (const auto& bufView : model.bufferViews)
-    {
-      switch (bufView.target)
-      {
-      case TINYGLTF_TARGET_ARRAY_BUFFER:
-        vertexBytes += bufView.byteLength;
-        break;
-      case TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER:
-        indexBytes += bufView.byteLength;
-        break;
-      default:
-        break;
-      }
-    }
-    result.vertices.reserve(vertexBytes / sizeof(Vertex));
-    result.indices.reserve(indexBytes / sizeof(std::uint32_t));
+    spdlog::error("glTF: non-indexed primitives are not supported");
+    return false;
+  }
+
+  const auto& accessor = model.accessors[prim.indices];
+  const std::size_t indexSize = index_component_size(accessor.componentType);
+  if (indexSize == 0)
+  {
+    spdlog::error("glTF: unsupported index component type {}", accessor.componentType);
+    return false;
+  }
+
+  if (
+    accessor.bufferView < 0 ||
+    static_cast<std::size_t>(accessor.bufferView) >= model.bufferViews.size())
+  {
+    spdlog::error("glTF: index accessor {} has no buffer view", prim.indices);
+    return false;
   }
 
+  const auto& bufView = model.bufferViews[accessor.bufferView];
+  if (
+    bufView.buffer < 0 || static_cast<std::size_t>(bufView.buffer) >= model.buffers.size() ||
+    bufView.byteOffset + accessor.byteOffset + accessor.count * indexSize >
+      model.buffers[bufView.buffer].data.size())
+  {
+    spdlog::error("glTF: index accessor {} is out of the bounds of its buffer", prim.indices);
+    return false;
+  }
+
+  return true;
+}
+
+std::optional<Baker::ProcessedMeshes> Baker::processMeshes(const tinygltf::Model& model) const
+{
+  ProcessedMeshes result;
+
+  std::vector<const tinygltf::Primitive*> relemPrimitives;
   {
     std::size_t totalPrimitives = 0;
     for (const auto& mesh : model.meshes)
       totalPrimitives += mesh.primitives.size();
     result.relems.reserve(totalPrimitives);
+    relemPrimitives.reserve(totalPrimitives);
   }
 
   result.meshes.reserve(model.meshes.size());
 
-
+  // Ranges of all relems are laid out upfront, so that the meshes can
+  // then be decoded in parallel straight into their final place
+  std::size_t totalVertices = 0;
+  std::size_t totalIndices = 0;
   for (const auto& mesh : model.meshes)
   {
     result.meshes.push_back(Mesh{
       .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
       .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
+      .box = {},
+      .sphere = {},
     });
 
     for (const auto& prim : mesh.primitives)
@@ -159,11 +302,15 @@ Baker::ProcessedMeshes Baker::processMeshes(const tinygltf::Model& model) const
         continue;
       }
 
-      result.relems.push_back(RenderElement{
-        .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
+      if (!indices_readable(model, prim))
+        return std::nullopt;
+
+      result.relems.push_back(RawRenderElement{
+        .vertexOffset = static_cast<std::uint32_t>(totalVertices),
         .vertexCount = static_cast<std::uint32_t>(model.accessors[pos_iter->second].count),
-        .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
+        .indexOffset = static_cast<std::uint32_t>(totalIndices),
         .indexCount = static_cast<std::uint32_t>(model.accessors[prim.indices].count),
+        .indexFormat = IndexFormat::Uint32,
         .posMax =
           {std::numeric_limits<double>::lowest(), // fuck numeric limits
            std::numeric_limits<double>::lowest(),
@@ -171,21 +318,43 @@ Baker::ProcessedMeshes Baker::processMeshes(const tinygltf::Model& model) const
         .posMin = {
           std::numeric_limits<double>::max(),
           std::numeric_limits<double>::max(),
-          std::numeric_limits<double>::max()}});
+          std::numeric_limits<double>::max()},
+        .firstLod = 0,
+        .lodCount = 0,
+        .duplicateOf = std::nullopt,
+        .baseColorImage = base_color_image(model, prim)});
+      relemPrimitives.push_back(&prim);
+
+      totalVertices += result.relems.back().vertexCount;
+      totalIndices += result.relems.back().indexCount;
+    }
+  }
+
+  result.vertices.resize(totalVertices);
+  result.indices.resize(totalIndices);
 
-      const std::size_t vertexCount = model.accessors[pos_iter->second].count;
+  std::vector<NormalEncodingError> meshNormalErrors(result.meshes.size());
 
-      result.vertices.resize(result.vertices.size() + vertexCount);
-      auto vertexSpan = std::span(result.vertices).last(vertexCount);
+  workers.parallelFor(result.meshes.size(), [&](std::size_t meshIdx) {
+    const auto& mesh = result.meshes[meshIdx];
+    auto& normalError = meshNormalErrors[meshIdx];
+
+    for (std::uint32_t relemIdx = mesh.firstRelem; relemIdx < mesh.firstRelem + mesh.relemCount;
+         ++relemIdx)
+    {
+      auto& relem = result.relems[relemIdx];
+      const auto& prim = *relemPrimitives[relemIdx];
+      auto vertexSpan = std::span(result.vertices).subspan(relem.vertexOffset, relem.vertexCount);
 
       for (const auto& [attr_type, index] : prim.attributes)
       {
         if (attr_type == "NORMAL")
         {
-          ProcessAttribute(model, index, vertexSpan, [](Vertex& vtx, const std::byte* ptr) {
+          ProcessAttribute(model, index, vertexSpan, [&](Vertex& vtx, const std::byte* ptr) {
             glm::vec3 normal{0};
             std::memcpy(&normal, ptr, sizeof(normal));
             vtx.positionAndNormal.w = std::bit_cast<float>(encode_normal(normal));
+            normalError.add(normal);
           });
         }
         else if (attr_type == "TANGENT")
@@ -193,7 +362,7 @@ Baker::ProcessedMeshes Baker::processMeshes(const tinygltf::Model& model) const
           ProcessAttribute(model, index, vertexSpan, [](Vertex& vtx, const std::byte* ptr) {
             glm::vec4 tangent{0};
             std::memcpy(&tangent, ptr, sizeof(tangent));
-            vtx.texCoordAndTangentAndPadding.z = std::bit_cast<float>(encode_normal(tangent));
+            vtx.texCoordAndTangentAndPadding.z = std::bit_cast<float>(encode_tangent(tangent));
           });
         }
         else if (attr_type == "TEXCOORD_0")
@@ -213,7 +382,7 @@ Baker::ProcessedMeshes Baker::processMeshes(const tinygltf::Model& model) const
             vtx.positionAndNormal.x = pos.x; // bit ugly, but it will do
             vtx.positionAndNormal.y = pos.y;
             vtx.positionAndNormal.z = pos.z;
-            updateMinMax(result.relems.back(), pos);
+            updateMinMax(relem, pos);
           });
         }
         else
@@ -224,31 +393,418 @@ Baker::ProcessedMeshes Baker::processMeshes(const tinygltf::Model& model) const
 
       auto& index_accessor = model.accessors[prim.indices];
 
-      const std::size_t indexCount = index_accessor.count;
+      auto indexSpan = std::span(result.indices).subspan(relem.indexOffset, relem.indexCount);
       auto& bufView = model.bufferViews[index_accessor.bufferView];
       auto ptr = reinterpret_cast<const std::byte*>(model.buffers[bufView.buffer].data.data()) +
         bufView.byteOffset + index_accessor.byteOffset;
 
-      if (index_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
-      {
-        for (std::size_t i = 0; i < indexCount; ++i)
+      // Component types are checked by indices_readable
+      auto widen = [&]<class Index>() {
+        for (auto& index : indexSpan)
         {
-          std::uint16_t index;
-          std::memcpy(&index, ptr, sizeof(index));
-          result.indices.push_back(index);
-          ptr += 2;
+          Index narrow;
+          std::memcpy(&narrow, ptr, sizeof(narrow));
+          index = narrow;
+          ptr += sizeof(narrow);
         }
-      }
+      };
+      if (index_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE)
+        widen.template operator()<std::uint8_t>();
+      else if (index_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
+        widen.template operator()<std::uint16_t>();
       else
+        std::memcpy(indexSpan.data(), ptr, indexSpan.size_bytes());
+
+      // Invalid in glTF anyway, but baked scenes promise that indices stay
+      // below the relem's vertex count, which is all the loader checks
+      const auto outOfRange = [&](std::uint32_t idx) { return idx >= relem.vertexCount; };
+      if (std::ranges::any_of(indexSpan, outOfRange))
       {
-        const std::size_t lastTotalIndices = result.indices.size();
-        result.indices.resize(lastTotalIndices + indexCount);
-        std::memcpy(
-          result.indices.data() + lastTotalIndices, ptr, sizeof(result.indices[0]) * indexCount);
+        spdlog::warn("Relem {} has out of range indices, zeroing them", relemIdx);
+        std::ranges::replace_if(indexSpan, outOfRange, 0u);
+        if (relem.vertexCount == 0)
+          relem.indexCount = 0;
       }
     }
+  });
+
+  NormalEncodingError normalError;
+  for (const auto& meshError : meshNormalErrors)
+    normalError += meshError;
+  normalError.log();
+
+  return result;
+}
+
+static std::size_t hash_bytes(std::span<const std::byte> bytes)
+{
+  return std::hash<std::string_view>{}(
+    std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+}
+
+void Baker::deduplicateMeshes(ProcessedMeshes& processed)
+{
+  struct VertexHash
+  {
+    std::size_t operator()(const Vertex& vtx) const
+    {
+      return hash_bytes(std::as_bytes(std::span{&vtx, 1}));
+    }
+  };
+
+  struct VertexEqual
+  {
+    bool operator()(const Vertex& a, const Vertex& b) const
+    {
+      return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+  };
+
+  const std::size_t bytesBefore = processed.vertices.size() * sizeof(Vertex) +
+    processed.indices.size() * sizeof(std::uint32_t);
+
+  // Every relem keeps the first occurrence of each distinct vertex,
+  // indices are rewritten in place
+  std::vector<std::vector<Vertex>> welded(processed.relems.size());
+  workers.parallelFor(processed.relems.size(), [&](std::size_t relemIdx) {
+    const auto& relem = processed.relems[relemIdx];
+    auto indices = std::span(processed.indices).subspan(relem.indexOffset, relem.indexCount);
+    const auto vertices =
+      std::span(processed.vertices).subspan(relem.vertexOffset, relem.vertexCount);
+
+    auto& unique = welded[relemIdx];
+    if (std::ranges::any_of(indices, [&](std::uint32_t idx) { return idx >= vertices.size(); }))
+    {
+      spdlog::warn("Relem {} has out of range indices, not welding it", relemIdx);
+      unique.assign(vertices.begin(), vertices.end());
+      return;
+    }
+
+    std::unordered_map<Vertex, std::uint32_t, VertexHash, VertexEqual> firstOccurrence;
+    firstOccurrence.reserve(vertices.size());
+    std::vector<std::uint32_t> remap(vertices.size());
+    for (std::size_t v = 0; v < vertices.size(); ++v)
+    {
+      const auto [it, inserted] =
+        firstOccurrence.try_emplace(vertices[v], static_cast<std::uint32_t>(unique.size()));
+      if (inserted)
+        unique.push_back(vertices[v]);
+      remap[v] = it->second;
+    }
+
+    for (auto& idx : indices)
+      idx = remap[idx];
+  });
+
+  auto relemIndices = [&](std::size_t relemIdx) {
+    const auto& relem = processed.relems[relemIdx];
+    return std::span(processed.indices).subspan(relem.indexOffset, relem.indexCount);
+  };
+
+  std::vector<std::size_t> relemHashes(processed.relems.size());
+  workers.parallelFor(processed.relems.size(), [&](std::size_t relemIdx) {
+    relemHashes[relemIdx] = hash_bytes(std::as_bytes(std::span{welded[relemIdx]})) * 31 +
+      hash_bytes(std::as_bytes(relemIndices(relemIdx)));
+  });
+
+  // Same geometry under different glTF meshes, e.g. copies of a prop that
+  // the exporter didn't instance. Welding is deterministic, so identical
+  // primitives are still identical after it.
+  std::unordered_map<std::size_t, std::vector<std::uint32_t>> relemsByHash;
+  std::size_t duplicateCount = 0;
+  for (std::uint32_t relemIdx = 0; relemIdx < processed.relems.size(); ++relemIdx)
+  {
+    auto& candidates = relemsByHash[relemHashes[relemIdx]];
+    const auto original = std::ranges::find_if(candidates, [&](std::uint32_t other) {
+      return std::ranges::equal(welded[other], welded[relemIdx], VertexEqual{}) &&
+        std::ranges::equal(relemIndices(other), relemIndices(relemIdx));
+    });
+
+    if (original == candidates.end())
+      candidates.push_back(relemIdx);
+    else
+    {
+      processed.relems[relemIdx].duplicateOf = *original;
+      ++duplicateCount;
+    }
+  }
+
+  std::vector<Vertex> vertices;
+  std::vector<std::uint32_t> indices;
+  vertices.reserve(processed.vertices.size());
+  indices.reserve(processed.indices.size());
+  std::size_t weldedCount = 0;
+  for (std::size_t relemIdx = 0; relemIdx < processed.relems.size(); ++relemIdx)
+  {
+    auto& relem = processed.relems[relemIdx];
+    if (relem.duplicateOf.has_value())
+    {
+      const auto& original = processed.relems[*relem.duplicateOf];
+      relem.vertexOffset = original.vertexOffset;
+      relem.vertexCount = original.vertexCount;
+      relem.indexOffset = original.indexOffset;
+      continue;
+    }
+
+    weldedCount += relem.vertexCount - welded[relemIdx].size();
+
+    const auto src = relemIndices(relemIdx);
+    relem.indexOffset = static_cast<std::uint32_t>(indices.size());
+    indices.insert(indices.end(), src.begin(), src.end());
+
+    relem.vertexOffset = static_cast<std::uint32_t>(vertices.size());
+    relem.vertexCount = static_cast<std::uint32_t>(welded[relemIdx].size());
+    vertices.insert(vertices.end(), welded[relemIdx].begin(), welded[relemIdx].end());
+  }
+
+  processed.vertices = std::move(vertices);
+  processed.indices = std::move(indices);
+
+  const std::size_t bytesAfter = processed.vertices.size() * sizeof(Vertex) +
+    processed.indices.size() * sizeof(std::uint32_t);
+  spdlog::info(
+    "Welded {} vertices, {} of {} relems are duplicates, geometry data: {} -> {} bytes ({} saved)",
+    weldedCount,
+    duplicateCount,
+    processed.relems.size(),
+    bytesBefore,
+    bytesAfter,
+    bytesBefore - bytesAfter);
+}
+
+void Baker::optimizeMeshes(const tinygltf::Model& model, ProcessedMeshes& processed)
+{
+  struct RelemStats
+  {
+    VertexCacheStats before;
+    VertexCacheStats after;
+  };
+
+  std::vector<RelemStats> stats(processed.relems.size());
+
+  // Relems own disjoint ranges of both buffers, except for duplicates,
+  // which get optimized along with their originals
+  workers.parallelFor(processed.relems.size(), [&](std::size_t relemIdx) {
+    const auto& relem = processed.relems[relemIdx];
+    if (relem.duplicateOf.has_value())
+      return;
+
+    auto indices = std::span(processed.indices).subspan(relem.indexOffset, relem.indexCount);
+    auto vertices = std::span(processed.vertices).subspan(relem.vertexOffset, relem.vertexCount);
+
+    if (std::ranges::any_of(indices, [&](std::uint32_t idx) { return idx >= vertices.size(); }))
+    {
+      spdlog::warn("Relem {} has out of range indices, not optimizing it", relemIdx);
+      return;
+    }
+
+    stats[relemIdx].before = analyze_vertex_cache(indices, vertices.size());
+
+    const auto clusters = optimize_vertex_cache(indices, vertices.size());
+
+    // Overdraw sorting breaks the cache at cluster boundaries. That is
+    // almost free by construction, but keep the plain order if it isn't.
+    {
+      const std::vector<std::uint32_t> cacheOptimal(indices.begin(), indices.end());
+      const float cacheOptimalAcmr = analyze_vertex_cache(cacheOptimal, vertices.size()).acmr();
+
+      optimize_overdraw(
+        indices,
+        clusters,
+        reinterpret_cast<const float*>(vertices.data()),
+        sizeof(Vertex) / sizeof(float));
+
+      if (analyze_vertex_cache(indices, vertices.size()).acmr() > cacheOptimalAcmr * 1.05f)
+        std::ranges::copy(cacheOptimal, indices.begin());
+    }
+
+    {
+      const auto remap = optimize_vertex_fetch(indices, vertices.size());
+      const std::vector<Vertex> original(vertices.begin(), vertices.end());
+      for (std::size_t v = 0; v < original.size(); ++v)
+        vertices[remap[v]] = original[v];
+    }
+
+    stats[relemIdx].after = analyze_vertex_cache(indices, vertices.size());
+  });
+
+  for (std::size_t meshIdx = 0; meshIdx < processed.meshes.size(); ++meshIdx)
+  {
+    const auto& mesh = processed.meshes[meshIdx];
+    if (mesh.relemCount == 0)
+      continue;
+
+    RelemStats total;
+    for (std::uint32_t i = mesh.firstRelem; i < mesh.firstRelem + mesh.relemCount; ++i)
+    {
+      total.before += stats[i].before;
+      total.after += stats[i].after;
+    }
+
+    spdlog::info(
+      "Mesh {} '{}': ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+      meshIdx,
+      model.meshes[meshIdx].name,
+      total.before.acmr(),
+      total.after.acmr(),
+      total.before.atvr(),
+      total.after.atvr());
+  }
+}
+
+void Baker::generateLods(ProcessedMeshes& processed)
+{
+  if (lodRatios.empty())
+    return;
+
+  std::vector<std::vector<SimplifiedIndices>> relemLods(processed.relems.size());
+
+  workers.parallelFor(processed.relems.size(), [&](std::size_t relemIdx) {
+    const auto& relem = processed.relems[relemIdx];
+    if (relem.duplicateOf.has_value())
+      return;
+
+    const auto indices =
+      std::span(processed.indices).subspan(relem.indexOffset, relem.indexCount);
+    if (std::ranges::any_of(indices, [&](std::uint32_t idx) { return idx >= relem.vertexCount; }))
+      return;
+
+    const auto* vertices =
+      reinterpret_cast<const float*>(processed.vertices.data() + relem.vertexOffset);
+    const std::size_t triangleCount = indices.size() / 3;
+
+    // Every level is simplified from the previous one, which is both faster
+    // and guarantees that the errors never decrease along the chain
+    relemLods[relemIdx].reserve(lodRatios.size());
+    std::span<const std::uint32_t> previous = indices;
+    float previousError = 0;
+    for (float ratio : lodRatios)
+    {
+      const auto targetTriangles = static_cast<std::size_t>(triangleCount * ratio);
+      auto lod = simplify_mesh(
+        previous, relem.vertexCount, vertices, sizeof(Vertex) / sizeof(float), targetTriangles * 3);
+
+      // Mesh is locked up by borders and seams, further levels won't help either
+      if (lod.indices.empty() || lod.indices.size() > previous.size() * 9 / 10)
+        break;
+
+      lod.error = std::max(lod.error, previousError);
+      optimize_vertex_cache(lod.indices, relem.vertexCount);
+
+      auto& stored = relemLods[relemIdx].emplace_back(std::move(lod));
+      previous = stored.indices;
+      previousError = stored.error;
+    }
+  });
+
+  std::vector<std::size_t> levelTriangles(lodRatios.size(), 0);
+  for (std::size_t relemIdx = 0; relemIdx < processed.relems.size(); ++relemIdx)
+  {
+    auto& relem = processed.relems[relemIdx];
+    if (relem.duplicateOf.has_value())
+    {
+      relem.firstLod = processed.relems[*relem.duplicateOf].firstLod;
+      relem.lodCount = processed.relems[*relem.duplicateOf].lodCount;
+      continue;
+    }
+
+    relem.firstLod = static_cast<std::uint32_t>(processed.lods.size());
+    relem.lodCount = static_cast<std::uint32_t>(relemLods[relemIdx].size());
+
+    for (std::size_t level = 0; level < relemLods[relemIdx].size(); ++level)
+    {
+      const auto& lod = relemLods[relemIdx][level];
+      processed.lods.push_back(RenderElementLod{
+        .indexOffset = static_cast<std::uint32_t>(processed.indices.size()),
+        .indexCount = static_cast<std::uint32_t>(lod.indices.size()),
+        .error = lod.error,
+      });
+      processed.indices.insert(processed.indices.end(), lod.indices.begin(), lod.indices.end());
+      levelTriangles[level] += lod.indices.size() / 3;
+    }
+  }
+
+  for (std::size_t level = 0; level < levelTriangles.size(); ++level)
+    spdlog::info("LOD {}: {} triangles", level + 1, levelTriangles[level]);
+}
+
+void Baker::narrowIndices(ProcessedMeshes& processed) const
+{
+  std::vector<std::uint32_t> indices;
+  std::vector<std::uint16_t> indices16;
+  indices.reserve(processed.indices.size());
+
+  // Ranges are appended relem by relem, LODs right after their relem
+  auto moveRange = [&](IndexFormat format, std::uint32_t& offset, std::uint32_t count) {
+    const auto src = std::span<const std::uint32_t>(processed.indices).subspan(offset, count);
+    if (format == IndexFormat::Uint16)
+    {
+      offset = static_cast<std::uint32_t>(indices16.size());
+      std::ranges::transform(src, std::back_inserter(indices16), [](std::uint32_t idx) {
+        return static_cast<std::uint16_t>(idx);
+      });
+    }
+    else
+    {
+      offset = static_cast<std::uint32_t>(indices.size());
+      indices.insert(indices.end(), src.begin(), src.end());
+    }
+  };
+
+  std::size_t narrowRelems = 0;
+  for (auto& relem : processed.relems)
+  {
+    // Originals always come first, so theirs are already moved
+    if (relem.duplicateOf.has_value())
+    {
+      const auto& original = processed.relems[*relem.duplicateOf];
+      relem.indexFormat = original.indexFormat;
+      relem.indexOffset = original.indexOffset;
+      if (relem.indexFormat == IndexFormat::Uint16)
+        ++narrowRelems;
+      continue;
+    }
+
+    // Narrowing out of range indices would silently turn them into valid ones
+    const auto relemIndices =
+      std::span(processed.indices).subspan(relem.indexOffset, relem.indexCount);
+    const bool inRange = std::ranges::all_of(
+      relemIndices, [&](std::uint32_t idx) { return idx < relem.vertexCount; });
+
+    relem.indexFormat = inRange ? index_format_for(relem.vertexCount) : IndexFormat::Uint32;
+    if (relem.indexFormat == IndexFormat::Uint16)
+      ++narrowRelems;
+
+    moveRange(relem.indexFormat, relem.indexOffset, relem.indexCount);
+    for (std::uint32_t i = relem.firstLod; i < relem.firstLod + relem.lodCount; ++i)
+      moveRange(relem.indexFormat, processed.lods[i].indexOffset, processed.lods[i].indexCount);
   }
 
+  spdlog::info(
+    "{} of {} relems use 16-bit indices, index data: {} -> {} bytes",
+    narrowRelems,
+    processed.relems.size(),
+    processed.indices.size() * sizeof(std::uint32_t),
+    indices.size() * sizeof(std::uint32_t) + indices16.size() * sizeof(std::uint16_t));
+
+  processed.indices = std::move(indices);
+  processed.indices16 = std::move(indices16);
+}
+
+static BakedCompactVertex compact_vertex(
+  glm::vec4 position_and_normal, glm::vec4 tex_coord_and_tangent, const BoundingBox& box)
+{
+  BakedCompactVertex result{};
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    const float extent = box.maxCoord[i] - box.minCoord[i];
+    const float t = extent > 0 ? (position_and_normal[i] - box.minCoord[i]) / extent : 0.0f;
+    result.position[i] =
+      static_cast<std::uint16_t>(std::round(std::clamp(t, 0.0f, 1.0f) * 65535.0f));
+  }
+  result.normal = std::bit_cast<std::uint32_t>(position_and_normal.w);
+  result.tangent = std::bit_cast<std::uint32_t>(tex_coord_and_tangent.z);
+  result.texCoord = glm::packHalf2x16(glm::vec2{tex_coord_and_tangent});
   return result;
 }
 
@@ -260,29 +816,445 @@ Baker::ProcessedMeshes Baker::processMeshes(const tinygltf::Model& model) const
 // Normals and tangents are defined for all primiteves, except ditto
 // No animations or skins are present
 
-void Baker::bakeScene(std::filesystem::path path)
+bool Baker::writeSceneContainer(
+  const std::filesystem::path& path,
+  const tinygltf::Model& model,
+  const ProcessedMeshes& processed)
+{
+  auto [instMats, instMeshes] = process_instances(model, workers);
+
+  std::vector<Bounds> relemBounds(processed.relems.size());
+  std::vector<std::vector<Meshlet>> relemMeshlets(processed.relems.size());
+  workers.parallelFor(processed.relems.size(), [&](std::size_t i) {
+    const auto& relem = processed.relems[i];
+    const auto* vertices =
+      reinterpret_cast<const float*>(processed.vertices.data() + relem.vertexOffset);
+
+    // Meshlets are built from 32-bit indices whatever the storage format is
+    std::vector<std::uint32_t> widened;
+    std::span<const std::uint32_t> indices;
+    if (relem.indexFormat == IndexFormat::Uint16)
+    {
+      const auto narrow =
+        std::span(processed.indices16).subspan(relem.indexOffset, relem.indexCount);
+      widened.assign(narrow.begin(), narrow.end());
+      indices = widened;
+    }
+    else
+      indices = std::span(processed.indices).subspan(relem.indexOffset, relem.indexCount);
+
+    relemBounds[i] =
+      compute_vertex_bounds(vertices, relem.vertexCount, sizeof(Vertex) / sizeof(float));
+
+    if (
+      relem.duplicateOf.has_value() ||
+      std::ranges::any_of(indices, [&](std::uint32_t idx) { return idx >= relem.vertexCount; }))
+      return;
+    relemMeshlets[i] =
+      build_meshlets(indices, relem.vertexCount, vertices, sizeof(Vertex) / sizeof(float));
+  });
+
+  std::vector<RenderElement> relems;
+  std::vector<std::uint32_t> relemVertexCounts;
+  std::vector<Meshlet> meshlets;
+  relems.reserve(processed.relems.size());
+  relemVertexCounts.reserve(processed.relems.size());
+  for (std::size_t i = 0; i < processed.relems.size(); ++i)
+  {
+    const auto& relem = processed.relems[i];
+    relemVertexCounts.push_back(relem.vertexCount);
+    // Duplicates share geometry, but not necessarily the material
+    if (relem.duplicateOf.has_value())
+    {
+      relems.push_back(relems[*relem.duplicateOf]);
+      relems.back().baseColorImage = relem.baseColorImage;
+      continue;
+    }
+
+    relems.push_back(RenderElement{
+      .vertexOffset = relem.vertexOffset,
+      .indexOffset = relem.indexOffset,
+      .indexCount = relem.indexCount,
+      .indexFormat = relem.indexFormat,
+      .firstMeshlet = static_cast<std::uint32_t>(meshlets.size()),
+      .meshletCount = static_cast<std::uint32_t>(relemMeshlets[i].size()),
+      .firstLod = relem.firstLod,
+      .lodCount = relem.lodCount,
+      .baseColorImage = relem.baseColorImage,
+    });
+    for (auto meshlet : relemMeshlets[i])
+    {
+      meshlet.indexOffset += relem.indexOffset;
+      meshlets.push_back(meshlet);
+    }
+  }
+  spdlog::info("Split {} relems into {} meshlets", relems.size(), meshlets.size());
+
+  // Quantized relative to exactly the boxes stored along with the relems,
+  // the renderer dequantizes with them
+  std::vector<BakedCompactVertex> compact;
+  if (compactVertices)
+  {
+    compact.resize(processed.vertices.size());
+    workers.parallelFor(processed.relems.size(), [&](std::size_t i) {
+      const auto& relem = processed.relems[i];
+      if (relem.duplicateOf.has_value())
+        return;
+      for (std::size_t v = relem.vertexOffset; v < relem.vertexOffset + relem.vertexCount; ++v)
+        compact[v] = compact_vertex(
+          processed.vertices[v].positionAndNormal,
+          processed.vertices[v].texCoordAndTangentAndPadding,
+          relemBounds[i].box);
+    });
+  }
+
+  std::vector<Mesh> meshes = processed.meshes;
+  for (auto& mesh : meshes)
+  {
+    const auto merged =
+      merge_bounds(std::span{relemBounds}.subspan(mesh.firstRelem, mesh.relemCount));
+    mesh.box = merged.box;
+    mesh.sphere = merged.sphere;
+  }
+
+  const BakedSceneData data{
+    .instanceMatrices = instMats,
+    .instanceMeshes = instMeshes,
+    .meshes = meshes,
+    .renderElements = relems,
+    .renderElementBounds = relemBounds,
+    .renderElementVertexCounts = relemVertexCounts,
+    .meshlets = meshlets,
+    .renderElementLods = processed.lods,
+    .vertexFormat = compactVertices ? BakedVertexFormat::Compact : BakedVertexFormat::Full,
+    .vertices = compactVertices ? std::as_bytes(std::span{compact})
+                                : std::as_bytes(std::span{processed.vertices}),
+    .indices = processed.indices,
+    .indices16 = processed.indices16,
+  };
+  if (!write_baked_scene(path, data))
+    return false;
+
+  return sectorSize <= 0 || writeWorld(path, model, data);
+}
+
+bool Baker::writeWorld(
+  const std::filesystem::path& scene_path, const tinygltf::Model& model, const BakedSceneData& data)
+{
+  const auto sectors = split_into_sectors(data, sectorSize, workers);
+
+  BakedWorld world{
+    .vertexFormat = data.vertexFormat,
+    .imageCount = static_cast<std::uint32_t>(model.images.size()),
+    .sectors = {},
+  };
+  std::atomic<bool> failed{false};
+  world.sectors.resize(sectors.size());
+  workers.parallelFor(sectors.size(), [&](std::size_t i) {
+    const auto& sector = sectors[i];
+    auto path = scene_path.parent_path() / scene_path.stem();
+    path += fmt::format(".sector{}_{}.scene", sector.x, sector.z);
+    world.sectors[i] = BakedWorldSector{.path = path, .box = sector.box};
+    if (!write_baked_scene(path, sector.view(data.vertexFormat)))
+      failed = true;
+  });
+  if (failed)
+    return false;
+
+  spdlog::info("Split {} instances into {} sectors", data.instanceMatrices.size(), sectors.size());
+  return write_baked_world(std::filesystem::path{scene_path}.replace_extension(".world"), world);
+}
+
+// Images are decoded by tinygltf as they are stored, 8 or 16 bits per component
+static std::vector<Rgba8> to_rgba8(const tinygltf::Image& image)
+{
+  const std::size_t pixelCount = static_cast<std::size_t>(image.width) * image.height;
+  const std::size_t components = static_cast<std::size_t>(image.component);
+  const std::size_t componentSize = image.bits == 16 ? 2 : 1;
+  if (
+    components < 1 || components > 4 ||
+    image.image.size() < pixelCount * components * componentSize)
+    return {};
+
+  // Only the most significant byte of 16-bit components is kept
+  auto component = [&](std::size_t pixel, std::size_t c) {
+    return image.image[(pixel * components + c) * componentSize + componentSize - 1];
+  };
+
+  std::vector<Rgba8> result(pixelCount);
+  for (std::size_t i = 0; i < pixelCount; ++i)
+  {
+    // Grayscale with an optional alpha channel for 1 and 2 components
+    const bool gray = components < 3;
+    const std::uint8_t r = component(i, 0);
+    const std::uint8_t g = gray ? r : component(i, 1);
+    const std::uint8_t b = gray ? r : component(i, 2);
+    const std::uint8_t a = components % 2 == 0 ? component(i, components - 1) : 255;
+    result[i] = Rgba8{r, g, b, a};
+  }
+  return result;
+}
+
+bool Baker::writeTextures(const tinygltf::Model& model, const std::filesystem::path& output_prefix)
+{
+  // Images that aren't referenced by any material are most likely colors
+  std::vector<TextureUsage> usages(model.images.size(), TextureUsage::Color);
+  auto markUsage = [&](int texture_idx, TextureUsage usage) {
+    if (texture_idx < 0 || static_cast<std::size_t>(texture_idx) >= model.textures.size())
+      return;
+    const int source = model.textures[texture_idx].source;
+    if (source >= 0 && static_cast<std::size_t>(source) < usages.size())
+      usages[source] = usage;
+  };
+  for (const auto& material : model.materials)
+  {
+    markUsage(material.pbrMetallicRoughness.metallicRoughnessTexture.index, TextureUsage::Linear);
+    markUsage(material.occlusionTexture.index, TextureUsage::Linear);
+    markUsage(material.normalTexture.index, TextureUsage::Normal);
+  }
+
+  std::atomic<std::size_t> baked{0};
+  std::atomic<bool> failed{false};
+  workers.parallelFor(model.images.size(), [&](std::size_t i) {
+    const auto& image = model.images[i];
+    const auto pixels = to_rgba8(image);
+    // tinygltf only warns about images it couldn't load
+    if (pixels.empty())
+    {
+      spdlog::warn("Image {} ('{}') has no data and won't be baked", i, image.uri);
+      return;
+    }
+
+    auto path = output_prefix;
+    path += fmt::format(".image{}.tex", i);
+    if (!bake_texture(
+          path,
+          pixels,
+          static_cast<std::uint32_t>(image.width),
+          static_cast<std::uint32_t>(image.height),
+          usages[i],
+          workers))
+      failed = true;
+    else
+      baked.fetch_add(1, std::memory_order_relaxed);
+  });
+
+  spdlog::info("Baked {} of {} textures", baked.load(), model.images.size());
+  return !failed;
+}
+
+// Moves all files out of the staging directory, replacing older versions,
+// and returns their names. Every rename is atomic, but the whole set of them
+// is not: an interrupted publish leaves a mix of old and new outputs behind.
+static std::optional<std::vector<std::filesystem::path>> publish_outputs(
+  const std::filesystem::path& staging, const std::filesystem::path& destination)
+{
+  std::error_code error;
+  std::vector<std::filesystem::path> files;
+  for (std::filesystem::directory_iterator it{staging, error}, end; !error && it != end;
+       it.increment(error))
+    files.push_back(it->path().filename());
+  if (error)
+  {
+    spdlog::error("Unable to list {}: {}", staging, error.message());
+    return std::nullopt;
+  }
+
+  for (const auto& file : files)
+  {
+    std::filesystem::rename(staging / file, destination / file, error);
+    if (error)
+    {
+      spdlog::error("Unable to move {} into {}: {}", file, destination, error.message());
+      return std::nullopt;
+    }
+  }
+
+  return files;
+}
+
+// Outputs that not every bake produces: <stem>_baked.image<N>.tex, whose number
+// depends on the scene, and the <stem>_baked.world manifest with its
+// <stem>_baked.sector<X>_<Z>.scene files, which only exist when baking sectors
+static bool is_optional_output(std::string_view suffix)
+{
+  return (suffix.starts_with("image") && suffix.ends_with(".tex")) || suffix == "world" ||
+    (suffix.starts_with("sector") && suffix.ends_with(".scene"));
+}
+
+// Removes optional outputs of previous bakes that this one didn't produce, e.g.
+// textures of images that were removed, sectors that are now empty, or the world
+// once the scene is baked without --sectors. Otherwise renderers would keep
+// picking up a world that no longer matches the scene.
+static void remove_stale_outputs(
+  const std::filesystem::path& scene, std::span<const std::filesystem::path> published)
+{
+  const std::string prefix = (scene.stem() += "_baked.").string();
+
+  std::error_code error;
+  std::vector<std::filesystem::path> stale;
+  for (std::filesystem::directory_iterator it{scene.parent_path(), error}, end;
+       !error && it != end;
+       it.increment(error))
+  {
+    const auto name = it->path().filename();
+    const std::string nameString = name.string();
+    if (
+      nameString.starts_with(prefix) &&
+      is_optional_output(std::string_view{nameString}.substr(prefix.size())) &&
+      std::ranges::find(published, name) == published.end())
+      stale.push_back(it->path());
+  }
+
+  for (const auto& file : stale)
+  {
+    std::filesystem::remove(file, error);
+    if (error)
+      spdlog::warn("Unable to remove the stale {}: {}", file, error.message());
+  }
+}
+
+std::uint64_t Baker::optionsHash() const
+{
+  const std::array<std::uint32_t, 8> versions = {
+    BAKER_VERSION,
+    BAKED_TEXTURE_VERSION,
+    BAKED_SCENE_VERSION,
+    BAKED_WORLD_VERSION,
+    octahedral::OCT_VERTEX_BITS,
+    compactVertices ? 1u : 0u,
+    bakeTextures ? 1u : 0u,
+    std::bit_cast<std::uint32_t>(sectorSize),
+  };
+  return hash_bytes64(
+    std::as_bytes(std::span{lodRatios}), hash_bytes64(std::as_bytes(std::span{versions})));
+}
+
+// Every output the stamp lists, which includes baked textures and sectors
+static bool outputs_exist(const BakeStamp& stamp, const std::filesystem::path& scene_dir)
 {
+  std::error_code error;
+  return !stamp.outputs.empty() && std::ranges::all_of(stamp.outputs, [&](const auto& output) {
+    return std::filesystem::exists(scene_dir / output, error);
+  });
+}
+
+BakeResult Baker::bakeScene(std::filesystem::path path)
+{
+  const auto stampPath = path.parent_path() / path.stem() += "_baked.hash";
+  const std::uint64_t options = optionsHash();
+
+  std::optional<BakeStamp> previous;
+  if (useCache)
+    previous = read_bake_stamp(stampPath);
+  if (
+    previous.has_value() &&
+    (previous->optionsHash != options || !outputs_exist(*previous, path.parent_path())))
+    previous.reset();
+
+  // Stat calls only, which is what makes no-op rebakes cheap
+  if (previous.has_value() && bake_inputs_untouched(*previous, path.parent_path()))
+    return BakeResult::UpToDate;
+
+  // Hashed before loading, so that inputs modified during the bake
+  // don't end up being considered baked next time
+  auto stamp = compute_bake_stamp(path, options);
+  if (!stamp.has_value())
+    return BakeResult::Failed;
+
+  // Touched but not modified, e.g. by a fresh checkout or a copy.
+  // Updating the stamp makes the next check a cheap one again.
+  if (previous.has_value() && previous->contentHash == stamp->contentHash)
+  {
+    stamp->outputs = std::move(previous->outputs);
+    write_bake_stamp(stampPath, *stamp);
+    return BakeResult::UpToDate;
+  }
+
   auto maybeModel = loadModel(path);
   if (!maybeModel.has_value())
-    return;
+    return BakeResult::Failed;
 
   auto model = std::move(*maybeModel);
-  auto [verts, inds, relems, meshes] = processMeshes(model);
+  auto maybeProcessed = processMeshes(model);
+  if (!maybeProcessed.has_value())
+  {
+    spdlog::error("Unable to read the meshes of {}", path);
+    return BakeResult::Failed;
+  }
+
+  auto processed = std::move(*maybeProcessed);
+  deduplicateMeshes(processed);
+  optimizeMeshes(model, processed);
+  generateLods(processed);
+  narrowIndices(processed);
+
+  // Next to the outputs, so that the final renames don't cross filesystems
+  const auto staging = path.parent_path() / path.stem() += "_baked.staging";
+  {
+    std::error_code error;
+    std::filesystem::remove_all(staging, error);
+    std::filesystem::create_directories(staging, error);
+    if (error)
+    {
+      spdlog::error("Unable to create {}: {}", staging, error.message());
+      return BakeResult::Failed;
+    }
+  }
 
+  // By the time bakeScene returns, the staging directory has either been
+  // published or the bake has failed, so it goes away in both cases
+  struct StagingRemover
+  {
+    const std::filesystem::path& staging;
+    ~StagingRemover()
+    {
+      std::error_code error;
+      std::filesystem::remove_all(staging, error);
+    }
+  } stagingRemover{staging};
+
+  // The engine-native container is what SceneManager actually loads,
+  // the glTF below is kept around for inspecting the result in other tools.
+  if (!writeSceneContainer(staging / (path.stem() += "_baked.scene"), model, processed))
+    return BakeResult::Failed;
+
+  if (bakeTextures && !writeTextures(model, staging / (path.stem() += "_baked")))
+    return BakeResult::Failed;
+
+  const auto& [verts, inds, inds16, relems, lods, meshes] = processed;
+
+  std::vector<DecodedNormalTangent> decoded(verts.size());
+  workers.parallelFor(verts.size(), [&](std::size_t i) {
+    decoded[i] =
+      decode_normal_tangent(verts[i].positionAndNormal, verts[i].texCoordAndTangentAndPadding);
+  });
+
+  // Offsets of float accessors have to be multiples of 4
+  const std::size_t decodedOffset =
+    (verts.size() * sizeof(Vertex) + inds.size() * sizeof(uint32_t) +
+     inds16.size() * sizeof(uint16_t) + 3) /
+    4 * 4;
 
-  // todo check if exists?
-  model.extensionsRequired.push_back("KHR_mesh_quantization");
-  model.extensionsUsed.push_back("KHR_mesh_quantization");
   if (model.buffers.size() != 1)
   {
     spdlog::warn("The model has more than one buffer, which means something is probably wrong");
   }
   {
     auto& buf = model.buffers[0];
-    buf.data.resize(verts.size() * sizeof(Vertex) + inds.size() * sizeof(uint32_t));
+    // Everything the engine uses comes first and is left as it is
+    buf.data.assign(decodedOffset + decoded.size() * sizeof(DecodedNormalTangent), 0);
     std::memcpy(buf.data.data(), verts.data(), verts.size() * sizeof(Vertex));
     std::memcpy(
       buf.data.data() + verts.size() * sizeof(Vertex), inds.data(), inds.size() * sizeof(uint32_t));
+    std::memcpy(
+      buf.data.data() + verts.size() * sizeof(Vertex) + inds.size() * sizeof(uint32_t),
+      inds16.data(),
+      inds16.size() * sizeof(uint16_t));
+    std::memcpy(
+      buf.data.data() + decodedOffset,
+      decoded.data(),
+      decoded.size() * sizeof(DecodedNormalTangent));
     buf.uri = (path.stem() += "_baked.bin").string();
 
     // create file itself?
@@ -306,6 +1278,26 @@ void Baker::bakeScene(std::filesystem::path path)
     buf.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
   }
 
+  // glTF forbids empty buffer views
+  if (!inds16.empty())
+  {
+    auto& buf = model.bufferViews.emplace_back();
+    buf.buffer = 0;
+    buf.byteLength = inds16.size() * sizeof(uint16_t);
+    buf.byteOffset = verts.size() * sizeof(Vertex) + inds.size() * sizeof(uint32_t);
+    buf.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+  }
+
+  const int decodedView = static_cast<int>(model.bufferViews.size());
+  {
+    auto& buf = model.bufferViews.emplace_back();
+    buf.buffer = 0;
+    buf.byteLength = decoded.size() * sizeof(DecodedNormalTangent);
+    buf.byteOffset = decodedOffset;
+    buf.byteStride = sizeof(DecodedNormalTangent);
+    buf.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+  }
+
   model.accessors.clear();
 
   {
@@ -320,10 +1312,9 @@ void Baker::bakeScene(std::filesystem::path path)
     pos_access.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
     pos_access.type = TINYGLTF_TYPE_VEC3;
     auto norm_access = tinygltf::Accessor();
-    norm_access.bufferView = 0;
-    norm_access.byteOffset = 12;
-    norm_access.componentType = TINYGLTF_COMPONENT_TYPE_BYTE;
-    norm_access.normalized = true;
+    norm_access.bufferView = decodedView;
+    norm_access.byteOffset = offsetof(DecodedNormalTangent, normal);
+    norm_access.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
     norm_access.type = TINYGLTF_TYPE_VEC3;
     auto tex_access = tinygltf::Accessor();
     tex_access.bufferView = 0;
@@ -331,11 +1322,13 @@ void Baker::bakeScene(std::filesystem::path path)
     tex_access.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
     tex_access.type = TINYGLTF_TYPE_VEC2;
     auto tan_access = tinygltf::Accessor();
-    tan_access.bufferView = 0;
-    tan_access.byteOffset = 24;
-    tan_access.componentType = TINYGLTF_COMPONENT_TYPE_BYTE;
-    tan_access.normalized = true;
+    tan_access.bufferView = decodedView;
+    tan_access.byteOffset = offsetof(DecodedNormalTangent, tangent);
+    tan_access.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
     tan_access.type = TINYGLTF_TYPE_VEC4;
+    // Normals and tangents come from the decoded copies
+    std::array strides = {
+      sizeof(Vertex), sizeof(DecodedNormalTangent), sizeof(Vertex), sizeof(DecodedNormalTangent)};
     std::array vertex_attrs = {pos_access, norm_access, tex_access, tan_access};
     std::array attr_names = {"POSITION", "NORMAL", "TEXCOORD_0", "TANGENT"};
 
@@ -357,7 +1350,14 @@ void Baker::bakeScene(std::filesystem::path path)
         {
           prim.indices = static_cast<int>(model.accessors.size());
           auto& curr = model.accessors.emplace_back(ind_access);
-          curr.byteOffset += relem.indexOffset * sizeof(uint32_t);
+          if (relem.indexFormat == IndexFormat::Uint16)
+          {
+            curr.bufferView = 2;
+            curr.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+            curr.byteOffset += relem.indexOffset * sizeof(uint16_t);
+          }
+          else
+            curr.byteOffset += relem.indexOffset * sizeof(uint32_t);
           curr.count = relem.indexCount;
         }
         std::erase_if(prim.attributes, [&](const auto& type) {
@@ -378,7 +1378,7 @@ void Baker::bakeScene(std::filesystem::path path)
           }
           prim.attributes[attr_names[k]] = static_cast<int>(model.accessors.size());
           auto& curr = model.accessors.emplace_back(vertex_attrs[k]);
-          curr.byteOffset += relem.vertexOffset * sizeof(Vertex);
+          curr.byteOffset += relem.vertexOffset * strides[k];
           curr.count = relem.vertexCount;
         }
       }
@@ -386,11 +1386,26 @@ void Baker::bakeScene(std::filesystem::path path)
   }
 
 
-  loader.WriteGltfSceneToFile(
-    &model,
-    (path.parent_path() / path.stem() += "_baked.gltf").string(),
-    false,
-    false,
-    true,
-    false);
+  if (!loader.WriteGltfSceneToFile(
+        &model, (staging / path.stem() += "_baked.gltf").string(), false, false, true, false))
+  {
+    spdlog::error("Unable to write the baked glTF for {}", path);
+    return BakeResult::Failed;
+  }
+
+  // A stamp must never describe a mix of old and new outputs, which is
+  // what an interrupted publish leaves behind
+  {
+    std::error_code error;
+    std::filesystem::remove(stampPath, error);
+  }
+  auto published = publish_outputs(staging, path.parent_path());
+  if (!published.has_value())
+    return BakeResult::Failed;
+  remove_stale_outputs(path, *published);
+  stamp->outputs = std::move(*published);
+
+  // Not being able to write it only costs a rebake next time
+  write_bake_stamp(stampPath, *stamp);
+  return BakeResult::Baked;
 }
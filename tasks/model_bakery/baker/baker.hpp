@@ -2,6 +2,8 @@
 #define BAKER_HPP
 
 #include <filesystem>
+#include <memory>
+#include <optional>
 
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
@@ -11,34 +13,79 @@
 
 #include <stb_image.h>
 
-struct RenderElement
+#include "parallel/ThreadPool.hpp"
+#include "scene/BakedScene.hpp"
+#include "scene/Mesh.hpp"
+
+// Render element along with the data the baker needs to fill in accessors
+struct RawRenderElement
 {
   std::uint32_t vertexOffset;
   std::uint32_t vertexCount;
   std::uint32_t indexOffset;
   std::uint32_t indexCount;
+  // Everything is processed as 32-bit, narrowIndices decides on the final format
+  IndexFormat indexFormat;
   std::array<double, 3> posMax;
   std::array<double, 3> posMin;
-
-  // Material* material;
+  // Into ProcessedMeshes::lods
+  std::uint32_t firstLod;
+  std::uint32_t lodCount;
+  // Earlier relem with bit-identical geometry. Its vertex and index
+  // ranges, LODs and meshlets are shared instead of being stored twice.
+  std::optional<std::uint32_t> duplicateOf;
+  // See RenderElement::baseColorImage
+  std::uint32_t baseColorImage;
 };
 
-struct Mesh
+enum class BakeResult
 {
-  std::uint32_t firstRelem;
-  std::uint32_t relemCount;
+  Baked,
+  // Neither the inputs nor the options changed since the last bake,
+  // so the outputs were left as they are
+  UpToDate,
+  Failed,
 };
 
 class Baker
 {
 public:
-  Baker() = default;
+  // Uses a thread pool of its own
+  Baker();
+  // Runs all of the work on the given pool, which may be shared by several
+  // Bakers working at the same time, see bake_scenes
+  explicit Baker(ThreadPool& shared_workers);
 
   void selectScene(std::filesystem::path path);
-  void bakeScene(std::filesystem::path path);
+  // Outputs are first written to a staging directory and then renamed
+  // into place, so they are never seen half-written. A stamp with the hash
+  // of the inputs and options is stored next to them, see cache.hpp.
+  BakeResult bakeScene(std::filesystem::path path);
+
+  // Target triangle count of every generated LOD relative to the full
+  // detail relem, coarsest last. Empty disables LOD generation.
+  void setLodRatios(std::vector<float> ratios) { lodRatios = std::move(ratios); }
+
+  // Store BakedVertexFormat::Compact vertices in the scene container.
+  // The glTF output always has full vertices.
+  void setCompactVertices(bool enabled) { compactVertices = enabled; }
+
+  // Bake every image of the scene into a block-compressed texture with
+  // mips next to the other outputs. Enabled by default.
+  void setBakeTextures(bool enabled) { bakeTextures = enabled; }
+
+  // Skip scenes whose stamp matches the inputs and options. Enabled by default.
+  void setUseCache(bool enabled) { useCache = enabled; }
+
+  // Additionally split the scene into sectors of a horizontal grid with cells
+  // this wide, which the renderer can stream in and out, see BakedWorld.hpp.
+  // Zero (the default) disables this.
+  void setSectorSize(float size) { sectorSize = size; }
 
 private:
   std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
+  // Everything besides the inputs that affects the outputs
+  std::uint64_t optionsHash() const;
 
   struct Vertex
   {
@@ -54,15 +101,48 @@ private:
   {
     std::vector<Vertex> vertices;
     std::vector<std::uint32_t> indices;
-    std::vector<RenderElement> relems;
+    std::vector<std::uint16_t> indices16;
+    std::vector<RawRenderElement> relems;
+    std::vector<RenderElementLod> lods;
     std::vector<Mesh> meshes;
   };
-  ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
+  // Fails on primitives whose indices can't be read
+  std::optional<ProcessedMeshes> processMeshes(const tinygltf::Model& model) const;
+  // Welds bit-identical vertices of every relem and makes relems with
+  // identical geometry share a single copy of it, see duplicateOf
+  void deduplicateMeshes(ProcessedMeshes& processed);
+  // Reorders triangles and vertices of every relem for the post-transform
+  // cache, overdraw and fetch locality. Doesn't change the draws themselves.
+  void optimizeMeshes(const tinygltf::Model& model, ProcessedMeshes& processed);
+  // Appends simplified index ranges of every relem to the index buffer
+  void generateLods(ProcessedMeshes& processed);
+  // Moves relems with few enough vertices, along with their LODs,
+  // to the 16-bit index region
+  void narrowIndices(ProcessedMeshes& processed) const;
+  // Writes <output_prefix>.image<N>.tex for every image N of the model,
+  // the format depends on what the materials use the image for
+  bool writeTextures(const tinygltf::Model& model, const std::filesystem::path& output_prefix);
+  bool writeSceneContainer(
+    const std::filesystem::path& path,
+    const tinygltf::Model& model,
+    const ProcessedMeshes& processed);
+  // Writes the sectors of the scene container and the world manifest next to it
+  bool writeWorld(
+    const std::filesystem::path& scene_path,
+    const tinygltf::Model& model,
+    const BakedSceneData& data);
   void ProcessAttribute(
     const tinygltf::Model& model, int accesor_ind, std::span<Vertex> vertices, auto setter) const;
 
 private:
   tinygltf::TinyGLTF loader;
+  std::unique_ptr<ThreadPool> ownWorkers;
+  ThreadPool& workers;
+  std::vector<float> lodRatios{0.5f, 0.25f, 0.125f};
+  bool compactVertices = false;
+  bool bakeTextures = true;
+  bool useCache = true;
+  float sectorSize = 0;
 };
 
 #endif // BAKER_HPP
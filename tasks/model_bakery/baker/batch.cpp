@@ -0,0 +1,112 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+
+static bool is_scene_file(const std::filesystem::path& path)
+{
+  const auto ext = path.extension();
+  const auto stem = path.stem().string();
+  return (ext == ".gltf" || ext == ".glb") && !stem.ends_with("_baked");
+}
+
+std::vector<std::filesystem::path> collect_scenes(const std::filesystem::path& source)
+{
+  std::vector<std::filesystem::path> result;
+
+  std::error_code error;
+  if (std::filesystem::is_directory(source, error))
+  {
+    // Unreadable subdirectories are skipped, anything else stops the search,
+    // but the scenes found so far are still baked
+    using std::filesystem::directory_options;
+    for (std::filesystem::recursive_directory_iterator
+           it{source, directory_options::skip_permission_denied, error},
+         end;
+         !error && it != end;
+         it.increment(error))
+    {
+      std::error_code fileError;
+      if (it->is_regular_file(fileError) && is_scene_file(it->path()))
+        result.push_back(it->path());
+    }
+    if (error)
+      spdlog::error("Unable to search {} for scenes: {}", source, error.message());
+
+    // Directory iteration order is unspecified
+    std::ranges::sort(result);
+    return result;
+  }
+
+  std::ifstream manifest{source};
+  if (!manifest)
+  {
+    spdlog::error("Unable to open the manifest {}", source);
+    return result;
+  }
+
+  for (std::string line; std::getline(manifest, line);)
+  {
+    // Manifests written on Windows
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty() || line.front() == '#')
+      continue;
+    result.push_back(source.parent_path() / line);
+  }
+
+  return result;
+}
+
+std::size_t bake_scenes(
+  std::span<const std::filesystem::path> scenes,
+  ThreadPool& workers,
+  fu2::function_view<void(Baker&)> configure)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  // Every scene is a single index, so the pool hands them out one by one
+  // to whichever thread is free, while the per-mesh loops of the scenes
+  // being baked get stolen by the threads that have nothing else to do.
+  std::atomic<std::size_t> baked{0};
+  std::atomic<std::size_t> upToDate{0};
+  std::atomic<std::size_t> failures{0};
+  workers.parallelFor(scenes.size(), [&](std::size_t i) {
+    Baker baker{workers};
+    configure(baker);
+
+    switch (baker.bakeScene(scenes[i]))
+    {
+    case BakeResult::Baked:
+      spdlog::info("Baked {}", scenes[i]);
+      baked.fetch_add(1, std::memory_order_relaxed);
+      break;
+    case BakeResult::UpToDate:
+      upToDate.fetch_add(1, std::memory_order_relaxed);
+      break;
+    case BakeResult::Failed:
+      spdlog::error("Failed to bake {}", scenes[i]);
+      failures.fetch_add(1, std::memory_order_relaxed);
+      break;
+    }
+  });
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  spdlog::info(
+    "Baked {} of {} scenes in {:.2f} s on {} threads, {} up to date (cache hits), {} failed",
+    baked.load(),
+    scenes.size(),
+    elapsed.count(),
+    workers.getWorkerCount() + 1,
+    upToDate.load(),
+    failures.load());
+
+  return failures.load();
+}
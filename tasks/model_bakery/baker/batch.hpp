@@ -0,0 +1,30 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include <function2/function2.hpp>
+
+#include "baker.hpp"
+
+// Scenes to bake in batch mode. `source` is either a directory, which is
+// searched recursively for .gltf/.glb files (except for baked outputs),
+// or a manifest with one path per line, relative to the manifest itself.
+// Empty lines and lines starting with '#' in manifests are ignored.
+std::vector<std::filesystem::path> collect_scenes(const std::filesystem::path& source);
+
+// Bakes all of the scenes concurrently, each one with a Baker of its own,
+// but all of them sharing `workers`. Big scenes are additionally split up
+// per mesh by the Baker itself, on the same pool. `configure` is applied to
+// every Baker before it starts. Scenes whose stamps are up to date are
+// skipped, unless `configure` disables the cache. Returns the number of
+// scenes that failed.
+std::size_t bake_scenes(
+  std::span<const std::filesystem::path> scenes,
+  ThreadPool& workers,
+  fu2::function_view<void(Baker&)> configure);
+
+#endif // BATCH_HPP
@@ -0,0 +1,459 @@
+#include "block_compression.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+
+#include <glm/glm.hpp>
+
+
+namespace
+{
+
+using FloatBlock = std::array<glm::vec4, 16>;
+// Per pixel, how far it is from the first endpoint towards the second one
+using Weights = std::array<float, 16>;
+
+struct Endpoints
+{
+  glm::vec4 a;
+  glm::vec4 b;
+};
+
+FloatBlock to_float(const PixelBlock& block)
+{
+  FloatBlock result;
+  for (std::size_t i = 0; i < block.size(); ++i)
+    result[i] = glm::vec4{block[i][0], block[i][1], block[i][2], block[i][3]};
+  return result;
+}
+
+float squared_distance(glm::vec4 a, glm::vec4 b)
+{
+  const glm::vec4 d = a - b;
+  return glm::dot(d, d);
+}
+
+// Direction of the largest variance, found by power iteration
+// on the covariance matrix. Zero for blocks of a single color.
+glm::vec4 principal_axis(const FloatBlock& pixels, glm::vec4 mean)
+{
+  std::array<glm::vec4, 4> covariance{};
+  for (const auto& p : pixels)
+  {
+    const glm::vec4 d = p - mean;
+    for (glm::length_t i = 0; i < 4; ++i)
+      covariance[i] += d[i] * d;
+  }
+
+  // The column of the channel with the largest variance is a good
+  // starting point, as it can't be orthogonal to the answer
+  std::size_t largest = 0;
+  for (glm::length_t i = 1; i < 4; ++i)
+    if (covariance[i][i] > covariance[largest][static_cast<glm::length_t>(largest)])
+      largest = static_cast<std::size_t>(i);
+
+  glm::vec4 axis = covariance[largest];
+  for (int iteration = 0; iteration < 8; ++iteration)
+  {
+    const float length = glm::length(axis);
+    if (length < 1e-6f)
+      return glm::vec4{0};
+    axis /= length;
+
+    glm::vec4 next{0};
+    for (glm::length_t i = 0; i < 4; ++i)
+      next += covariance[i] * axis[i];
+    axis = next;
+  }
+
+  const float length = glm::length(axis);
+  return length < 1e-6f ? glm::vec4{0} : axis / length;
+}
+
+// Extremes of the projections of the pixels onto their principal axis
+Endpoints fit_endpoints(const FloatBlock& pixels)
+{
+  glm::vec4 mean{0};
+  for (const auto& p : pixels)
+    mean += p;
+  mean /= static_cast<float>(pixels.size());
+
+  const glm::vec4 axis = principal_axis(pixels, mean);
+  float tMin = 0;
+  float tMax = 0;
+  for (const auto& p : pixels)
+  {
+    const float t = glm::dot(p - mean, axis);
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+
+  return Endpoints{.a = mean + tMin * axis, .b = mean + tMax * axis};
+}
+
+// Endpoints minimizing the squared error for the given weights,
+// nullopt if the weights don't determine both of them
+std::optional<Endpoints> least_squares_endpoints(const FloatBlock& pixels, const Weights& weights)
+{
+  float aa = 0;
+  float ab = 0;
+  float bb = 0;
+  glm::vec4 ax{0};
+  glm::vec4 bx{0};
+  for (std::size_t i = 0; i < pixels.size(); ++i)
+  {
+    const float w = weights[i];
+    const float u = 1.0f - w;
+    aa += u * u;
+    ab += u * w;
+    bb += w * w;
+    ax += u * pixels[i];
+    bx += w * pixels[i];
+  }
+
+  const float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) < 1e-6f)
+    return std::nullopt;
+
+  return Endpoints{
+    .a = (bb * ax - ab * bx) / determinant,
+    .b = (aa * bx - ab * ax) / determinant,
+  };
+}
+
+template <class Candidate>
+Candidate refine(const FloatBlock& pixels, Candidate best, auto evaluate)
+{
+  if (const auto endpoints = least_squares_endpoints(pixels, best.weights))
+  {
+    Candidate refined = evaluate(pixels, *endpoints);
+    if (refined.error < best.error)
+      best = refined;
+  }
+  return best;
+}
+
+// Little endian
+template <std::size_t N>
+void store_bytes(
+  std::array<std::byte, N>& dst, std::size_t offset, std::uint64_t value, std::size_t bytes)
+{
+  for (std::size_t i = 0; i < bytes; ++i)
+    dst[offset + i] = static_cast<std::byte>(value >> (8 * i));
+}
+
+int quantize(float value, int max_value, float scale)
+{
+  return std::clamp(static_cast<int>(std::lround(value * scale)), 0, max_value);
+}
+
+// BC1
+
+std::uint16_t pack_565(glm::vec4 color)
+{
+  const int r = quantize(color.r, 31, 31.0f / 255.0f);
+  const int g = quantize(color.g, 63, 63.0f / 255.0f);
+  const int b = quantize(color.b, 31, 31.0f / 255.0f);
+  return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+}
+
+glm::vec4 unpack_565(std::uint16_t color)
+{
+  const int r = color >> 11;
+  const int g = (color >> 5) & 63;
+  const int b = color & 31;
+  return glm::vec4{(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 0};
+}
+
+struct Bc1Candidate
+{
+  std::uint16_t color0;
+  std::uint16_t color1;
+  std::uint32_t indices = 0;
+  float error = 0;
+  Weights weights{};
+};
+
+Bc1Candidate evaluate_bc1(const FloatBlock& pixels, const Endpoints& endpoints)
+{
+  Bc1Candidate result{.color0 = pack_565(endpoints.a), .color1 = pack_565(endpoints.b)};
+  // The 4-color mode is selected by color0 > color1
+  if (result.color0 < result.color1)
+    std::swap(result.color0, result.color1);
+
+  const glm::vec4 e0 = unpack_565(result.color0);
+  const glm::vec4 e1 = unpack_565(result.color1);
+  const std::array<glm::vec4, 4> palette = {
+    e0, e1, (2.0f * e0 + e1) / 3.0f, (e0 + 2.0f * e1) / 3.0f};
+  constexpr std::array<float, 4> WEIGHTS = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+  // Equal colors mean the 3-color mode, but index 0 is color0 there as well
+  const std::size_t paletteSize = result.color0 == result.color1 ? 1 : palette.size();
+
+  for (std::size_t i = 0; i < pixels.size(); ++i)
+  {
+    std::size_t best = 0;
+    float bestDistance = std::numeric_limits<float>::max();
+    for (std::size_t k = 0; k < paletteSize; ++k)
+      if (const float distance = squared_distance(pixels[i], palette[k]); distance < bestDistance)
+      {
+        bestDistance = distance;
+        best = k;
+      }
+
+    result.indices |= static_cast<std::uint32_t>(best) << (2 * i);
+    result.error += bestDistance;
+    result.weights[i] = WEIGHTS[best];
+  }
+
+  return result;
+}
+
+// BC4, values are in the x components
+
+struct Bc4Candidate
+{
+  std::uint64_t bits = 0;
+  float error = 0;
+  Weights weights{};
+};
+
+Bc4Candidate evaluate_bc4(const FloatBlock& pixels, const Endpoints& endpoints)
+{
+  int r0 = quantize(endpoints.a.x, 255, 1.0f);
+  int r1 = quantize(endpoints.b.x, 255, 1.0f);
+  // The 8-value mode is selected by r0 > r1
+  if (r0 < r1)
+    std::swap(r0, r1);
+
+  std::array<float, 8> palette{static_cast<float>(r0), static_cast<float>(r1)};
+  std::array<float, 8> weights{0.0f, 1.0f};
+  for (std::size_t k = 2; k < palette.size(); ++k)
+  {
+    weights[k] = static_cast<float>(k - 1) / 7.0f;
+    palette[k] = (1.0f - weights[k]) * r0 + weights[k] * r1;
+  }
+  const std::size_t paletteSize = r0 == r1 ? 1 : palette.size();
+
+  Bc4Candidate result{.bits = static_cast<std::uint64_t>(r0) | static_cast<std::uint64_t>(r1) << 8};
+  for (std::size_t i = 0; i < pixels.size(); ++i)
+  {
+    std::size_t best = 0;
+    float bestDistance = std::numeric_limits<float>::max();
+    for (std::size_t k = 0; k < paletteSize; ++k)
+    {
+      const float distance = (pixels[i].x - palette[k]) * (pixels[i].x - palette[k]);
+      if (distance < bestDistance)
+      {
+        bestDistance = distance;
+        best = k;
+      }
+    }
+
+    result.bits |= static_cast<std::uint64_t>(best) << (16 + 3 * i);
+    result.error += bestDistance;
+    result.weights[i] = weights[best];
+  }
+
+  return result;
+}
+
+std::uint64_t encode_bc4_channel(const PixelBlock& block, std::size_t channel)
+{
+  FloatBlock pixels{};
+  float minValue = 255;
+  float maxValue = 0;
+  for (std::size_t i = 0; i < block.size(); ++i)
+  {
+    pixels[i].x = block[i][channel];
+    minValue = std::min(minValue, pixels[i].x);
+    maxValue = std::max(maxValue, pixels[i].x);
+  }
+
+  // Single channel, so the principal axis is trivial
+  const Endpoints endpoints{.a = glm::vec4{maxValue, 0, 0, 0}, .b = glm::vec4{minValue, 0, 0, 0}};
+  return refine(pixels, evaluate_bc4(pixels, endpoints), evaluate_bc4).bits;
+}
+
+// BC7 mode 6
+
+constexpr std::array<int, 16> BC7_WEIGHTS = {
+  0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Candidate
+{
+  // 7 bits per channel, the p-bit is the lowest bit of the 8-bit value
+  std::array<std::array<int, 4>, 2> endpoints{};
+  std::array<int, 2> pBits{};
+  std::array<std::uint8_t, 16> indices{};
+  float error = std::numeric_limits<float>::max();
+  Weights weights{};
+};
+
+Bc7Candidate evaluate_bc7(const FloatBlock& pixels, const Endpoints& endpoints)
+{
+  Bc7Candidate best;
+  for (int pBits = 0; pBits < 4; ++pBits)
+  {
+    Bc7Candidate candidate{.pBits = {pBits & 1, pBits >> 1}, .error = 0};
+
+    std::array<glm::ivec4, 2> expanded;
+    for (std::size_t e = 0; e < 2; ++e)
+    {
+      const glm::vec4 endpoint = e == 0 ? endpoints.a : endpoints.b;
+      for (glm::length_t c = 0; c < 4; ++c)
+      {
+        const int value =
+          quantize((endpoint[c] - static_cast<float>(candidate.pBits[e])) / 2.0f, 127, 1.0f);
+        candidate.endpoints[e][c] = value;
+        expanded[e][c] = (value << 1) | candidate.pBits[e];
+      }
+    }
+
+    std::array<glm::vec4, 16> palette;
+    for (std::size_t k = 0; k < palette.size(); ++k)
+      palette[k] = glm::vec4{
+        ((64 - BC7_WEIGHTS[k]) * expanded[0] + BC7_WEIGHTS[k] * expanded[1] + 32) >> 6};
+
+    for (std::size_t i = 0; i < pixels.size() && candidate.error < best.error; ++i)
+    {
+      std::size_t bestIndex = 0;
+      float bestDistance = std::numeric_limits<float>::max();
+      for (std::size_t k = 0; k < palette.size(); ++k)
+        if (const float distance = squared_distance(pixels[i], palette[k]); distance < bestDistance)
+        {
+          bestDistance = distance;
+          bestIndex = k;
+        }
+
+      candidate.indices[i] = static_cast<std::uint8_t>(bestIndex);
+      candidate.error += bestDistance;
+      candidate.weights[i] = static_cast<float>(BC7_WEIGHTS[bestIndex]) / 64.0f;
+    }
+
+    if (candidate.error < best.error)
+      best = candidate;
+  }
+
+  return best;
+}
+
+// Fields of BC7 blocks are packed starting from the lowest bit
+class BitWriter
+{
+public:
+  void write(std::uint32_t value, std::size_t bits)
+  {
+    for (std::size_t i = 0; i < bits; ++i, ++position)
+      if ((value >> i) & 1)
+        data[position / 8] |= static_cast<std::byte>(1u << (position % 8));
+  }
+
+  const std::array<std::byte, 16>& getData() const { return data; }
+
+private:
+  std::array<std::byte, 16> data{};
+  std::size_t position = 0;
+};
+
+} // namespace
+
+std::array<std::byte, 8> encode_bc1_block(const PixelBlock& block)
+{
+  FloatBlock pixels = to_float(block);
+  for (auto& p : pixels)
+    p.a = 0;
+
+  const auto best = refine(pixels, evaluate_bc1(pixels, fit_endpoints(pixels)), evaluate_bc1);
+
+  std::array<std::byte, 8> result;
+  store_bytes(result, 0, best.color0, 2);
+  store_bytes(result, 2, best.color1, 2);
+  store_bytes(result, 4, best.indices, 4);
+  return result;
+}
+
+std::array<std::byte, 16> encode_bc5_block(const PixelBlock& block)
+{
+  std::array<std::byte, 16> result;
+  store_bytes(result, 0, encode_bc4_channel(block, 0), 8);
+  store_bytes(result, 8, encode_bc4_channel(block, 1), 8);
+  return result;
+}
+
+std::array<std::byte, 16> encode_bc7_block(const PixelBlock& block)
+{
+  const FloatBlock pixels = to_float(block);
+  auto best = refine(pixels, evaluate_bc7(pixels, fit_endpoints(pixels)), evaluate_bc7);
+
+  // The top bit of the first index isn't stored and is implied to be 0
+  if (best.indices[0] >= 8)
+  {
+    std::swap(best.endpoints[0], best.endpoints[1]);
+    std::swap(best.pBits[0], best.pBits[1]);
+    for (auto& index : best.indices)
+      index = static_cast<std::uint8_t>(15 - index);
+  }
+
+  BitWriter writer;
+  // Mode 6 is 6 zero bits followed by a one
+  writer.write(1u << 6, 7);
+  for (std::size_t c = 0; c < 4; ++c)
+  {
+    writer.write(static_cast<std::uint32_t>(best.endpoints[0][c]), 7);
+    writer.write(static_cast<std::uint32_t>(best.endpoints[1][c]), 7);
+  }
+  writer.write(static_cast<std::uint32_t>(best.pBits[0]), 1);
+  writer.write(static_cast<std::uint32_t>(best.pBits[1]), 1);
+  for (std::size_t i = 0; i < best.indices.size(); ++i)
+    writer.write(best.indices[i], i == 0 ? 3 : 4);
+
+  return writer.getData();
+}
+
+std::vector<std::byte> compress_image(
+  std::span<const Rgba8> pixels,
+  std::uint32_t width,
+  std::uint32_t height,
+  BakedTextureFormat format,
+  ThreadPool& workers)
+{
+  const std::size_t blocksX = (width + 3) / 4;
+  const std::size_t blocksY = (height + 3) / 4;
+  const std::size_t blockSize = baked_texture_block_size(format);
+
+  std::vector<std::byte> result(blocksX * blocksY * blockSize);
+
+  workers.parallelFor(blocksY, [&](std::size_t by) {
+    for (std::size_t bx = 0; bx < blocksX; ++bx)
+    {
+      PixelBlock block;
+      for (std::size_t y = 0; y < 4; ++y)
+        for (std::size_t x = 0; x < 4; ++x)
+        {
+          const std::size_t px = std::min<std::size_t>(bx * 4 + x, width - 1);
+          const std::size_t py = std::min<std::size_t>(by * 4 + y, height - 1);
+          block[y * 4 + x] = pixels[py * width + px];
+        }
+
+      std::byte* dst = result.data() + (by * blocksX + bx) * blockSize;
+      switch (format)
+      {
+      case BakedTextureFormat::Bc1Unorm:
+      case BakedTextureFormat::Bc1Srgb:
+        std::ranges::copy(encode_bc1_block(block), dst);
+        break;
+      case BakedTextureFormat::Bc5Unorm:
+        std::ranges::copy(encode_bc5_block(block), dst);
+        break;
+      case BakedTextureFormat::Bc7Unorm:
+      case BakedTextureFormat::Bc7Srgb:
+        std::ranges::copy(encode_bc7_block(block), dst);
+        break;
+      }
+    }
+  });
+
+  return result;
+}
@@ -0,0 +1,38 @@
+#ifndef BLOCK_COMPRESSION_HPP
+#define BLOCK_COMPRESSION_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "parallel/ThreadPool.hpp"
+#include "scene/BakedTexture.hpp"
+
+using Rgba8 = std::array<std::uint8_t, 4>;
+// Pixels of a 4x4 block, row by row
+using PixelBlock = std::array<Rgba8, 16>;
+
+// Single block encoders. All of them fit endpoints along the principal axis
+// of the block and refine them once by least squares for the chosen indices.
+
+// Opaque 4-color mode only, alpha is ignored
+std::array<std::byte, 8> encode_bc1_block(const PixelBlock& block);
+// Red and green channels as two independent BC4 blocks
+std::array<std::byte, 16> encode_bc5_block(const PixelBlock& block);
+// Mode 6 only: a single RGBA endpoint pair with 4-bit indices. Not as good
+// as a full search over all 8 modes, but close on smooth content and fast.
+std::array<std::byte, 16> encode_bc7_block(const PixelBlock& block);
+
+// Compresses a whole image, width * height pixels row by row. Rows of blocks
+// are encoded in parallel. Edge blocks of sizes that aren't multiples of 4
+// are padded by repeating the last row and column.
+std::vector<std::byte> compress_image(
+  std::span<const Rgba8> pixels,
+  std::uint32_t width,
+  std::uint32_t height,
+  BakedTextureFormat format,
+  ThreadPool& workers);
+
+#endif // BLOCK_COMPRESSION_HPP
@@ -0,0 +1,351 @@
+#include "cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <json.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+
+#include "scene/MappedFile.hpp"
+
+
+namespace
+{
+
+constexpr std::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr std::uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+constexpr std::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+constexpr std::uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+// Only little endian platforms are supported anyway
+std::uint64_t read64(const std::byte* ptr)
+{
+  std::uint64_t result;
+  std::memcpy(&result, ptr, sizeof(result));
+  return result;
+}
+
+std::uint32_t read32(const std::byte* ptr)
+{
+  std::uint32_t result;
+  std::memcpy(&result, ptr, sizeof(result));
+  return result;
+}
+
+std::uint64_t xxh_round(std::uint64_t acc, std::uint64_t input)
+{
+  acc += input * PRIME64_2;
+  acc = std::rotl(acc, 31);
+  return acc * PRIME64_1;
+}
+
+std::uint64_t xxh_merge_round(std::uint64_t acc, std::uint64_t val)
+{
+  acc ^= xxh_round(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+// Files are named in glTF through URIs, so spaces and such are escaped
+std::string decode_uri(std::string_view uri)
+{
+  std::string result;
+  result.reserve(uri.size());
+  for (std::size_t i = 0; i < uri.size(); ++i)
+  {
+    if (uri[i] == '%' && i + 2 < uri.size())
+    {
+      const std::string hex{uri.substr(i + 1, 2)};
+      char* end = nullptr;
+      const long code = std::strtol(hex.c_str(), &end, 16);
+      if (end == hex.c_str() + hex.size())
+      {
+        result.push_back(static_cast<char>(code));
+        i += 2;
+        continue;
+      }
+    }
+    result.push_back(uri[i]);
+  }
+  return result;
+}
+
+// The JSON part of either a .gltf or a .glb file
+std::optional<std::string_view> gltf_json(
+  const std::filesystem::path& path, std::span<const std::byte> contents)
+{
+  const std::string_view text{reinterpret_cast<const char*>(contents.data()), contents.size()};
+  if (path.extension() != ".glb")
+    return text;
+
+  // 12 byte header, then the JSON chunk, which is always the first one
+  constexpr std::uint32_t GLB_MAGIC = 0x46546C67;
+  constexpr std::uint32_t JSON_CHUNK = 0x4E4F534A;
+  if (
+    contents.size() < 20 || read32(contents.data()) != GLB_MAGIC ||
+    read32(contents.data() + 16) != JSON_CHUNK)
+    return std::nullopt;
+
+  const std::uint32_t jsonLength = read32(contents.data() + 12);
+  if (jsonLength > contents.size() - 20)
+    return std::nullopt;
+  return text.substr(20, jsonLength);
+}
+
+BakeStamp::Input stat_input(
+  const std::filesystem::path& scene_dir, const std::filesystem::path& path)
+{
+  BakeStamp::Input result{.path = path, .size = BakeStamp::MISSING, .modificationTime = 0};
+
+  std::error_code error;
+  const auto fullPath = scene_dir / path;
+  const auto size = std::filesystem::file_size(fullPath, error);
+  if (error)
+    return result;
+  const auto time = std::filesystem::last_write_time(fullPath, error);
+  if (error)
+    return result;
+
+  result.size = size;
+  result.modificationTime = static_cast<std::int64_t>(time.time_since_epoch().count());
+  return result;
+}
+
+} // namespace
+
+std::uint64_t hash_bytes64(std::span<const std::byte> data, std::uint64_t seed)
+{
+  const std::byte* ptr = data.data();
+  const std::byte* const end = ptr + data.size();
+
+  std::uint64_t hash;
+  if (data.size() >= 32)
+  {
+    std::array<std::uint64_t, 4> acc = {
+      seed + PRIME64_1 + PRIME64_2, seed + PRIME64_2, seed, seed - PRIME64_1};
+    for (; ptr + 32 <= end; ptr += 32)
+      for (std::size_t i = 0; i < acc.size(); ++i)
+        acc[i] = xxh_round(acc[i], read64(ptr + 8 * i));
+
+    hash = std::rotl(acc[0], 1) + std::rotl(acc[1], 7) + std::rotl(acc[2], 12) +
+      std::rotl(acc[3], 18);
+    for (auto lane : acc)
+      hash = xxh_merge_round(hash, lane);
+  }
+  else
+    hash = seed + PRIME64_5;
+
+  hash += data.size();
+
+  for (; ptr + 8 <= end; ptr += 8)
+  {
+    hash ^= xxh_round(0, read64(ptr));
+    hash = std::rotl(hash, 27) * PRIME64_1 + PRIME64_4;
+  }
+  if (ptr + 4 <= end)
+  {
+    hash ^= static_cast<std::uint64_t>(read32(ptr)) * PRIME64_1;
+    hash = std::rotl(hash, 23) * PRIME64_2 + PRIME64_3;
+    ptr += 4;
+  }
+  for (; ptr < end; ++ptr)
+  {
+    hash ^= static_cast<std::uint64_t>(*ptr) * PRIME64_5;
+    hash = std::rotl(hash, 11) * PRIME64_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+std::optional<BakeStamp> compute_bake_stamp(
+  const std::filesystem::path& scene, std::uint64_t options_hash)
+{
+  const auto sceneDir = scene.parent_path();
+
+  BakeStamp result;
+  result.optionsHash = options_hash;
+
+  auto addInput = [&](const std::filesystem::path& path, std::span<const std::byte> contents) {
+    const std::string name = path.generic_string();
+    result.contentHash = hash_bytes64(std::as_bytes(std::span{name}), result.contentHash);
+    result.contentHash = hash_bytes64(contents, result.contentHash);
+    result.inputs.push_back(stat_input(sceneDir, path));
+  };
+
+  // Mapping fails for empty files, which are just as fine to hash though
+  auto mapInput = [&](const std::filesystem::path& path) -> std::optional<MappedFile> {
+    std::error_code error;
+    const auto size = std::filesystem::file_size(sceneDir / path, error);
+    if (error)
+      return std::nullopt;
+    if (size == 0)
+      return MappedFile{};
+    MappedFile file{sceneDir / path};
+    if (!file.isValid())
+      return std::nullopt;
+    return file;
+  };
+
+  const auto sceneFile = mapInput(scene.filename());
+  if (!sceneFile.has_value())
+  {
+    spdlog::error("Unable to read {}", scene);
+    return std::nullopt;
+  }
+  addInput(scene.filename(), sceneFile->getData());
+
+  const auto text = gltf_json(scene, sceneFile->getData());
+  if (!text.has_value())
+  {
+    spdlog::error("{} is not a valid glTF binary", scene);
+    return std::nullopt;
+  }
+
+  auto json = nlohmann::json::parse(*text, nullptr, false);
+  if (json.is_discarded())
+  {
+    spdlog::error("{} is not a valid JSON file", scene);
+    return std::nullopt;
+  }
+
+  struct Reference
+  {
+    std::filesystem::path path;
+    bool required;
+  };
+  std::vector<Reference> references;
+  for (const char* property : {"buffers", "images"})
+  {
+    const auto it = json.find(property);
+    if (it == json.end() || !it->is_array())
+      continue;
+    for (const auto& item : *it)
+    {
+      if (!item.is_object())
+        continue;
+      const std::string uri = item.value("uri", "");
+      // Embedded data is already covered by the hash of the scene itself
+      if (uri.empty() || uri.starts_with("data:"))
+        continue;
+      std::filesystem::path path = decode_uri(uri);
+      if (std::ranges::find(references, path, &Reference::path) == references.end())
+        references.push_back(Reference{
+          .path = std::move(path),
+          .required = std::string_view{property} == "buffers",
+        });
+    }
+  }
+
+  for (const auto& [path, required] : references)
+  {
+    const auto file = mapInput(path);
+    if (file.has_value())
+      addInput(path, file->getData());
+    else if (!required && !std::filesystem::exists(sceneDir / path))
+      addInput(path, {});
+    else
+    {
+      spdlog::error("Unable to read {}", sceneDir / path);
+      return std::nullopt;
+    }
+  }
+
+  return result;
+}
+
+bool bake_inputs_untouched(const BakeStamp& stamp, const std::filesystem::path& scene_dir)
+{
+  return !stamp.inputs.empty() && std::ranges::all_of(stamp.inputs, [&](const auto& input) {
+    const auto current = stat_input(scene_dir, input.path);
+    return current.size == input.size && current.modificationTime == input.modificationTime;
+  });
+}
+
+std::optional<BakeStamp> read_bake_stamp(const std::filesystem::path& path)
+{
+  std::ifstream file{path};
+  if (!file)
+    return std::nullopt;
+
+  BakeStamp result;
+  bool hasOptions = false;
+  bool hasContent = false;
+  for (std::string line; std::getline(file, line);)
+  {
+    std::istringstream stream{line};
+    std::string key;
+    stream >> key;
+    if (key == "options")
+      hasOptions = static_cast<bool>(stream >> std::hex >> result.optionsHash);
+    else if (key == "content")
+      hasContent = static_cast<bool>(stream >> std::hex >> result.contentHash);
+    else if (key == "input")
+    {
+      BakeStamp::Input input;
+      std::string inputPath;
+      // The path is last and may contain spaces
+      if (
+        !(stream >> input.size >> input.modificationTime) ||
+        !std::getline(stream >> std::ws, inputPath))
+        return std::nullopt;
+      input.path = inputPath;
+      result.inputs.push_back(std::move(input));
+    }
+    else if (key == "output")
+    {
+      std::string outputPath;
+      if (!std::getline(stream >> std::ws, outputPath))
+        return std::nullopt;
+      result.outputs.emplace_back(outputPath);
+    }
+    else
+      return std::nullopt;
+  }
+
+  if (!hasOptions || !hasContent)
+    return std::nullopt;
+  return result;
+}
+
+bool write_bake_stamp(const std::filesystem::path& path, const BakeStamp& stamp)
+{
+  auto temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream file{temporary, std::ios::trunc};
+    file << "options " << std::hex << stamp.optionsHash << "\n";
+    file << "content " << std::hex << stamp.contentHash << "\n" << std::dec;
+    for (const auto& input : stamp.inputs)
+      file << "input " << input.size << " " << input.modificationTime << " "
+           << input.path.generic_string() << "\n";
+    for (const auto& output : stamp.outputs)
+      file << "output " << output.generic_string() << "\n";
+
+    if (!file)
+    {
+      spdlog::error("Unable to write {}", temporary);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error)
+  {
+    spdlog::error("Unable to move {} into place: {}", temporary, error.message());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,54 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Incremental baking: a stamp with the hash of everything a bake depends on
+// is stored next to its outputs, and the scene is only rebaked once that
+// hash changes. Checking sizes and modification times of the inputs first
+// makes no-op rebakes nearly free, the contents only get hashed when those
+// differ, e.g. after a fresh checkout.
+
+struct BakeStamp
+{
+  static constexpr std::uintmax_t MISSING = ~std::uintmax_t{0};
+
+  struct Input
+  {
+    // Relative to the directory of the scene
+    std::filesystem::path path;
+    // MISSING for images that don't exist, tinygltf only warns about those.
+    // They still have to be tracked so that they trigger a rebake once added.
+    std::uintmax_t size = 0;
+    std::int64_t modificationTime = 0;
+  };
+
+  // Bake options and format versions
+  std::uint64_t optionsHash = 0;
+  // Contents of all inputs
+  std::uint64_t contentHash = 0;
+  // The scene file first, then all external buffers and images it references
+  std::vector<Input> inputs;
+  // Every file the bake produced, relative to the directory of the scene
+  std::vector<std::filesystem::path> outputs;
+};
+
+// xxHash64, fast enough to not be the bottleneck even when reading from the page cache
+std::uint64_t hash_bytes64(std::span<const std::byte> data, std::uint64_t seed = 0);
+
+std::optional<BakeStamp> compute_bake_stamp(
+  const std::filesystem::path& scene, std::uint64_t options_hash);
+
+// True if none of the inputs changed in size or modification time
+bool bake_inputs_untouched(const BakeStamp& stamp, const std::filesystem::path& scene_dir);
+
+std::optional<BakeStamp> read_bake_stamp(const std::filesystem::path& path);
+// Written to a temporary file first and renamed into place
+bool write_bake_stamp(const std::filesystem::path& path, const BakeStamp& stamp);
+
+#endif // CACHE_HPP
@@ -1,13 +1,152 @@
 #include "baker.hpp"
+#include "batch.hpp"
+#include "textures.hpp"
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 int main(int argc, char* argv[])
 {
-  if (argc != 2)
+  if (argc < 2)
   {
-    std::cerr << "Expected exactly one argument\n";
+    std::cerr << "Usage: model_bakery_baker <scene.gltf | directory | manifest.txt> "
+                 "[--lods=0.5,0.25,0.125] [--compact-vertices] [--no-textures] [--sectors=<size>] "
+                 "[--force]\n"
+                 "       model_bakery_baker <image.png> [--usage=color|linear|normal]\n"
+                 "Directories and manifests (one scene path per line) are baked in parallel\n"
+                 "Scenes whose inputs and options didn't change since the last bake are "
+                 "skipped, unless --force is given\n"
+                 "--sectors additionally splits every scene into a streamable world "
+                 "of sectors <size> units wide\n";
     return 1;
   }
-  Baker baker;
-  baker.bakeScene(argv[1]);
+
+  std::optional<std::vector<float>> lodRatios;
+  bool compactVertices = false;
+  bool noTextures = false;
+  bool force = false;
+  float sectorSize = 0;
+  TextureUsage textureUsage = TextureUsage::Color;
+
+  for (int i = 2; i < argc; ++i)
+  {
+    constexpr std::string_view LODS_FLAG = "--lods=";
+    constexpr std::string_view COMPACT_VERTICES_FLAG = "--compact-vertices";
+    constexpr std::string_view NO_TEXTURES_FLAG = "--no-textures";
+    constexpr std::string_view FORCE_FLAG = "--force";
+    constexpr std::string_view SECTORS_FLAG = "--sectors=";
+    constexpr std::string_view USAGE_FLAG = "--usage=";
+    const std::string_view arg = argv[i];
+    if (arg == COMPACT_VERTICES_FLAG)
+    {
+      compactVertices = true;
+      continue;
+    }
+    if (arg == NO_TEXTURES_FLAG)
+    {
+      noTextures = true;
+      continue;
+    }
+    if (arg == FORCE_FLAG)
+    {
+      force = true;
+      continue;
+    }
+    if (arg.starts_with(SECTORS_FLAG))
+    {
+      std::istringstream sizeStream{std::string{arg.substr(SECTORS_FLAG.size())}};
+      if (!(sizeStream >> sectorSize) || sectorSize <= 0)
+      {
+        std::cerr << "Sector size must be a positive number, got '"
+                  << arg.substr(SECTORS_FLAG.size()) << "'\n";
+        return 1;
+      }
+      continue;
+    }
+    if (arg.starts_with(USAGE_FLAG))
+    {
+      const auto usage = arg.substr(USAGE_FLAG.size());
+      if (usage == "color")
+        textureUsage = TextureUsage::Color;
+      else if (usage == "linear")
+        textureUsage = TextureUsage::Linear;
+      else if (usage == "normal")
+        textureUsage = TextureUsage::Normal;
+      else
+      {
+        std::cerr << "Texture usage must be one of color, linear or normal, got '" << usage
+                  << "'\n";
+        return 1;
+      }
+      continue;
+    }
+    if (!arg.starts_with(LODS_FLAG))
+    {
+      std::cerr << "Unknown option " << arg << "\n";
+      return 1;
+    }
+
+    std::vector<float> ratios;
+    std::istringstream list{std::string{arg.substr(LODS_FLAG.size())}};
+    for (std::string item; std::getline(list, item, ',');)
+    {
+      float ratio = 0;
+      std::istringstream itemStream{item};
+      if (!(itemStream >> ratio) || ratio <= 0 || ratio >= 1)
+      {
+        std::cerr << "LOD ratios must be numbers between 0 and 1, got '" << item << "'\n";
+        return 1;
+      }
+      ratios.push_back(ratio);
+    }
+    lodRatios = std::move(ratios);
+  }
+
+  auto configure = [&](Baker& baker) {
+    baker.setCompactVertices(compactVertices);
+    baker.setBakeTextures(!noTextures);
+    baker.setUseCache(!force);
+    baker.setSectorSize(sectorSize);
+    if (lodRatios.has_value())
+      baker.setLodRatios(*lodRatios);
+  };
+
+  const std::filesystem::path source = argv[1];
+  const auto ext = source.extension();
+  if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga")
+  {
+    ThreadPool workers;
+    return bake_texture_file(source, textureUsage, workers) ? 0 : 1;
+  }
+
+  if (!std::filesystem::is_directory(source) && (ext == ".gltf" || ext == ".glb"))
+  {
+    Baker baker;
+    configure(baker);
+    switch (baker.bakeScene(source))
+    {
+    case BakeResult::Baked:
+      return 0;
+    case BakeResult::UpToDate:
+      std::cout << source << " is up to date\n";
+      return 0;
+    case BakeResult::Failed:
+      return 1;
+    }
+    return 1;
+  }
+
+  const auto scenes = collect_scenes(source);
+  if (scenes.empty())
+  {
+    std::cerr << "No scenes to bake in " << source << "\n";
+    return 1;
+  }
+
+  ThreadPool workers;
+  return bake_scenes(scenes, workers, configure) == 0 ? 0 : 1;
 }
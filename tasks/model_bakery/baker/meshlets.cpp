@@ -0,0 +1,129 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "scene/Bounds.hpp"
+
+
+static glm::vec3 vertex_position(const float* vertices, std::size_t stride_floats, std::uint32_t v)
+{
+  const float* p = vertices + v * stride_floats;
+  return glm::vec3{p[0], p[1], p[2]};
+}
+
+static void finish_meshlet(
+  Meshlet& meshlet,
+  std::span<const std::uint32_t> indices,
+  std::span<const std::uint32_t> unique_vertices,
+  const float* vertices,
+  std::size_t stride_floats)
+{
+  // Gather positions so that the regular bounds code can chew through them
+  std::array<float, MESHLET_MAX_VERTICES * 4> positions{};
+  for (std::size_t i = 0; i < unique_vertices.size(); ++i)
+  {
+    const glm::vec3 p = vertex_position(vertices, stride_floats, unique_vertices[i]);
+    positions[4 * i + 0] = p.x;
+    positions[4 * i + 1] = p.y;
+    positions[4 * i + 2] = p.z;
+  }
+  meshlet.sphere = compute_vertex_bounds(positions.data(), unique_vertices.size(), 4).sphere;
+
+  const auto triangles = indices.subspan(meshlet.indexOffset, meshlet.indexCount);
+
+  std::array<glm::vec3, MESHLET_MAX_TRIANGLES> normals;
+  std::size_t normalCount = 0;
+  glm::vec3 axis{0};
+  for (std::size_t t = 0; t + 2 < triangles.size(); t += 3)
+  {
+    const glm::vec3 a = vertex_position(vertices, stride_floats, triangles[t + 0]);
+    const glm::vec3 b = vertex_position(vertices, stride_floats, triangles[t + 1]);
+    const glm::vec3 c = vertex_position(vertices, stride_floats, triangles[t + 2]);
+    const glm::vec3 n = glm::cross(b - a, c - a);
+    const float length = glm::length(n);
+    // Degenerate triangles are never rasterized and don't restrict the cone
+    if (length <= 0)
+      continue;
+
+    normals[normalCount++] = n / length;
+    axis += n / length;
+  }
+
+  meshlet.coneAxis = {0, 0, 0};
+  meshlet.coneCutoff = 1;
+
+  const float axisLength = glm::length(axis);
+  if (normalCount == 0 || axisLength <= 0)
+    return;
+  axis /= axisLength;
+
+  float minDot = 1;
+  for (std::size_t i = 0; i < normalCount; ++i)
+    minDot = std::min(minDot, glm::dot(normals[i], axis));
+
+  meshlet.coneAxis = {axis.x, axis.y, axis.z};
+  // The normal cone has a half-angle of acos(minDot). Everything is back-facing
+  // when the view direction is within 90 - acos(minDot) degrees of the axis,
+  // which is where the sine comes from. Cones wider than a hemisphere can't
+  // ever be culled, and almost-hemispheres are not worth the check.
+  if (minDot > 0.1f)
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+std::vector<Meshlet> build_meshlets(
+  std::span<const std::uint32_t> indices,
+  std::size_t vertex_count,
+  const float* vertices,
+  std::size_t stride_floats)
+{
+  std::vector<Meshlet> result;
+
+  // Which meshlet has last used a vertex, + 1 so that 0 means none
+  std::vector<std::uint32_t> usedBy(vertex_count, 0);
+  std::vector<std::uint32_t> uniqueVertices;
+  uniqueVertices.reserve(MESHLET_MAX_VERTICES);
+
+  Meshlet current{};
+  for (std::size_t t = 0; t + 2 < indices.size(); t += 3)
+  {
+    std::uint32_t newVertices = 0;
+    for (std::size_t k = 0; k < 3; ++k)
+      if (usedBy[indices[t + k]] != result.size() + 1)
+        ++newVertices;
+    // Repeated vertices within a triangle are double-counted, which is harmless
+
+    if (
+      uniqueVertices.size() + newVertices > MESHLET_MAX_VERTICES ||
+      current.indexCount / 3 + 1 > MESHLET_MAX_TRIANGLES)
+    {
+      finish_meshlet(current, indices, uniqueVertices, vertices, stride_floats);
+      result.push_back(current);
+      uniqueVertices.clear();
+      current = Meshlet{};
+      current.indexOffset = static_cast<std::uint32_t>(t);
+    }
+
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      const std::uint32_t v = indices[t + k];
+      if (usedBy[v] != result.size() + 1)
+      {
+        usedBy[v] = static_cast<std::uint32_t>(result.size() + 1);
+        uniqueVertices.push_back(v);
+      }
+    }
+    current.indexCount += 3;
+  }
+
+  if (current.indexCount > 0)
+  {
+    finish_meshlet(current, indices, uniqueVertices, vertices, stride_floats);
+    result.push_back(current);
+  }
+
+  return result;
+}
@@ -0,0 +1,22 @@
+#ifndef MESHLETS_HPP
+#define MESHLETS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "scene/Mesh.hpp"
+
+// Splits the triangles of a single relem into meshlets, keeping their current
+// order. The order is expected to be optimized for the vertex cache already,
+// which makes consecutive triangles share vertices and the greedy split good.
+// Index offsets of the result are relative to the start of indices, positions
+// are the first 3 floats of every vertex, vertices are stride_floats floats apart.
+std::vector<Meshlet> build_meshlets(
+  std::span<const std::uint32_t> indices,
+  std::size_t vertex_count,
+  const float* vertices,
+  std::size_t stride_floats);
+
+#endif // MESHLETS_HPP
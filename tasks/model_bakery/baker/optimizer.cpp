@@ -0,0 +1,267 @@
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+
+float VertexCacheStats::acmr() const
+{
+  return triangles == 0 ? 0.0f : static_cast<float>(transformedVertices) / triangles;
+}
+
+float VertexCacheStats::atvr() const
+{
+  return vertices == 0 ? 0.0f : static_cast<float>(transformedVertices) / vertices;
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other)
+{
+  transformedVertices += other.transformedVertices;
+  triangles += other.triangles;
+  vertices += other.vertices;
+  return *this;
+}
+
+VertexCacheStats analyze_vertex_cache(std::span<const std::uint32_t> indices, std::size_t vertex_count)
+{
+  constexpr std::size_t NEVER = std::numeric_limits<std::size_t>::max();
+
+  VertexCacheStats result;
+  result.triangles = indices.size() / 3;
+
+  // A vertex is still in the FIFO if less than VERTEX_CACHE_SIZE
+  // misses happened since it was put there.
+  std::vector<std::size_t> cachedAt(vertex_count, NEVER);
+  for (auto index : indices)
+  {
+    if (cachedAt[index] == NEVER)
+      ++result.vertices;
+
+    if (cachedAt[index] == NEVER || result.transformedVertices - cachedAt[index] >= VERTEX_CACHE_SIZE)
+    {
+      cachedAt[index] = result.transformedVertices;
+      ++result.transformedVertices;
+    }
+  }
+
+  return result;
+}
+
+std::vector<std::size_t> optimize_vertex_cache(
+  std::span<std::uint32_t> indices, std::size_t vertex_count)
+{
+  const std::size_t triangleCount = indices.size() / 3;
+
+  std::vector<std::uint32_t> liveTriangles(vertex_count, 0);
+  for (std::size_t i = 0; i < triangleCount * 3; ++i)
+    ++liveTriangles[indices[i]];
+
+  // Vertex -> triangles adjacency in CSR form
+  std::vector<std::size_t> adjacencyOffsets(vertex_count + 1, 0);
+  for (std::size_t v = 0; v < vertex_count; ++v)
+    adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+  std::vector<std::uint32_t> adjacency(triangleCount * 3);
+  {
+    std::vector<std::size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (std::size_t i = 0; i < triangleCount * 3; ++i)
+      adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  // Timestamps start far enough in the future for every vertex to miss
+  std::vector<std::size_t> cacheTime(vertex_count, 0);
+  std::size_t timestamp = VERTEX_CACHE_SIZE + 1;
+
+  std::vector<std::uint32_t> deadEnds;
+  std::size_t cursor = 0;
+
+  std::vector<std::uint32_t> output;
+  output.reserve(triangleCount * 3);
+  std::vector<std::size_t> clusterStarts;
+  std::vector<std::uint32_t> candidates;
+
+  constexpr std::int64_t NONE = -1;
+
+  // Most recently used vertex that still has triangles, or
+  // the next one in the input order if there are none
+  auto skipDeadEnd = [&]() -> std::int64_t {
+    while (!deadEnds.empty())
+    {
+      const auto v = deadEnds.back();
+      deadEnds.pop_back();
+      if (liveTriangles[v] > 0)
+        return v;
+    }
+    for (; cursor < vertex_count; ++cursor)
+      if (liveTriangles[cursor] > 0)
+        return static_cast<std::int64_t>(cursor);
+    return NONE;
+  };
+
+  std::int64_t fanning = skipDeadEnd();
+  if (fanning != NONE)
+    clusterStarts.push_back(0);
+
+  while (fanning != NONE)
+  {
+    candidates.clear();
+
+    const auto fan = static_cast<std::size_t>(fanning);
+    for (std::size_t i = adjacencyOffsets[fan]; i < adjacencyOffsets[fan + 1]; ++i)
+    {
+      const std::uint32_t triangle = adjacency[i];
+      if (emitted[triangle])
+        continue;
+      emitted[triangle] = true;
+
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        const std::uint32_t v = indices[3 * triangle + k];
+        output.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        --liveTriangles[v];
+        if (timestamp - cacheTime[v] > VERTEX_CACHE_SIZE)
+          cacheTime[v] = timestamp++;
+      }
+    }
+
+    // Prefer the oldest vertex that will still be in the cache
+    // after all of its remaining triangles get emitted.
+    std::int64_t next = NONE;
+    std::int64_t bestPriority = -1;
+    for (auto v : candidates)
+    {
+      if (liveTriangles[v] == 0)
+        continue;
+
+      std::int64_t priority = 0;
+      const std::size_t age = timestamp - cacheTime[v];
+      if (age + 2 * liveTriangles[v] <= VERTEX_CACHE_SIZE)
+        priority = static_cast<std::int64_t>(age);
+
+      if (priority > bestPriority)
+      {
+        bestPriority = priority;
+        next = v;
+      }
+    }
+
+    if (next == NONE)
+    {
+      next = skipDeadEnd();
+      if (next != NONE)
+        clusterStarts.push_back(output.size() / 3);
+    }
+
+    fanning = next;
+  }
+
+  std::copy(output.begin(), output.end(), indices.begin());
+
+  return clusterStarts;
+}
+
+void optimize_overdraw(
+  std::span<std::uint32_t> indices,
+  std::span<const std::size_t> cluster_starts,
+  const float* vertices,
+  std::size_t stride_floats)
+{
+  const std::size_t triangleCount = indices.size() / 3;
+  if (cluster_starts.size() < 2)
+    return;
+
+  auto position = [&](std::uint32_t v) {
+    const float* p = vertices + v * stride_floats;
+    return glm::vec3{p[0], p[1], p[2]};
+  };
+
+  struct Cluster
+  {
+    std::size_t first;
+    std::size_t last;
+    glm::vec3 centroid{0};
+    glm::vec3 normal{0};
+    float area = 0;
+    float sortKey = 0;
+  };
+
+  std::vector<Cluster> clusters(cluster_starts.size());
+  glm::vec3 meshCentroid{0};
+  float meshArea = 0;
+
+  for (std::size_t c = 0; c < clusters.size(); ++c)
+  {
+    auto& cluster = clusters[c];
+    cluster.first = cluster_starts[c];
+    cluster.last = c + 1 < cluster_starts.size() ? cluster_starts[c + 1] : triangleCount;
+
+    for (std::size_t t = cluster.first; t < cluster.last; ++t)
+    {
+      const glm::vec3 a = position(indices[3 * t + 0]);
+      const glm::vec3 b = position(indices[3 * t + 1]);
+      const glm::vec3 c2 = position(indices[3 * t + 2]);
+      const glm::vec3 n = glm::cross(b - a, c2 - a);
+      const float area = 0.5f * glm::length(n);
+
+      cluster.normal += n;
+      cluster.centroid += area * (a + b + c2) / 3.0f;
+      cluster.area += area;
+    }
+
+    meshCentroid += cluster.centroid;
+    meshArea += cluster.area;
+    if (cluster.area > 0)
+      cluster.centroid /= cluster.area;
+  }
+
+  if (meshArea > 0)
+    meshCentroid /= meshArea;
+
+  // Clusters far out on the hull and facing away from the center are
+  // likely to occlude others, so they should be drawn first
+  for (auto& cluster : clusters)
+  {
+    const float normalLength = glm::length(cluster.normal);
+    if (normalLength > 0)
+      cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal / normalLength);
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+    return a.sortKey > b.sortKey;
+  });
+
+  std::vector<std::uint32_t> sorted;
+  sorted.reserve(indices.size());
+  for (const auto& cluster : clusters)
+    sorted.insert(
+      sorted.end(), indices.begin() + 3 * cluster.first, indices.begin() + 3 * cluster.last);
+
+  std::copy(sorted.begin(), sorted.end(), indices.begin());
+}
+
+std::vector<std::uint32_t> optimize_vertex_fetch(
+  std::span<std::uint32_t> indices, std::size_t vertex_count)
+{
+  constexpr std::uint32_t UNUSED = std::numeric_limits<std::uint32_t>::max();
+
+  std::vector<std::uint32_t> remap(vertex_count, UNUSED);
+  std::uint32_t next = 0;
+
+  for (auto& index : indices)
+  {
+    if (remap[index] == UNUSED)
+      remap[index] = next++;
+    index = remap[index];
+  }
+
+  for (auto& v : remap)
+    if (v == UNUSED)
+      v = next++;
+
+  return remap;
+}
@@ -0,0 +1,55 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Index and vertex reordering passes applied to every relem while baking.
+// All of them work on a single relem: indices are relative to its first
+// vertex and must be smaller than vertex_count.
+
+// Size of the simulated FIFO post-transform cache. Actual hardware doesn't
+// quite work like this, but the results transfer well enough.
+constexpr std::size_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+  std::size_t transformedVertices = 0;
+  std::size_t triangles = 0;
+  std::size_t vertices = 0;
+
+  // Average cache miss ratio, vertex shader invocations per triangle.
+  // 0.5 is the theoretical lower bound, 3 is the worst case.
+  float acmr() const;
+  // Average transformed to vertex ratio, 1 is optimal
+  float atvr() const;
+
+  VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+VertexCacheStats analyze_vertex_cache(std::span<const std::uint32_t> indices, std::size_t vertex_count);
+
+// Tipsify (Sander et al. 2007). Reorders triangles in place for the post-transform
+// cache and returns the first triangle of every cluster, i.e. the spots where the
+// cache had to be abandoned. Clusters can be freely permuted at a small cost.
+std::vector<std::size_t> optimize_vertex_cache(
+  std::span<std::uint32_t> indices, std::size_t vertex_count);
+
+// Sorts clusters produced by optimize_vertex_cache so that the ones facing
+// outwards from the mesh center go first and occlude the rest. Positions are
+// the first 3 floats of every vertex, vertices are stride_floats floats apart.
+void optimize_overdraw(
+  std::span<std::uint32_t> indices,
+  std::span<const std::size_t> cluster_starts,
+  const float* vertices,
+  std::size_t stride_floats);
+
+// Returns a remap table old vertex -> new vertex which orders vertices by their
+// first use in the index buffer, and applies it to the indices. Unused vertices
+// are moved to the end.
+std::vector<std::uint32_t> optimize_vertex_fetch(
+  std::span<std::uint32_t> indices, std::size_t vertex_count);
+
+#endif // OPTIMIZER_HPP
@@ -0,0 +1,201 @@
+#include "sectors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <span>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+#include "scene/Bounds.hpp"
+
+
+namespace
+{
+
+// Copies parts of the scene into a single sector, every piece of the source
+// is copied at most once
+class SectorBuilder
+{
+public:
+  SectorBuilder(const BakedSceneData& source, BakedSector& target)
+    : scene{source}
+    , sector{target}
+    , vertexSize{baked_vertex_size(source.vertexFormat)}
+  {
+  }
+
+  std::uint32_t addMesh(std::uint32_t mesh_idx)
+  {
+    auto [it, inserted] =
+      meshMap.try_emplace(mesh_idx, static_cast<std::uint32_t>(sector.meshes.size()));
+    if (!inserted)
+      return it->second;
+
+    Mesh mesh = scene.meshes[mesh_idx];
+    const std::uint32_t firstRelem = mesh.firstRelem;
+    mesh.firstRelem = static_cast<std::uint32_t>(sector.renderElements.size());
+    sector.meshes.push_back(mesh);
+    for (std::uint32_t i = firstRelem; i < firstRelem + mesh.relemCount; ++i)
+    {
+      sector.renderElements.push_back(
+        copyRelem(scene.renderElements[i], scene.renderElementVertexCounts[i]));
+      sector.renderElementBounds.push_back(scene.renderElementBounds[i]);
+      sector.renderElementVertexCounts.push_back(scene.renderElementVertexCounts[i]);
+    }
+    return it->second;
+  }
+
+private:
+  RenderElement copyRelem(const RenderElement& relem, std::uint32_t vertex_count)
+  {
+    RenderElement result = relem;
+
+    auto [vertexIt, newVertices] =
+      vertexMap.try_emplace(relem.vertexOffset, static_cast<std::uint32_t>(sectorVertexCount));
+    if (newVertices)
+    {
+      const auto bytes = scene.vertices.subspan(
+        relem.vertexOffset * vertexSize, vertex_count * vertexSize);
+      sector.vertices.insert(sector.vertices.end(), bytes.begin(), bytes.end());
+      sectorVertexCount += bytes.size() / vertexSize;
+    }
+    result.vertexOffset = vertexIt->second;
+
+    result.indexOffset = copyIndices(relem.indexFormat, relem.indexOffset, relem.indexCount);
+
+    // Meshlets are within the range of the relem itself. Relems without any
+    // can't be told apart by their first meshlet, so they aren't remembered.
+    result.firstMeshlet = static_cast<std::uint32_t>(sector.meshlets.size());
+    if (relem.meshletCount > 0)
+    {
+      auto [it, inserted] = meshletMap.try_emplace(relem.firstMeshlet, result.firstMeshlet);
+      if (inserted)
+        for (auto meshlet : scene.meshlets.subspan(relem.firstMeshlet, relem.meshletCount))
+        {
+          meshlet.indexOffset = meshlet.indexOffset - relem.indexOffset + result.indexOffset;
+          sector.meshlets.push_back(meshlet);
+        }
+      result.firstMeshlet = it->second;
+    }
+
+    result.firstLod = static_cast<std::uint32_t>(sector.renderElementLods.size());
+    if (relem.lodCount > 0)
+    {
+      auto [it, inserted] = lodMap.try_emplace(relem.firstLod, result.firstLod);
+      if (inserted)
+        for (auto lod : scene.renderElementLods.subspan(relem.firstLod, relem.lodCount))
+        {
+          lod.indexOffset = copyIndices(relem.indexFormat, lod.indexOffset, lod.indexCount);
+          sector.renderElementLods.push_back(lod);
+        }
+      result.firstLod = it->second;
+    }
+
+    return result;
+  }
+
+  std::uint32_t copyIndices(IndexFormat format, std::uint32_t offset, std::uint32_t count)
+  {
+    auto& indices16 = sector.indices16;
+    auto& indices = sector.indices;
+    const std::uint32_t newOffset = static_cast<std::uint32_t>(
+      format == IndexFormat::Uint16 ? indices16.size() : indices.size());
+    auto [it, inserted] = indexMap.try_emplace(std::tuple{format, offset, count}, newOffset);
+    if (!inserted)
+      return it->second;
+
+    if (format == IndexFormat::Uint16)
+    {
+      const auto range = scene.indices16.subspan(offset, count);
+      indices16.insert(indices16.end(), range.begin(), range.end());
+    }
+    else
+    {
+      const auto range = scene.indices.subspan(offset, count);
+      indices.insert(indices.end(), range.begin(), range.end());
+    }
+    return newOffset;
+  }
+
+private:
+  const BakedSceneData& scene;
+  BakedSector& sector;
+  std::size_t vertexSize;
+  std::size_t sectorVertexCount = 0;
+
+  // From the scene to the sector
+  std::unordered_map<std::uint32_t, std::uint32_t> meshMap;
+  std::unordered_map<std::uint32_t, std::uint32_t> vertexMap;
+  std::unordered_map<std::uint32_t, std::uint32_t> meshletMap;
+  std::unordered_map<std::uint32_t, std::uint32_t> lodMap;
+  std::map<std::tuple<IndexFormat, std::uint32_t, std::uint32_t>, std::uint32_t> indexMap;
+};
+
+} // namespace
+
+BakedSceneData BakedSector::view(BakedVertexFormat format) const
+{
+  return BakedSceneData{
+    .instanceMatrices = instanceMatrices,
+    .instanceMeshes = instanceMeshes,
+    .meshes = meshes,
+    .renderElements = renderElements,
+    .renderElementBounds = renderElementBounds,
+    .renderElementVertexCounts = renderElementVertexCounts,
+    .meshlets = meshlets,
+    .renderElementLods = renderElementLods,
+    .vertexFormat = format,
+    .vertices = vertices,
+    .indices = indices,
+    .indices16 = indices16,
+  };
+}
+
+std::vector<BakedSector> split_into_sectors(
+  const BakedSceneData& scene, float sector_size, ThreadPool& workers)
+{
+  std::vector<Bounds> instanceBounds(scene.instanceMatrices.size());
+  std::map<std::pair<std::int32_t, std::int32_t>, std::vector<std::uint32_t>> cells;
+  for (std::uint32_t i = 0; i < instanceBounds.size(); ++i)
+  {
+    const auto& mesh = scene.meshes[scene.instanceMeshes[i]];
+    instanceBounds[i] =
+      transform_bounds(Bounds{.box = mesh.box, .sphere = mesh.sphere}, scene.instanceMatrices[i]);
+
+    const auto& box = instanceBounds[i].box;
+    const float centerX = 0.5f * (box.minCoord[0] + box.maxCoord[0]);
+    const float centerZ = 0.5f * (box.minCoord[2] + box.maxCoord[2]);
+    cells[{
+            static_cast<std::int32_t>(std::floor(centerX / sector_size)),
+            static_cast<std::int32_t>(std::floor(centerZ / sector_size)),
+          }]
+      .push_back(i);
+  }
+
+  std::vector<BakedSector> result(cells.size());
+  std::vector<const std::vector<std::uint32_t>*> cellInstances;
+  cellInstances.reserve(cells.size());
+  for (const auto& [cell, instances] : cells)
+  {
+    auto& sector = result[cellInstances.size()];
+    std::tie(sector.x, sector.z) = cell;
+    cellInstances.push_back(&instances);
+  }
+
+  workers.parallelFor(result.size(), [&](std::size_t i) {
+    auto& sector = result[i];
+    SectorBuilder builder{scene, sector};
+    std::vector<Bounds> bounds;
+    for (std::uint32_t instIdx : *cellInstances[i])
+    {
+      sector.instanceMatrices.push_back(scene.instanceMatrices[instIdx]);
+      sector.instanceMeshes.push_back(builder.addMesh(scene.instanceMeshes[instIdx]));
+      bounds.push_back(instanceBounds[instIdx]);
+    }
+    sector.box = merge_bounds(bounds).box;
+  });
+
+  return result;
+}
@@ -0,0 +1,47 @@
+#ifndef SECTORS_HPP
+#define SECTORS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "parallel/ThreadPool.hpp"
+#include "scene/BakedScene.hpp"
+#include "scene/Mesh.hpp"
+
+// A single sector of a world, see BakedWorld.hpp
+struct BakedSector
+{
+  // Cell of the grid the sector covers
+  std::int32_t x;
+  std::int32_t z;
+  // World-space, encloses all of the instances
+  BoundingBox box;
+
+  std::vector<glm::mat4x4> instanceMatrices;
+  std::vector<std::uint32_t> instanceMeshes;
+  std::vector<Mesh> meshes;
+  std::vector<RenderElement> renderElements;
+  std::vector<Bounds> renderElementBounds;
+  std::vector<std::uint32_t> renderElementVertexCounts;
+  std::vector<Meshlet> meshlets;
+  std::vector<RenderElementLod> renderElementLods;
+  std::vector<std::byte> vertices;
+  std::vector<std::uint32_t> indices;
+  std::vector<std::uint16_t> indices16;
+
+  // Views into the above, ready for write_baked_scene
+  BakedSceneData view(BakedVertexFormat format) const;
+};
+
+// Buckets the instances by the cell of a horizontal (XZ) grid with cells
+// sector_size wide that the centers of their world-space bounds fall into.
+// Every sector gets its own copies of just the meshes, relems and geometry its
+// instances use. Relems that share geometry in the scene share it within
+// a sector too. Empty cells produce no sectors.
+std::vector<BakedSector> split_into_sectors(
+  const BakedSceneData& scene, float sector_size, ThreadPool& workers);
+
+#endif // SECTORS_HPP
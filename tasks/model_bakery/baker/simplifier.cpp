@@ -0,0 +1,268 @@
+#include "simplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+
+// Symmetric 4x4 matrix, only the upper triangle is stored
+struct Quadric
+{
+  // xx, xy, xz, xw, yy, yz, yw, zz, zw, ww
+  std::array<double, 10> m{};
+
+  Quadric& operator+=(const Quadric& other)
+  {
+    for (std::size_t i = 0; i < m.size(); ++i)
+      m[i] += other.m[i];
+    return *this;
+  }
+};
+
+static Quadric operator+(Quadric a, const Quadric& b)
+{
+  a += b;
+  return a;
+}
+
+// Sum of squared distances to the plane dot(n, p) + d = 0
+static Quadric plane_quadric(glm::dvec3 n, double d)
+{
+  return Quadric{{
+    n.x * n.x,
+    n.x * n.y,
+    n.x * n.z,
+    n.x * d,
+    n.y * n.y,
+    n.y * n.z,
+    n.y * d,
+    n.z * n.z,
+    n.z * d,
+    d * d,
+  }};
+}
+
+static double evaluate(const Quadric& q, glm::dvec3 p)
+{
+  const auto& m = q.m;
+  const double result = m[0] * p.x * p.x + 2 * m[1] * p.x * p.y + 2 * m[2] * p.x * p.z +
+    2 * m[3] * p.x + m[4] * p.y * p.y + 2 * m[5] * p.y * p.z + 2 * m[6] * p.y +
+    m[7] * p.z * p.z + 2 * m[8] * p.z + m[9];
+  // Might get slightly negative due to rounding
+  return std::max(result, 0.0);
+}
+
+static std::uint64_t edge_key(std::uint32_t a, std::uint32_t b)
+{
+  return (std::uint64_t{std::min(a, b)} << 32) | std::max(a, b);
+}
+
+SimplifiedIndices simplify_mesh(
+  std::span<const std::uint32_t> indices,
+  std::size_t vertex_count,
+  const float* vertices,
+  std::size_t stride_floats,
+  std::size_t target_index_count)
+{
+  const std::size_t triangleCount = indices.size() / 3;
+
+  auto position = [&](std::uint32_t v) {
+    const float* p = vertices + v * stride_floats;
+    return glm::dvec3{p[0], p[1], p[2]};
+  };
+
+  std::vector<std::uint32_t> triangles(indices.begin(), indices.begin() + triangleCount * 3);
+  std::vector<bool> triangleAlive(triangleCount, true);
+  std::size_t liveIndexCount = triangles.size();
+
+  std::vector<Quadric> quadrics(vertex_count);
+  std::vector<std::vector<std::uint32_t>> vertexTriangles(vertex_count);
+  std::unordered_map<std::uint64_t, std::uint32_t> edgeUses;
+  edgeUses.reserve(triangles.size());
+
+  for (std::uint32_t t = 0; t < triangleCount; ++t)
+  {
+    const std::uint32_t* tri = &triangles[3 * t];
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      vertexTriangles[tri[k]].push_back(t);
+      ++edgeUses[edge_key(tri[k], tri[(k + 1) % 3])];
+    }
+
+    const glm::dvec3 a = position(tri[0]);
+    const glm::dvec3 normal = glm::cross(position(tri[1]) - a, position(tri[2]) - a);
+    const double length = glm::length(normal);
+    if (length <= 0)
+      continue;
+
+    const glm::dvec3 n = normal / length;
+    const Quadric q = plane_quadric(n, -glm::dot(n, a));
+    for (std::size_t k = 0; k < 3; ++k)
+      quadrics[tri[k]] += q;
+  }
+
+  // Open borders (including the ones caused by attribute seams, where
+  // vertices get duplicated) and non-manifold edges must stay in place
+  std::vector<bool> locked(vertex_count, false);
+  for (const auto& [key, uses] : edgeUses)
+    if (uses != 2)
+    {
+      locked[key >> 32] = true;
+      locked[key & 0xFFFFFFFFu] = true;
+    }
+
+  std::vector<std::uint32_t> collapsedInto(vertex_count);
+  for (std::uint32_t v = 0; v < vertex_count; ++v)
+    collapsedInto[v] = v;
+
+  auto find = [&](std::uint32_t v) {
+    while (collapsedInto[v] != v)
+    {
+      collapsedInto[v] = collapsedInto[collapsedInto[v]];
+      v = collapsedInto[v];
+    }
+    return v;
+  };
+
+  struct Collapse
+  {
+    double cost;
+    std::uint32_t from;
+    std::uint32_t to;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+  };
+
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue;
+
+  auto pushCollapse = [&](std::uint32_t from, std::uint32_t to) {
+    if (!locked[from])
+      queue.push(Collapse{
+        .cost = evaluate(quadrics[from] + quadrics[to], position(to)),
+        .from = from,
+        .to = to,
+      });
+  };
+
+  for (std::size_t t = 0; t < triangleCount; ++t)
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      const std::uint32_t a = triangles[3 * t + k];
+      const std::uint32_t b = triangles[3 * t + (k + 1) % 3];
+      pushCollapse(a, b);
+      pushCollapse(b, a);
+    }
+
+  double maxCost = 0;
+
+  while (liveIndexCount > target_index_count && !queue.empty())
+  {
+    const Collapse collapse = queue.top();
+    queue.pop();
+
+    const std::uint32_t from = collapse.from;
+    if (collapsedInto[from] != from)
+      continue;
+    const std::uint32_t to = find(collapse.to);
+    if (to == from)
+      continue;
+
+    // Quadrics only ever grow, so stale entries can only underestimate
+    // the cost. Put them back with the correct one instead of doing them.
+    const double cost = evaluate(quadrics[from] + quadrics[to], position(to));
+    if (cost > collapse.cost * (1 + 1e-6) + 1e-12 || to != collapse.to)
+    {
+      queue.push(Collapse{.cost = cost, .from = from, .to = to});
+      continue;
+    }
+
+    // The edge must still exist and the collapse must not flip any triangles
+    bool sharesTriangle = false;
+    bool flips = false;
+    for (auto t : vertexTriangles[from])
+    {
+      if (!triangleAlive[t])
+        continue;
+
+      const std::uint32_t* tri = &triangles[3 * t];
+      if (tri[0] == to || tri[1] == to || tri[2] == to)
+      {
+        sharesTriangle = true;
+        continue;
+      }
+
+      std::array<glm::dvec3, 3> before;
+      std::array<glm::dvec3, 3> after;
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        before[k] = position(tri[k]);
+        after[k] = tri[k] == from ? position(to) : before[k];
+      }
+      const glm::dvec3 nBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+      const glm::dvec3 nAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+      if (glm::dot(nBefore, nAfter) <= 0)
+      {
+        flips = true;
+        break;
+      }
+    }
+
+    if (!sharesTriangle || flips)
+      continue;
+
+    for (auto t : vertexTriangles[from])
+    {
+      if (!triangleAlive[t])
+        continue;
+
+      std::uint32_t* tri = &triangles[3 * t];
+      if (tri[0] == to || tri[1] == to || tri[2] == to)
+      {
+        triangleAlive[t] = false;
+        liveIndexCount -= 3;
+        continue;
+      }
+
+      for (std::size_t k = 0; k < 3; ++k)
+        if (tri[k] == from)
+          tri[k] = to;
+      vertexTriangles[to].push_back(t);
+    }
+    vertexTriangles[from].clear();
+
+    quadrics[to] += quadrics[from];
+    collapsedInto[from] = to;
+    maxCost = std::max(maxCost, cost);
+
+    for (auto t : vertexTriangles[to])
+    {
+      if (!triangleAlive[t])
+        continue;
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        const std::uint32_t other = triangles[3 * t + k];
+        if (other == to)
+          continue;
+        pushCollapse(to, other);
+        pushCollapse(other, to);
+      }
+    }
+  }
+
+  SimplifiedIndices result;
+  result.indices.reserve(liveIndexCount);
+  for (std::size_t t = 0; t < triangleCount; ++t)
+    if (triangleAlive[t])
+      result.indices.insert(
+        result.indices.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+
+  // The cost is a sum of squared distances to the original planes around
+  // the vertex, so its root bounds the distance to any single one of them.
+  result.error = static_cast<float>(std::sqrt(maxCost));
+
+  return result;
+}
@@ -0,0 +1,29 @@
+#ifndef SIMPLIFIER_HPP
+#define SIMPLIFIER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct SimplifiedIndices
+{
+  std::vector<std::uint32_t> indices;
+  // Estimated maximum deviation from the source surface, in mesh space units
+  float error = 0;
+};
+
+// Quadric error metric simplification (Garland & Heckbert 1997) with half-edge
+// collapses, i.e. vertices only ever move onto other existing vertices, so the
+// result can reuse the original vertex buffer. Vertices on open borders and
+// attribute seams are locked to keep the silhouette and UVs intact. Stops once
+// target_index_count is reached or no collapse is possible. Positions are the
+// first 3 floats of every vertex, vertices are stride_floats floats apart.
+SimplifiedIndices simplify_mesh(
+  std::span<const std::uint32_t> indices,
+  std::size_t vertex_count,
+  const float* vertices,
+  std::size_t stride_floats,
+  std::size_t target_index_count);
+
+#endif // SIMPLIFIER_HPP
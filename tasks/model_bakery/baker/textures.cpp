@@ -0,0 +1,234 @@
+#include "textures.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/std.h>
+#include <stb_image.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define BAKER_TEXTURES_SSE 1
+#endif
+
+
+namespace
+{
+
+static_assert(sizeof(Rgba8) == 4 && sizeof(glm::vec4) == 4 * sizeof(float));
+
+const std::array<float, 256>& srgb_to_linear_table()
+{
+  static const auto table = [] {
+    std::array<float, 256> result;
+    for (std::size_t i = 0; i < result.size(); ++i)
+    {
+      const float c = static_cast<float>(i) / 255.0f;
+      result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return result;
+  }();
+  return table;
+}
+
+float linear_to_srgb(float c)
+{
+  return c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+std::uint8_t to_unorm8(float value)
+{
+  return static_cast<std::uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+glm::vec4 decode_pixel(Rgba8 pixel, TextureUsage usage)
+{
+  const glm::vec4 unorm = glm::vec4{pixel[0], pixel[1], pixel[2], pixel[3]} / 255.0f;
+  switch (usage)
+  {
+  case TextureUsage::Color:
+  {
+    const auto& table = srgb_to_linear_table();
+    return glm::vec4{table[pixel[0]], table[pixel[1]], table[pixel[2]], unorm.a};
+  }
+  case TextureUsage::Linear:
+    return unorm;
+  case TextureUsage::Normal:
+    return glm::vec4{2.0f * glm::vec3{unorm} - 1.0f, unorm.a};
+  }
+  return unorm;
+}
+
+Rgba8 encode_pixel(glm::vec4 value, TextureUsage usage)
+{
+  switch (usage)
+  {
+  case TextureUsage::Color:
+    value = glm::vec4{
+      linear_to_srgb(value.r), linear_to_srgb(value.g), linear_to_srgb(value.b), value.a};
+    break;
+  case TextureUsage::Linear:
+    break;
+  case TextureUsage::Normal:
+    value = glm::vec4{0.5f * glm::vec3{value} + 0.5f, value.a};
+    break;
+  }
+  return Rgba8{to_unorm8(value.r), to_unorm8(value.g), to_unorm8(value.b), to_unorm8(value.a)};
+}
+
+// 2x2 box filter of two rows of the source level into a row of the next one.
+// The last column is repeated for odd widths.
+void downsample_row(
+  const glm::vec4* top,
+  const glm::vec4* bottom,
+  std::uint32_t src_width,
+  glm::vec4* dst,
+  std::uint32_t dst_width)
+{
+  for (std::uint32_t x = 0; x < dst_width; ++x)
+  {
+    const std::uint32_t x0 = std::min(2 * x, src_width - 1);
+    const std::uint32_t x1 = std::min(2 * x + 1, src_width - 1);
+#ifdef BAKER_TEXTURES_SSE
+    // A whole RGBA pixel per register
+    const __m128 sum = _mm_add_ps(
+      _mm_add_ps(_mm_loadu_ps(&top[x0].x), _mm_loadu_ps(&top[x1].x)),
+      _mm_add_ps(_mm_loadu_ps(&bottom[x0].x), _mm_loadu_ps(&bottom[x1].x)));
+    _mm_storeu_ps(&dst[x].x, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+    dst[x] = 0.25f * (top[x0] + top[x1] + bottom[x0] + bottom[x1]);
+#endif
+  }
+}
+
+// Averaging shortens the normals, and z has to be recoverable from xy
+glm::vec4 renormalize(glm::vec4 normal)
+{
+  const glm::vec3 n{normal};
+  const float length = glm::length(n);
+  return length > 1e-6f ? glm::vec4{n / length, normal.a} : glm::vec4{0, 0, 1, normal.a};
+}
+
+} // namespace
+
+std::vector<std::vector<Rgba8>> generate_mips(
+  std::span<const Rgba8> pixels,
+  std::uint32_t width,
+  std::uint32_t height,
+  TextureUsage usage,
+  ThreadPool& workers)
+{
+  std::vector<std::vector<Rgba8>> result;
+  result.emplace_back(pixels.begin(), pixels.end());
+
+  std::vector<glm::vec4> current(pixels.size());
+  workers.parallelFor(height, [&](std::size_t y) {
+    for (std::size_t x = 0; x < width; ++x)
+      current[y * width + x] = decode_pixel(pixels[y * width + x], usage);
+  });
+
+  std::vector<glm::vec4> next;
+  while (width > 1 || height > 1)
+  {
+    const std::uint32_t nextWidth = std::max(width / 2, 1u);
+    const std::uint32_t nextHeight = std::max(height / 2, 1u);
+    next.resize(std::size_t{nextWidth} * nextHeight);
+    auto& level = result.emplace_back(next.size());
+
+    workers.parallelFor(nextHeight, [&](std::size_t y) {
+      const std::size_t y0 = std::min<std::size_t>(2 * y, height - 1);
+      const std::size_t y1 = std::min<std::size_t>(2 * y + 1, height - 1);
+      glm::vec4* row = next.data() + y * nextWidth;
+      downsample_row(
+        current.data() + y0 * width, current.data() + y1 * width, width, row, nextWidth);
+
+      for (std::size_t x = 0; x < nextWidth; ++x)
+      {
+        if (usage == TextureUsage::Normal)
+          row[x] = renormalize(row[x]);
+        level[y * nextWidth + x] = encode_pixel(row[x], usage);
+      }
+    });
+
+    std::swap(current, next);
+    width = nextWidth;
+    height = nextHeight;
+  }
+
+  return result;
+}
+
+BakedTextureFormat choose_texture_format(std::span<const Rgba8> pixels, TextureUsage usage)
+{
+  switch (usage)
+  {
+  case TextureUsage::Color:
+    if (std::ranges::all_of(pixels, [](const Rgba8& p) { return p[3] == 255; }))
+      return BakedTextureFormat::Bc1Srgb;
+    return BakedTextureFormat::Bc7Srgb;
+  case TextureUsage::Linear:
+    return BakedTextureFormat::Bc7Unorm;
+  case TextureUsage::Normal:
+    return BakedTextureFormat::Bc5Unorm;
+  }
+  return BakedTextureFormat::Bc7Unorm;
+}
+
+bool bake_texture(
+  const std::filesystem::path& path,
+  std::span<const Rgba8> pixels,
+  std::uint32_t width,
+  std::uint32_t height,
+  TextureUsage usage,
+  ThreadPool& workers)
+{
+  if (width == 0 || height == 0 || std::max(width, height) >> BAKED_TEXTURE_MAX_LEVELS != 0)
+  {
+    spdlog::error("Unable to bake a {}x{} texture into {}", width, height, path);
+    return false;
+  }
+
+  const auto format = choose_texture_format(pixels, usage);
+  const auto mips = generate_mips(pixels, width, height, usage, workers);
+
+  std::vector<std::vector<std::byte>> compressed;
+  compressed.reserve(mips.size());
+  for (std::size_t i = 0; i < mips.size(); ++i)
+    compressed.push_back(compress_image(
+      mips[i], std::max(width >> i, 1u), std::max(height >> i, 1u), format, workers));
+
+  BakedTextureData data{.format = format, .width = width, .height = height, .levels = {}};
+  for (const auto& level : compressed)
+    data.levels.emplace_back(level);
+
+  return write_baked_texture(path, data);
+}
+
+bool bake_texture_file(const std::filesystem::path& path, TextureUsage usage, ThreadPool& workers)
+{
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  stbi_uc* data = stbi_load(path.string().c_str(), &width, &height, &channels, 4);
+  if (data == nullptr)
+  {
+    spdlog::error("Unable to load {}: {}", path, stbi_failure_reason());
+    return false;
+  }
+
+  const std::span pixels{
+    reinterpret_cast<const Rgba8*>(data), static_cast<std::size_t>(width) * height};
+  const bool success = bake_texture(
+    path.parent_path() / path.stem() += "_baked.tex",
+    pixels,
+    static_cast<std::uint32_t>(width),
+    static_cast<std::uint32_t>(height),
+    usage,
+    workers);
+
+  stbi_image_free(data);
+  return success;
+}
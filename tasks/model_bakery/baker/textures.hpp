@@ -0,0 +1,47 @@
+#ifndef TEXTURES_HPP
+#define TEXTURES_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "block_compression.hpp"
+
+enum class TextureUsage
+{
+  // sRGB color with optional alpha, e.g. base color and emissive maps
+  Color,
+  // Data that isn't a color, e.g. metallic-roughness and occlusion maps
+  Linear,
+  // Tangent space normals, only xy are stored and z has to be reconstructed
+  Normal,
+};
+
+// Mip chain of an image down to 1x1, level 0 being the image itself.
+// Every level is a 2x2 box filter of the previous one done in linear space:
+// sRGB colors are decoded first and normals are renormalized after every step.
+std::vector<std::vector<Rgba8>> generate_mips(
+  std::span<const Rgba8> pixels,
+  std::uint32_t width,
+  std::uint32_t height,
+  TextureUsage usage,
+  ThreadPool& workers);
+
+// BC1 for opaque colors, BC7 for colors with alpha and other data, BC5 for normals
+BakedTextureFormat choose_texture_format(std::span<const Rgba8> pixels, TextureUsage usage);
+
+// Generates mips, compresses all of them and writes the result, see BakedTexture.hpp
+bool bake_texture(
+  const std::filesystem::path& path,
+  std::span<const Rgba8> pixels,
+  std::uint32_t width,
+  std::uint32_t height,
+  TextureUsage usage,
+  ThreadPool& workers);
+
+// For images that aren't a part of any scene, anything stb_image can read.
+// The result is written next to the image with a _baked.tex suffix.
+bool bake_texture_file(const std::filesystem::path& path, TextureUsage usage, ThreadPool& workers);
+
+#endif // TEXTURES_HPP
@@ -28,9 +28,13 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    // Baked textures are block-compressed, shaders write texture streaming feedback
+    .features =
+      vk::PhysicalDeviceFeatures2{
+        .features = {.textureCompressionBC = true, .fragmentStoresAndAtomics = true},
+      },
     .physicalDeviceIndexOverride = {},
-    .numFramesInFlight = 2,
+    .numFramesInFlight = numFramesInFlight,
   });
 }
 
@@ -53,7 +57,7 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
 
   resolution = {w, h};
 
-  worldRenderer = std::make_unique<WorldRenderer>();
+  worldRenderer = std::make_unique<WorldRenderer>(numFramesInFlight);
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
@@ -34,6 +34,8 @@ private:
   std::unique_ptr<etna::Window> window;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
 
+  static constexpr std::uint32_t numFramesInFlight = 2;
+
   glm::uvec2 resolution;
   bool useVsync = true;
 
@@ -5,10 +5,23 @@
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
+#include <fmt/format.h>
 
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-WorldRenderer::WorldRenderer()
-  : sceneMgr{std::make_unique<SceneManager>()}
+
+WorldRenderer::WorldRenderer(std::uint32_t frames_in_flight)
+  : framesInFlight{frames_in_flight}
+  , sceneMgr{std::make_unique<SceneManager>()}
+  , textureStreamer{TextureStreamer::CreateInfo{.framesInFlight = frames_in_flight}}
+  , textureSampler{
+      etna::Sampler::CreateInfo{.filter = vk::Filter::eLinear, .name = "texture_sampler"}}
 {
 }
 
@@ -28,7 +41,38 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
+  // The baker puts every image of the scene next to it as <scene>.image<N>.tex
+  auto texturePath = [&](std::uint32_t image) {
+    return path.parent_path() / fmt::format("{}.image{}.tex", path.stem().string(), image);
+  };
+  std::vector<std::filesystem::path> texturePaths;
+
+  // Scenes baked with --sectors are streamed
+  auto worldPath = path;
+  worldPath.replace_extension(".world");
+  if (std::filesystem::exists(worldPath))
+  {
+    sceneMgr->selectWorld(worldPath, SectorStreamer::CreateInfo{.framesInFlight = framesInFlight});
+    // Relems of sectors aren't known upfront, so all images are candidates
+    if (const auto* streamer = sceneMgr->getSectorStreamer())
+      for (std::uint32_t image = 0; image < streamer->getImageCount(); ++image)
+        texturePaths.push_back(texturePath(image));
+    textureStreamer.load(texturePaths);
+    return;
+  }
+
   sceneMgr->selectScenePrebaked(path);
+
+  // Only the images used as base colors are needed so far
+  for (const auto& relem : sceneMgr->getRenderElements())
+  {
+    if (relem.baseColorImage == NO_TEXTURE)
+      continue;
+    if (relem.baseColorImage >= texturePaths.size())
+      texturePaths.resize(relem.baseColorImage + 1);
+    texturePaths[relem.baseColorImage] = texturePath(relem.baseColorImage);
+  }
+  textureStreamer.load(texturePaths);
 }
 
 void WorldRenderer::loadShaders()
@@ -37,37 +81,49 @@ void WorldRenderer::loadShaders()
     "static_mesh_material",
     {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
      MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
+  etna::create_program(
+    "static_mesh_material_compact",
+    {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
+     MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh_compact.vert.spv"});
   etna::create_program("static_mesh", {MODEL_BAKERY_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
-  etna::VertexShaderInputDescription sceneVertexInputDesc{
-    .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
-    }},
-  };
+  // The scene is loaded after the pipelines get created,
+  // so both vertex formats have to be supported upfront
+  auto createPipeline = [&](const char* program, BakedVertexFormat vertex_format) {
+    etna::VertexShaderInputDescription sceneVertexInputDesc{
+      .bindings = {etna::VertexShaderInputDescription::Binding{
+        .byteStreamDescription = SceneManager::getVertexFormatDescription(vertex_format),
+      }},
+    };
 
-  auto& pipelineManager = etna::get_context().getPipelineManager();
+    auto& pipelineManager = etna::get_context().getPipelineManager();
+    return pipelineManager.createGraphicsPipeline(
+      program,
+      etna::GraphicsPipeline::CreateInfo{
+        .vertexShaderInput = sceneVertexInputDesc,
+        .rasterizationConfig =
+          vk::PipelineRasterizationStateCreateInfo{
+            .polygonMode = vk::PolygonMode::eFill,
+            .cullMode = vk::CullModeFlagBits::eBack,
+            .frontFace = vk::FrontFace::eCounterClockwise,
+            .lineWidth = 1.f,
+          },
+        .fragmentShaderOutput =
+          {
+            .colorAttachmentFormats = {swapchain_format},
+            .depthAttachmentFormat = vk::Format::eD32Sfloat,
+          },
+      });
+  };
 
   staticMeshPipeline = {};
-  staticMeshPipeline = pipelineManager.createGraphicsPipeline(
-    "static_mesh_material",
-    etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
-      .rasterizationConfig =
-        vk::PipelineRasterizationStateCreateInfo{
-          .polygonMode = vk::PolygonMode::eFill,
-          .cullMode = vk::CullModeFlagBits::eBack,
-          .frontFace = vk::FrontFace::eCounterClockwise,
-          .lineWidth = 1.f,
-        },
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
-        },
-    });
+  staticMeshPipeline = createPipeline("static_mesh_material", BakedVertexFormat::Full);
+  staticMeshCompactPipeline = {};
+  staticMeshCompactPipeline =
+    createPipeline("static_mesh_material_compact", BakedVertexFormat::Compact);
 }
 
 void WorldRenderer::debugInput(const Keyboard&) {}
@@ -81,16 +137,77 @@ void WorldRenderer::update(const FramePacket& packet)
     const float aspect = float(resolution.x) / float(resolution.y);
     worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
   }
+
+  cameraPosition = packet.mainCam.position;
+  lodErrorScale =
+    float(resolution.y) / (2.0f * std::tan(glm::radians(packet.mainCam.fov) * 0.5f));
+}
+
+// Coarsest LOD of the relem with an error below the threshold
+static std::pair<std::uint32_t, std::uint32_t> select_lod(
+  const RenderElement& relem, std::span<const RenderElementLod> lods, float max_error)
+{
+  std::pair result{relem.indexOffset, relem.indexCount};
+  for (const auto& lod : lods.subspan(relem.firstLod, relem.lodCount))
+  {
+    if (lod.error > max_error)
+      break;
+    result = {lod.indexOffset, lod.indexCount};
+  }
+  return result;
+}
+
+// See unpack_quantized_model in unpack_attributes_baked.glsl
+static glm::mat4x4 quantized_model_matrix(const glm::mat4x4& model, const BoundingBox& box)
+{
+  const glm::vec3 min{box.minCoord[0], box.minCoord[1], box.minCoord[2]};
+  const glm::vec3 max{box.maxCoord[0], box.maxCoord[1], box.maxCoord[2]};
+  const glm::vec3 extent = max - min;
+
+  glm::mat4x4 result = glm::translate(model, min);
+  result[0][3] = extent.x;
+  result[1][3] = extent.y;
+  result[2][3] = extent.z;
+  return result;
 }
 
 void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+  vk::CommandBuffer cmd_buf,
+  const glm::mat4x4& glob_tm,
+  const char* program,
+  vk::PipelineLayout pipeline_layout)
 {
   if (!sceneMgr->getVertexBuffer())
     return;
 
+  // Every texture gets its own set the first time a relem uses it this frame
+  const auto descriptorLayout = etna::get_shader_program(program).getDescriptorLayoutId(0);
+  std::unordered_map<std::uint32_t, vk::DescriptorSet> textureSets;
+  std::optional<std::uint32_t> boundTexture;
+  auto bindTexture = [&](std::uint32_t texture) {
+    if (texture == boundTexture)
+      return;
+    auto [it, inserted] = textureSets.try_emplace(texture);
+    if (inserted)
+      it->second = etna::create_descriptor_set(
+                     descriptorLayout,
+                     cmd_buf,
+                     {
+                       etna::Binding{
+                         0,
+                         textureStreamer.getImage(texture).genBinding(
+                           textureSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+                       etna::Binding{1, textureStreamer.getFeedbackBuffer().genBinding()},
+                     })
+                     .getVkSet();
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, 1, &it->second, 0, nullptr);
+    boundTexture = texture;
+  };
+
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+  // Bound lazily, relems with different index formats can be mixed even within a mesh
+  std::optional<IndexFormat> boundIndexFormat;
 
   pushConst2M.projView = glob_tm;
 
@@ -99,13 +216,37 @@ void WorldRenderer::renderScene(
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
+  auto lods = sceneMgr->getRenderElementLods();
+  auto instanceBounds = sceneMgr->getInstanceBounds();
+  auto relemBounds = sceneMgr->getRenderElementBounds();
+  const bool quantized = sceneMgr->getVertexFormat() == BakedVertexFormat::Compact;
 
   for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
   {
     pushConst2M.model = instanceMatrices[instIdx];
 
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+    // Mesh space error that projects to lodPixelThreshold pixels at the
+    // closest point of the instance. LOD errors are measured in mesh space,
+    // hence the division by the instance scale.
+    float maxLodError = 0;
+    {
+      const auto& sphere = instanceBounds[instIdx].sphere;
+      const glm::vec3 center{sphere.center[0], sphere.center[1], sphere.center[2]};
+      const float distance = glm::length(center - cameraPosition) - sphere.radius;
+
+      const auto& model = instanceMatrices[instIdx];
+      const float scale = std::max(
+        {glm::length(glm::vec3{model[0]}),
+         glm::length(glm::vec3{model[1]}),
+         glm::length(glm::vec3{model[2]})});
+
+      if (distance > 0 && scale > 0)
+        maxLodError = lodPixelThreshold * distance / (lodErrorScale * scale);
+    }
+
+    if (!quantized)
+      cmd_buf.pushConstants<PushConstants>(
+        pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
 
     const auto meshIdx = instanceMeshes[instIdx];
 
@@ -113,7 +254,27 @@ void WorldRenderer::renderScene(
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      if (relem.indexFormat != boundIndexFormat)
+      {
+        sceneMgr->bindIndexBuffer(cmd_buf, relem.indexFormat);
+        boundIndexFormat = relem.indexFormat;
+      }
+      // Every relem is quantized relative to its own box
+      if (quantized)
+      {
+        pushConst2M.model =
+          quantized_model_matrix(instanceMatrices[instIdx], relemBounds[relemIdx].box);
+        cmd_buf.pushConstants<PushConstants>(
+          pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+      }
+
+      // Shaders get the texture index through gl_InstanceIndex
+      const std::uint32_t texture =
+        textureStreamer.isStreamed(relem.baseColorImage) ? relem.baseColorImage : NO_TEXTURE;
+      bindTexture(texture);
+
+      const auto [indexOffset, indexCount] = select_lod(relem, lods, maxLodError);
+      cmd_buf.drawIndexed(indexCount, 1, indexOffset, relem.vertexOffset, texture);
     }
   }
 }
@@ -123,6 +284,9 @@ void WorldRenderer::renderWorld(
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
+  sceneMgr->updateStreaming(cmd_buf, cameraPosition);
+  textureStreamer.update(cmd_buf);
+
   // draw final scene to screen
   {
     ETNA_PROFILE_GPU(cmd_buf, renderForward);
@@ -133,7 +297,15 @@ void WorldRenderer::renderWorld(
       {{.image = target_image, .view = target_image_view}},
       {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, staticMeshPipeline.getVkPipeline());
-    renderScene(cmd_buf, worldViewProj, staticMeshPipeline.getVkPipelineLayout());
+    const bool compact = sceneMgr->getVertexFormat() == BakedVertexFormat::Compact;
+    auto& pipeline = compact ? staticMeshCompactPipeline : staticMeshPipeline;
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
+    renderScene(
+      cmd_buf,
+      worldViewProj,
+      compact ? "static_mesh_material_compact" : "static_mesh_material",
+      pipeline.getVkPipelineLayout());
   }
+
+  textureStreamer.readBackFeedback(cmd_buf);
 }
@@ -7,6 +7,7 @@
 #include <glm/glm.hpp>
 
 #include "scene/SceneManager.hpp"
+#include "scene/TextureStreamer.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -15,7 +16,7 @@
 class WorldRenderer
 {
 public:
-  WorldRenderer();
+  explicit WorldRenderer(std::uint32_t frames_in_flight);
 
   void loadScene(std::filesystem::path path);
 
@@ -31,11 +32,18 @@ public:
 
 private:
   void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+    vk::CommandBuffer cmd_buf,
+    const glm::mat4x4& glob_tm,
+    const char* program,
+    vk::PipelineLayout pipeline_layout);
 
 
 private:
+  std::uint32_t framesInFlight;
   std::unique_ptr<SceneManager> sceneMgr;
+  // Base color textures of the relems, see RenderElement::baseColorImage
+  TextureStreamer textureStreamer;
+  etna::Sampler textureSampler;
 
   etna::Image mainViewDepth;
   etna::Buffer constants;
@@ -49,7 +57,15 @@ private:
   glm::mat4x4 worldViewProj;
   glm::mat4x4 lightMatrix;
 
+  glm::vec3 cameraPosition{0};
+  // Size in pixels of a unit long segment at a unit distance from the camera
+  float lodErrorScale = 1;
+  // LODs are switched when their error becomes smaller than this many pixels
+  float lodPixelThreshold = 1;
+
   etna::GraphicsPipeline staticMeshPipeline{};
+  // For scenes baked with BakedVertexFormat::Compact
+  etna::GraphicsPipeline staticMeshCompactPipeline{};
 
   glm::uvec2 resolution;
 };
@@ -2,6 +2,8 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
 
+#define NO_TEXTURE 0xFFFFFFFFu
+
 
 layout(location = 0) out vec4 out_fragColor;
 
@@ -11,12 +13,34 @@ layout(location = 0) in VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  flat uint textureIdx;
 } surf;
 
+layout(binding = 0) uniform sampler2D baseColorTex;
+
+// See TextureFeedback, x is the level of the full chain at level 0 of
+// the resident image, y is the finest level of the full chain wanted
+layout(binding = 1, std430) buffer feedback_t
+{
+  uvec2 feedback[];
+};
+
 void main()
 {
   const vec3 wLightPos = vec3(10, 10, 10);
-  const vec3 surfaceColor = vec3(1.0f, 1.0f, 1.0f);
+  vec3 surfaceColor = vec3(1.0f, 1.0f, 1.0f);
+
+  if (surf.textureIdx != NO_TEXTURE)
+  {
+    surfaceColor = texture(baseColorTex, surf.texCoord).rgb;
+
+    // The lod is relative to the resident image, not the full chain
+    const float lod = textureQueryLod(baseColorTex, surf.texCoord).y;
+    const uint level = feedback[surf.textureIdx].x + uint(max(floor(lod), 0.0f));
+    // Most invocations want the same level, skip the atomic for them
+    if (level < feedback[surf.textureIdx].y)
+      atomicMin(feedback[surf.textureIdx].y, level);
+  }
 
   const vec3 lightColor = vec3(1.0f, 1.0f, 1.0f);
 
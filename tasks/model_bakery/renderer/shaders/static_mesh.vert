@@ -21,6 +21,7 @@ layout (location = 0 ) out VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  flat uint textureIdx;
 } vOut;
 
 out gl_PerVertex { vec4 gl_Position; };
@@ -28,7 +29,7 @@ out gl_PerVertex { vec4 gl_Position; };
 void main(void)
 {
   const vec4 wNorm = vec4(decode_normal(floatBitsToUint(vPosNorm.w)),     0.0f);
-  const vec4 wTang = vec4(decode_normal(floatBitsToUint(vTexCoordAndTang.z)), 0.0f);
+  const vec4 wTang = vec4(decode_tangent(floatBitsToUint(vTexCoordAndTang.z)).xyz, 0.0f);
 
 
   vOut.wPos   = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
@@ -36,5 +37,8 @@ void main(void)
   vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
   vOut.texCoord = vTexCoordAndTang.xy;
 
+  // WorldRenderer passes the texture as the first instance
+  vOut.textureIdx = gl_InstanceIndex;
+
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
 }
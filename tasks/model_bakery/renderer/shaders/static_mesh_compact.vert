@@ -0,0 +1,49 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "unpack_attributes_baked.glsl"
+
+
+layout(location = 0) in vec4 vPos;
+layout(location = 1) in uvec2 vNormAndTang;
+layout(location = 2) in vec2 vTexCoord;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+  // See unpack_quantized_model
+  mat4 mModel;
+} params;
+
+
+
+layout (location = 0 ) out VS_OUT
+{
+  vec3 wPos;
+  vec3 wNorm;
+  vec3 wTangent;
+  vec2 texCoord;
+  flat uint textureIdx;
+} vOut;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main(void)
+{
+  const mat4 model = unpack_quantized_model(params.mModel);
+  const vec3 pos   = dequantize_position(vPos.xyz, params.mModel);
+
+  const vec4 wNorm = vec4(decode_normal(vNormAndTang.x), 0.0f);
+  const vec4 wTang = vec4(decode_tangent(vNormAndTang.y).xyz, 0.0f);
+
+
+  vOut.wPos   = (model * vec4(pos, 1.0f)).xyz;
+  vOut.wNorm  = normalize(mat3(transpose(inverse(model))) * wNorm.xyz);
+  vOut.wTangent = normalize(mat3(transpose(inverse(model))) * wTang.xyz);
+  vOut.texCoord = vTexCoord;
+
+  // WorldRenderer passes the texture as the first instance
+  vOut.textureIdx = gl_InstanceIndex;
+
+  gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
+}
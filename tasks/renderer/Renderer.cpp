@@ -25,12 +25,20 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+  // For drawIndexedIndirectCount of the GPU-driven culling mode
+  vk::PhysicalDeviceVulkan12Features vulkan12Features{.drawIndirectCount = vk::True};
+
   etna::initialize(etna::InitParams{
     .applicationName = "model_bakery_renderer",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {.tessellationShader = true}},
+    .features =
+      vk::PhysicalDeviceFeatures2{
+        .pNext = &vulkan12Features,
+        // resolve.comp accesses the rg16_snorm G-buffer normals as a storage image
+        .features = {.tessellationShader = true, .shaderStorageImageExtendedFormats = true},
+      },
     .physicalDeviceIndexOverride = {},
     .numFramesInFlight = numFramesInFlight,
   });
@@ -1,5 +1,10 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <thread>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
@@ -8,13 +13,98 @@
 #include "shaders/tonemap/tonemap.h"
 #include "shaders/resolve.h"
 #include "shaders/terrain/terrain.h"
+#include "scene/AsyncTransferHelper.hpp"
 #include "TerrainGenerator.hpp"
 #include <imgui.h>
 
+
+namespace
+{
+
+// Large enough for the per-chunk overhead to vanish, small enough
+// for the chunks to be balanced dynamically between the threads
+constexpr std::size_t CULLING_CHUNK_SIZE = 16 * 1024;
+
+static_assert(sizeof(culling::DrawCommand) == sizeof(vk::DrawIndexedIndirectCommand));
+
+void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+
+  vk::DependencyInfo depInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  };
+
+  cmd_buf.pipelineBarrier2(depInfo);
+}
+
+} // namespace
+
 WorldRenderer::WorldRenderer(const etna::GpuWorkCount& workCount)
   : sceneMgr{std::make_unique<SceneManager>()}
   , modelMatrices{workCount, std::in_place_t()}
+  , cullingParams{workCount, std::in_place_t()}
+  , recorders{workCount, std::in_place_t()}
+{
+  const int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+  cullingTimes.resize(std::max(hardwareThreads, 1), 0.0f);
+  setCullingThreadCount(static_cast<int>(cullingTimes.size()));
+  recordingTimes.resize(cullingTimes.size(), 0.0f);
+  setRecordingThreadCount(static_cast<int>(recordingTimes.size()));
+}
+
+void WorldRenderer::setCullingThreadCount(int thread_count)
 {
+  cullingThreadCount = thread_count;
+  cullingWorkers = std::make_unique<ThreadPool>(static_cast<std::size_t>(thread_count - 1));
+}
+
+void WorldRenderer::setRecordingThreadCount(int thread_count)
+{
+  recordingThreadCount = thread_count;
+  recordingWorkers = std::make_unique<ThreadPool>(static_cast<std::size_t>(thread_count - 1));
+
+  auto& ctx = etna::get_context();
+  auto device = ctx.getDevice();
+  // A task per slice of the scene, then the terrain and the light cubes
+  const auto taskCount = static_cast<std::size_t>(thread_count) + 2;
+  recorders.iterate([&](auto& frame_recorders) {
+    while (frame_recorders.size() < taskCount)
+    {
+      SecondaryRecorder recorder;
+      recorder.pool =
+        etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+          .flags = vk::CommandPoolCreateFlagBits::eTransient,
+          .queueFamilyIndex = ctx.getQueueFamilyIdx(),
+        }));
+      recorder.cmdBuf =
+        etna::unwrap_vk_result(device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{
+          .commandPool = recorder.pool.get(),
+          .level = vk::CommandBufferLevel::eSecondary,
+          .commandBufferCount = 1,
+        }))[0];
+      frame_recorders.push_back(std::move(recorder));
+    }
+  });
+}
+
+void WorldRenderer::setStressGridSize(int grid_size)
+{
+  // Frames in flight might still be drawing the previous instances
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+  stressGridSize = grid_size;
+  loadScene(scenePath);
 }
 
 void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
@@ -41,23 +131,38 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
       vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eStorage,
   });
 
+  // Octahedral normals, the same as octahedral::oct_encode with 16 bits,
+  // except that the quantization is done by the hardware
   gBuffer.normal = ctx.createImage(etna::Image::CreateInfo{
     .extent = vk::Extent3D{resolution.x, resolution.y, 1},
     .name = "gBuffer.normal",
-    .format = vk::Format::eA8B8G8R8SnormPack32,
+    .format = vk::Format::eR16G16Snorm,
     .imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eStorage});
 
-  modelMatrices.iterate([&](auto& buf) {
+  cullingParams.iterate([&](auto& buf) {
     buf = ctx.createBuffer(etna::Buffer::CreateInfo{
-      .size = sceneMgr->getInstanceMatrices().size_bytes(),
-      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .size = sizeof(culling::Params),
+      .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
       .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
-      .name = "model_matrices",
+      .name = "culling_params",
     });
 
     buf.map();
   });
 
+  {
+    const glm::uvec2 extent = glm::max(resolution / 2u, glm::uvec2{1});
+    depthPyramidLevelCount =
+      static_cast<std::uint32_t>(glm::floor(glm::log2(float(glm::max(extent.x, extent.y))))) + 1;
+    depthPyramid = ctx.createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{extent.x, extent.y, 1},
+      .name = "depth_pyramid",
+      .format = vk::Format::eR32Sfloat,
+      .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+      .mipLevels = depthPyramidLevelCount,
+    });
+  }
+
   {
     // todo fix this
     // double aspect = double(resolution.x) / double(resolution.y);
@@ -95,7 +200,134 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScenePrebaked(path);
+  scenePath = std::move(path);
+  sceneMgr->selectScenePrebaked(scenePath);
+  sceneMgr->tileInstances(static_cast<std::uint32_t>(stressGridSize));
+
+  modelMatrices.iterate([&](auto& buf) {
+    buf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+      .size = sceneMgr->getInstanceMatrices().size_bytes(),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .name = "model_matrices",
+    });
+
+    buf.map();
+  });
+
+  instanceBoxes = make_frustum_culling_boxes(sceneMgr->getInstanceBounds());
+  visibleInstances.resize(instanceBoxes.size());
+  visibleInstanceCount = 0;
+
+  const std::size_t chunkCount =
+    (instanceBoxes.size() + CULLING_CHUNK_SIZE - 1) / CULLING_CHUNK_SIZE;
+  chunkVisible.resize(instanceBoxes.size());
+  chunkVisibleCounts.resize(chunkCount);
+  chunkOffsets.resize(chunkCount);
+
+  createGpuCullingResources();
+}
+
+void WorldRenderer::createGpuCullingResources()
+{
+  auto& ctx = etna::get_context();
+
+  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  auto instanceMeshes = sceneMgr->getInstanceMeshes();
+  auto instanceBounds = sceneMgr->getInstanceBounds();
+  auto meshes = sceneMgr->getMeshes();
+  auto relems = sceneMgr->getRenderElements();
+
+  gpuCulling = {};
+  if (instanceMatrices.empty() || relems.empty())
+    return;
+
+  std::vector<culling::InstanceBox> boxes(instanceMatrices.size());
+  for (std::size_t i = 0; i < boxes.size(); ++i)
+  {
+    const auto& box = instanceBounds[i].box;
+    const glm::vec3 min{box.minCoord[0], box.minCoord[1], box.minCoord[2]};
+    const glm::vec3 max{box.maxCoord[0], box.maxCoord[1], box.maxCoord[2]};
+    boxes[i] = culling::InstanceBox{
+      .center = 0.5f * (min + max),
+      .mesh = instanceMeshes[i],
+      .extent = 0.5f * (max - min),
+      .padding = 0,
+    };
+  }
+
+  // Every mesh gets a range of instance ids large enough for all of its instances
+  std::vector<std::uint32_t> meshFirstInstances(meshes.size(), 0);
+  for (auto mesh : instanceMeshes)
+    ++meshFirstInstances[mesh];
+  std::exclusive_scan(
+    meshFirstInstances.begin(),
+    meshFirstInstances.end(),
+    meshFirstInstances.begin(),
+    std::uint32_t{0});
+
+  std::vector<culling::RelemDraw> relemDraws(relems.size());
+  for (std::uint32_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx)
+    for (std::uint32_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+    {
+      const auto relemIdx = meshes[meshIdx].firstRelem + j;
+      const auto& relem = relems[relemIdx];
+      relemDraws[relemIdx] = culling::RelemDraw{
+        .indexCount = relem.indexCount,
+        .firstIndex = relem.indexOffset,
+        .vertexOffset = relem.vertexOffset,
+        .mesh = meshIdx,
+        .indexFormat = static_cast<std::uint32_t>(relem.indexFormat),
+      };
+      gpuCulling.indexFormatUsed[static_cast<std::size_t>(relem.indexFormat)] = true;
+    }
+
+  auto createBuffer = [&](vk::DeviceSize size, vk::BufferUsageFlags usage, const char* name) {
+    return ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = size,
+      .bufferUsage = usage | vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
+      .name = name,
+    });
+  };
+  const auto transferDst = vk::BufferUsageFlagBits::eTransferDst;
+  const auto indirect = vk::BufferUsageFlagBits::eIndirectBuffer;
+
+  gpuCulling.instanceMatrices =
+    createBuffer(instanceMatrices.size_bytes(), transferDst, "gpu_culling_instance_matrices");
+  gpuCulling.instanceBoxes = createBuffer(
+    boxes.size() * sizeof(culling::InstanceBox), transferDst, "gpu_culling_instance_boxes");
+  gpuCulling.meshFirstInstances = createBuffer(
+    meshFirstInstances.size() * sizeof(std::uint32_t),
+    transferDst,
+    "gpu_culling_mesh_first_instances");
+  gpuCulling.relemDraws = createBuffer(
+    relemDraws.size() * sizeof(culling::RelemDraw), transferDst, "gpu_culling_relem_draws");
+  gpuCulling.meshVisibleCounts = createBuffer(
+    meshes.size() * sizeof(std::uint32_t), transferDst, "gpu_culling_mesh_visible_counts");
+  gpuCulling.instanceIds =
+    createBuffer(instanceMatrices.size() * sizeof(std::uint32_t), {}, "gpu_culling_instance_ids");
+  gpuCulling.drawCommands = createBuffer(
+    2 * relems.size() * sizeof(culling::DrawCommand), indirect, "gpu_culling_draw_commands");
+  gpuCulling.drawCounts =
+    createBuffer(2 * sizeof(std::uint32_t), indirect | transferDst, "gpu_culling_draw_counts");
+  gpuCulling.instanceVisibility = createBuffer(
+    instanceMatrices.size() * sizeof(std::uint32_t),
+    transferDst,
+    "gpu_culling_instance_visibility");
+
+  // Everything is drawn in the first phase of the first frame,
+  // the occlusion phase then sorts it out
+  const std::vector<std::uint32_t> visibility(instanceMatrices.size(), 1);
+
+  AsyncTransferHelper transferHelper{
+    AsyncTransferHelper::CreateInfo{.sliceSize = 16 * 1024 * 1024, .sliceCount = 2}};
+  transferHelper.uploadBuffer<glm::mat4x4>(gpuCulling.instanceMatrices, 0, instanceMatrices);
+  transferHelper.uploadBuffer<culling::InstanceBox>(gpuCulling.instanceBoxes, 0, boxes);
+  transferHelper.uploadBuffer<std::uint32_t>(gpuCulling.meshFirstInstances, 0, meshFirstInstances);
+  transferHelper.uploadBuffer<culling::RelemDraw>(gpuCulling.relemDraws, 0, relemDraws);
+  transferHelper.uploadBuffer<std::uint32_t>(gpuCulling.instanceVisibility, 0, visibility);
+  transferHelper.wait();
 }
 
 void WorldRenderer::loadShaders()
@@ -104,6 +336,15 @@ void WorldRenderer::loadShaders()
     "static_mesh_material",
     {COMPLETE_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
      COMPLETE_RENDERER_SHADERS_ROOT "static_mesh.vert.spv"});
+  etna::create_program(
+    "static_mesh_indirect",
+    {COMPLETE_RENDERER_SHADERS_ROOT "static_mesh.frag.spv",
+     COMPLETE_RENDERER_SHADERS_ROOT "static_mesh_indirect.vert.spv"});
+  etna::create_program(
+    "cull_instances", {COMPLETE_RENDERER_SHADERS_ROOT "cull_instances.comp.spv"});
+  etna::create_program("build_draws", {COMPLETE_RENDERER_SHADERS_ROOT "build_draws.comp.spv"});
+  etna::create_program(
+    "depth_pyramid", {COMPLETE_RENDERER_SHADERS_ROOT "depth_pyramid.comp.spv"});
   etna::create_program(
     "terrain_render",
     {COMPLETE_RENDERER_SHADERS_ROOT "terrain.vert.spv",
@@ -133,39 +374,42 @@ void WorldRenderer::setupPipelines()
 
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
+  // The GPU-driven variant only differs in where the vertex shader takes the matrices from
+  const etna::GraphicsPipeline::CreateInfo staticMeshPipelineInfo{
+    .vertexShaderInput = sceneVertexInputDesc,
+    .rasterizationConfig =
+      vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = vk::PolygonMode::eFill,
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.f,
+      },
+    .blendingConfig =
+      {.attachments =
+         {vk::PipelineColorBlendAttachmentState{
+            .blendEnable = vk::False,
+            .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+          },
+          vk::PipelineColorBlendAttachmentState{
+            .blendEnable = vk::False,
+            .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+          }},
+       .logicOp = vk::LogicOp::eSet},
+    .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats = {vk::Format::eB10G11R11UfloatPack32, vk::Format::eR16G16Snorm},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      },
+  };
+
   staticMeshPipeline = {};
   staticMeshPipeline =
-    pipelineManager.createGraphicsPipeline(
-      "static_mesh_material",
-      etna::GraphicsPipeline::CreateInfo{
-        .vertexShaderInput = sceneVertexInputDesc,
-        .rasterizationConfig =
-          vk::PipelineRasterizationStateCreateInfo{
-            .polygonMode = vk::PolygonMode::eFill,
-            .cullMode = vk::CullModeFlagBits::eBack,
-            .frontFace = vk::FrontFace::eCounterClockwise,
-            .lineWidth = 1.f,
-          },
-        .blendingConfig =
-          {.attachments =
-             {vk::PipelineColorBlendAttachmentState{
-                .blendEnable = vk::False,
-                .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                  vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-              },
-              vk::PipelineColorBlendAttachmentState{
-                .blendEnable = vk::False,
-                .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                  vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
-              }},
-           .logicOp = vk::LogicOp::eSet},
-        .fragmentShaderOutput =
-          {
-            .colorAttachmentFormats =
-              {vk::Format::eB10G11R11UfloatPack32, vk::Format::eA8B8G8R8SnormPack32},
-            .depthAttachmentFormat = vk::Format::eD32Sfloat,
-          },
-      });
+    pipelineManager.createGraphicsPipeline("static_mesh_material", staticMeshPipelineInfo);
+  staticMeshIndirectPipeline = {};
+  staticMeshIndirectPipeline =
+    pipelineManager.createGraphicsPipeline("static_mesh_indirect", staticMeshPipelineInfo);
   cubePipeline =
     pipelineManager.createGraphicsPipeline(
       "cube",
@@ -194,7 +438,7 @@ void WorldRenderer::setupPipelines()
         .fragmentShaderOutput =
           {
             .colorAttachmentFormats =
-              {vk::Format::eB10G11R11UfloatPack32, vk::Format::eA8B8G8R8SnormPack32},
+              {vk::Format::eB10G11R11UfloatPack32, vk::Format::eR16G16Snorm},
             .depthAttachmentFormat = vk::Format::eD32Sfloat,
           },
       });
@@ -226,7 +470,7 @@ void WorldRenderer::setupPipelines()
         .fragmentShaderOutput =
           {
             .colorAttachmentFormats =
-              {vk::Format::eB10G11R11UfloatPack32, vk::Format::eA8B8G8R8SnormPack32},
+              {vk::Format::eB10G11R11UfloatPack32, vk::Format::eR16G16Snorm},
             .depthAttachmentFormat = vk::Format::eD32Sfloat,
           },
       });
@@ -239,6 +483,10 @@ void WorldRenderer::setupPipelines()
   tonemapPipeline = pipelineManager.createComputePipeline("tonemap", {});
 
   resolvePipeline = pipelineManager.createComputePipeline("resolve", {});
+
+  cullInstancesPipeline = pipelineManager.createComputePipeline("cull_instances", {});
+  buildDrawsPipeline = pipelineManager.createComputePipeline("build_draws", {});
+  depthPyramidPipeline = pipelineManager.createComputePipeline("depth_pyramid", {});
 }
 
 void WorldRenderer::debugInput(const Keyboard&) {}
@@ -259,10 +507,194 @@ void WorldRenderer::update(const FramePacket& packet)
   }
 }
 
-// todo redo
-bool WorldRenderer::shouldCull(glm::mat4, BoundingBox)
+void WorldRenderer::cullInstances()
+{
+  ZoneScoped;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // Planes are extracted once per frame, then every box is tested against
+  // them directly instead of projecting its corners with its own matrix
+  const Frustum frustum = extract_frustum(worldViewProj);
+  const std::size_t instanceCount = instanceBoxes.size();
+  const std::size_t chunkCount = chunkVisibleCounts.size();
+
+  cullingWorkers->parallelFor(chunkCount, [&](std::size_t chunk) {
+    const std::size_t first = chunk * CULLING_CHUNK_SIZE;
+    const std::size_t count = std::min(CULLING_CHUNK_SIZE, instanceCount - first);
+    chunkVisibleCounts[chunk] = cull_frustum(
+      frustum, instanceBoxes, first, count, std::span{chunkVisible}.subspan(first, count));
+  });
+
+  std::exclusive_scan(
+    chunkVisibleCounts.begin(), chunkVisibleCounts.end(), chunkOffsets.begin(), std::size_t{0});
+  visibleInstanceCount = chunkCount > 0 ? chunkOffsets.back() + chunkVisibleCounts.back() : 0;
+
+  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  std::byte* matrices = modelMatrices.get().data();
+  cullingWorkers->parallelFor(chunkCount, [&](std::size_t chunk) {
+    const std::uint32_t* visible = chunkVisible.data() + chunk * CULLING_CHUNK_SIZE;
+    const std::size_t offset = chunkOffsets[chunk];
+    for (std::size_t i = 0; i < chunkVisibleCounts[chunk]; ++i)
+    {
+      visibleInstances[offset + i] = visible[i];
+      std::memcpy(
+        matrices + (offset + i) * sizeof(glm::mat4),
+        &instanceMatrices[visible[i]],
+        sizeof(glm::mat4));
+    }
+  });
+
+  const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  float& average = cullingTimes[cullingThreadCount - 1];
+  average = average == 0 ? elapsed.count() : glm::mix(average, elapsed.count(), 0.05f);
+}
+
+void WorldRenderer::writeCullingParams()
+{
+  culling::Params params{};
+  params.viewProj = worldViewProj;
+  const Frustum frustum = extract_frustum(worldViewProj);
+  std::copy(frustum.planes.begin(), frustum.planes.end(), params.planes);
+  params.instanceCount = static_cast<std::uint32_t>(sceneMgr->getInstanceMatrices().size());
+  params.relemCount = static_cast<std::uint32_t>(sceneMgr->getRenderElements().size());
+  params.depthSize = resolution;
+  params.pyramidLevelCount = depthPyramidLevelCount;
+
+  std::memcpy(cullingParams.get().data(), &params, sizeof(params));
+}
+
+void WorldRenderer::cullInstancesGpu(vk::CommandBuffer cmd_buf, std::uint32_t phase)
+{
+  if (!gpuCulling.drawCommands.get())
+    return;
+  ETNA_PROFILE_GPU(cmd_buf, cullInstancesGpu);
+
+  const auto instanceCount = static_cast<std::uint32_t>(sceneMgr->getInstanceMatrices().size());
+  const auto relemCount = static_cast<std::uint32_t>(sceneMgr->getRenderElements().size());
+
+  // Draws of the previous frame or phase might still read the results
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader,
+    vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eShaderStorageRead,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite);
+
+  cmd_buf.fillBuffer(gpuCulling.meshVisibleCounts.get(), 0, VK_WHOLE_SIZE, 0);
+  cmd_buf.fillBuffer(gpuCulling.drawCounts.get(), 0, VK_WHOLE_SIZE, 0);
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+  {
+    auto info = etna::get_shader_program("cull_instances");
+    auto set = etna::create_descriptor_set(
+      info.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, cullingParams.get().genBinding()},
+        etna::Binding{1, gpuCulling.instanceBoxes.genBinding()},
+        etna::Binding{2, gpuCulling.meshFirstInstances.genBinding()},
+        etna::Binding{3, gpuCulling.meshVisibleCounts.genBinding()},
+        etna::Binding{4, gpuCulling.instanceIds.genBinding()},
+        etna::Binding{5, gpuCulling.instanceVisibility.genBinding()},
+        etna::Binding{
+          6,
+          depthPyramid.genBinding(
+            defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal, {})},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+    auto layout = cullInstancesPipeline.getVkPipelineLayout();
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, cullInstancesPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, 1, &vkSet, 0, nullptr);
+    cmd_buf.pushConstants<std::uint32_t>(layout, vk::ShaderStageFlagBits::eCompute, 0, {phase});
+    etna::flush_barriers(cmd_buf);
+    cmd_buf.dispatch((instanceCount + culling::groupSize - 1) / culling::groupSize, 1, 1);
+  }
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+  {
+    auto info = etna::get_shader_program("build_draws");
+    auto set = etna::create_descriptor_set(
+      info.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, cullingParams.get().genBinding()},
+        etna::Binding{1, gpuCulling.relemDraws.genBinding()},
+        etna::Binding{2, gpuCulling.meshFirstInstances.genBinding()},
+        etna::Binding{3, gpuCulling.meshVisibleCounts.genBinding()},
+        etna::Binding{4, gpuCulling.drawCommands.genBinding()},
+        etna::Binding{5, gpuCulling.drawCounts.genBinding()},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+    auto layout = buildDrawsPipeline.getVkPipelineLayout();
+    cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, buildDrawsPipeline.getVkPipeline());
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, 1, &vkSet, 0, nullptr);
+    etna::flush_barriers(cmd_buf);
+    cmd_buf.dispatch((relemCount + culling::groupSize - 1) / culling::groupSize, 1, 1);
+  }
+
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader,
+    vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eShaderStorageRead);
+}
+
+void WorldRenderer::buildDepthPyramid(vk::CommandBuffer cmd_buf)
 {
-  return false;
+  ETNA_PROFILE_GPU(cmd_buf, buildDepthPyramid);
+
+  auto info = etna::get_shader_program("depth_pyramid");
+  auto layout = depthPyramidPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, depthPyramidPipeline.getVkPipeline());
+
+  for (std::uint32_t level = 0; level < depthPyramidLevelCount; ++level)
+  {
+    // Every level is reduced from the previous one, the first one from the depth buffer itself
+    auto source = level == 0
+      ? gBuffer.depthStencil.genBinding({}, vk::ImageLayout::eGeneral, {})
+      : depthPyramid.genBinding(
+          {}, vk::ImageLayout::eGeneral, {.baseMip = level - 1, .levelCount = 1});
+    auto target =
+      depthPyramid.genBinding({}, vk::ImageLayout::eGeneral, {.baseMip = level, .levelCount = 1});
+    auto set = etna::create_descriptor_set(
+      info.getDescriptorLayoutId(0),
+      cmd_buf,
+      {
+        etna::Binding{0, source},
+        etna::Binding{1, target},
+      });
+    vk::DescriptorSet vkSet = set.getVkSet();
+    cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, 1, &vkSet, 0, nullptr);
+    etna::flush_barriers(cmd_buf);
+
+    const glm::uvec2 extent = glm::max(resolution >> (level + 1), glm::uvec2{1});
+    cmd_buf.dispatch(
+      (extent.x + culling::depthPyramidGroupSize - 1) / culling::depthPyramidGroupSize,
+      (extent.y + culling::depthPyramidGroupSize - 1) / culling::depthPyramidGroupSize,
+      1);
+
+    // Levels are all in the same layout, so nothing orders them otherwise
+    memory_barrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageWrite,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderSampledRead);
+  }
 }
 
 void WorldRenderer::drawGui()
@@ -279,6 +711,43 @@ void WorldRenderer::drawGui()
       tonemapPushConstants.forceLinear = tmp ? 1 : 0;
     }
   }
+  if (ImGui::CollapsingHeader("Culling"))
+  {
+    ImGui::Checkbox("GPU-driven", &gpuDrivenCulling);
+    if (gpuDrivenCulling)
+      ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+    // The GPU-driven mode never reads its results back
+    if (!gpuDrivenCulling)
+      ImGui::Text(
+        "Visible instances: %u / %u",
+        static_cast<unsigned>(visibleInstanceCount),
+        static_cast<unsigned>(instanceBoxes.size()));
+    int threadCount = cullingThreadCount;
+    if (ImGui::SliderInt("Threads", &threadCount, 1, static_cast<int>(cullingTimes.size())))
+      setCullingThreadCount(threadCount);
+    // Every thread count that has been tried keeps its last average
+    for (std::size_t i = 0; i < cullingTimes.size(); ++i)
+      if (cullingTimes[i] > 0)
+        ImGui::Text("%u threads: %.3f ms", static_cast<unsigned>(i + 1), cullingTimes[i]);
+  }
+  if (ImGui::CollapsingHeader("Recording"))
+  {
+    // Every copy adds instances, non-instanced draws turn them into draw calls
+    int gridSize = stressGridSize;
+    ImGui::SliderInt("Stress grid", &gridSize, 1, 64);
+    if (ImGui::IsItemDeactivatedAfterEdit() && gridSize != stressGridSize)
+      setStressGridSize(gridSize);
+    ImGui::Checkbox("Instanced draws", &instancedDraws);
+    // Indirect draws are counted on the GPU
+    if (!gpuDrivenCulling)
+      ImGui::Text("Scene draw calls: %u", static_cast<unsigned>(sceneDrawCount));
+    int threadCount = recordingThreadCount;
+    if (ImGui::SliderInt("Threads##recording", &threadCount, 1, int(recordingTimes.size())))
+      setRecordingThreadCount(threadCount);
+    for (std::size_t i = 0; i < recordingTimes.size(); ++i)
+      if (recordingTimes[i] > 0)
+        ImGui::Text("%u threads: %.3f ms", static_cast<unsigned>(i + 1), recordingTimes[i]);
+  }
   if (ImGui::CollapsingHeader("Lighting"))
   {
     ImGui::InputFloat("Attenuation coefficient", &resolveUniformParams.attenuationCoef);
@@ -307,20 +776,46 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
+  // Not in update, the per-frame buffers of this frame are only free once the frame has begun
+  const bool occlusionPhase = gpuDrivenCulling && occlusionCulling;
+  if (gpuDrivenCulling)
+  {
+    writeCullingParams();
+    cullInstancesGpu(
+      cmd_buf, occlusionPhase ? culling::phasePreviouslyVisible : culling::phaseFrustum);
+  }
+  else
+    cullInstances();
+
   {
     ETNA_PROFILE_GPU(cmd_buf, renderForward);
+    renderForward(cmd_buf);
+  }
+
+  // Draws whatever the first phase has missed, testing against its depth
+  if (occlusionPhase)
+  {
+    buildDepthPyramid(cmd_buf);
+    cullInstancesGpu(cmd_buf, culling::phaseOcclusion);
+
+    ETNA_PROFILE_GPU(cmd_buf, renderForwardOcclusion);
 
+    auto sceneBindings = createSceneBindings(cmd_buf);
     etna::RenderTargetState renderTargets(
       cmd_buf,
       {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = gBuffer.color.get(), .view = gBuffer.color.getView({})},
-       {.image = gBuffer.normal.get(), .view = gBuffer.normal.getView({})}},
-      {.image = gBuffer.depthStencil.get(), .view = gBuffer.depthStencil.getView({})});
-
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, staticMeshPipeline.getVkPipeline());
-    renderScene(cmd_buf, worldViewProj, staticMeshPipeline.getVkPipelineLayout());
-    renderTerrain(cmd_buf);
-    renderCube(cmd_buf);
+      {{.image = gBuffer.color.get(),
+        .view = gBuffer.color.getView({}),
+        .loadOp = vk::AttachmentLoadOp::eLoad},
+       {.image = gBuffer.normal.get(),
+        .view = gBuffer.normal.getView({}),
+        .loadOp = vk::AttachmentLoadOp::eLoad}},
+      {.image = gBuffer.depthStencil.get(),
+       .view = gBuffer.depthStencil.getView({}),
+       .loadOp = vk::AttachmentLoadOp::eLoad});
+
+    if (sceneBindings.has_value())
+      renderSceneIndirect(cmd_buf, sceneBindings->getVkSet());
   }
 
   resolve(cmd_buf);
@@ -376,82 +871,266 @@ void WorldRenderer::renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_imag
 }
 
 
-void WorldRenderer::renderScene(
-  vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
+void WorldRenderer::renderForward(vk::CommandBuffer cmd_buf)
+{
+  ZoneScoped;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  ForwardBindings bindings = createForwardBindings(cmd_buf);
+
+  // Indirect draws are too few to be worth splitting
+  const std::size_t sceneSliceCount =
+    gpuDrivenCulling ? 1 : static_cast<std::size_t>(recordingThreadCount);
+  const std::size_t taskCount = sceneSliceCount + 2;
+  auto& frameRecorders = recorders.get();
+
+  const std::array colorFormats = {vk::Format::eB10G11R11UfloatPack32, vk::Format::eR16G16Snorm};
+  const vk::CommandBufferInheritanceRenderingInfo inheritanceRendering{
+    .colorAttachmentCount = static_cast<std::uint32_t>(colorFormats.size()),
+    .pColorAttachmentFormats = colorFormats.data(),
+    .depthAttachmentFormat = vk::Format::eD32Sfloat,
+    .rasterizationSamples = vk::SampleCountFlagBits::e1,
+  };
+  const vk::CommandBufferInheritanceInfo inheritance{.pNext = &inheritanceRendering};
+
+  // Secondaries don't inherit any dynamic state from the primary
+  const vk::Viewport viewport{
+    .x = 0.0f,
+    .y = 0.0f,
+    .width = static_cast<float>(resolution.x),
+    .height = static_cast<float>(resolution.y),
+    .minDepth = 0.0f,
+    .maxDepth = 1.0f,
+  };
+  const vk::Rect2D scissor{{0, 0}, {resolution.x, resolution.y}};
+
+  auto device = etna::get_context().getDevice();
+  std::vector<std::size_t> taskDrawCounts(taskCount, 0);
+  recordingWorkers->parallelFor(taskCount, [&](std::size_t task) {
+    ZoneScopedN("recordForwardTask");
+
+    auto& recorder = frameRecorders[task];
+    ETNA_CHECK_VK_RESULT(device.resetCommandPool(recorder.pool.get()));
+    ETNA_CHECK_VK_RESULT(recorder.cmdBuf.begin(vk::CommandBufferBeginInfo{
+      .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+        vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+      .pInheritanceInfo = &inheritance,
+    }));
+    recorder.cmdBuf.setViewport(0, {viewport});
+    recorder.cmdBuf.setScissor(0, {scissor});
+
+    if (task == sceneSliceCount)
+      renderTerrain(recorder.cmdBuf, bindings.terrain.getVkSet());
+    else if (task == sceneSliceCount + 1)
+      renderCube(recorder.cmdBuf, bindings.cube.getVkSet());
+    else if (bindings.scene.has_value() && gpuDrivenCulling)
+      renderSceneIndirect(recorder.cmdBuf, bindings.scene->getVkSet());
+    else if (bindings.scene.has_value())
+      taskDrawCounts[task] = renderScene(
+        recorder.cmdBuf,
+        bindings.scene->getVkSet(),
+        visibleInstanceCount * task / sceneSliceCount,
+        visibleInstanceCount * (task + 1) / sceneSliceCount);
+
+    ETNA_CHECK_VK_RESULT(recorder.cmdBuf.end());
+  });
+  sceneDrawCount = std::accumulate(taskDrawCounts.begin(), taskDrawCounts.end(), std::size_t{0});
+
+  // etna::RenderTargetState has no way of taking secondaries,
+  // so the attachments are transitioned and bound here instead
+  for (const auto* image : {&gBuffer.color, &gBuffer.normal})
+    etna::set_state(
+      cmd_buf,
+      image->get(),
+      vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+      vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite,
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::ImageAspectFlagBits::eColor);
+  etna::set_state(
+    cmd_buf,
+    gBuffer.depthStencil.get(),
+    vk::PipelineStageFlagBits2::eEarlyFragmentTests |
+      vk::PipelineStageFlagBits2::eLateFragmentTests,
+    vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+      vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+    vk::ImageLayout::eDepthStencilAttachmentOptimal,
+    vk::ImageAspectFlagBits::eDepth);
+  etna::flush_barriers(cmd_buf);
+
+  const std::array colorAttachments = {
+    vk::RenderingAttachmentInfo{
+      .imageView = gBuffer.color.getView({}),
+      .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+      .loadOp = vk::AttachmentLoadOp::eClear,
+      .storeOp = vk::AttachmentStoreOp::eStore,
+    },
+    vk::RenderingAttachmentInfo{
+      .imageView = gBuffer.normal.getView({}),
+      .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+      .loadOp = vk::AttachmentLoadOp::eClear,
+      .storeOp = vk::AttachmentStoreOp::eStore,
+    },
+  };
+  const vk::RenderingAttachmentInfo depthAttachment{
+    .imageView = gBuffer.depthStencil.getView({}),
+    .imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal,
+    .loadOp = vk::AttachmentLoadOp::eClear,
+    .storeOp = vk::AttachmentStoreOp::eStore,
+    .clearValue = {.depthStencil = {.depth = 1.0f, .stencil = 0}},
+  };
+
+  cmd_buf.beginRendering(vk::RenderingInfo{
+    .flags = vk::RenderingFlagBits::eContentsSecondaryCommandBuffers,
+    .renderArea = scissor,
+    .layerCount = 1,
+    .colorAttachmentCount = static_cast<std::uint32_t>(colorAttachments.size()),
+    .pColorAttachments = colorAttachments.data(),
+    .pDepthAttachment = &depthAttachment,
+  });
+
+  std::vector<vk::CommandBuffer> secondaries(taskCount);
+  for (std::size_t task = 0; task < taskCount; ++task)
+    secondaries[task] = frameRecorders[task].cmdBuf;
+  cmd_buf.executeCommands(secondaries);
+
+  cmd_buf.endRendering();
+
+  const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  float& average = recordingTimes[recordingThreadCount - 1];
+  average = average == 0 ? elapsed.count() : glm::mix(average, elapsed.count(), 0.05f);
+}
+
+std::optional<etna::DescriptorSet> WorldRenderer::createSceneBindings(vk::CommandBuffer cmd_buf)
 {
   if (!sceneMgr->getVertexBuffer())
-    return;
-  ETNA_PROFILE_GPU(cmd_buf, renderScene);
+    return std::nullopt;
 
-  cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+  if (!gpuDrivenCulling)
   {
     auto info = etna::get_shader_program("static_mesh_material");
-
-    auto set = etna::create_descriptor_set(
+    return etna::create_descriptor_set(
       info.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, modelMatrices.get().genBinding()}});
-    vk::DescriptorSet vkSet = set.getVkSet();
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, 1, &vkSet, 0, nullptr);
   }
 
+  if (!gpuCulling.drawCommands.get())
+    return std::nullopt;
+
+  auto info = etna::get_shader_program("static_mesh_indirect");
+  return etna::create_descriptor_set(
+    info.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, gpuCulling.instanceMatrices.genBinding()},
+      etna::Binding{1, gpuCulling.instanceIds.genBinding()},
+    });
+}
+
+WorldRenderer::ForwardBindings WorldRenderer::createForwardBindings(vk::CommandBuffer cmd_buf)
+{
+  auto terrainInfo = etna::get_shader_program("terrain_render");
+  auto bind0 = heightMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+  auto bind1 = normalMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+
+  auto cubeInfo = etna::get_shader_program("cube");
+
+  return ForwardBindings{
+    .scene = createSceneBindings(cmd_buf),
+    .terrain = etna::create_descriptor_set(
+      terrainInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{0, bind0}, etna::Binding{1, bind1}}),
+    .cube = etna::create_descriptor_set(
+      cubeInfo.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, lightList.genBinding()}}),
+  };
+}
+
+std::size_t WorldRenderer::renderScene(
+  vk::CommandBuffer cmd_buf, vk::DescriptorSet set, std::size_t first, std::size_t last)
+{
+  auto layout = staticMeshPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, staticMeshPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &set, 0, nullptr);
+  cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
+  std::optional<IndexFormat> boundIndexFormat;
 
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
-  {
-    const auto meshIdx = instanceMeshes[instIdx];
+  // Matrices of visible instances are packed by cullInstances, so every run of
+  // instances of the same mesh is drawn with a single instanced draw per relem.
+  // Runs don't cross slice boundaries, which costs at most a draw per slice.
+  cmd_buf.pushConstants<glm::mat4>(layout, vk::ShaderStageFlagBits::eVertex, 0, worldViewProj);
 
-    std::size_t nextIdx = instIdx;
-    std::size_t nonCulled = 0;
-    while (nextIdx < instanceMeshes.size() && instanceMeshes[nextIdx] == meshIdx)
-    {
-      if (!shouldCull(instanceMatrices[nextIdx], sceneMgr->getMeshes()[meshIdx].box))
-      {
-        std::memcpy(
-          modelMatrices.get().data() + (nonCulled + instIdx) * sizeof(glm::mat4),
-          &instanceMatrices[nextIdx],
-          sizeof(glm::mat4));
-        nonCulled += 1;
-      }
-      ++nextIdx;
-    }
+  std::size_t drawCount = 0;
+  for (std::size_t runFirst = first; runFirst < last;)
+  {
+    const auto meshIdx = instanceMeshes[visibleInstances[runFirst]];
 
-    cmd_buf.pushConstants<glm::mat4>(pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, glob_tm);
+    std::size_t runLast = runFirst + 1;
+    while (instancedDraws && runLast < last &&
+           instanceMeshes[visibleInstances[runLast]] == meshIdx)
+      ++runLast;
 
     for (uint32_t j = 0; j < meshes[meshIdx].relemCount; ++j)
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
+      if (relem.indexFormat != boundIndexFormat)
+      {
+        sceneMgr->bindIndexBuffer(cmd_buf, relem.indexFormat);
+        boundIndexFormat = relem.indexFormat;
+      }
       cmd_buf.drawIndexed(
         relem.indexCount,
-        static_cast<uint32_t>(nonCulled),
+        static_cast<uint32_t>(runLast - runFirst),
         relem.indexOffset,
         relem.vertexOffset,
-        static_cast<uint32_t>(instIdx));
+        static_cast<uint32_t>(runFirst));
+      ++drawCount;
     }
-    instIdx = nextIdx - 1;
+    runFirst = runLast;
   }
+  return drawCount;
 }
 
-void WorldRenderer::renderTerrain(vk::CommandBuffer cmd_buf)
+void WorldRenderer::renderSceneIndirect(vk::CommandBuffer cmd_buf, vk::DescriptorSet set)
 {
-  ETNA_PROFILE_GPU(cmd_buf, renderTerrain);
-  auto info = etna::get_shader_program("terrain_render");
-  auto bind0 = heightMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
-  auto bind1 = normalMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+  auto layout = staticMeshIndirectPipeline.getVkPipelineLayout();
+  cmd_buf.bindPipeline(
+    vk::PipelineBindPoint::eGraphics, staticMeshIndirectPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &set, 0, nullptr);
+  cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
+
+  cmd_buf.pushConstants<glm::mat4>(layout, vk::ShaderStageFlagBits::eVertex, 0, worldViewProj);
+
+  // Every index format has a region of relemCount commands, see build_draws.comp
+  const auto relemCount = static_cast<std::uint32_t>(sceneMgr->getRenderElements().size());
+  for (auto format : {IndexFormat::Uint32, IndexFormat::Uint16})
+  {
+    const auto region = static_cast<std::uint32_t>(format);
+    if (!gpuCulling.indexFormatUsed[region])
+      continue;
+
+    sceneMgr->bindIndexBuffer(cmd_buf, format);
+    cmd_buf.drawIndexedIndirectCount(
+      gpuCulling.drawCommands.get(),
+      region * relemCount * sizeof(culling::DrawCommand),
+      gpuCulling.drawCounts.get(),
+      region * sizeof(std::uint32_t),
+      relemCount,
+      static_cast<std::uint32_t>(sizeof(culling::DrawCommand)));
+  }
+}
 
-  auto descSet = etna::create_descriptor_set(
-    info.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, bind0}, etna::Binding{1, bind1}});
-  auto vkSet = descSet.getVkSet();
+void WorldRenderer::renderTerrain(vk::CommandBuffer cmd_buf, vk::DescriptorSet set)
+{
   auto layout = terrainPipeline.getVkPipelineLayout();
 
   cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, terrainPipeline.getVkPipeline());
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &vkSet, 0, nullptr);
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &set, 0, nullptr);
 
   cmd_buf.pushConstants<TerrainPushConst>(
     layout,
@@ -464,20 +1143,12 @@ void WorldRenderer::renderTerrain(vk::CommandBuffer cmd_buf)
   cmd_buf.draw(3, (4096 * 4096) / (128 * 128), 0, 0);
 }
 
-void WorldRenderer::renderCube(vk::CommandBuffer cmd_buf)
+void WorldRenderer::renderCube(vk::CommandBuffer cmd_buf, vk::DescriptorSet set)
 {
-
-  ETNA_PROFILE_GPU(cmd_buf, cube);
-  auto info = etna::get_shader_program("cube");
-  auto bind0 = lightList.genBinding();
-
-  auto descSet =
-    etna::create_descriptor_set(info.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{0, bind0}});
-  auto vkSet = descSet.getVkSet();
   auto layout = cubePipeline.getVkPipelineLayout();
 
   cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, cubePipeline.getVkPipeline());
-  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &vkSet, 0, nullptr);
+  cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, 1, &set, 0, nullptr);
 
   cmd_buf.pushConstants<glm::mat4>(layout, vk::ShaderStageFlagBits::eVertex, 0, worldViewProj);
 
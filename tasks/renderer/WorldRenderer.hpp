@@ -5,13 +5,17 @@
 #include <etna/Buffer.hpp>
 #include <etna/GraphicsPipeline.hpp>
 #include <etna/ComputePipeline.hpp>
+#include <etna/DescriptorSet.hpp>
 #include <etna/GpuSharedResource.hpp>
 #include <glm/glm.hpp>
 
+#include "scene/FrustumCulling.hpp"
+#include "parallel/ThreadPool.hpp"
 #include "scene/SceneManager.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
+#include "shaders/culling.h"
 #include "shaders/resolve.h"
 
 
@@ -32,18 +36,57 @@ public:
   void renderWorld(vk::CommandBuffer cmd_buf, vk::Image target_image);
 
 private:
-  void renderScene(
-    vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+  // Everything the G-buffer pass binds. etna's descriptor pools and barrier
+  // tracking are not thread-safe, so these are created on the render thread
+  // and the recording threads only ever record plain Vulkan commands.
+  struct ForwardBindings
+  {
+    // Empty when there is no scene to draw
+    std::optional<etna::DescriptorSet> scene;
+    etna::DescriptorSet terrain;
+    etna::DescriptorSet cube;
+  };
+
+  // A secondary command buffer along with the pool it is allocated from
+  struct SecondaryRecorder
+  {
+    vk::UniqueCommandPool pool;
+    vk::CommandBuffer cmdBuf;
+  };
+
+  // Records the G-buffer pass into secondary command buffers in parallel
+  void renderForward(vk::CommandBuffer cmd_buf);
+  std::optional<etna::DescriptorSet> createSceneBindings(vk::CommandBuffer cmd_buf);
+  ForwardBindings createForwardBindings(vk::CommandBuffer cmd_buf);
+  // Draws visibleInstances in [first, last), returns the number of draw calls
+  std::size_t renderScene(
+    vk::CommandBuffer cmd_buf, vk::DescriptorSet set, std::size_t first, std::size_t last);
+  void renderSceneIndirect(vk::CommandBuffer cmd_buf, vk::DescriptorSet set);
   void createTerrainMap(vk::CommandBuffer cmd_buf);
-  void renderTerrain(vk::CommandBuffer cmd_buf);
-  void renderCube(vk::CommandBuffer cmd_buf);
+  void renderTerrain(vk::CommandBuffer cmd_buf, vk::DescriptorSet set);
+  void renderCube(vk::CommandBuffer cmd_buf, vk::DescriptorSet set);
   void tonemap(vk::CommandBuffer cmd_buf);
   void resolve(vk::CommandBuffer cmd_buf);
 
-  bool shouldCull(glm::mat4 mModel, BoundingBox box);
+  // Culls the instances and packs the matrices of visible ones into modelMatrices
+  void cullInstances();
+  void setCullingThreadCount(int thread_count);
+  void createGpuCullingResources();
+  void writeCullingParams();
+  // Records culling and building of draw commands for renderSceneIndirect,
+  // phase is one of culling::phase*
+  void cullInstancesGpu(vk::CommandBuffer cmd_buf, std::uint32_t phase);
+  void buildDepthPyramid(vk::CommandBuffer cmd_buf);
+
+  void setRecordingThreadCount(int thread_count);
+  // Reloads the scene tiled into a grid of copies, see SceneManager::tileInstances
+  void setStressGridSize(int grid_size);
 
 private:
   std::unique_ptr<SceneManager> sceneMgr;
+  std::filesystem::path scenePath;
+  // Copies of the scene along each axis, 1 is just the scene itself
+  int stressGridSize = 1;
 
   etna::Image heightMap;
   etna::Image normalMap;
@@ -64,7 +107,78 @@ private:
   glm::mat4x4 worldViewProj;
   glm::vec3 eye;
 
+  // World-space boxes of the instances, the scene is static
+  FrustumCullingBoxes instanceBoxes;
+  // Instances that passed frustum culling this frame, in increasing order,
+  // so instances of the same mesh stay next to each other
+  std::vector<std::uint32_t> visibleInstances;
+  std::size_t visibleInstanceCount = 0;
+
+  // Instances are culled in chunks of CULLING_CHUNK_SIZE on these, every
+  // chunk writes its visible instances to its own range of chunkVisible.
+  // A prefix sum over the chunk counts then gives every chunk its place
+  // in visibleInstances and modelMatrices.
+  std::unique_ptr<ThreadPool> cullingWorkers;
+  // Including the render thread, which takes part in the work
+  int cullingThreadCount = 1;
+  std::vector<std::uint32_t> chunkVisible;
+  std::vector<std::size_t> chunkVisibleCounts;
+  std::vector<std::size_t> chunkOffsets;
+  // Moving averages of the CPU time of cullInstances in ms, per thread count
+  std::vector<float> cullingTimes;
+
+  // Culls on the GPU and draws with a single indirect count draw per index
+  // format instead, so that the CPU cost doesn't depend on the scene at all
+  bool gpuDrivenCulling = false;
+  // Only with gpuDrivenCulling, see culling.h for the phases
+  bool occlusionCulling = true;
+  etna::GpuSharedResource<etna::Buffer> cullingParams;
+  // Max-reduced gBuffer.depthStencil, level 0 is half of its resolution
+  etna::Image depthPyramid;
+  std::uint32_t depthPyramidLevelCount = 0;
+  struct
+  {
+    // Uploaded once per scene
+    etna::Buffer instanceMatrices;
+    etna::Buffer instanceBoxes;
+    etna::Buffer meshFirstInstances;
+    etna::Buffer relemDraws;
+    // Rewritten every frame
+    etna::Buffer meshVisibleCounts;
+    etna::Buffer instanceIds;
+    etna::Buffer drawCommands;
+    etna::Buffer drawCounts;
+    // Occlusion test results of the previous frame
+    etna::Buffer instanceVisibility;
+    // Only formats that some relem uses get drawn, the other region might be empty
+    std::array<bool, 2> indexFormatUsed{};
+  } gpuCulling;
+
+  // The G-buffer pass is split into recording tasks: the visible instances in
+  // recordingThreadCount equal slices (or all of the indirect draws in a single
+  // one), then the terrain and the light cubes. Every task records its own
+  // secondary command buffer on these, and the primary one executes them in
+  // task order, so the result is the same as with a single thread.
+  std::unique_ptr<ThreadPool> recordingWorkers;
+  // Including the render thread, which takes part in the work
+  int recordingThreadCount = 1;
+  // Every task has its own command pool per frame in flight, so that no pool
+  // is ever used by two threads at once. Pools of a frame are reset as a whole
+  // once the frame comes around again. There are only ever more of them, as
+  // frames in flight might still be executing buffers of the existing ones.
+  etna::GpuSharedResource<std::vector<SecondaryRecorder>> recorders;
+  // Moving averages of the CPU time of recording the G-buffer pass in ms, per thread count
+  std::vector<float> recordingTimes;
+  // Off draws every visible instance with its own draw call instead of drawing
+  // runs of instances of the same mesh at once, to stress the recording
+  bool instancedDraws = true;
+  std::size_t sceneDrawCount = 0;
+
   etna::GraphicsPipeline staticMeshPipeline{};
+  etna::GraphicsPipeline staticMeshIndirectPipeline{};
+  etna::ComputePipeline cullInstancesPipeline{};
+  etna::ComputePipeline buildDrawsPipeline{};
+  etna::ComputePipeline depthPyramidPipeline{};
   etna::GraphicsPipeline terrainPipeline{};
   etna::ComputePipeline tonemapDownscalePipeline{};
   etna::ComputePipeline tonemapMinmaxPipeline{};
@@ -1,13 +1,15 @@
 #version 450
 #extension GL_GOOGLE_include_directive : require
 
+#include "octahedral.h"
+
 layout(location = 0) in vec3 in_normal;
 layout(location = 1) in vec3 in_color;
 layout(location = 0) out vec4 out_color;
-layout(location = 1) out vec4 out_normal;
+layout(location = 1) out vec2 out_normal;
 
 void main()
 {
-  out_normal = vec4(in_normal, 1.0);
+  out_normal = oct_encode_float(in_normal);
   out_color = vec4(in_color, 1.0);
 }
@@ -0,0 +1,78 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include "cpp_glsl_compat.h"
+
+SHADER_NAMESPACE(culling)
+
+#define CULLING_GROUP_SIZE 64
+
+const shader_uint groupSize = CULLING_GROUP_SIZE;
+
+// What cull_instances.comp emits draws for. With occlusion culling,
+// a frame is drawn in two phases: instances that were visible the previous
+// frame are drawn first, the depth pyramid is built from the result, and then
+// the instances that pass the pyramid test but haven't been drawn yet follow.
+#define CULLING_PHASE_FRUSTUM 0
+#define CULLING_PHASE_PREVIOUSLY_VISIBLE 1
+// Also records which instances are visible for the next frame
+#define CULLING_PHASE_OCCLUSION 2
+
+const shader_uint phaseFrustum = CULLING_PHASE_FRUSTUM;
+const shader_uint phasePreviouslyVisible = CULLING_PHASE_PREVIOUSLY_VISIBLE;
+const shader_uint phaseOcclusion = CULLING_PHASE_OCCLUSION;
+
+#define DEPTH_PYRAMID_GROUP_SIZE 8
+
+const shader_uint depthPyramidGroupSize = DEPTH_PYRAMID_GROUP_SIZE;
+
+// World-space box of an instance
+struct InstanceBox
+{
+  shader_vec3 center;
+  shader_uint mesh;
+  shader_vec3 extent;
+  shader_float padding;
+};
+
+// The parts of a relem that end up in its draw command
+struct RelemDraw
+{
+  shader_uint indexCount;
+  shader_uint firstIndex;
+  shader_uint vertexOffset;
+  shader_uint mesh;
+  // IndexFormat, draw commands of every format are written to their own region
+  shader_uint indexFormat;
+};
+
+// Same layout as VkDrawIndexedIndirectCommand,
+// vertexOffset is signed there but never negative here
+struct DrawCommand
+{
+  shader_uint indexCount;
+  shader_uint instanceCount;
+  shader_uint firstIndex;
+  shader_uint vertexOffset;
+  shader_uint firstInstance;
+};
+
+// Uniform buffer, the same for all of the phases of a frame
+struct Params
+{
+  shader_mat4 viewProj;
+  // See extract_frustum, normals point inwards
+  shader_vec4 planes[6];
+  shader_uint instanceCount;
+  shader_uint relemCount;
+  // Of gBuffer.depthStencil, level 0 of the depth pyramid is half of it
+  shader_uvec2 depthSize;
+  shader_uint pyramidLevelCount;
+  shader_uint padding0;
+  shader_uint padding1;
+  shader_uint padding2;
+};
+
+SHADER_NAMESPACE_END
+
+#endif // CULLING_H
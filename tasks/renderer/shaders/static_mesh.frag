@@ -2,9 +2,10 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
 
+#include "octahedral.h"
 
 layout(location = 0) out vec4 out_color;
-layout(location = 1) out vec4 out_normal;
+layout(location = 1) out vec2 out_normal;
 
 layout(location = 0) in in_vs_out
 {
@@ -18,5 +19,5 @@ void main()
 
   out_color.rgb = surfaceColor;
   out_color.a = 1.0f;
-  out_normal.xyz = wNorm;
+  out_normal = oct_encode_float(wNorm);
 }
@@ -2,8 +2,10 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
 
+#include "octahedral.h"
+
 layout(location = 0) out vec4 outColor;
-layout(location = 1) out vec4 outNormal;
+layout(location = 1) out vec2 outNormal;
 layout(binding = 1) uniform sampler2D normalMap;
 
 layout(location = 0) in vec2 inTexCoord;
@@ -22,5 +24,5 @@ void main()
 
   outColor.rgb = surfaceColor;
   outColor.a = 1.0f;
-  outNormal.xyz = wNorm.xyz;
+  outNormal = oct_encode_float(wNorm);
 }
@@ -35,7 +35,7 @@ out gl_PerVertex
 void main(void)
 {
   const vec4 wNorm = vec4(decode_normal(floatBitsToUint(vPosNorm.w)), 0.0f);
-  const vec4 wTang = vec4(decode_normal(floatBitsToUint(vTexCoordAndTang.z)), 0.0f);
+  const vec4 wTang = vec4(decode_tangent(floatBitsToUint(vTexCoordAndTang.z)).xyz, 0.0f);
   const mat4 mModel = mModels[gl_InstanceIndex];
 
   vOut.wPos = (mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
@@ -200,7 +200,7 @@ void WorldRenderer::renderScene(
     return;
 
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
-  cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
+  std::optional<IndexFormat> boundIndexFormat;
   {
     auto info = etna::get_shader_program("static_mesh_material");
 
@@ -243,6 +243,11 @@ void WorldRenderer::renderScene(
     {
       const auto relemIdx = meshes[meshIdx].firstRelem + j;
       const auto& relem = relems[relemIdx];
+      if (relem.indexFormat != boundIndexFormat)
+      {
+        sceneMgr->bindIndexBuffer(cmd_buf, relem.indexFormat);
+        boundIndexFormat = relem.indexFormat;
+      }
       cmd_buf.drawIndexed(
         relem.indexCount,
         static_cast<uint32_t>(nonCulled),